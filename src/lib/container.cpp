@@ -0,0 +1,849 @@
+/**
+ * @file container.cpp
+ * @brief Typed C++ API over the LXC library
+ *
+ * This file contains the implementation of the container handle and of the operations behind the functions of lib.cpp.
+ * Nothing here prints, registers activity or allocates memory: results and errors are returned to the caller, and
+ * names, keys and values are copied to fixed buffers on the stack because liblxc expects NUL-terminated strings.
+ *
+ * @author Simão Andrade
+ * @date 2024-06-13
+ */
+
+#include "container.h"
+#include "inspect.h"
+#include "idle.h"
+#include "layers.h"
+#include "netqos.h"
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <lxc/lxccontainer.h>
+
+/**
+ * @brief Size of the buffer used to copy a file when the kernel cannot copy it by itself
+ */
+#define COPY_BUFFER_SIZE (64 * 1024)
+
+/**
+ * @brief Directory of the container where the files of the host are copied
+ */
+#define CONTAINER_HOME_PATH "/home/ubuntu"
+
+/**
+ * @brief Size of a field of the download template (distribution, release or architecture)
+ */
+#define TEMPLATE_FIELD_SIZE 64
+
+namespace cmt
+{
+
+const char *error_message(error_code code) noexcept
+{
+    switch (code)
+    {
+    case error_code::none:
+        return "Success";
+    case error_code::invalid_argument:
+        return "Invalid argument";
+    case error_code::buffer_too_small:
+        return "Buffer too small for the result";
+    case error_code::setup_failed:
+        return "Failed to setup lxc_container struct";
+    case error_code::not_defined:
+        return "Container does not exist";
+    case error_code::already_defined:
+        return "Container already exists";
+    case error_code::create_failed:
+        return "Failed to create container rootfs";
+    case error_code::start_failed:
+        return "Failed to start the container";
+    case error_code::stop_failed:
+        return "Failed to stop the container";
+    case error_code::destroy_failed:
+        return "Failed to destroy the container";
+    case error_code::thaw_failed:
+        return "Failed to thaw the container";
+    case error_code::attach_failed:
+        return "Failed to execute command";
+    case error_code::console_failed:
+        return "Failed to start connection";
+    case error_code::cgroup_failed:
+        return "Failed to access the cgroup";
+    case error_code::config_failed:
+        return "Failed to save the limit to the container config";
+    case error_code::copy_failed:
+        return "Failed to copy file";
+    case error_code::list_failed:
+        return "Failed to list containers";
+    case error_code::not_running:
+        return "The container is not running";
+    }
+    return "Unknown error";
+}
+
+const char *state_name(container_state state) noexcept
+{
+    switch (state)
+    {
+    case container_state::stopped:
+        return "STOPPED";
+    case container_state::starting:
+        return "STARTING";
+    case container_state::running:
+        return "RUNNING";
+    case container_state::stopping:
+        return "STOPPING";
+    case container_state::aborting:
+        return "ABORTING";
+    case container_state::freezing:
+        return "FREEZING";
+    case container_state::frozen:
+        return "FROZEN";
+    case container_state::thawed:
+        return "THAWED";
+    case container_state::unknown:
+        break;
+    }
+    return "UNKNOWN";
+}
+
+/**
+ * @brief Build an error without details
+ */
+static error make_error(error_code code, int system_error = 0)
+{
+    error failure;
+    failure.code = code;
+    failure.system_error = system_error;
+    return failure;
+}
+
+/**
+ * @brief Build an error carrying the error message of LXC
+ */
+static error make_lxc_error(error_code code, struct lxc_container *handle)
+{
+    error failure = make_error(code);
+    if (handle != NULL && handle->error_string != NULL)
+        snprintf(failure.detail, sizeof(failure.detail), "%s", handle->error_string);
+    return failure;
+}
+
+/**
+ * @brief Build a buffer_too_small error with the needed size
+ */
+static error make_size_error(size_t needed_size)
+{
+    error failure = make_error(error_code::buffer_too_small);
+    failure.size = needed_size;
+    return failure;
+}
+
+/**
+ * @brief Copy a non empty string to a buffer as a NUL-terminated string
+ *
+ * @return bool false if the string is empty, holds a NUL or does not fit
+ */
+static bool copy_string(std::string_view text, char *buffer, size_t size)
+{
+    if (text.empty() || text.size() >= size || text.find('\0') != std::string_view::npos)
+        return false;
+
+    memcpy(buffer, text.data(), text.size());
+    buffer[text.size()] = 0;
+    return true;
+}
+
+/**
+ * @brief Parse the state reported by LXC
+ */
+static container_state parse_state(const char *state)
+{
+    static const struct
+    {
+        const char *name;
+        container_state state;
+    } states[] = {
+        {"STOPPED", container_state::stopped}, {"STARTING", container_state::starting}, {"RUNNING", container_state::running},
+        {"STOPPING", container_state::stopping}, {"ABORTING", container_state::aborting}, {"FREEZING", container_state::freezing},
+        {"FROZEN", container_state::frozen}, {"THAWED", container_state::thawed},
+    };
+
+    if (state == NULL)
+        return container_state::unknown;
+
+    for (const auto &entry : states)
+        if (strcmp(state, entry.name) == 0)
+            return entry.state;
+
+    return container_state::unknown;
+}
+
+/**
+ * @brief Read the first IPv4 address of an interface, freeing the list returned by LXC
+ *
+ * @return size_t length of the address (written only if it fits), 0 if there is none
+ */
+static size_t read_ip_address(struct lxc_container *handle, const char *interface, char *buffer, size_t size)
+{
+    char **addresses = handle->get_ips(handle, interface, "inet", 0);
+    size_t length = 0;
+
+    if (addresses == NULL)
+        return 0;
+
+    if (addresses[0] != NULL)
+    {
+        length = strlen(addresses[0]);
+        if (length < size)
+            memcpy(buffer, addresses[0], length + 1);
+    }
+
+    for (char **address = addresses; *address != NULL; address++)
+        free(*address);
+    free(addresses);
+
+    return length;
+}
+
+/**
+ * @brief Remove the trailing newlines of a value read from LXC
+ */
+static size_t trim_newlines(char *value, size_t length)
+{
+    while (length > 0 && value[length - 1] == '\n')
+        value[--length] = 0;
+    return length;
+}
+
+result<container> container::open(std::string_view name) noexcept
+{
+    char container_name[CONTAINER_NAME_SIZE];
+    struct lxc_container *handle;
+
+    if (!copy_string(name, container_name, sizeof(container_name)) || name.find('/') != std::string_view::npos)
+        return make_error(error_code::invalid_argument);
+
+    handle = TRACE_CALL("lxc.new", container_name, lxc_container_new(container_name, get_containers_path()));
+    if (handle == NULL)
+        return make_error(error_code::setup_failed, errno);
+
+    return container(handle);
+}
+
+result<container> container::create(std::string_view name, const create_options &options) noexcept
+{
+    char distribution[TEMPLATE_FIELD_SIZE], release[TEMPLATE_FIELD_SIZE], architecture[TEMPLATE_FIELD_SIZE];
+
+    if (!copy_string(options.distribution, distribution, sizeof(distribution)) || !copy_string(options.release, release, sizeof(release)) ||
+        !copy_string(options.architecture, architecture, sizeof(architecture)))
+        return make_error(error_code::invalid_argument);
+
+    result<container> opened = open(name);
+    if (!opened)
+        return opened;
+
+    struct lxc_container *handle = opened.value().get();
+    if (handle->is_defined(handle))
+        return make_error(error_code::already_defined);
+
+    if (!TRACE_CALL("lxc.create", handle->name, handle->createl(handle, "download", NULL, NULL, LXC_CREATE_QUIET, "-d", distribution, "-r", release, "-a", architecture, NULL)))
+        return make_lxc_error(error_code::create_failed, handle);
+
+    return opened;
+}
+
+container &container::operator=(container &&other) noexcept
+{
+    if (this != &other)
+    {
+        if (handle_ != NULL)
+            lxc_container_put(handle_);
+        handle_ = std::exchange(other.handle_, nullptr);
+    }
+    return *this;
+}
+
+container::~container()
+{
+    if (handle_ != NULL)
+        lxc_container_put(handle_);
+}
+
+std::string_view container::name() const noexcept
+{
+    return handle_->name;
+}
+
+bool container::is_defined() const noexcept
+{
+    return handle_->is_defined(handle_);
+}
+
+bool container::is_running() const noexcept
+{
+    return handle_->is_running(handle_);
+}
+
+container_state container::state() const noexcept
+{
+    return parse_state(handle_->state(handle_));
+}
+
+int container::pid() const noexcept
+{
+    return handle_->is_running(handle_) ? handle_->init_pid(handle_) : -1;
+}
+
+result<size_t> container::ip_address(char *buffer, size_t size, const char *interface) const noexcept
+{
+    size_t length = read_ip_address(handle_, interface, buffer, size);
+    if (length >= size)
+        return make_size_error(length + 1);
+
+    if (length == 0 && size > 0)
+        buffer[0] = 0;
+
+    return length;
+}
+
+result<void> container::start() noexcept
+{
+    if (!handle_->is_defined(handle_))
+        return make_error(error_code::not_defined);
+
+    if (handle_->is_running(handle_))
+        return {};
+
+    // The rootfs of the base layer is the lower layer of every layered container, it must not change under them
+    if (strcmp(handle_->name, LAYER_BASE_CONTAINER) == 0)
+    {
+        error failure = make_error(error_code::invalid_argument);
+        snprintf(failure.detail, sizeof(failure.detail), "%s is the base layer and is never started", LAYER_BASE_CONTAINER);
+        return failure;
+    }
+
+    if (!TRACE_CALL("lxc.start", handle_->name, handle_->start(handle_, 0, NULL)))
+        return make_lxc_error(error_code::start_failed, handle_);
+
+    // A saved network policy that cannot be applied is logged as a warning, it never keeps the container from starting
+    restore_container_network_qos(handle_);
+
+    return {};
+}
+
+result<void> container::stop() noexcept
+{
+    if (!handle_->is_defined(handle_))
+        return make_error(error_code::not_defined);
+
+    if (!TRACE_CALL("lxc.stop", handle_->name, handle_->stop(handle_)))
+        return make_lxc_error(error_code::stop_failed, handle_);
+
+    return {};
+}
+
+result<void> container::destroy() noexcept
+{
+    if (!handle_->is_defined(handle_))
+        return make_error(error_code::not_defined);
+
+    if (!TRACE_CALL("lxc.destroy", handle_->name, handle_->destroy(handle_)))
+        return make_lxc_error(error_code::destroy_failed, handle_);
+
+    return {};
+}
+
+result<void> container::prepare() noexcept
+{
+    result<void> started = start();
+    if (!started)
+        return started;
+
+    if (wake_idle_container(handle_) < 0) // frozen by the idle manager
+        return make_lxc_error(error_code::thaw_failed, handle_);
+
+    return {};
+}
+
+result<int> container::run(const char *const arguments[]) noexcept
+{
+    int status;
+
+    if (arguments == NULL || arguments[0] == NULL)
+        return make_error(error_code::invalid_argument);
+
+    status = TRACE_CALL("lxc.attach_run_wait", handle_->name, handle_->attach_run_wait(handle_, NULL, arguments[0], arguments));
+    if (status < 0)
+        return make_lxc_error(error_code::attach_failed, handle_);
+
+    if (WIFEXITED(status))
+        return WEXITSTATUS(status);
+    if (WIFSIGNALED(status))
+        return 128 + WTERMSIG(status);
+
+    return status;
+}
+
+result<int> container::run(std::string_view command, char *buffer, size_t size) noexcept
+{
+    const char *arguments[CONTAINER_MAX_COMMAND_ARGUMENTS + 1];
+    size_t number_of_arguments = 0;
+
+    if (command.size() >= size)
+        return make_size_error(command.size() + 1);
+
+    memmove(buffer, command.data(), command.size()); // the buffer may hold the command itself
+    buffer[command.size()] = 0;
+
+    char *position = NULL;
+    for (char *token = strtok_r(buffer, " ", &position); token != NULL; token = strtok_r(NULL, " ", &position))
+    {
+        if (number_of_arguments == CONTAINER_MAX_COMMAND_ARGUMENTS)
+            return make_error(error_code::invalid_argument);
+        arguments[number_of_arguments++] = token;
+    }
+    arguments[number_of_arguments] = NULL;
+
+    return run(arguments);
+}
+
+result<void> container::console(int tty, int input_fd, int output_fd, int error_fd) noexcept
+{
+    if (TRACE_CALL("lxc.console", handle_->name, handle_->console(handle_, tty, input_fd, output_fd, error_fd, 1)) < 0)
+        return make_lxc_error(error_code::console_failed, handle_);
+
+    return {};
+}
+
+ssize_t copy_file_contents(int source_fd, int destination_fd) noexcept
+{
+    char buffer[COPY_BUFFER_SIZE];
+    ssize_t copied = 0, length;
+
+    while ((length = copy_file_range(source_fd, NULL, destination_fd, NULL, SSIZE_MAX, 0)) > 0)
+        copied += length;
+
+    if (length == 0)
+        return copied;
+
+    if (copied > 0 || (errno != EXDEV && errno != ENOSYS && errno != EINVAL && errno != EOPNOTSUPP))
+        return -1;
+
+    while ((length = read(source_fd, buffer, sizeof(buffer))) > 0)
+    {
+        for (ssize_t written = 0; written < length;)
+        {
+            ssize_t chunk = write(destination_fd, buffer + written, length - written);
+            if (chunk < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return -1;
+            }
+            written += chunk;
+        }
+        copied += length;
+    }
+
+    return length < 0 ? -1 : copied;
+}
+
+/**
+ * @brief What the attached process needs to write a file in the home directory of the container
+ */
+struct copy_destination
+{
+    const char *file_name;
+    mode_t mode;
+};
+
+/**
+ * @brief Write the standard input to a file of the home directory, run inside the container by attach()
+ *
+ * @return int 0 on success, errno on failure (exit status of the attached process)
+ */
+static int write_attached_file(void *payload)
+{
+    const struct copy_destination *destination = (const struct copy_destination *)payload;
+    char path[FILENAME_MAX];
+    struct stat home_stat;
+
+    if (snprintf(path, sizeof(path), "%s/%s", CONTAINER_HOME_PATH, destination->file_name) >= (int)sizeof(path))
+        return ENAMETOOLONG;
+
+    int fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, destination->mode);
+    if (fd < 0)
+        return errno;
+
+    // Owned by the user of the home directory, as if they had copied it
+    if (stat(CONTAINER_HOME_PATH, &home_stat) < 0 || fchown(fd, home_stat.st_uid, home_stat.st_gid) < 0 || copy_file_contents(STDIN_FILENO, fd) < 0)
+    {
+        int saved_errno = errno;
+        close(fd);
+        return saved_errno;
+    }
+
+    return close(fd) < 0 ? errno : 0;
+}
+
+/**
+ * @brief Find the mode and owner of a directory in the lower layers of an overlay
+ *
+ * @param lowers lower layers separated by ':', from the top
+ * @param path absolute path in the container
+ *
+ * @return int 0 if a layer has the directory, -1 otherwise
+ */
+static int stat_lower_directory(const char *lowers, const char *path, struct stat *directory_stat)
+{
+    char layers[FILENAME_MAX], directory[FILENAME_MAX], *saveptr = NULL;
+
+    if (snprintf(layers, sizeof(layers), "%s", lowers) >= (int)sizeof(layers))
+        return -1;
+
+    for (char *layer = strtok_r(layers, ":", &saveptr); layer != NULL; layer = strtok_r(NULL, ":", &saveptr))
+    {
+        if (snprintf(directory, sizeof(directory), "%s%s", layer, path) < (int)sizeof(directory) && lstat(directory, directory_stat) == 0)
+            return S_ISDIR(directory_stat->st_mode) ? 0 : -1;
+    }
+    return -1;
+}
+
+/**
+ * @brief Open the home directory of a stopped container from the host, without following symbolic links out of the rootfs
+ *
+ * A directory missing from the upper layer of an overlay is created with the mode and owner it has in the layers below,
+ * as the kernel does when it copies a directory up
+ *
+ * @param root directory written by the container (the rootfs, or the upper layer of an overlay)
+ * @param lowers lower layers of an overlay separated by ':', NULL for a plain directory
+ *
+ * @return int descriptor of the home directory, -1 with errno set on failure
+ */
+static int open_stopped_home(const char *root, const char *lowers)
+{
+    char components[sizeof(CONTAINER_HOME_PATH)], path[sizeof(CONTAINER_HOME_PATH)], *saveptr = NULL;
+    struct stat lower_stat;
+
+    int directory_fd = ::open(root, O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (directory_fd < 0)
+        return -1;
+
+    snprintf(components, sizeof(components), "%s", CONTAINER_HOME_PATH);
+    for (char *component = strtok_r(components, "/", &saveptr); component != NULL; component = strtok_r(NULL, "/", &saveptr))
+    {
+        snprintf(path, sizeof(path), "%.*s", (int)(component - components + strlen(component)), CONTAINER_HOME_PATH);
+
+        int next_fd = openat(directory_fd, component, O_PATH | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (next_fd < 0 && errno == ENOENT && lowers != NULL && stat_lower_directory(lowers, path, &lower_stat) == 0 &&
+            mkdirat(directory_fd, component, lower_stat.st_mode & 07777) == 0 &&
+            fchownat(directory_fd, component, lower_stat.st_uid, lower_stat.st_gid, AT_SYMLINK_NOFOLLOW) == 0)
+            next_fd = openat(directory_fd, component, O_PATH | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+
+        int saved_errno = errno;
+        close(directory_fd);
+        errno = saved_errno;
+        if (next_fd < 0)
+            return -1;
+        directory_fd = next_fd;
+    }
+
+    return directory_fd;
+}
+
+/**
+ * @brief Write a file to the home directory of a stopped container straight into its rootfs, without starting it
+ *
+ * Only rootfs backends that are directories of the host are written: a directory, or the upper layer of an overlay
+ *
+ * @return int 0 on success, -1 with errno set on failure (EOPNOTSUPP for another backend)
+ */
+static int write_stopped_file(struct lxc_container *handle, int source_fd, const struct copy_destination *destination)
+{
+    char rootfs[FILENAME_MAX];
+    const char *root = NULL, *lowers = NULL;
+    struct stat home_stat;
+    int result = -1, saved_errno;
+
+    int length = handle->get_config_item(handle, "lxc.rootfs.path", rootfs, sizeof(rootfs));
+    if (length >= (int)sizeof(rootfs))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    if (length > 0 && (strncmp(rootfs, "overlay:", 8) == 0 || strncmp(rootfs, "overlayfs:", 10) == 0))
+    {
+        char *first = strchr(rootfs, ':'), *last = strrchr(rootfs, ':');
+        if (last != first) // overlay:LOWER[:LOWER...]:UPPER
+        {
+            *last = 0;
+            root = last + 1;
+            lowers = first + 1;
+        }
+    }
+    else if (length > 0 && (strncmp(rootfs, "dir:", 4) == 0 || strncmp(rootfs, "btrfs:", 6) == 0))
+        root = strchr(rootfs, ':') + 1;
+    else if (length > 0 && rootfs[0] == '/')
+        root = rootfs;
+
+    struct stat root_stat;
+    if (root == NULL || stat(root, &root_stat) < 0 || !S_ISDIR(root_stat.st_mode)) // a block device, an image or a remote backend
+    {
+        errno = EOPNOTSUPP;
+        return -1;
+    }
+
+    int home_fd = open_stopped_home(root, lowers);
+    if (home_fd < 0)
+        return -1;
+
+    int fd = openat(home_fd, destination->file_name, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, destination->mode);
+    if (fd >= 0)
+    {
+        // Owned by the user of the home directory, as if they had copied it
+        if (fstat(home_fd, &home_stat) == 0 && fchown(fd, home_stat.st_uid, home_stat.st_gid) == 0 && copy_file_contents(source_fd, fd) >= 0)
+            result = 0;
+        saved_errno = errno;
+        if (close(fd) < 0 && result == 0)
+        {
+            saved_errno = errno;
+            result = -1;
+        }
+        errno = saved_errno;
+    }
+
+    saved_errno = errno;
+    close(home_fd);
+    errno = saved_errno;
+    return result;
+}
+
+result<size_t> container::copy_file(std::string_view source_path) noexcept
+{
+    char source[FILENAME_MAX];
+    struct copy_destination destination;
+    lxc_attach_options_t options = LXC_ATTACH_OPTIONS_DEFAULT;
+    struct stat source_stat;
+    int source_fd = -1, status = 0;
+    pid_t pid = -1;
+    error failure;
+
+    if (!copy_string(source_path, source, sizeof(source)))
+        return make_error(error_code::invalid_argument);
+
+    destination.file_name = strrchr(source, '/') != NULL ? strrchr(source, '/') + 1 : source;
+    if (*destination.file_name == 0)
+        return make_error(error_code::invalid_argument);
+
+    if (!handle_->is_defined(handle_))
+        return make_error(error_code::not_defined);
+
+    source_fd = ::open(source, O_RDONLY | O_CLOEXEC);
+    if (source_fd < 0 || fstat(source_fd, &source_stat) < 0)
+    {
+        failure = make_error(error_code::copy_failed, errno);
+        goto out;
+    }
+    if (!S_ISREG(source_stat.st_mode))
+    {
+        failure = make_error(error_code::invalid_argument);
+        snprintf(failure.detail, sizeof(failure.detail), "%.100s is not a regular file", source);
+        goto out;
+    }
+    destination.mode = source_stat.st_mode & 07777;
+
+    // A stopped container is never booted for a copy, the file is written into its rootfs from the host
+    if (!is_running())
+    {
+        if (write_stopped_file(handle_, source_fd, &destination) == 0)
+            goto out;
+
+        if (errno == EOPNOTSUPP)
+        {
+            failure = make_error(error_code::not_running);
+            snprintf(failure.detail, sizeof(failure.detail), "the rootfs of %.64s is not a directory of the host, start it first", handle_->name);
+        }
+        else
+            failure = make_error(error_code::copy_failed, errno);
+        goto out;
+    }
+
+    // The file is written from inside the running container: its rootfs may be an overlay, another backend or owned by mapped ids
+    if (wake_idle_container(handle_) < 0) // frozen by the idle manager
+    {
+        failure = make_lxc_error(error_code::thaw_failed, handle_);
+        goto out;
+    }
+
+    options.stdin_fd = source_fd;
+    if (TRACE_CALL("file.copy", handle_->name, handle_->attach(handle_, write_attached_file, &destination, &options, &pid)) < 0)
+    {
+        failure = make_lxc_error(error_code::attach_failed, handle_);
+        goto out;
+    }
+
+    while (waitpid(pid, &status, 0) < 0)
+    {
+        if (errno != EINTR)
+        {
+            failure = make_error(error_code::copy_failed, errno);
+            goto out;
+        }
+    }
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        failure = make_error(error_code::copy_failed, WIFEXITED(status) ? WEXITSTATUS(status) : EINTR);
+
+out:
+    if (source_fd >= 0)
+        close(source_fd);
+
+    if (failure.code != error_code::none)
+        return failure;
+    return (size_t)source_stat.st_size;
+}
+
+/**
+ * @brief Translate a cgroup limit to this host and build its configuration key (e.g. lxc.cgroup2.memory.max)
+ *
+ * @param value requested value, NULL when only the name is translated
+ *
+ * @return bool false if the host has no such limit or it does not fit
+ */
+static bool make_config_key(const char *subsystem, const char *value, char *host_subsystem, char *host_value, char *config_key, size_t size)
+{
+    if (resolve_cgroup_limit(subsystem, value, host_subsystem, CONTAINER_KEY_SIZE, host_value, CONTAINER_VALUE_SIZE) < 0)
+        return false;
+
+    int length = snprintf(config_key, size, "%s%s", get_cgroup_config_prefix(), host_subsystem);
+    return length > 0 && (size_t)length < size;
+}
+
+/**
+ * @brief Build an invalid_argument error naming a limit this host does not have
+ */
+static error make_limit_error(const char *subsystem)
+{
+    error failure = make_error(error_code::invalid_argument);
+    snprintf(failure.detail, sizeof(failure.detail), "%.64s is not a cgroup limit of this host", subsystem);
+    return failure;
+}
+
+result<limit_source> container::set_limit(std::string_view subsystem, std::string_view value) noexcept
+{
+    char cgroup_subsystem[CONTAINER_KEY_SIZE], cgroup_value[CONTAINER_VALUE_SIZE], config_key[CONTAINER_KEY_SIZE + 16];
+    char host_subsystem[CONTAINER_KEY_SIZE], host_value[CONTAINER_VALUE_SIZE], requested_key[CONTAINER_KEY_SIZE + 16];
+    limit_source source = limit_source::configured;
+
+    if (!copy_string(subsystem, cgroup_subsystem, sizeof(cgroup_subsystem)) || !copy_string(value, cgroup_value, sizeof(cgroup_value)))
+        return make_error(error_code::invalid_argument);
+
+    // A key the host does not have would be saved and stop the container from booting
+    if (!make_config_key(cgroup_subsystem, cgroup_value, host_subsystem, host_value, config_key, sizeof(config_key)))
+        return make_limit_error(cgroup_subsystem);
+
+    if (!handle_->is_defined(handle_))
+        return make_error(error_code::not_defined);
+
+    if (handle_->is_running(handle_)) // apply it right away, no need to boot a stopped container
+    {
+        if (!TRACE_CALL("cgroup.set", handle_->name, handle_->set_cgroup_item(handle_, host_subsystem, host_value)))
+            return make_lxc_error(error_code::cgroup_failed, handle_);
+        source = limit_source::live;
+    }
+
+    // Persist the limit so it survives the next boot, dropping the key of the other cgroup version if it was saved before
+    if (strcmp(host_subsystem, cgroup_subsystem) != 0 && snprintf(requested_key, sizeof(requested_key), "%s%s", get_cgroup_config_prefix(), cgroup_subsystem) < (int)sizeof(requested_key))
+        handle_->clear_config_item(handle_, requested_key);
+    handle_->clear_config_item(handle_, config_key);
+    if (!TRACE_CALL("config.save", handle_->name, handle_->set_config_item(handle_, config_key, host_value) && handle_->save_config(handle_, NULL)))
+        return make_lxc_error(error_code::config_failed, handle_);
+
+    return source;
+}
+
+result<limit_value> container::get_limit(std::string_view subsystem, char *buffer, size_t size) const noexcept
+{
+    char cgroup_subsystem[CONTAINER_KEY_SIZE], host_subsystem[CONTAINER_KEY_SIZE], config_key[CONTAINER_KEY_SIZE + 16];
+    int length;
+
+    if (!copy_string(subsystem, cgroup_subsystem, sizeof(cgroup_subsystem)))
+        return make_error(error_code::invalid_argument);
+
+    if (!make_config_key(cgroup_subsystem, NULL, host_subsystem, NULL, config_key, sizeof(config_key)))
+        return make_limit_error(cgroup_subsystem);
+
+    if (size == 0)
+        return make_size_error(1);
+
+    if (!handle_->is_defined(handle_))
+        return make_error(error_code::not_defined);
+
+    if (!handle_->is_running(handle_)) // read the configured value instead of booting the container
+    {
+        length = TRACE_CALL("config.get", handle_->name, handle_->get_config_item(handle_, config_key, buffer, (int)size));
+        if (length <= 0)
+        {
+            buffer[0] = 0;
+            return limit_value{std::string_view(buffer, 0), limit_source::unset};
+        }
+        if ((size_t)length >= size)
+            return make_size_error((size_t)length + 1);
+
+        return limit_value{std::string_view(buffer, trim_newlines(buffer, length)), limit_source::configured};
+    }
+
+    length = TRACE_CALL("cgroup.get", handle_->name, handle_->get_cgroup_item(handle_, host_subsystem, buffer, (int)size));
+    if (length < 0)
+        return make_lxc_error(error_code::cgroup_failed, handle_);
+    if ((size_t)length >= size)
+        return make_size_error((size_t)length + 1);
+
+    return limit_value{std::string_view(buffer, trim_newlines(buffer, length)), limit_source::live};
+}
+
+result<size_t> list_running(container_info *containers, size_t capacity) noexcept
+{
+    struct lxc_container **handles;
+    char **names;
+    int number_of_containers;
+
+    number_of_containers = TRACE_CALL("lxc.list_active", NULL, list_active_containers(get_containers_path(), &names, &handles));
+    if (number_of_containers < 0)
+        return make_error(error_code::list_failed);
+
+    for (int index = 0; index < number_of_containers; index++)
+    {
+        if ((size_t)index < capacity)
+        {
+            container_info *info = &containers[index];
+            snprintf(info->name, sizeof(info->name), "%s", names[index]);
+            info->state = parse_state(handles[index]->state(handles[index]));
+            info->pid = handles[index]->init_pid(handles[index]);
+            size_t ip_length = read_ip_address(handles[index], "eth0", info->ip, sizeof(info->ip));
+            if (ip_length == 0 || ip_length >= sizeof(info->ip))
+                info->ip[0] = 0;
+        }
+        lxc_container_put(handles[index]);
+        free(names[index]);
+    }
+    free(handles);
+    free(names);
+
+    if ((size_t)number_of_containers > capacity)
+        return make_size_error((size_t)number_of_containers);
+
+    return (size_t)number_of_containers;
+}
+
+} // namespace cmt
@@ -0,0 +1,374 @@
+#ifndef CONTAINER_H
+#define CONTAINER_H
+
+/**
+ * @file container.h
+ * @brief This file contains the typed C++ API used by lib.cpp regarding LXC containers operations
+ *
+ * The functions of lib.h print their results and register them in the activity log, which suits the CLI but not a service that
+ * embeds the library. This API does the same operations without console output or log records: a container is a move-only handle
+ * that releases the LXC object when it goes out of scope, every operation returns a move-only result holding either its value or
+ * an error, names and values are taken as std::string_view and anything variable-sized is written to a buffer given by the caller,
+ * which gets an error with the needed size instead of a truncated value. Nothing here allocates memory or throws (liblxc still
+ * allocates internally, and what it returns is freed before returning). The functions of lib.h are thin wrappers that print
+ *
+ * @author Simão Andrade
+ * @date 2024-06-13
+ */
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <optional>
+#include <string_view>
+#include <utility>
+
+struct lxc_container;
+
+/**
+ * @brief Maximum size of a container name, of a cgroup key or value, and number of arguments of a command
+ */
+#define CONTAINER_NAME_SIZE 256
+#define CONTAINER_KEY_SIZE 128
+#define CONTAINER_VALUE_SIZE 4096
+#define CONTAINER_MAX_COMMAND_ARGUMENTS 100
+
+/**
+ * @brief Size of the buffer holding an IP address (IPv6 included)
+ */
+#define CONTAINER_IP_SIZE 46
+
+/**
+ * @brief Size of the copy of the LXC error message kept in an error
+ */
+#define CONTAINER_ERROR_DETAIL_SIZE 128
+
+namespace cmt
+{
+
+/**
+ * @brief Reason of a failed operation
+ */
+enum class error_code
+{
+    none,
+    invalid_argument, // empty or too long name, key or value, too many arguments
+    buffer_too_small, // the buffer of the caller cannot hold the result, error::size has the needed size
+    setup_failed,     // lxc_container_new failed
+    not_defined,
+    already_defined,
+    create_failed,
+    start_failed,
+    stop_failed,
+    destroy_failed,
+    thaw_failed,
+    attach_failed,
+    console_failed,
+    cgroup_failed,
+    config_failed,
+    copy_failed,
+    list_failed,
+    not_running,      // the operation needs a running container
+};
+
+/**
+ * @brief Error of a failed operation
+ */
+struct error
+{
+    error_code code = error_code::none;
+    int system_error = 0;                           // errno of the failed system call, 0 if none
+    size_t size = 0;                                // needed size of the buffer for error_code::buffer_too_small
+    char detail[CONTAINER_ERROR_DETAIL_SIZE] = {0}; // error message of LXC, empty if none
+};
+
+/**
+ * @brief Get the description of an error code
+ *
+ * @param code error code
+ *
+ * @return const char* static description
+ */
+const char *error_message(error_code code) noexcept;
+
+/**
+ * @brief Value of an operation or the error that prevented it (a result is moved, never copied)
+ */
+template <typename T>
+class result
+{
+public:
+    result(const T &value) noexcept : value_(value) {}
+    result(T &&value) noexcept : value_(std::move(value)) {}
+    result(const cmt::error &error) noexcept : error_(error) {}
+    result(result &&) noexcept = default;
+    result &operator=(result &&) noexcept = default;
+    result(const result &) = delete;
+    result &operator=(const result &) = delete;
+
+    explicit operator bool() const noexcept { return error_.code == error_code::none; }
+    T &value() & noexcept { return *value_; }
+    const T &value() const & noexcept { return *value_; }
+    T &&value() && noexcept { return std::move(*value_); }
+    const cmt::error &error() const noexcept { return error_; }
+
+private:
+    std::optional<T> value_;
+    cmt::error error_;
+};
+
+/**
+ * @brief Outcome of an operation without a value
+ */
+template <>
+class result<void>
+{
+public:
+    result() noexcept = default;
+    result(const cmt::error &error) noexcept : error_(error) {}
+    result(result &&) noexcept = default;
+    result &operator=(result &&) noexcept = default;
+    result(const result &) = delete;
+    result &operator=(const result &) = delete;
+
+    explicit operator bool() const noexcept { return error_.code == error_code::none; }
+    const cmt::error &error() const noexcept { return error_; }
+
+private:
+    cmt::error error_;
+};
+
+/**
+ * @brief State of a container as reported by LXC
+ */
+enum class container_state
+{
+    unknown,
+    stopped,
+    starting,
+    running,
+    stopping,
+    aborting,
+    freezing,
+    frozen,
+    thawed,
+};
+
+/**
+ * @brief Get the name of a state as shown by LXC (e.g. RUNNING)
+ *
+ * @param state state
+ *
+ * @return const char* static name
+ */
+const char *state_name(container_state state) noexcept;
+
+/**
+ * @brief Template used to create a container
+ */
+struct create_options
+{
+    std::string_view distribution = "ubuntu";
+    std::string_view release = "bionic";
+    std::string_view architecture = "amd64";
+};
+
+/**
+ * @brief Where the value of a limit comes from
+ */
+enum class limit_source
+{
+    live,       // cgroup of the running container
+    configured, // configuration of the stopped container, applied on the next boot
+    unset,      // not configured, the host default applies
+};
+
+/**
+ * @brief Value of a limit, viewing the buffer of the caller
+ */
+struct limit_value
+{
+    std::string_view value;
+    limit_source source;
+};
+
+/**
+ * @brief Summary of a running container, filled in place by list_running()
+ */
+struct container_info
+{
+    char name[CONTAINER_NAME_SIZE];
+    container_state state;
+    int pid;
+    char ip[CONTAINER_IP_SIZE]; // IPv4 address of eth0, empty if none
+};
+
+/**
+ * @brief Handle of a LXC container, released when it goes out of scope
+ */
+class container
+{
+public:
+    /**
+     * @brief Get a handle of a container, which may not be defined yet
+     *
+     * @param name name of the container
+     *
+     * @return result<container> handle, or error_code::invalid_argument or setup_failed
+     */
+    static result<container> open(std::string_view name) noexcept;
+
+    /**
+     * @brief Create a container from the download template, without starting it
+     *
+     * @param name name of the container
+     * @param options template of the container
+     *
+     * @return result<container> handle of the new container, or error_code::already_defined or create_failed
+     */
+    static result<container> create(std::string_view name, const create_options &options = create_options()) noexcept;
+
+    container(container &&other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+    container &operator=(container &&other) noexcept;
+    container(const container &) = delete;
+    container &operator=(const container &) = delete;
+    ~container();
+
+    /**
+     * @brief Get the LXC object, still owned by the handle
+     */
+    struct lxc_container *get() const noexcept { return handle_; }
+
+    std::string_view name() const noexcept;
+    bool is_defined() const noexcept;
+    bool is_running() const noexcept;
+    container_state state() const noexcept;
+
+    /**
+     * @brief Get the PID of the init process of the container
+     *
+     * @return int PID, -1 if the container is not running
+     */
+    int pid() const noexcept;
+
+    /**
+     * @brief Get the IPv4 address of an interface of the container
+     *
+     * @param buffer buffer receiving the address
+     * @param size size of the buffer
+     * @param interface name of the interface
+     *
+     * @return result<size_t> length of the address, 0 if the interface has none
+     */
+    result<size_t> ip_address(char *buffer, size_t size, const char *interface = "eth0") const noexcept;
+
+    /**
+     * @brief Start the container unless it is already running, and apply its saved network policy
+     */
+    result<void> start() noexcept;
+
+    /**
+     * @brief Stop the container
+     */
+    result<void> stop() noexcept;
+
+    /**
+     * @brief Destroy a stopped container
+     */
+    result<void> destroy() noexcept;
+
+    /**
+     * @brief Start the container if needed and thaw it if the idle manager froze it, before using it
+     */
+    result<void> prepare() noexcept;
+
+    /**
+     * @brief Run a program in the running container and wait for it
+     *
+     * @param arguments NULL-terminated arguments, the first one being the program
+     *
+     * @return result<int> exit status of the program, 128 + signal if it was killed
+     */
+    result<int> run(const char *const arguments[]) noexcept;
+
+    /**
+     * @brief Run a command line split on spaces in the running container and wait for it
+     *
+     * @param command command line
+     * @param buffer buffer receiving the split arguments, may hold the command line itself
+     * @param size size of the buffer, at least the length of the command plus one
+     *
+     * @return result<int> exit status of the command, 128 + signal if it was killed
+     */
+    result<int> run(std::string_view command, char *buffer, size_t size) noexcept;
+
+    /**
+     * @brief Attach a terminal of the running container to the given descriptors until the escape sequence
+     *
+     * @param tty terminal number, -1 for the first available one
+     */
+    result<void> console(int tty, int input_fd, int output_fd, int error_fd) noexcept;
+
+    /**
+     * @brief Copy a file of the host to the home directory of the container (/home/ubuntu)
+     *
+     * In a running container the file is written by an attached process, so it lands in the merged rootfs whatever the
+     * backend. A stopped container is never started: the file is written from the host into its rootfs directory, or into
+     * the upper layer of an overlay, and not_running is returned for any other backend. Either way the file is owned by
+     * the user of the home directory
+     *
+     * @param source_path path of a regular file on the host
+     *
+     * @return result<size_t> number of copied bytes
+     */
+    result<size_t> copy_file(std::string_view source_path) noexcept;
+
+    /**
+     * @brief Set a cgroup limit, right away if the container is running, and persist it in its configuration
+     *
+     * @param subsystem cgroup key (e.g. memory.max)
+     * @param value value of the limit
+     *
+     * @return result<limit_source> limit_source::live if it was applied right away, configured if only on the next boot
+     */
+    result<limit_source> set_limit(std::string_view subsystem, std::string_view value) noexcept;
+
+    /**
+     * @brief Get a cgroup limit, from the cgroup if the container is running or from its configuration otherwise
+     *
+     * @param subsystem cgroup key (e.g. memory.max)
+     * @param buffer buffer receiving the value
+     * @param size size of the buffer
+     *
+     * @return result<limit_value> value viewing the buffer and where it comes from
+     */
+    result<limit_value> get_limit(std::string_view subsystem, char *buffer, size_t size) const noexcept;
+
+private:
+    explicit container(struct lxc_container *handle) noexcept : handle_(handle) {}
+
+    struct lxc_container *handle_;
+};
+
+/**
+ * @brief Copy the rest of a file to another, in the kernel when possible
+ *
+ * @param source_fd descriptor to read from
+ * @param destination_fd descriptor to write to
+ *
+ * @return ssize_t number of copied bytes, -1 on failure (errno is set)
+ */
+ssize_t copy_file_contents(int source_fd, int destination_fd) noexcept;
+
+/**
+ * @brief List the running containers into an array of the caller
+ *
+ * @param containers array receiving the containers, filled up to its capacity
+ * @param capacity size of the array
+ *
+ * @return result<size_t> number of running containers, or error_code::buffer_too_small with the needed capacity
+ */
+result<size_t> list_running(container_info *containers, size_t capacity) noexcept;
+
+} // namespace cmt
+
+#endif // CONTAINER_H
@@ -0,0 +1,820 @@
+/**
+ * @file ephemeral.cpp
+ * @brief One-shot commands in throwaway LXC containers
+ *
+ * This file contains the implementation of the ephemeral runs. Every run gets a private lxcpath under EPHEMERAL_DIRECTORY,
+ * mounted as a tmpfs, where the base container is cloned as an overlay snapshot: the base rootfs is the lower layer and the
+ * upper layer lives in memory. Inputs are written straight into the upper layer before the start, so no attach is needed,
+ * and the command is started as the init of the container (lxc-execute style), so the distribution does not boot.
+ *
+ * Teardown does not depend on this process: before anything is created, a watchdog process is forked holding a lock on the
+ * run and the read end of a pipe. When the pipe closes, because the run finished or because this process died, the watchdog
+ * stops and destroys the container and unmounts the tmpfs. The process running the container gets SIGKILL when this process
+ * dies, and the watchdog kills what is left in the cgroup of the container. Runs whose lock is free were left by a crash of
+ * both processes and are removed first.
+ *
+ * @author Simão Andrade
+ * @date 2024-06-13
+ */
+
+#include "ephemeral.h"
+#include "lib.h"
+#include "inspect.h"
+#include "layers.h"
+#include "container.h"
+#include "events.h"
+#include "trace.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/file.h>
+#include <sys/mount.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <lxc/lxccontainer.h>
+
+/**
+ * @brief Maximum size of a path and of the name of an ephemeral container
+ */
+#define EPHEMERAL_PATH_SIZE 1024
+#define EPHEMERAL_NAME_SIZE 64
+
+/**
+ * @brief Directory of the container where the inputs are copied
+ */
+#define EPHEMERAL_HOME_DIRECTORY "/home/ubuntu"
+
+/**
+ * @brief Options of the tmpfs holding the upper layer
+ */
+#define EPHEMERAL_TMPFS_OPTIONS "mode=0700"
+
+/**
+ * @brief File of a run keeping the cgroup (v2) of its container, so that its processes can be killed once LXC no longer sees it,
+ * and how often it is looked for while the container starts, in milliseconds
+ */
+#define EPHEMERAL_CGROUP_FILE "payload.cgroup"
+#define EPHEMERAL_CGROUP_POLL_MS 100
+
+/**
+ * @brief Get the current time of the monotonic clock
+ *
+ * @return long long milliseconds
+ */
+static long long now_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+void ephemeral_default_options(struct ephemeral_options *options)
+{
+    memset(options, 0, sizeof(*options));
+    options->timeout_seconds = EPHEMERAL_DEFAULT_TIMEOUT;
+}
+
+/**
+ * @brief Get the directory holding the ephemeral runs, creating it if needed
+ *
+ * @return int 0 on success, -1 on failure
+ */
+static int get_ephemeral_directory(char *directory, size_t size)
+{
+    snprintf(directory, size, "%s/%s", get_containers_path(), EPHEMERAL_DIRECTORY);
+    if (mkdir(directory, 0700) < 0 && errno != EEXIST)
+    {
+        fprintf(stderr, "Failed to create %s: %s\n", directory, strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Remove one entry of a directory tree, called by nftw
+ */
+static int remove_entry(const char *path, const struct stat *, int type, struct FTW *)
+{
+    return type == FTW_DP ? rmdir(path) : unlink(path);
+}
+
+/**
+ * @brief Stop and destroy an ephemeral container and remove its private lxcpath, whatever is left of it
+ *
+ * @param directory directory of the ephemeral runs
+ * @param container_name name of the ephemeral container
+ */
+static void remove_ephemeral_run(const char *directory, const char *container_name)
+{
+    TRACE_SPAN_ARGUMENT("remove_ephemeral_run", container_name);
+    char run_path[EPHEMERAL_PATH_SIZE], lock_path[EPHEMERAL_PATH_SIZE], cgroup_file[EPHEMERAL_PATH_SIZE], kill_path[EPHEMERAL_PATH_SIZE] = {0};
+    struct lxc_container *container;
+    FILE *file;
+
+    snprintf(run_path, sizeof(run_path), "%s/%s", directory, container_name);
+    snprintf(lock_path, sizeof(lock_path), "%s/%s.lock", directory, container_name);
+
+    container = lxc_container_new(container_name, run_path);
+    if (container != NULL)
+    {
+        if (container->is_running(container))
+            TRACE_CALL("lxc.stop", container_name, container->stop(container));
+
+        // Without its monitor (killed with the program) LXC no longer sees the container, but its processes may still run
+        file = snprintf(cgroup_file, sizeof(cgroup_file), "%s/%s", run_path, EPHEMERAL_CGROUP_FILE) < (int)sizeof(cgroup_file) ? fopen(cgroup_file, "r") : NULL;
+        if (file != NULL)
+        {
+            if (fgets(kill_path, sizeof(kill_path) - strlen("/cgroup.kill"), file) != NULL)
+            {
+                kill_path[strcspn(kill_path, "\n")] = '\0';
+                strcat(kill_path, "/cgroup.kill");
+            }
+            fclose(file);
+        }
+
+        int kill_fd = kill_path[0] == '/' ? open(kill_path, O_WRONLY | O_CLOEXEC) : -1;
+        if (kill_fd >= 0)
+        {
+            if (write(kill_fd, "1", 1) < 0)
+                fprintf(stderr, "Failed to kill the processes of the ephemeral container %s\n", container_name);
+            close(kill_fd);
+        }
+
+        if (container->is_defined(container) && !TRACE_CALL("lxc.destroy", container_name, container->destroy(container)))
+            fprintf(stderr, "Failed to destroy the ephemeral container %s: %s\n", container_name, container->error_string ? container->error_string : "unknown error");
+        lxc_container_put(container);
+    }
+
+    // The upper layer goes away with the tmpfs, and a partial clone on disk with the directory
+    umount2(run_path, MNT_DETACH);
+    nftw(run_path, remove_entry, 16, FTW_DEPTH | FTW_PHYS | FTW_MOUNT);
+    unlink(lock_path);
+}
+
+int clean_ephemeral_containers(void)
+{
+    TRACE_SPAN("clean_ephemeral_containers");
+    char directory[EPHEMERAL_PATH_SIZE], lock_path[EPHEMERAL_PATH_SIZE], container_name[EPHEMERAL_NAME_SIZE];
+    struct dirent *entry;
+    int removed = 0;
+    DIR *runs;
+
+    if (get_ephemeral_directory(directory, sizeof(directory)) < 0)
+        return -1;
+
+    runs = opendir(directory);
+    if (runs == NULL)
+    {
+        fprintf(stderr, "Failed to open %s: %s\n", directory, strerror(errno));
+        return -1;
+    }
+
+    while ((entry = readdir(runs)) != NULL)
+    {
+        size_t length = strlen(entry->d_name);
+        if (length <= strlen(".lock") || length - strlen(".lock") >= sizeof(container_name) || strcmp(entry->d_name + length - strlen(".lock"), ".lock") != 0)
+            continue;
+
+        snprintf(container_name, sizeof(container_name), "%.*s", (int)(length - strlen(".lock")), entry->d_name);
+        if (snprintf(lock_path, sizeof(lock_path), "%s/%s", directory, entry->d_name) >= (int)sizeof(lock_path))
+            continue;
+
+        int lock_fd = open(lock_path, O_RDWR | O_CLOEXEC);
+        if (lock_fd < 0)
+            continue;
+
+        if (flock(lock_fd, LOCK_EX | LOCK_NB) == 0) // neither the program nor the watchdog of the run is alive
+        {
+            remove_ephemeral_run(directory, container_name);
+            removed++;
+        }
+        close(lock_fd);
+    }
+    closedir(runs);
+
+    if (removed > 0)
+    {
+        char log_message[LOG_MESSAGE_SIZE] = {0};
+        snprintf(log_message, LOG_MESSAGE_SIZE, "Removed %d left over ephemeral containers", removed);
+        log_activity("WARNING", "run", NULL, log_message);
+    }
+
+    return removed;
+}
+
+/**
+ * @brief Fork the watchdog that removes the run once the returned pipe is closed, even if this process dies
+ *
+ * @param directory directory of the ephemeral runs
+ * @param container_name name of the ephemeral container
+ * @param watchdog_fd write end of the pipe, to close when the run is over
+ *
+ * @return pid_t PID of the watchdog, -1 on failure
+ */
+static pid_t start_watchdog(const char *directory, const char *container_name, int *watchdog_fd)
+{
+    int pipe_fds[2];
+    pid_t pid;
+
+    if (pipe2(pipe_fds, O_CLOEXEC) < 0)
+        return -1;
+
+    fflush(NULL);
+    pid = fork();
+    if (pid < 0)
+    {
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        return -1;
+    }
+
+    if (pid == 0)
+    {
+        char byte;
+
+        close(pipe_fds[1]);
+        setsid(); // out of the process group of the terminal, Ctrl-C only interrupts the program
+        signal(SIGINT, SIG_IGN);
+        signal(SIGTERM, SIG_IGN);
+        signal(SIGHUP, SIG_IGN);
+
+        while (read(pipe_fds[0], &byte, 1) < 0 && errno == EINTR)
+            ;
+
+        remove_ephemeral_run(directory, container_name);
+        _exit(0);
+    }
+
+    close(pipe_fds[0]);
+    *watchdog_fd = pipe_fds[1];
+    return pid;
+}
+
+/**
+ * @brief Fork the process running the container, which writes the exit status of the command to the returned pipe
+ *
+ * The command is the init of the container, so the container stops when it exits
+ *
+ * @param run_path private lxcpath of the run
+ * @param container_name name of the ephemeral container
+ * @param command program and its arguments, ending with NULL
+ * @param output_fd descriptor receiving the output, -1 for the standard output and error
+ * @param watchdog_fd write end of the pipe of the watchdog, which must not outlive this process
+ * @param status_fd read end of the pipe receiving the exit status, closed without data if the container did not start
+ *
+ * @return pid_t PID of the process, -1 on failure
+ */
+static pid_t start_runner(const char *run_path, const char *container_name, char *const command[], int output_fd, int watchdog_fd, int *status_fd)
+{
+    int pipe_fds[2];
+    pid_t parent = getpid(), pid;
+
+    if (pipe2(pipe_fds, O_CLOEXEC) < 0)
+        return -1;
+
+    fflush(NULL);
+    pid = fork();
+    if (pid < 0)
+    {
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        return -1;
+    }
+
+    if (pid == 0)
+    {
+        struct lxc_container *container;
+        int null_fd, status;
+
+        close(pipe_fds[0]);
+        close(watchdog_fd);
+        prctl(PR_SET_PDEATHSIG, SIGKILL); // the container ends with the program
+        if (getppid() != parent)
+            _exit(1);
+
+        null_fd = open("/dev/null", O_RDONLY);
+        if (null_fd >= 0)
+            dup2(null_fd, STDIN_FILENO);
+        if (output_fd >= 0)
+        {
+            dup2(output_fd, STDOUT_FILENO);
+            dup2(output_fd, STDERR_FILENO);
+        }
+
+        container = lxc_container_new(container_name, run_path);
+        if (container == NULL)
+            _exit(1);
+
+        container->want_daemonize(container, false);
+        if (!TRACE_CALL("lxc.execute", container_name, container->start(container, 1, command)))
+        {
+            fprintf(stderr, "Failed to run the command in container %s: %s\n", container_name, container->error_string ? container->error_string : "unknown error");
+            _exit(1);
+        }
+
+        status = container->error_num; // wait status of the init of the container
+        if (write(pipe_fds[1], &status, sizeof(status)) != (ssize_t)sizeof(status))
+            _exit(1);
+        _exit(0);
+    }
+
+    close(pipe_fds[1]);
+    *status_fd = pipe_fds[0];
+    return pid;
+}
+
+/**
+ * @brief Get the lower and upper layers of an overlay container ("overlay:LOWER:UPPER")
+ *
+ * @return int 0 on success, -1 on failure
+ */
+static int get_overlay_layers(struct lxc_container *container, char *lower, char *upper, size_t size)
+{
+    char rootfs[2 * EPHEMERAL_PATH_SIZE] = {0};
+    char *lower_start, *upper_start;
+
+    if (container->get_config_item(container, "lxc.rootfs.path", rootfs, sizeof(rootfs)) <= 0)
+        return -1;
+    rootfs[strcspn(rootfs, "\n")] = 0;
+
+    lower_start = strchr(rootfs, ':');
+    upper_start = strrchr(rootfs, ':');
+    if (strncmp(rootfs, "overlay", strlen("overlay")) != 0 || lower_start == NULL || upper_start == lower_start)
+        return -1;
+
+    *upper_start++ = 0;
+    lower_start = strrchr(rootfs, ':') + 1; // the layer just below, for a snapshot of a snapshot
+
+    snprintf(lower, size, "%s", lower_start);
+    snprintf(upper, size, "%s", upper_start);
+    return 0;
+}
+
+/**
+ * @brief Create a directory of the container in the upper layer, with the mode and owner it has in the lower layer
+ *
+ * @param path absolute path in the container
+ *
+ * @return int 0 on success, -1 on failure
+ */
+static int make_upper_directory(const char *lower, const char *upper, const char *path)
+{
+    char partial[EPHEMERAL_PATH_SIZE], lower_path[EPHEMERAL_PATH_SIZE], upper_path[EPHEMERAL_PATH_SIZE];
+    struct stat lower_stat;
+
+    if (snprintf(partial, sizeof(partial), "%s", path) >= (int)sizeof(partial))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    for (char *slash = strchr(partial + 1, '/');; slash = strchr(slash + 1, '/'))
+    {
+        if (slash != NULL)
+            *slash = 0;
+
+        if (snprintf(lower_path, sizeof(lower_path), "%s%s", lower, partial) >= (int)sizeof(lower_path) ||
+            snprintf(upper_path, sizeof(upper_path), "%s%s", upper, partial) >= (int)sizeof(upper_path))
+        {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        if (stat(lower_path, &lower_stat) < 0)
+        {
+            lower_stat.st_mode = 0755;
+            lower_stat.st_uid = 0;
+            lower_stat.st_gid = 0;
+        }
+
+        if (mkdir(upper_path, lower_stat.st_mode & 07777) == 0)
+        {
+            if (chown(upper_path, lower_stat.st_uid, lower_stat.st_gid) < 0)
+                return -1;
+        }
+        else if (errno != EEXIST)
+            return -1;
+
+        if (slash == NULL)
+            return 0;
+        *slash = '/';
+    }
+}
+
+/**
+ * @brief Copy an input of the host to the home directory of the container, owned by the owner of that directory
+ *
+ * @return int 0 on success, -1 on failure
+ */
+static int copy_input(const char *upper, const char *input)
+{
+    char destination[EPHEMERAL_PATH_SIZE], home[EPHEMERAL_PATH_SIZE];
+    const char *file_name = strrchr(input, '/') != NULL ? strrchr(input, '/') + 1 : input;
+    struct stat source_stat, home_stat;
+    int source_fd, destination_fd, result = -1;
+
+    if (snprintf(home, sizeof(home), "%s%s", upper, EPHEMERAL_HOME_DIRECTORY) >= (int)sizeof(home) ||
+        snprintf(destination, sizeof(destination), "%s/%s", home, file_name) >= (int)sizeof(destination))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    if (stat(home, &home_stat) < 0)
+        return -1;
+
+    source_fd = open(input, O_RDONLY | O_CLOEXEC);
+    if (source_fd < 0)
+        return -1;
+
+    if (fstat(source_fd, &source_stat) == 0 && S_ISREG(source_stat.st_mode))
+    {
+        destination_fd = open(destination, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, source_stat.st_mode & 07777);
+        if (destination_fd >= 0)
+        {
+            if (cmt::copy_file_contents(source_fd, destination_fd) >= 0 && fchown(destination_fd, home_stat.st_uid, home_stat.st_gid) == 0)
+                result = 0;
+            close(destination_fd);
+        }
+    }
+    else
+        errno = EINVAL;
+    close(source_fd);
+
+    return result;
+}
+
+/**
+ * @brief Open a file under a root directory without following symbolic links, which could point out of it
+ *
+ * @param root root directory (a layer of the container)
+ * @param path absolute path in the container
+ *
+ * @return int descriptor of the file, -1 on failure
+ */
+static int open_in_layer(const char *root, const char *path)
+{
+    char components[EPHEMERAL_PATH_SIZE], *saveptr = NULL;
+    int directory_fd, fd;
+
+    snprintf(components, sizeof(components), "%s", path);
+    directory_fd = open(root, O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (directory_fd < 0)
+        return -1;
+
+    char *component = strtok_r(components, "/", &saveptr);
+    while (component != NULL)
+    {
+        char *next = strtok_r(NULL, "/", &saveptr);
+        if (strcmp(component, "..") == 0)
+        {
+            close(directory_fd);
+            errno = EINVAL;
+            return -1;
+        }
+
+        fd = openat(directory_fd, component, O_NOFOLLOW | O_CLOEXEC | (next != NULL ? O_PATH | O_DIRECTORY : O_RDONLY | O_NONBLOCK));
+        close(directory_fd);
+        if (fd < 0 || next == NULL)
+            return fd;
+
+        directory_fd = fd;
+        component = next;
+    }
+
+    close(directory_fd);
+    errno = EINVAL;
+    return -1;
+}
+
+/**
+ * @brief Copy a file of the container to the current directory, from the upper layer or else from the lower one
+ *
+ * @return int 0 on success, -1 on failure
+ */
+static int collect_output(const char *lower, const char *upper, const char *path)
+{
+    const char *file_name = strrchr(path, '/') != NULL ? strrchr(path, '/') + 1 : path;
+    struct stat source_stat;
+    int source_fd, destination_fd, result = -1;
+
+    source_fd = open_in_layer(upper, path);
+    if (source_fd < 0 && errno == ENOENT)
+        source_fd = open_in_layer(lower, path);
+    if (source_fd < 0)
+        return -1;
+
+    if (fstat(source_fd, &source_stat) < 0 || !S_ISREG(source_stat.st_mode)) // a whiteout (deleted file) is a device
+    {
+        close(source_fd);
+        errno = ENOENT;
+        return -1;
+    }
+
+    destination_fd = open(file_name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (destination_fd >= 0)
+    {
+        if (cmt::copy_file_contents(source_fd, destination_fd) >= 0)
+            result = 0;
+        close(destination_fd);
+    }
+    close(source_fd);
+
+    return result;
+}
+
+/**
+ * @brief Save the cgroup of a running container in its run, taken from its init as LXC placed it
+ *
+ * @return int -1 while the container is not running yet, 0 once it was saved or cannot be (no cgroup v2)
+ */
+static int save_payload_cgroup(struct lxc_container *container, const char *run_path)
+{
+    char cgroup_path[EPHEMERAL_PATH_SIZE], cgroup_file[EPHEMERAL_PATH_SIZE];
+
+    pid_t pid = container->init_pid(container);
+    if (pid <= 0)
+        return -1;
+
+    if (get_process_cgroup_path(pid, cgroup_path, sizeof(cgroup_path)) < 0)
+        return 0;
+
+    if (snprintf(cgroup_file, sizeof(cgroup_file), "%s/%s", run_path, EPHEMERAL_CGROUP_FILE) >= (int)sizeof(cgroup_file))
+        return 0;
+
+    FILE *file = fopen(cgroup_file, "w");
+    if (file == NULL)
+        return 0;
+    fprintf(file, "%s\n", cgroup_path);
+    fclose(file);
+
+    return 0;
+}
+
+/**
+ * @brief Wait for the exit status of the command, stopping the container when the timeout expires
+ *
+ * The cgroup of the container is saved in the run as soon as it is running
+ *
+ * @return int 0 on success, -1 if the container did not run the command
+ */
+static int wait_for_command(struct lxc_container *container, const char *run_path, int status_fd, unsigned int timeout_seconds, int *exit_code)
+{
+    long long deadline = timeout_seconds > 0 ? now_ms() + (long long)timeout_seconds * 1000 : -1;
+    struct pollfd status_poll = {status_fd, POLLIN, 0};
+    int timed_out = 0, cgroup_saved = 0, status;
+    ssize_t length;
+
+    while (!timed_out)
+    {
+        int timeout_ms = deadline < 0 ? -1 : (int)(deadline - now_ms() > 0 ? deadline - now_ms() : 0);
+        if (!cgroup_saved)
+        {
+            cgroup_saved = save_payload_cgroup(container, run_path) == 0;
+            if (!cgroup_saved && (timeout_ms < 0 || timeout_ms > EPHEMERAL_CGROUP_POLL_MS))
+                timeout_ms = EPHEMERAL_CGROUP_POLL_MS;
+        }
+
+        int ready = poll(&status_poll, 1, timeout_ms);
+        if (ready < 0 && errno == EINTR)
+            continue;
+        if (ready != 0)
+            break;
+        if (deadline < 0 || now_ms() < deadline) // woken up to look for the cgroup
+            continue;
+
+        fprintf(stderr, "The command timed out after %u seconds, stopping the container\n", timeout_seconds);
+        timed_out = 1;
+        container->stop(container);
+    }
+
+    while ((length = read(status_fd, &status, sizeof(status))) < 0 && errno == EINTR)
+        ;
+    if (length != (ssize_t)sizeof(status))
+        return -1;
+
+    if (timed_out)
+        *exit_code = EPHEMERAL_TIMEOUT_EXIT_CODE;
+    else if (WIFEXITED(status))
+        *exit_code = WEXITSTATUS(status);
+    else if (WIFSIGNALED(status))
+        *exit_code = 128 + WTERMSIG(status);
+    else
+        *exit_code = status;
+
+    return 0;
+}
+
+int run_ephemeral_command(char *const command[], const struct ephemeral_options *options, int *exit_code)
+{
+    TRACE_SPAN("run_ephemeral_command");
+    struct ephemeral_options default_options;
+    struct lxc_container *base = NULL, *container = NULL;
+    char directory[EPHEMERAL_PATH_SIZE], run_path[EPHEMERAL_PATH_SIZE], lock_path[EPHEMERAL_PATH_SIZE];
+    char container_name[EPHEMERAL_NAME_SIZE], lower[EPHEMERAL_PATH_SIZE], upper[EPHEMERAL_PATH_SIZE], config_key[EPHEMERAL_PATH_SIZE];
+    char log_message[LOG_MESSAGE_SIZE] = {0};
+    const char *base_name;
+    long long started_ms = now_ms(), command_ms = 0, finished_ms = 0;
+    int lock_fd = -1, watchdog_fd = -1, status_fd = -1, output_fd = -1, result = -1;
+    pid_t watchdog = -1, runner = -1;
+    struct stat lock_stat, path_stat;
+
+    if (options == NULL)
+    {
+        ephemeral_default_options(&default_options);
+        options = &default_options;
+    }
+    base_name = options->base_container != NULL ? options->base_container : LAYER_BASE_CONTAINER;
+    *exit_code = -1;
+
+    if (command == NULL || command[0] == NULL || command[0][0] == 0)
+    {
+        fprintf(stderr, "Error: Missing the command\n");
+        return -1;
+    }
+
+    if (clean_ephemeral_containers() < 0 || get_ephemeral_directory(directory, sizeof(directory)) < 0)
+        return -1;
+
+    if (options->base_container == NULL && prepare_base_layer() < 0)
+        return -1;
+
+    base = TRACE_CALL("lxc.new", base_name, lxc_container_new(base_name, get_containers_path()));
+    if (base == NULL || !base->is_defined(base))
+    {
+        fprintf(stderr, "The base container %s does not exist\n", base_name);
+        goto out;
+    }
+
+    if (base->is_running(base)) // the lower layer must not change under the snapshot
+    {
+        fprintf(stderr, "The base container %s must be stopped\n", base_name);
+        goto out;
+    }
+
+    // The lock is held by the watchdog as long as the run may need cleaning
+    snprintf(container_name, sizeof(container_name), EPHEMERAL_NAME_PREFIX "%d-%lld", (int)getpid(), started_ms);
+    if (snprintf(run_path, sizeof(run_path), "%s/%s", directory, container_name) >= (int)sizeof(run_path) ||
+        snprintf(lock_path, sizeof(lock_path), "%s/%s.lock", directory, container_name) >= (int)sizeof(lock_path))
+    {
+        fprintf(stderr, "The path of the ephemeral run %s is too long\n", container_name);
+        goto out;
+    }
+
+    lock_fd = open(lock_path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (lock_fd < 0 || flock(lock_fd, LOCK_EX) < 0 || fstat(lock_fd, &lock_stat) < 0 || stat(lock_path, &path_stat) < 0 || lock_stat.st_ino != path_stat.st_ino)
+    {
+        fprintf(stderr, "Failed to lock the ephemeral run %s\n", container_name);
+        goto out;
+    }
+
+    if (mkdir(run_path, 0700) < 0)
+    {
+        fprintf(stderr, "Failed to create %s: %s\n", run_path, strerror(errno));
+        unlink(lock_path);
+        goto out;
+    }
+
+    // From here on the watchdog removes everything, whatever happens to this process
+    watchdog = start_watchdog(directory, container_name, &watchdog_fd);
+    if (watchdog < 0)
+    {
+        fprintf(stderr, "Failed to start the watchdog of the ephemeral run\n");
+        remove_ephemeral_run(directory, container_name);
+        goto out;
+    }
+
+    if (!options->on_disk && mount("tmpfs", run_path, "tmpfs", MS_NOSUID | MS_NODEV, EPHEMERAL_TMPFS_OPTIONS) < 0)
+        fprintf(stderr, "Failed to mount a tmpfs for the upper layer (%s), keeping it on disk\n", strerror(errno));
+
+    // Only the config and an empty upper layer are written, the rootfs is not copied
+    container = TRACE_CALL("lxc.clone", container_name, base->clone(base, container_name, run_path, LXC_CLONE_SNAPSHOT, LAYER_BACKING_STORE, NULL, 0, NULL));
+    if (container == NULL)
+    {
+        fprintf(stderr, "Failed to create the ephemeral container: %s\n", base->error_string ? base->error_string : "unknown error");
+        goto out;
+    }
+
+    for (int index = 0; index < options->number_of_limits; index++)
+    {
+        char host_subsystem[CONTAINER_KEY_SIZE], host_value[CONTAINER_VALUE_SIZE];
+
+        if (resolve_cgroup_limit(options->limits[index].subsystem, options->limits[index].value, host_subsystem, sizeof(host_subsystem), host_value, sizeof(host_value)) < 0)
+        {
+            fprintf(stderr, "%s is not a cgroup limit of this host\n", options->limits[index].subsystem);
+            goto out;
+        }
+
+        snprintf(config_key, sizeof(config_key), "%s%s", get_cgroup_config_prefix(), host_subsystem);
+        if (!container->set_config_item(container, config_key, host_value))
+        {
+            fprintf(stderr, "Failed to set the limit %s: %s\n", options->limits[index].subsystem, container->error_string ? container->error_string : "unknown error");
+            goto out;
+        }
+    }
+    if (options->number_of_limits > 0 && !container->save_config(container, NULL))
+    {
+        fprintf(stderr, "Failed to save the config of the ephemeral container\n");
+        goto out;
+    }
+
+    if (get_overlay_layers(container, lower, upper, sizeof(lower)) < 0)
+    {
+        fprintf(stderr, "Failed to find the layers of the ephemeral container\n");
+        goto out;
+    }
+
+    if (options->number_of_inputs > 0 && make_upper_directory(lower, upper, EPHEMERAL_HOME_DIRECTORY) < 0)
+    {
+        fprintf(stderr, "Failed to create %s in the ephemeral container: %s\n", EPHEMERAL_HOME_DIRECTORY, strerror(errno));
+        goto out;
+    }
+
+    for (int index = 0; index < options->number_of_inputs; index++)
+    {
+        if (TRACE_CALL("file.input", container_name, copy_input(upper, options->inputs[index])) < 0)
+        {
+            fprintf(stderr, "Failed to copy %s to the ephemeral container: %s\n", options->inputs[index], strerror(errno));
+            goto out;
+        }
+    }
+
+    if (options->output_path != NULL)
+    {
+        output_fd = open(options->output_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (output_fd < 0)
+        {
+            fprintf(stderr, "Failed to open %s: %s\n", options->output_path, strerror(errno));
+            goto out;
+        }
+    }
+
+    command_ms = now_ms();
+    runner = start_runner(run_path, container_name, command, output_fd, watchdog_fd, &status_fd);
+    if (runner < 0)
+    {
+        fprintf(stderr, "Failed to start the ephemeral container\n");
+        goto out;
+    }
+
+    if (TRACE_CALL("ephemeral.wait", container_name, wait_for_command(container, run_path, status_fd, options->timeout_seconds, exit_code)) < 0)
+    {
+        fprintf(stderr, "The ephemeral container did not run the command\n");
+        goto out;
+    }
+    finished_ms = now_ms();
+
+    result = 0;
+    for (int index = 0; index < options->number_of_collected; index++)
+    {
+        if (collect_output(lower, upper, options->collect[index]) < 0)
+        {
+            fprintf(stderr, "Failed to collect %s from the ephemeral container: %s\n", options->collect[index], strerror(errno));
+            result = -1;
+        }
+    }
+
+out:
+    if (runner > 0)
+        waitpid(runner, NULL, 0);
+    if (status_fd >= 0)
+        close(status_fd);
+    if (output_fd >= 0)
+        close(output_fd);
+    if (container != NULL)
+        lxc_container_put(container);
+    if (base != NULL)
+        lxc_container_put(base);
+
+    if (watchdog > 0) // closing the pipe tells the watchdog to remove the run
+    {
+        long long teardown_ms = now_ms();
+        close(watchdog_fd);
+        waitpid(watchdog, NULL, 0);
+        teardown_ms = now_ms() - teardown_ms;
+
+        if (result == 0)
+        {
+            fprintf(stderr, "Ephemeral container %s: setup %lld ms, command %lld ms, teardown %lld ms, exit code %d\n", container_name,
+                    command_ms - started_ms, finished_ms - command_ms, teardown_ms, *exit_code);
+        }
+    }
+    if (lock_fd >= 0)
+        close(lock_fd);
+
+    if (result == 0)
+        snprintf(log_message, LOG_MESSAGE_SIZE, "Ephemeral run on %s exited with %d", base_name, *exit_code);
+    else
+        snprintf(log_message, LOG_MESSAGE_SIZE, "Ephemeral run on %s failed", base_name);
+    log_activity(result == 0 ? "INFO" : "ERROR", "run", NULL, log_message);
+
+    return result;
+}
@@ -0,0 +1,95 @@
+#ifndef EPHEMERAL_H
+#define EPHEMERAL_H
+
+/**
+ * @file ephemeral.h
+ * @brief This file contains the definitions of the functions used in ephemeral.cpp regarding one-shot commands in throwaway LXC containers
+ *
+ * An ephemeral run does not download, boot or destroy a full container: it takes an overlay snapshot of a stopped base container
+ * (only a config and an empty upper layer are written, on a tmpfs by default), copies the inputs straight into the upper layer,
+ * runs the command as the init of the container (like lxc-execute, without booting the distribution) with its output captured,
+ * and destroys the snapshot. A watchdog process tears the container down if the program dies, and runs left over by a crash of
+ * both are removed by the next run
+ *
+ * @author Simão Andrade
+ * @date 2024-06-13
+ */
+
+/**
+ * @brief Directory of the lxcpath, holding one private lxcpath (and lock file) per ephemeral run
+ */
+#define EPHEMERAL_DIRECTORY "cmt-ephemeral"
+
+/**
+ * @brief Prefix of the names of the ephemeral containers
+ */
+#define EPHEMERAL_NAME_PREFIX "cmt-run-"
+
+/**
+ * @brief Maximum number of inputs, collected files and limits of a run
+ */
+#define EPHEMERAL_MAX_FILES 16
+#define EPHEMERAL_MAX_LIMITS 8
+
+/**
+ * @brief Default timeout of the command, in seconds
+ */
+#define EPHEMERAL_DEFAULT_TIMEOUT 3600
+
+/**
+ * @brief Exit status of a command stopped by the timeout (as timeout(1))
+ */
+#define EPHEMERAL_TIMEOUT_EXIT_CODE 124
+
+/**
+ * @brief A cgroup limit of an ephemeral container
+ */
+struct ephemeral_limit
+{
+    const char *subsystem; // e.g. memory.max
+    const char *value;
+};
+
+/**
+ * @brief Options of an ephemeral run
+ */
+struct ephemeral_options
+{
+    const char *base_container;               // stopped container to snapshot, NULL for the shared base layer
+    const char *inputs[EPHEMERAL_MAX_FILES];  // host files copied to /home/ubuntu before the command runs
+    int number_of_inputs;
+    const char *collect[EPHEMERAL_MAX_FILES]; // container files copied to the current directory after the command
+    int number_of_collected;
+    struct ephemeral_limit limits[EPHEMERAL_MAX_LIMITS];
+    int number_of_limits;
+    unsigned int timeout_seconds;             // the container is stopped after this time, 0 for no timeout
+    int on_disk;                              // 1 to keep the upper layer on disk instead of a tmpfs
+    const char *output_path;                  // file receiving the output of the command, NULL for the standard output
+};
+
+/**
+ * @brief Fill the options of an ephemeral run with the defaults
+ *
+ * @param options options to fill
+ */
+void ephemeral_default_options(struct ephemeral_options *options);
+
+/**
+ * @brief Run a command in a throwaway snapshot of a base container and destroy it
+ *
+ * @param command program and its arguments, ending with NULL, run as they are without a shell (e.g. {"sh", "-c", "echo a b", NULL})
+ * @param options options of the run, NULL for the defaults
+ * @param exit_code exit status of the command, 128 + signal if it was killed, EPHEMERAL_TIMEOUT_EXIT_CODE if it timed out
+ *
+ * @return int 0 if the command ran (whatever its exit status), -1 on failure
+ */
+int run_ephemeral_command(char *const command[], const struct ephemeral_options *options, int *exit_code);
+
+/**
+ * @brief Remove the ephemeral containers left over by runs whose program and watchdog both died
+ *
+ * @return int number of removed containers, -1 on failure
+ */
+int clean_ephemeral_containers(void);
+
+#endif // EPHEMERAL_H
@@ -0,0 +1,1437 @@
+/**
+ * @file events.cpp
+ * @brief Memory-pressure and OOM notifications for LXC containers
+ *
+ * This file contains the implementation of the event monitor. Nothing is polled periodically: every source is a file descriptor
+ * in one epoll set and the kernel wakes the monitor only when something happens:
+ * - PSI triggers ("some <stall> <window>" written to memory.pressure, cpu.pressure and io.pressure) signal EPOLLPRI;
+ * - memory.events and cgroup.events are kernfs files that signal EPOLLPRI when their counters change;
+ * - on a cgroup v1 memory controller, an eventfd registered in cgroup.event_control for memory.oom_control is signalled on OOM;
+ * - new containers are found with inotify on the directory holding the lxc.payload.<name> cgroups.
+ *
+ * @author Simão Andrade
+ * @date 2024-06-13
+ */
+
+#include "events.h"
+#include "lib.h"
+#include "inspect.h"
+#include "trace.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include <lxc/lxccontainer.h>
+#include <atomic>
+#include <vector>
+
+/**
+ * @brief Mount points of the cgroup v2 hierarchy (unified or hybrid layout) and of the cgroup v1 memory controller
+ */
+#define CGROUP2_ROOT "/sys/fs/cgroup"
+#define CGROUP2_HYBRID_ROOT "/sys/fs/cgroup/unified"
+#define CGROUP1_MEMORY_ROOT "/sys/fs/cgroup/memory"
+
+/**
+ * @brief Prefix of the cgroups LXC creates for the containers, followed by the name of the container
+ */
+#define LXC_PAYLOAD_PREFIX "lxc.payload."
+
+/**
+ * @brief Maximum number of epoll events handled at once
+ */
+#define EVENT_BATCH_SIZE 64
+
+/**
+ * @brief Size of the buffer used to read a cgroup file
+ */
+#define CGROUP_FILE_BUFFER_SIZE 4096
+
+/**
+ * @brief Limits of the PSI trigger window imposed by the kernel, in microseconds
+ */
+#define PSI_WINDOW_MIN_US 500000ULL
+#define PSI_WINDOW_MAX_US 10000000ULL
+
+/**
+ * @brief Delay before reading again the kill counter of a cgroup v1 OOM, the victim is chosen after the notification
+ */
+#define OOM_KILL_RECHECK_NS 100000000
+
+/**
+ * @brief A v1 memory limit at or above this value means unlimited
+ */
+#define CGROUP1_UNLIMITED (1ULL << 62)
+
+/**
+ * @brief Sources of events
+ */
+enum watch_kind
+{
+    WATCH_WAKE,            // eventfd written by event_monitor_stop()
+    WATCH_NEW_CONTAINERS,  // inotify on the directory of the container cgroups
+    WATCH_CGROUP_EVENTS,   // cgroup.events, tells when the container starts and stops
+    WATCH_MEMORY_EVENTS,   // memory.events (cgroup v2)
+    WATCH_OOM_CONTROL,     // eventfd signalled on OOM (cgroup v1)
+    WATCH_OOM_RECHECK,     // one-shot timer reading the kill counter after an OOM (cgroup v1)
+    WATCH_MEMORY_PRESSURE, // PSI triggers
+    WATCH_CPU_PRESSURE,
+    WATCH_IO_PRESSURE
+};
+
+struct watched_container;
+
+/**
+ * @brief A file descriptor in the epoll set
+ */
+struct event_watch
+{
+    enum watch_kind kind;
+    int fd;
+    int control_fd; // memory.oom_control, kept open while its eventfd is registered
+    struct watched_container *container;
+};
+
+/**
+ * @brief Order of the counters of memory.events reported as events
+ */
+static const char *const memory_events_keys[] = {"high", "max", "oom", "oom_kill"};
+static const enum container_event_type memory_events_types[] = {CONTAINER_EVENT_MEMORY_HIGH, CONTAINER_EVENT_MEMORY_MAX, CONTAINER_EVENT_OOM, CONTAINER_EVENT_OOM_KILL};
+#define MEMORY_EVENTS_COUNTERS 4
+
+/**
+ * @brief A watched container
+ */
+struct watched_container
+{
+    char name[EVENT_CONTAINER_NAME_SIZE];
+    char cgroup_path[PATH_MAX];  // cgroup v2 directory, empty without cgroup v2
+    char memory_path[PATH_MAX];  // cgroup v1 memory directory, empty when memory is on cgroup v2
+    std::vector<struct event_watch *> watches;
+    bool armed;                  // memory and pressure sources registered
+    bool removed;
+    unsigned long long memory_events[MEMORY_EVENTS_COUNTERS];
+    unsigned long long oom_total; // cgroup v1 counters
+    unsigned long long oom_kill_total;
+    struct event_watch *oom_recheck;
+    std::vector<long long> last_action; // time each action last ran on this container
+};
+
+/**
+ * @brief A set of watched containers
+ */
+struct event_monitor
+{
+    struct event_monitor_options options;
+    int epoll_fd;
+    int wake_fd;
+    int inotify_fd;
+    char payload_directory[PATH_MAX]; // directory watched for new containers
+    struct event_watch wake_watch;
+    struct event_watch inotify_watch;
+    FILE *json;
+    bool warned_psi;
+    std::atomic<bool> stopping;
+    std::vector<std::pair<container_event_callback, void *>> callbacks;
+    std::vector<struct event_action> actions;
+    std::vector<struct watched_container *> containers;
+    std::vector<struct watched_container *> retired; // removed while their events were being handled
+};
+
+/**
+ * @brief Names of the types of events, in the order of enum container_event_type
+ */
+static const char *const event_type_names[CONTAINER_EVENT_TYPES] = {
+    "memory_pressure", "cpu_pressure", "io_pressure", "high", "max", "oom", "oom_kill", "started", "stopped"};
+
+/**
+ * @brief Current time in microseconds since the epoch
+ */
+static long long realtime_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (long long)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/**
+ * @brief Get the mount point of the cgroup v2 hierarchy
+ *
+ * @return const char* mount point, NULL if there is no cgroup v2 hierarchy
+ */
+static const char *get_cgroup2_root(void)
+{
+    if (access(CGROUP2_ROOT "/cgroup.controllers", F_OK) == 0)
+        return CGROUP2_ROOT;
+    if (access(CGROUP2_HYBRID_ROOT "/cgroup.controllers", F_OK) == 0)
+        return CGROUP2_HYBRID_ROOT;
+    return NULL;
+}
+
+/**
+ * @brief Read a whole cgroup file from the beginning, which also acknowledges its pending notification
+ *
+ * @return ssize_t number of bytes read, -1 on failure
+ */
+static ssize_t read_cgroup_file(int fd, char *buffer, size_t buffer_size)
+{
+    ssize_t length = pread(fd, buffer, buffer_size - 1, 0);
+    if (length < 0)
+        return -1;
+
+    buffer[length] = '\0';
+    return length;
+}
+
+/**
+ * @brief Read a cgroup file by path
+ *
+ * @return ssize_t number of bytes read, -1 on failure
+ */
+static ssize_t read_cgroup_path(const char *directory, const char *file_name, char *buffer, size_t buffer_size)
+{
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", directory, file_name);
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+
+    ssize_t length = read_cgroup_file(fd, buffer, buffer_size);
+    close(fd);
+    return length;
+}
+
+/**
+ * @brief Find "key value" in a flat keyed cgroup file
+ *
+ * @return int 0 if the key was found, -1 otherwise
+ */
+static int get_keyed_value(const char *content, const char *key, unsigned long long *value)
+{
+    size_t key_length = strlen(key);
+
+    for (const char *line = content; line != NULL && *line; line = strchr(line, '\n') ? strchr(line, '\n') + 1 : NULL)
+    {
+        if (strncmp(line, key, key_length) == 0 && line[key_length] == ' ')
+        {
+            *value = strtoull(line + key_length + 1, NULL, 10);
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * @brief Deliver an event to the callbacks, the log, the JSON stream and the actions
+ */
+static void deliver_event(struct event_monitor *monitor, struct watched_container *container, enum container_event_type type, unsigned long long count, unsigned long long total, const char *detail);
+
+/**
+ * @brief Add a file descriptor to the epoll set
+ *
+ * @return struct event_watch* the watch, NULL on failure (the file descriptors are closed)
+ */
+static struct event_watch *add_watch(struct event_monitor *monitor, struct watched_container *container, enum watch_kind kind, int fd, int control_fd, unsigned int epoll_events)
+{
+    struct event_watch *watch = new struct event_watch;
+    struct epoll_event event;
+
+    watch->kind = kind;
+    watch->fd = fd;
+    watch->control_fd = control_fd;
+    watch->container = container;
+
+    memset(&event, 0, sizeof(event));
+    event.events = epoll_events;
+    event.data.ptr = watch;
+
+    if (epoll_ctl(monitor->epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0)
+    {
+        close(fd);
+        if (control_fd >= 0)
+            close(control_fd);
+        delete watch;
+        return NULL;
+    }
+
+    container->watches.push_back(watch);
+    return watch;
+}
+
+/**
+ * @brief Remove a watch from the epoll set and close it
+ */
+static void close_watch(struct event_monitor *monitor, struct event_watch *watch)
+{
+    epoll_ctl(monitor->epoll_fd, EPOLL_CTL_DEL, watch->fd, NULL);
+    close(watch->fd);
+    if (watch->control_fd >= 0)
+        close(watch->control_fd);
+    watch->fd = -1;
+    watch->control_fd = -1;
+}
+
+/**
+ * @brief Register a PSI trigger on a pressure file of the container
+ *
+ * @return int 0 on success (or when the trigger is disabled), -1 on failure
+ */
+static int add_pressure_trigger(struct event_monitor *monitor, struct watched_container *container, enum watch_kind kind, const char *file_name, unsigned long long stall_us)
+{
+    char path[PATH_MAX], trigger[64];
+
+    if (stall_us == 0 || container->cgroup_path[0] == '\0')
+        return 0;
+
+    if (snprintf(path, sizeof(path), "%s/%s", container->cgroup_path, file_name) >= (int)sizeof(path))
+        return -1;
+
+    int fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+        goto unsupported;
+
+    // The terminating null byte is part of the trigger
+    snprintf(trigger, sizeof(trigger), "some %llu %llu", stall_us, monitor->options.window_us);
+    if (write(fd, trigger, strlen(trigger) + 1) < 0)
+    {
+        close(fd);
+        goto unsupported;
+    }
+
+    return add_watch(monitor, container, kind, fd, -1, EPOLLPRI) != NULL ? 0 : -1;
+
+unsupported:
+    if (!monitor->warned_psi)
+    {
+        fprintf(stderr, "PSI triggers are not available for %s (%s), pressure events are disabled\n", path, strerror(errno));
+        monitor->warned_psi = true;
+    }
+    return -1;
+}
+
+/**
+ * @brief Register the OOM notification of a cgroup v1 memory controller
+ *
+ * @return int 0 on success, -1 on failure
+ */
+static int add_oom_notification(struct event_monitor *monitor, struct watched_container *container)
+{
+    char path[PATH_MAX], registration[64], content[CGROUP_FILE_BUFFER_SIZE];
+    int event_fd = -1, control_fd = -1, registration_fd = -1, result = -1;
+
+    if (snprintf(path, sizeof(path), "%s/memory.oom_control", container->memory_path) >= (int)sizeof(path))
+        goto out;
+
+    control_fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (control_fd < 0)
+        goto out;
+
+    if (read_cgroup_file(control_fd, content, sizeof(content)) >= 0)
+        get_keyed_value(content, "oom_kill", &container->oom_kill_total);
+
+    event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (snprintf(path, sizeof(path), "%s/cgroup.event_control", container->memory_path) >= (int)sizeof(path))
+        goto out;
+
+    registration_fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (event_fd < 0 || registration_fd < 0)
+        goto out;
+
+    snprintf(registration, sizeof(registration), "%d %d", event_fd, control_fd);
+    if (write(registration_fd, registration, strlen(registration)) < 0)
+        goto out;
+
+    result = add_watch(monitor, container, WATCH_OOM_CONTROL, event_fd, control_fd, EPOLLIN) != NULL ? 0 : -1;
+    event_fd = control_fd = -1; // owned by the watch now
+
+out:
+    if (registration_fd >= 0)
+        close(registration_fd);
+    if (event_fd >= 0)
+        close(event_fd);
+    if (control_fd >= 0)
+        close(control_fd);
+    return result;
+}
+
+/**
+ * @brief Find the cgroup v1 memory directory of a container from one of its processes
+ */
+static void resolve_memory_path(struct watched_container *container, int pid)
+{
+    char path[PATH_MAX], line[PATH_MAX];
+
+    container->memory_path[0] = '\0';
+    snprintf(path, sizeof(path), "/proc/%d/cgroup", pid);
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+        return;
+
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        // hierarchy-ID:controller-list:cgroup-path
+        char *controllers = strchr(line, ':');
+        char *cgroup = controllers != NULL ? strchr(controllers + 1, ':') : NULL;
+        if (cgroup == NULL)
+            continue;
+
+        *cgroup++ = '\0';
+        cgroup[strcspn(cgroup, "\n")] = '\0';
+
+        for (char *controller = strtok(controllers + 1, ","); controller != NULL; controller = strtok(NULL, ","))
+        {
+            if (strcmp(controller, "memory") == 0)
+                snprintf(container->memory_path, sizeof(container->memory_path), "%s%s", CGROUP1_MEMORY_ROOT, cgroup);
+        }
+    }
+
+    fclose(file);
+}
+
+int get_process_cgroup_path(int pid, char *cgroup_path, size_t cgroup_path_size)
+{
+    char path[PATH_MAX], line[PATH_MAX];
+    const char *root = get_cgroup2_root();
+    int result = -1;
+
+    cgroup_path[0] = '\0';
+    snprintf(path, sizeof(path), "/proc/%d/cgroup", pid);
+    FILE *file = fopen(path, "r");
+    if (root == NULL || file == NULL)
+        goto out;
+
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        if (strncmp(line, "0::", 3) != 0)
+            continue;
+
+        line[strcspn(line, "\n")] = '\0';
+
+        // A systemd running in the container moves itself out of the container cgroup
+        size_t length = strlen(line);
+        if (length > strlen("/init.scope") && strcmp(line + length - strlen("/init.scope"), "/init.scope") == 0)
+            line[length - strlen("/init.scope")] = '\0';
+
+        if (snprintf(cgroup_path, cgroup_path_size, "%s%s", root, line + 3) < (int)cgroup_path_size)
+            result = 0;
+        else
+            cgroup_path[0] = '\0';
+    }
+
+out:
+    if (file != NULL)
+        fclose(file);
+    return result;
+}
+
+/**
+ * @brief Register the memory and pressure sources of a container that has processes
+ */
+static void arm_container(struct event_monitor *monitor, struct watched_container *container, int pid)
+{
+    char path[PATH_MAX], content[CGROUP_FILE_BUFFER_SIZE];
+
+    if (container->armed)
+        return;
+
+    // A container found by inotify has no known process yet, take one from its cgroup
+    if (pid <= 0 && read_cgroup_path(container->cgroup_path, "cgroup.procs", content, sizeof(content)) > 0)
+        pid = atoi(content);
+
+    bool has_path = container->cgroup_path[0] && snprintf(path, sizeof(path), "%s/memory.events", container->cgroup_path) < (int)sizeof(path);
+    int fd = has_path ? open(path, O_RDONLY | O_CLOEXEC) : -1;
+    if (fd >= 0)
+    {
+        container->memory_path[0] = '\0';
+        if (read_cgroup_file(fd, content, sizeof(content)) >= 0)
+        {
+            for (int index = 0; index < MEMORY_EVENTS_COUNTERS; index++)
+                get_keyed_value(content, memory_events_keys[index], &container->memory_events[index]);
+        }
+        add_watch(monitor, container, WATCH_MEMORY_EVENTS, fd, -1, EPOLLPRI);
+    }
+    else
+    {
+        if (pid > 0)
+            resolve_memory_path(container, pid);
+        if (container->memory_path[0] == '\0' || add_oom_notification(monitor, container) < 0)
+            fprintf(stderr, "No OOM notifications for container %s\n", container->name);
+    }
+
+    add_pressure_trigger(monitor, container, WATCH_MEMORY_PRESSURE, "memory.pressure", monitor->options.memory_stall_us);
+    add_pressure_trigger(monitor, container, WATCH_CPU_PRESSURE, "cpu.pressure", monitor->options.cpu_stall_us);
+    add_pressure_trigger(monitor, container, WATCH_IO_PRESSURE, "io.pressure", monitor->options.io_stall_us);
+
+    container->armed = true;
+}
+
+/**
+ * @brief Find a watched container by name
+ */
+static struct watched_container *find_container(struct event_monitor *monitor, const char *name)
+{
+    for (struct watched_container *container : monitor->containers)
+    {
+        if (strcmp(container->name, name) == 0)
+            return container;
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Start watching a cgroup
+ *
+ * @param pid a process of the container, 0 when the container has not started yet
+ *
+ * @return int 0 on success, -1 on failure
+ */
+static int add_cgroup(struct event_monitor *monitor, const char *name, const char *cgroup_path, int pid)
+{
+    char path[PATH_MAX], content[CGROUP_FILE_BUFFER_SIZE];
+    unsigned long long populated = pid > 0;
+
+    if (find_container(monitor, name) != NULL)
+        return 0;
+
+    struct watched_container *container = new struct watched_container();
+    snprintf(container->name, sizeof(container->name), "%s", name);
+    snprintf(container->cgroup_path, sizeof(container->cgroup_path), "%s", cgroup_path);
+
+    if (cgroup_path[0] != '\0')
+    {
+        snprintf(path, sizeof(path), "%s/cgroup.events", cgroup_path);
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd >= 0 && read_cgroup_file(fd, content, sizeof(content)) < 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+
+        // add_watch() closes the fd when it fails
+        if (fd < 0 || add_watch(monitor, container, WATCH_CGROUP_EVENTS, fd, -1, EPOLLPRI) == NULL)
+        {
+            fprintf(stderr, "Failed to watch the cgroup %s: %s\n", cgroup_path, strerror(errno));
+            delete container;
+            return -1;
+        }
+        get_keyed_value(content, "populated", &populated);
+    }
+
+    monitor->containers.push_back(container);
+
+    if (populated)
+        arm_container(monitor, container, pid);
+
+    return 0;
+}
+
+/**
+ * @brief Stop watching a container, its memory is released once the current batch of events is handled
+ */
+static void retire_container(struct event_monitor *monitor, struct watched_container *container)
+{
+    for (struct event_watch *watch : container->watches)
+    {
+        if (watch->fd >= 0)
+            close_watch(monitor, watch);
+    }
+
+    for (size_t index = 0; index < monitor->containers.size(); index++)
+    {
+        if (monitor->containers[index] == container)
+        {
+            monitor->containers.erase(monitor->containers.begin() + index);
+            break;
+        }
+    }
+
+    container->removed = true;
+    monitor->retired.push_back(container);
+}
+
+/**
+ * @brief Release the containers retired during a batch of events
+ */
+static void free_retired_containers(struct event_monitor *monitor)
+{
+    for (struct watched_container *container : monitor->retired)
+    {
+        for (struct event_watch *watch : container->watches)
+            delete watch;
+        delete container;
+    }
+
+    monitor->retired.clear();
+}
+
+void event_monitor_default_options(struct event_monitor_options *options)
+{
+    memset(options, 0, sizeof(*options));
+    options->memory_stall_us = EVENT_DEFAULT_MEMORY_STALL_US;
+    options->cpu_stall_us = EVENT_DEFAULT_CPU_STALL_US;
+    options->io_stall_us = EVENT_DEFAULT_IO_STALL_US;
+    options->window_us = EVENT_DEFAULT_WINDOW_US;
+}
+
+struct event_monitor *event_monitor_new(const struct event_monitor_options *options)
+{
+    struct event_monitor *monitor = new struct event_monitor();
+    struct epoll_event event;
+
+    if (options != NULL)
+        monitor->options = *options;
+    else
+        event_monitor_default_options(&monitor->options);
+
+    monitor->options.json_path = NULL;
+    monitor->epoll_fd = -1;
+    monitor->wake_fd = -1;
+    monitor->inotify_fd = -1;
+    monitor->stopping = false;
+
+    if (monitor->options.window_us < PSI_WINDOW_MIN_US || monitor->options.window_us > PSI_WINDOW_MAX_US)
+    {
+        fprintf(stderr, "The pressure window must be between %llu and %llu microseconds\n", PSI_WINDOW_MIN_US, PSI_WINDOW_MAX_US);
+        goto error;
+    }
+
+    if (options != NULL && options->json_path != NULL)
+    {
+        monitor->json = strcmp(options->json_path, "-") == 0 ? stdout : fopen(options->json_path, "a");
+        if (monitor->json == NULL)
+        {
+            fprintf(stderr, "Failed to open %s: %s\n", options->json_path, strerror(errno));
+            goto error;
+        }
+    }
+
+    monitor->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    monitor->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (monitor->epoll_fd < 0 || monitor->wake_fd < 0)
+        goto error;
+
+    monitor->wake_watch.kind = WATCH_WAKE;
+    monitor->wake_watch.fd = monitor->wake_fd;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.ptr = &monitor->wake_watch;
+    if (epoll_ctl(monitor->epoll_fd, EPOLL_CTL_ADD, monitor->wake_fd, &event) < 0)
+        goto error;
+
+    return monitor;
+
+error:
+    if (monitor->json != NULL && monitor->json != stdout)
+        fclose(monitor->json);
+    if (monitor->epoll_fd >= 0)
+        close(monitor->epoll_fd);
+    if (monitor->wake_fd >= 0)
+        close(monitor->wake_fd);
+    delete monitor;
+    return NULL;
+}
+
+void event_monitor_free(struct event_monitor *monitor)
+{
+    if (monitor == NULL)
+        return;
+
+    while (!monitor->containers.empty())
+        retire_container(monitor, monitor->containers.back());
+    free_retired_containers(monitor);
+
+    if (monitor->inotify_fd >= 0)
+        close(monitor->inotify_fd);
+    if (monitor->json != NULL && monitor->json != stdout)
+        fclose(monitor->json);
+    close(monitor->wake_fd);
+    close(monitor->epoll_fd);
+    delete monitor;
+}
+
+int event_monitor_add_callback(struct event_monitor *monitor, container_event_callback callback, void *user_data)
+{
+    if (callback == NULL)
+        return -1;
+
+    monitor->callbacks.push_back(std::make_pair(callback, user_data));
+    return 0;
+}
+
+int event_monitor_add_action(struct event_monitor *monitor, const struct event_action *action)
+{
+    if (action->events == 0 || (action->type == EVENT_ACTION_COMMAND && action->command[0] == '\0'))
+        return -1;
+
+    monitor->actions.push_back(*action);
+    return 0;
+}
+
+int event_monitor_add_process(struct event_monitor *monitor, const char *name, int pid)
+{
+    char cgroup_path[PATH_MAX];
+
+    if (get_process_cgroup_path(pid, cgroup_path, sizeof(cgroup_path)) < 0 && access(CGROUP1_MEMORY_ROOT, F_OK) < 0)
+    {
+        fprintf(stderr, "Failed to find the cgroups of process %d\n", pid);
+        return -1;
+    }
+
+    return add_cgroup(monitor, name, cgroup_path, pid);
+}
+
+int event_monitor_add_container(struct event_monitor *monitor, const char *container_name)
+{
+    TRACE_SPAN_ARGUMENT("event_monitor_add_container", container_name);
+    struct lxc_container *container;
+    int result = -1;
+
+    container = lxc_container_new(container_name, get_containers_path());
+    if (container == NULL)
+    {
+        fprintf(stderr, "Failed to setup LXC container %s\n", container_name);
+        return -1;
+    }
+
+    if (!container->is_running(container))
+    {
+        fprintf(stderr, "Container %s is not running\n", container_name);
+        goto out;
+    }
+
+    result = event_monitor_add_process(monitor, container_name, container->init_pid(container));
+
+out:
+    lxc_container_put(container);
+    return result;
+}
+
+int event_monitor_remove_container(struct event_monitor *monitor, const char *container_name)
+{
+    struct watched_container *container = find_container(monitor, container_name);
+    if (container == NULL)
+        return -1;
+
+    retire_container(monitor, container);
+    return 0;
+}
+
+void event_monitor_stop(struct event_monitor *monitor)
+{
+    uint64_t value = 1;
+
+    monitor->stopping = true;
+    if (write(monitor->wake_fd, &value, sizeof(value)) < 0)
+        return;
+}
+
+const char *container_event_type_name(enum container_event_type type)
+{
+    return type >= 0 && type < CONTAINER_EVENT_TYPES ? event_type_names[type] : "unknown";
+}
+
+/**
+ * @brief Parse a size such as "512M" or "4G" into bytes
+ */
+static unsigned long long parse_size(const char *text)
+{
+    char *end;
+    unsigned long long value = strtoull(text, &end, 10);
+
+    switch (*end)
+    {
+    case 'k':
+    case 'K':
+        return value << 10;
+    case 'm':
+    case 'M':
+        return value << 20;
+    case 'g':
+    case 'G':
+        return value << 30;
+    default:
+        return value;
+    }
+}
+
+int parse_event_action(const char *text, struct event_action *action)
+{
+    char events[EVENT_DETAIL_SIZE];
+    const char *separator = strchr(text, '=');
+
+    memset(action, 0, sizeof(*action));
+    if (separator == NULL || (size_t)(separator - text) >= sizeof(events))
+        return -1;
+
+    snprintf(events, sizeof(events), "%.*s", (int)(separator - text), text);
+    for (char *name = strtok(events, ","); name != NULL; name = strtok(NULL, ","))
+    {
+        int type = 0;
+        while (type < CONTAINER_EVENT_TYPES && strcmp(name, event_type_names[type]) != 0)
+            type++;
+
+        if (strcmp(name, "all") == 0)
+            action->events |= CONTAINER_EVENT_ALL;
+        else if (type < CONTAINER_EVENT_TYPES)
+            action->events |= 1U << type;
+        else
+            return -1;
+    }
+
+    const char *definition = separator + 1;
+    if (strncmp(definition, "raise:", 6) == 0)
+    {
+        const char *ceiling = strchr(definition + 6, ':');
+
+        action->type = EVENT_ACTION_RAISE_MEMORY;
+        action->raise_percent = (unsigned int)atoi(definition + 6);
+        action->raise_ceiling = ceiling != NULL ? parse_size(ceiling + 1) : 0;
+        if (action->raise_percent == 0)
+            return -1;
+    }
+    else if (strcmp(definition, "dump") == 0)
+    {
+        action->type = EVENT_ACTION_DUMP;
+    }
+    else if (strncmp(definition, "exec:", 5) == 0 && definition[5] != '\0')
+    {
+        action->type = EVENT_ACTION_COMMAND;
+        snprintf(action->command, sizeof(action->command), "%s", definition + 5);
+    }
+    else
+    {
+        return -1;
+    }
+
+    return action->events != 0 ? 0 : -1;
+}
+
+/**
+ * @brief Raise the memory limit of a container, the new limit is also saved in its configuration
+ *
+ * @return int 0 on success, -1 on failure
+ */
+static int raise_memory_limit(const struct watched_container *container, const struct event_action *action)
+{
+    char content[CGROUP_FILE_BUFFER_SIZE], value[32];
+    const char *directory = container->memory_path[0] ? container->memory_path : container->cgroup_path;
+    const char *subsystem = container->memory_path[0] ? "memory.limit_in_bytes" : "memory.max";
+
+    if (read_cgroup_path(directory, subsystem, content, sizeof(content)) < 0)
+        return -1;
+
+    // "max" (cgroup v2) or a huge value (cgroup v1) means there is no limit to raise
+    unsigned long long limit = strtoull(content, NULL, 10);
+    if (limit == 0 || limit >= CGROUP1_UNLIMITED)
+        return -1;
+
+    unsigned long long raised = limit + limit / 100 * action->raise_percent;
+    if (action->raise_ceiling != 0 && raised > action->raise_ceiling)
+        raised = action->raise_ceiling;
+    if (raised <= limit)
+    {
+        fprintf(stderr, "The memory limit of container %s is already at its ceiling\n", container->name);
+        return -1;
+    }
+
+    snprintf(value, sizeof(value), "%llu", raised);
+    return define_limits_of_system_resources(container->name, subsystem, value);
+}
+
+/**
+ * @brief Copy a cgroup file into a diagnostics file
+ */
+static void dump_cgroup_file(FILE *file, const char *directory, const char *file_name)
+{
+    char content[CGROUP_FILE_BUFFER_SIZE];
+
+    if (directory[0] == '\0' || read_cgroup_path(directory, file_name, content, sizeof(content)) < 0)
+        return;
+
+    fprintf(file, "--- %s ---\n%s\n", file_name, content);
+}
+
+/**
+ * @brief Save the memory, pressure and process statistics of a container in <lxcpath>/<name>/diagnostics-<time>.txt
+ *
+ * @return int 0 on success, -1 on failure
+ */
+static int dump_diagnostics(const struct watched_container *container, const struct container_event *event)
+{
+    char path[PATH_MAX], stamp[32], content[CGROUP_FILE_BUFFER_SIZE], line[256];
+    time_t seconds = (time_t)(event->timestamp / 1000000);
+    struct tm local;
+
+    localtime_r(&seconds, &local);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &local);
+    snprintf(path, sizeof(path), "%s/%s/diagnostics-%s.txt", get_containers_path(), container->name, stamp);
+
+    FILE *file = fopen(path, "a");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Failed to write the diagnostics %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    fprintf(file, "=== %s: %s (%llu) %s ===\n", container->name, container_event_type_name(event->type), event->count, event->detail);
+
+    const char *memory = container->memory_path[0] ? container->memory_path : container->cgroup_path;
+    dump_cgroup_file(file, memory, container->memory_path[0] ? "memory.usage_in_bytes" : "memory.current");
+    dump_cgroup_file(file, memory, container->memory_path[0] ? "memory.limit_in_bytes" : "memory.max");
+    dump_cgroup_file(file, memory, container->memory_path[0] ? "memory.oom_control" : "memory.events");
+    dump_cgroup_file(file, memory, "memory.stat");
+    dump_cgroup_file(file, container->cgroup_path, "memory.pressure");
+    dump_cgroup_file(file, container->cgroup_path, "cpu.pressure");
+    dump_cgroup_file(file, container->cgroup_path, "io.pressure");
+
+    // Resident memory of every process, to find the culprit
+    const char *procs = container->cgroup_path[0] ? container->cgroup_path : container->memory_path;
+    if (read_cgroup_path(procs, "cgroup.procs", content, sizeof(content)) >= 0)
+    {
+        fprintf(file, "--- processes ---\n");
+        for (char *pid = strtok(content, "\n"); pid != NULL; pid = strtok(NULL, "\n"))
+        {
+            char name[64] = "?", rss[64] = "?";
+
+            snprintf(path, sizeof(path), "/proc/%s/status", pid);
+            FILE *status = fopen(path, "r");
+            while (status != NULL && fgets(line, sizeof(line), status) != NULL)
+            {
+                if (strncmp(line, "Name:", 5) == 0)
+                    sscanf(line + 5, " %63[^\n]", name);
+                else if (strncmp(line, "VmRSS:", 6) == 0)
+                    sscanf(line + 6, " %63[^\n]", rss);
+            }
+            if (status != NULL)
+                fclose(status);
+
+            fprintf(file, "%s %s %s\n", pid, name, rss);
+        }
+    }
+
+    fprintf(file, "\n");
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+/**
+ * @brief Run a shell command for an event without waiting for it
+ *
+ * @return int 0 on success, -1 on failure
+ */
+static int run_event_command(const struct event_action *action, const struct container_event *event)
+{
+    pid_t child = fork();
+
+    if (child == 0)
+    {
+        // Double fork so the monitor never has to reap the command
+        if (fork() == 0)
+        {
+            setenv("CMT_EVENT_CONTAINER", event->container_name, 1);
+            setenv("CMT_EVENT_TYPE", container_event_type_name(event->type), 1);
+            setenv("CMT_EVENT_DETAIL", event->detail, 1);
+            execl("/bin/sh", "sh", "-c", action->command, (char *)NULL);
+        }
+        _exit(0);
+    }
+
+    if (child < 0 || waitpid(child, NULL, 0) < 0)
+        return -1;
+
+    return 0;
+}
+
+/**
+ * @brief Run the actions matching an event
+ */
+static void run_actions(struct event_monitor *monitor, struct watched_container *container, const struct container_event *event)
+{
+    char log_message[LOG_MESSAGE_SIZE] = {0};
+    static const char *const action_names[] = {"raise", "dump", "exec"};
+
+    container->last_action.resize(monitor->actions.size(), 0);
+
+    for (size_t index = 0; index < monitor->actions.size(); index++)
+    {
+        const struct event_action *action = &monitor->actions[index];
+        int result = 0;
+
+        if (!(action->events & (1U << event->type)) || event->timestamp - container->last_action[index] < EVENT_ACTION_COOLDOWN_US)
+            continue;
+
+        container->last_action[index] = event->timestamp;
+
+        switch (action->type)
+        {
+        case EVENT_ACTION_RAISE_MEMORY:
+            result = raise_memory_limit(container, action);
+            break;
+        case EVENT_ACTION_DUMP:
+            result = dump_diagnostics(container, event);
+            break;
+        case EVENT_ACTION_COMMAND:
+            result = run_event_command(action, event);
+            break;
+        }
+
+        snprintf(log_message, LOG_MESSAGE_SIZE, "Action %s on %s of container %.32s %s", action_names[action->type], container_event_type_name(event->type), container->name, result == 0 ? "done" : "failed");
+        log_activity(result == 0 ? "INFO" : "ERROR", "events", container->name, log_message);
+    }
+}
+
+/**
+ * @brief Write a JSON string, escaping the quotes, the backslashes and the control characters
+ */
+static void write_json_string(FILE *json, const char *text)
+{
+    fputc('"', json);
+    for (const unsigned char *character = (const unsigned char *)text; *character; character++)
+    {
+        if (*character == '"' || *character == '\\')
+            fprintf(json, "\\%c", *character);
+        else if (*character < 0x20)
+            fprintf(json, "\\u%04x", *character);
+        else
+            fputc(*character, json);
+    }
+    fputc('"', json);
+}
+
+/**
+ * @brief Append an event to the JSON stream
+ */
+static void write_json_event(FILE *json, const struct container_event *event)
+{
+    fprintf(json, "{\"timestamp\":%lld,\"container\":", event->timestamp);
+    write_json_string(json, event->container_name);
+    fprintf(json, ",\"event\":\"%s\",\"count\":%llu,\"total\":%llu,\"detail\":", container_event_type_name(event->type), event->count, event->total);
+    write_json_string(json, event->detail);
+    fputs("}\n", json);
+    fflush(json);
+}
+
+static void deliver_event(struct event_monitor *monitor, struct watched_container *container, enum container_event_type type, unsigned long long count, unsigned long long total, const char *detail)
+{
+    TRACE_SPAN_ARGUMENT("deliver_event", container->name);
+    struct container_event event;
+    char log_message[LOG_MESSAGE_SIZE] = {0};
+
+    memset(&event, 0, sizeof(event));
+    event.timestamp = realtime_now();
+    snprintf(event.container_name, sizeof(event.container_name), "%s", container->name);
+    event.type = type;
+    event.count = count;
+    event.total = total;
+    snprintf(event.detail, sizeof(event.detail), "%s", detail != NULL ? detail : "");
+
+    for (auto &callback : monitor->callbacks)
+        callback.first(&event, callback.second);
+
+    if (monitor->json != NULL)
+        write_json_event(monitor->json, &event);
+
+    const char *level = type == CONTAINER_EVENT_OOM || type == CONTAINER_EVENT_OOM_KILL ? "ERROR" : type >= CONTAINER_EVENT_STARTED ? "INFO" : "WARNING";
+    snprintf(log_message, LOG_MESSAGE_SIZE, "Container %.32s: %s (%llu) %.40s", container->name, container_event_type_name(type), count, event.detail);
+    log_activity(level, "events", container->name, log_message);
+
+    run_actions(monitor, container, &event);
+}
+
+/**
+ * @brief Handle a change of memory.events
+ */
+static void handle_memory_events(struct event_monitor *monitor, struct event_watch *watch)
+{
+    struct watched_container *container = watch->container;
+    char content[CGROUP_FILE_BUFFER_SIZE];
+
+    if (read_cgroup_file(watch->fd, content, sizeof(content)) < 0)
+        return;
+
+    for (int index = 0; index < MEMORY_EVENTS_COUNTERS && !container->removed; index++)
+    {
+        unsigned long long value = 0;
+        if (get_keyed_value(content, memory_events_keys[index], &value) < 0 || value <= container->memory_events[index])
+            continue;
+
+        unsigned long long count = value - container->memory_events[index];
+        container->memory_events[index] = value;
+        deliver_event(monitor, container, memory_events_types[index], count, value, "");
+    }
+}
+
+/**
+ * @brief Report the processes killed by the OOM killer of a cgroup v1 memory controller since the last check
+ */
+static void check_oom_kills(struct event_monitor *monitor, struct watched_container *container, int control_fd)
+{
+    char content[CGROUP_FILE_BUFFER_SIZE];
+    unsigned long long kills = container->oom_kill_total;
+
+    if (read_cgroup_file(control_fd, content, sizeof(content)) >= 0)
+        get_keyed_value(content, "oom_kill", &kills);
+
+    if (kills > container->oom_kill_total)
+    {
+        unsigned long long killed = kills - container->oom_kill_total;
+        container->oom_kill_total = kills;
+        deliver_event(monitor, container, CONTAINER_EVENT_OOM_KILL, killed, kills, "");
+    }
+}
+
+/**
+ * @brief Handle the OOM eventfd of a cgroup v1 memory controller
+ */
+static void handle_oom_control(struct event_monitor *monitor, struct event_watch *watch)
+{
+    struct watched_container *container = watch->container;
+    struct itimerspec delay;
+    uint64_t count = 0;
+
+    if (read(watch->fd, &count, sizeof(count)) != sizeof(count))
+        return;
+
+    // The eventfd is also signalled when the cgroup is removed
+    if (access(container->memory_path, F_OK) < 0)
+    {
+        if (container->cgroup_path[0] == '\0')
+        {
+            deliver_event(monitor, container, CONTAINER_EVENT_STOPPED, 1, 1, "");
+            retire_container(monitor, container);
+        }
+        return;
+    }
+
+    container->oom_total += count;
+    deliver_event(monitor, container, CONTAINER_EVENT_OOM, count, container->oom_total, "");
+    if (container->removed)
+        return;
+
+    check_oom_kills(monitor, container, watch->control_fd);
+
+    // The victim may not be killed yet, look again a bit later
+    if (container->oom_recheck == NULL)
+    {
+        int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (timer_fd < 0 || (container->oom_recheck = add_watch(monitor, container, WATCH_OOM_RECHECK, timer_fd, -1, EPOLLIN)) == NULL)
+            return;
+    }
+
+    memset(&delay, 0, sizeof(delay));
+    delay.it_value.tv_nsec = OOM_KILL_RECHECK_NS;
+    timerfd_settime(container->oom_recheck->fd, 0, &delay, NULL);
+}
+
+/**
+ * @brief Handle the timer reading the kill counter again after a cgroup v1 OOM
+ */
+static void handle_oom_recheck(struct event_monitor *monitor, struct event_watch *watch)
+{
+    uint64_t expirations;
+
+    if (read(watch->fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+        return;
+
+    for (struct event_watch *control : watch->container->watches)
+    {
+        if (control->kind == WATCH_OOM_CONTROL && control->fd >= 0)
+        {
+            check_oom_kills(monitor, watch->container, control->control_fd);
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Handle a PSI trigger
+ */
+static void handle_pressure(struct event_monitor *monitor, struct event_watch *watch, unsigned int epoll_events)
+{
+    struct watched_container *container = watch->container;
+    char content[CGROUP_FILE_BUFFER_SIZE], detail[EVENT_DETAIL_SIZE] = {0};
+    unsigned long long total = 0;
+
+    // The trigger is gone with its cgroup
+    if (read_cgroup_file(watch->fd, content, sizeof(content)) < 0 || !(epoll_events & EPOLLPRI))
+    {
+        if (epoll_events & (EPOLLERR | EPOLLHUP))
+            close_watch(monitor, watch);
+        return;
+    }
+
+    // "some avg10=1.23 avg60=0.40 avg300=0.10 total=123456"
+    const char *total_field = strstr(content, "total=");
+    if (total_field != NULL)
+        total = strtoull(total_field + 6, NULL, 10);
+
+    content[strcspn(content, "\n")] = '\0';
+    char *end = strstr(content, " total=");
+    if (end != NULL)
+        *end = '\0';
+    snprintf(detail, sizeof(detail), "%.*s", (int)sizeof(detail) - 1, content);
+
+    enum container_event_type type = watch->kind == WATCH_MEMORY_PRESSURE ? CONTAINER_EVENT_MEMORY_PRESSURE : watch->kind == WATCH_CPU_PRESSURE ? CONTAINER_EVENT_CPU_PRESSURE : CONTAINER_EVENT_IO_PRESSURE;
+    deliver_event(monitor, container, type, 1, total, detail);
+}
+
+/**
+ * @brief Handle a change of cgroup.events: the container started or stopped
+ */
+static void handle_cgroup_events(struct event_monitor *monitor, struct event_watch *watch)
+{
+    struct watched_container *container = watch->container;
+    char content[CGROUP_FILE_BUFFER_SIZE];
+    unsigned long long populated = 0;
+
+    if (read_cgroup_file(watch->fd, content, sizeof(content)) < 0 || get_keyed_value(content, "populated", &populated) < 0)
+        populated = 0;
+
+    if (populated && !container->armed)
+    {
+        arm_container(monitor, container, 0);
+        deliver_event(monitor, container, CONTAINER_EVENT_STARTED, 1, 1, "");
+    }
+    else if (!populated)
+    {
+        deliver_event(monitor, container, CONTAINER_EVENT_STOPPED, 1, 1, "");
+        if (!container->removed)
+            retire_container(monitor, container);
+    }
+}
+
+/**
+ * @brief Start watching the containers created in the directory of the lxc.payload.<name> cgroups
+ *
+ * @return int 0 on success, -1 on failure
+ */
+static int watch_new_containers(struct event_monitor *monitor)
+{
+    struct epoll_event event;
+    const char *root = get_cgroup2_root();
+
+    if (root == NULL)
+    {
+        fprintf(stderr, "New containers can only be found with cgroup v2\n");
+        return -1;
+    }
+
+    // The containers live next to the ones already watched, or at the root of the hierarchy
+    snprintf(monitor->payload_directory, sizeof(monitor->payload_directory), "%s", root);
+    for (struct watched_container *container : monitor->containers)
+    {
+        const char *slash = strrchr(container->cgroup_path, '/');
+        if (slash != NULL && strncmp(slash + 1, LXC_PAYLOAD_PREFIX, strlen(LXC_PAYLOAD_PREFIX)) == 0)
+        {
+            snprintf(monitor->payload_directory, sizeof(monitor->payload_directory), "%.*s", (int)(slash - container->cgroup_path), container->cgroup_path);
+            break;
+        }
+    }
+
+    monitor->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (monitor->inotify_fd < 0 || inotify_add_watch(monitor->inotify_fd, monitor->payload_directory, IN_CREATE | IN_ONLYDIR) < 0)
+    {
+        fprintf(stderr, "Failed to watch %s: %s\n", monitor->payload_directory, strerror(errno));
+        return -1;
+    }
+
+    monitor->inotify_watch.kind = WATCH_NEW_CONTAINERS;
+    monitor->inotify_watch.fd = monitor->inotify_fd;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.ptr = &monitor->inotify_watch;
+
+    return epoll_ctl(monitor->epoll_fd, EPOLL_CTL_ADD, monitor->inotify_fd, &event);
+}
+
+/**
+ * @brief Handle the creation of cgroups in the directory of the containers
+ */
+static void handle_new_containers(struct event_monitor *monitor)
+{
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    char path[PATH_MAX];
+    ssize_t length;
+
+    while ((length = read(monitor->inotify_fd, buffer, sizeof(buffer))) > 0)
+    {
+        for (char *position = buffer; position < buffer + length;)
+        {
+            struct inotify_event *event = (struct inotify_event *)position;
+            position += sizeof(struct inotify_event) + event->len;
+
+            if (event->len == 0 || !(event->mask & IN_ISDIR) || strncmp(event->name, LXC_PAYLOAD_PREFIX, strlen(LXC_PAYLOAD_PREFIX)) != 0)
+                continue;
+
+            if (snprintf(path, sizeof(path), "%s/%s", monitor->payload_directory, event->name) >= (int)sizeof(path))
+                continue;
+            add_cgroup(monitor, event->name + strlen(LXC_PAYLOAD_PREFIX), path, 0);
+        }
+    }
+}
+
+int event_monitor_run(struct event_monitor *monitor)
+{
+    struct epoll_event events[EVENT_BATCH_SIZE];
+    uint64_t value;
+
+    if (monitor->options.watch_new_containers && monitor->inotify_fd < 0 && watch_new_containers(monitor) < 0)
+        return -1;
+
+    while (!monitor->stopping)
+    {
+        int number_of_events = epoll_wait(monitor->epoll_fd, events, EVENT_BATCH_SIZE, -1);
+        if (number_of_events < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        for (int index = 0; index < number_of_events; index++)
+        {
+            struct event_watch *watch = (struct event_watch *)events[index].data.ptr;
+
+            // Skip the sources closed earlier in this batch
+            if (watch->fd < 0 || (watch->container != NULL && watch->container->removed))
+                continue;
+
+            switch (watch->kind)
+            {
+            case WATCH_WAKE:
+                if (read(watch->fd, &value, sizeof(value)) < 0)
+                    break;
+                break;
+            case WATCH_NEW_CONTAINERS:
+                handle_new_containers(monitor);
+                break;
+            case WATCH_CGROUP_EVENTS:
+                handle_cgroup_events(monitor, watch);
+                break;
+            case WATCH_MEMORY_EVENTS:
+                handle_memory_events(monitor, watch);
+                break;
+            case WATCH_OOM_CONTROL:
+                handle_oom_control(monitor, watch);
+                break;
+            case WATCH_OOM_RECHECK:
+                handle_oom_recheck(monitor, watch);
+                break;
+            case WATCH_MEMORY_PRESSURE:
+            case WATCH_CPU_PRESSURE:
+            case WATCH_IO_PRESSURE:
+                handle_pressure(monitor, watch, events[index].events);
+                break;
+            }
+        }
+
+        free_retired_containers(monitor);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Monitor stopped by SIGINT and SIGTERM
+ */
+static struct event_monitor *interrupted_monitor = NULL;
+
+/**
+ * @brief Stop the monitor on SIGINT and SIGTERM
+ */
+static void stop_on_signal(int signal_number)
+{
+    (void)signal_number;
+
+    if (interrupted_monitor != NULL)
+        event_monitor_stop(interrupted_monitor);
+}
+
+/**
+ * @brief Print an event
+ */
+static void print_event(const struct container_event *event, void *user_data)
+{
+    char stamp[32];
+    time_t seconds = (time_t)(event->timestamp / 1000000);
+    struct tm local;
+
+    (void)user_data;
+    localtime_r(&seconds, &local);
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &local);
+
+    printf("%s %-20s %-16s count=%llu total=%llu %s\n", stamp, event->container_name, container_event_type_name(event->type), event->count, event->total, event->detail);
+    fflush(stdout);
+}
+
+int watch_container_events(const char **container_names, int number_of_containers, const struct event_monitor_options *options, const struct event_action *actions, int number_of_actions)
+{
+    struct event_monitor_options monitor_options = *options;
+    struct lxc_container **containers = NULL;
+    char **containers_names = NULL;
+    struct sigaction action;
+    int result = 0;
+
+    monitor_options.watch_new_containers = container_names == NULL || number_of_containers == 0;
+    struct event_monitor *monitor = event_monitor_new(&monitor_options);
+    if (monitor == NULL)
+        return -1;
+
+    if (options->json_path == NULL || strcmp(options->json_path, "-") != 0)
+        event_monitor_add_callback(monitor, print_event, NULL);
+
+    for (int index = 0; index < number_of_actions; index++)
+        event_monitor_add_action(monitor, &actions[index]);
+
+    if (monitor_options.watch_new_containers)
+    {
+        int number_of_active_containers = list_active_containers(get_containers_path(), &containers_names, &containers);
+        for (int index = 0; index < number_of_active_containers; index++)
+        {
+            event_monitor_add_container(monitor, containers_names[index]);
+            free(containers_names[index]);
+            lxc_container_put(containers[index]);
+        }
+        free(containers_names);
+        free(containers);
+    }
+    else
+    {
+        for (int index = 0; index < number_of_containers; index++)
+            event_monitor_add_container(monitor, container_names[index]);
+
+        if (monitor->containers.empty())
+        {
+            event_monitor_free(monitor);
+            return -1;
+        }
+    }
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stop_on_signal;
+    interrupted_monitor = monitor;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    fprintf(stderr, "Watching %zu containers%s, press Ctrl-C to stop\n", monitor->containers.size(), monitor_options.watch_new_containers ? " and the ones started later" : "");
+    result = event_monitor_run(monitor);
+
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    interrupted_monitor = NULL;
+    event_monitor_free(monitor);
+
+    return result;
+}
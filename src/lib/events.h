@@ -0,0 +1,258 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+/**
+ * @file events.h
+ * @brief This file contains the definitions of the functions used in events.cpp regarding memory-pressure and OOM notifications of LXC containers
+ *
+ * Each container gets PSI triggers on memory.pressure, cpu.pressure and io.pressure and a watch on memory.events
+ * (memory.oom_control through cgroup.event_control when the memory controller is still on cgroup v1).
+ * All the file descriptors live in a single epoll set, so an idle monitor does not wake up at all
+ *
+ * @author Simão Andrade
+ * @date 2024-06-13
+ */
+
+#include <stddef.h>
+
+/**
+ * @brief Maximum size of the name of a container and of the details of an event
+ */
+#define EVENT_CONTAINER_NAME_SIZE 100
+#define EVENT_DETAIL_SIZE 128
+
+/**
+ * @brief Maximum size of the command run by an action
+ */
+#define EVENT_COMMAND_SIZE 256
+
+/**
+ * @brief Default PSI triggers: stall time, in microseconds, tolerated within the window
+ *
+ * Without CAP_SYS_RESOURCE the kernel only accepts windows that are multiples of 2 seconds
+ */
+#define EVENT_DEFAULT_MEMORY_STALL_US 200000
+#define EVENT_DEFAULT_CPU_STALL_US 1000000
+#define EVENT_DEFAULT_IO_STALL_US 400000
+#define EVENT_DEFAULT_WINDOW_US 2000000
+
+/**
+ * @brief Minimum time between two runs of the same action on the same container, in microseconds
+ */
+#define EVENT_ACTION_COOLDOWN_US 1000000
+
+/**
+ * @brief Types of events
+ */
+enum container_event_type
+{
+    CONTAINER_EVENT_MEMORY_PRESSURE, // PSI trigger on memory.pressure
+    CONTAINER_EVENT_CPU_PRESSURE,    // PSI trigger on cpu.pressure
+    CONTAINER_EVENT_IO_PRESSURE,     // PSI trigger on io.pressure
+    CONTAINER_EVENT_MEMORY_HIGH,     // memory.high was exceeded and reclaim was forced
+    CONTAINER_EVENT_MEMORY_MAX,      // memory.max was reached
+    CONTAINER_EVENT_OOM,             // the OOM killer was invoked
+    CONTAINER_EVENT_OOM_KILL,        // a process was killed by the OOM killer
+    CONTAINER_EVENT_STARTED,         // the container got its first process
+    CONTAINER_EVENT_STOPPED,         // the container has no process left
+    CONTAINER_EVENT_TYPES
+};
+
+/**
+ * @brief Mask of every type of event
+ */
+#define CONTAINER_EVENT_ALL ((1U << CONTAINER_EVENT_TYPES) - 1)
+
+/**
+ * @brief An event of a container
+ */
+struct container_event
+{
+    long long timestamp; // microseconds since the epoch
+    char container_name[EVENT_CONTAINER_NAME_SIZE];
+    enum container_event_type type;
+    unsigned long long count; // occurrences since the previous event of this type
+    unsigned long long total; // occurrences (stall microseconds for pressure events) since the container started
+    char detail[EVENT_DETAIL_SIZE];
+};
+
+/**
+ * @brief Actions that can be run when an event happens
+ */
+enum event_action_type
+{
+    EVENT_ACTION_RAISE_MEMORY, // raise the memory limit by a percentage, up to a ceiling
+    EVENT_ACTION_DUMP,         // save the memory and pressure statistics of the container
+    EVENT_ACTION_COMMAND       // run a shell command with CMT_EVENT_CONTAINER, CMT_EVENT_TYPE and CMT_EVENT_DETAIL set
+};
+
+/**
+ * @brief An action and the events that run it
+ */
+struct event_action
+{
+    unsigned int events; // mask of (1 << container_event_type)
+    enum event_action_type type;
+    unsigned int raise_percent;
+    unsigned long long raise_ceiling; // bytes, 0 for no ceiling
+    char command[EVENT_COMMAND_SIZE];
+};
+
+/**
+ * @brief Options of a monitor, stall times of 0 disable the matching PSI trigger
+ */
+struct event_monitor_options
+{
+    unsigned long long memory_stall_us;
+    unsigned long long cpu_stall_us;
+    unsigned long long io_stall_us;
+    unsigned long long window_us;
+    const char *json_path;     // file receiving one JSON line per event ("-" for the standard output), NULL for none
+    int watch_new_containers;  // also watch the containers started after the monitor
+};
+
+/**
+ * @brief Function called for each event
+ */
+typedef void (*container_event_callback)(const struct container_event *event, void *user_data);
+
+/**
+ * @brief A set of watched containers
+ */
+struct event_monitor;
+
+/**
+ * @brief Fill the options with the defaults
+ *
+ * @param options options to fill
+ */
+void event_monitor_default_options(struct event_monitor_options *options);
+
+/**
+ * @brief Create a monitor
+ *
+ * @param options options of the monitor, NULL for the defaults
+ *
+ * @return struct event_monitor* the monitor, NULL on failure
+ */
+struct event_monitor *event_monitor_new(const struct event_monitor_options *options);
+
+/**
+ * @brief Stop watching every container and free a monitor
+ *
+ * @param monitor monitor to free
+ */
+void event_monitor_free(struct event_monitor *monitor);
+
+/**
+ * @brief Add a function called for each event
+ *
+ * @param monitor monitor
+ * @param callback function to call
+ * @param user_data argument passed to the function
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int event_monitor_add_callback(struct event_monitor *monitor, container_event_callback callback, void *user_data);
+
+/**
+ * @brief Add an action run for some types of events
+ *
+ * @param monitor monitor
+ * @param action action to run
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int event_monitor_add_action(struct event_monitor *monitor, const struct event_action *action);
+
+/**
+ * @brief Watch a running LXC container
+ *
+ * @param monitor monitor
+ * @param container_name name of the container
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int event_monitor_add_container(struct event_monitor *monitor, const char *container_name);
+
+/**
+ * @brief Watch the cgroups of a process, reporting its events under the given name
+ *
+ * @param monitor monitor
+ * @param name name used in the events
+ * @param pid process whose cgroups are watched
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int event_monitor_add_process(struct event_monitor *monitor, const char *name, int pid);
+
+/**
+ * @brief Stop watching a container
+ *
+ * @param monitor monitor
+ * @param container_name name of the container
+ *
+ * @return int 0 on success, -1 if the container was not watched
+ */
+int event_monitor_remove_container(struct event_monitor *monitor, const char *container_name);
+
+/**
+ * @brief Wait for events and deliver them until event_monitor_stop() is called
+ *
+ * @param monitor monitor
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int event_monitor_run(struct event_monitor *monitor);
+
+/**
+ * @brief Make event_monitor_run() return, safe to call from another thread or a signal handler
+ *
+ * @param monitor monitor
+ */
+void event_monitor_stop(struct event_monitor *monitor);
+
+/**
+ * @brief Parse an action such as "oom,max=raise:25:4G", "memory_pressure=dump" or "oom_kill=exec:COMMAND"
+ *
+ * @param text action to parse
+ * @param action parsed action
+ *
+ * @return int 0 on success, -1 on malformed input
+ */
+int parse_event_action(const char *text, struct event_action *action);
+
+/**
+ * @brief Get the name of a type of event
+ *
+ * @param type type of event
+ *
+ * @return const char* name of the type
+ */
+const char *container_event_type_name(enum container_event_type type);
+
+/**
+ * @brief Find the cgroup v2 directory of a process, the one of the container when it is the init of a container
+ *
+ * @param pid PID of the process
+ * @param cgroup_path path of the directory (e.g. /sys/fs/cgroup/lxc.payload.NAME)
+ * @param cgroup_path_size size of cgroup_path
+ *
+ * @return int 0 on success, -1 if the process has no cgroup v2 directory
+ */
+int get_process_cgroup_path(int pid, char *cgroup_path, size_t cgroup_path_size);
+
+/**
+ * @brief Watch LXC containers and print their events until interrupted
+ *
+ * @param container_names names of the containers, NULL (or none) to watch every running container and the ones started later
+ * @param number_of_containers number of names
+ * @param options options of the monitor
+ * @param actions actions to run
+ * @param number_of_actions number of actions
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int watch_container_events(const char **container_names, int number_of_containers, const struct event_monitor_options *options, const struct event_action *actions, int number_of_actions);
+
+#endif // EVENTS_H
@@ -0,0 +1,1434 @@
+/**
+ * @file fleet.cpp
+ * @brief Fleet of nodes running LXC containers
+ *
+ * This file contains the implementation of the agent and of the coordinator. The agent accepts connections and serves each one
+ * in a child process, so a slow operation (a creation) does not hold the others; the operations of the library print their results,
+ * so the agent redirects the standard output and error of the child to a memory file while it runs one and sends it back.
+ * The coordinator sends a request to every node from its own thread and waits for all of them. Connections are checked before any
+ * request is served: a request without the token of the agent is refused, and an agent without a token only listens on a unix
+ * socket that it keeps to its own user and checks the user of every peer (SO_PEERCRED).
+ *
+ * Requests: {"op":"resources"}, {"op":"list"}, {"op":"create","name":N,"layered":B}, {"op":"remove","name":N},
+ * {"op":"exec","name":N,"command":C}, {"op":"exec_all","command":C}, {"op":"limit","name":N,"key":K,"value":V},
+ * {"op":"limit_all","key":K,"value":V}, each with "token":T when the fleet has a token. Every answer has "ok", and "error" when
+ * ok is false.
+ *
+ * @author Simão Andrade
+ * @date 2024-06-13
+ */
+
+#include "fleet.h"
+#include "lib.h"
+#include "inspect.h"
+#include "layers.h"
+#include "trace.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <lxc/lxccontainer.h>
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Maximum nesting of a JSON message
+ */
+#define FLEET_JSON_MAX_DEPTH 16
+
+/**
+ * @brief Size of a read from a socket or from the captured output
+ */
+#define FLEET_BUFFER_SIZE 65536
+
+/**
+ * @brief Types of a JSON value
+ */
+enum json_type
+{
+    JSON_NULL,
+    JSON_BOOL,
+    JSON_NUMBER,
+    JSON_STRING,
+    JSON_ARRAY,
+    JSON_OBJECT
+};
+
+/**
+ * @brief A parsed JSON value
+ */
+struct json_value
+{
+    enum json_type type = JSON_NULL;
+    bool boolean = false;
+    double number = 0;
+    std::string string;
+    std::vector<struct json_value> array;
+    std::map<std::string, struct json_value> object;
+};
+
+/**
+ * @brief Answer of a node to a request
+ */
+struct fleet_reply
+{
+    bool ok = false;
+    std::string error;
+    struct json_value value;
+};
+
+/**
+ * @brief Set by SIGINT and SIGTERM to stop the agent
+ */
+static volatile sig_atomic_t fleet_agent_stopping = 0;
+
+/**
+ * @brief Token sent by the coordinator of this process, empty for none
+ */
+static char fleet_token[FLEET_TOKEN_SIZE] = {0};
+
+/**
+ * @brief Append a JSON string, the text may hold any byte
+ */
+static void append_json_string(std::string &message, const char *text, size_t length)
+{
+    message += '"';
+    for (size_t index = 0; index < length; index++)
+    {
+        unsigned char character = (unsigned char)text[index];
+        if (character == '"')
+            message += "\\\"";
+        else if (character == '\\')
+            message += "\\\\";
+        else if (character == '\n')
+            message += "\\n";
+        else if (character == '\t')
+            message += "\\t";
+        else if (character < 0x20)
+        {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", character);
+            message += escaped;
+        }
+        else
+            message += (char)character;
+    }
+    message += '"';
+}
+
+static void append_json_string(std::string &message, const std::string &text)
+{
+    append_json_string(message, text.data(), text.size());
+}
+
+/**
+ * @brief Append a "key": "value" member, with a comma before it unless it is the first member
+ */
+static void append_json_member(std::string &message, const char *key, const std::string &value)
+{
+    if (message.back() != '{')
+        message += ',';
+    append_json_string(message, key, strlen(key));
+    message += ':';
+    append_json_string(message, value);
+}
+
+static void append_json_member(std::string &message, const char *key, long long value)
+{
+    if (message.back() != '{')
+        message += ',';
+    append_json_string(message, key, strlen(key));
+    message += ':';
+    message += std::to_string(value);
+}
+
+static const char *parse_json_value(const char *position, struct json_value *value, int depth);
+
+/**
+ * @brief Skip the white space of a JSON message
+ */
+static const char *skip_json_spaces(const char *position)
+{
+    while (*position == ' ' || *position == '\t' || *position == '\r' || *position == '\n')
+        position++;
+    return position;
+}
+
+/**
+ * @brief Parse a JSON string, position is on the opening quote
+ *
+ * @return const char* position after the closing quote, NULL on error
+ */
+static const char *parse_json_string(const char *position, std::string *string)
+{
+    string->clear();
+    for (position++; *position != '"'; position++)
+    {
+        if (*position == '\0')
+            return NULL;
+        if (*position != '\\')
+        {
+            *string += *position;
+            continue;
+        }
+
+        switch (*++position)
+        {
+        case 'n':
+            *string += '\n';
+            break;
+        case 't':
+            *string += '\t';
+            break;
+        case 'r':
+            *string += '\r';
+            break;
+        case 'b':
+            *string += '\b';
+            break;
+        case 'f':
+            *string += '\f';
+            break;
+        case 'u':
+        {
+            char digits[5] = {0};
+            if (strlen(position + 1) < 4)
+                return NULL;
+            memcpy(digits, position + 1, 4);
+            unsigned long code = strtoul(digits, NULL, 16);
+            position += 4;
+
+            // UTF-8 (pairs of surrogates are not joined)
+            if (code < 0x80)
+                *string += (char)code;
+            else if (code < 0x800)
+            {
+                *string += (char)(0xC0 | (code >> 6));
+                *string += (char)(0x80 | (code & 0x3F));
+            }
+            else
+            {
+                *string += (char)(0xE0 | (code >> 12));
+                *string += (char)(0x80 | ((code >> 6) & 0x3F));
+                *string += (char)(0x80 | (code & 0x3F));
+            }
+            break;
+        }
+        case '\0':
+            return NULL;
+        default: // '"', '\\' and '/'
+            *string += *position;
+        }
+    }
+    return position + 1;
+}
+
+/**
+ * @brief Parse the members of a JSON object, position is on the opening brace
+ */
+static const char *parse_json_object(const char *position, struct json_value *value, int depth)
+{
+    std::string key;
+
+    value->type = JSON_OBJECT;
+    position = skip_json_spaces(position + 1);
+    if (*position == '}')
+        return position + 1;
+
+    for (;;)
+    {
+        if (*position != '"' || (position = parse_json_string(position, &key)) == NULL)
+            return NULL;
+        position = skip_json_spaces(position);
+        if (*position != ':')
+            return NULL;
+        if ((position = parse_json_value(position + 1, &value->object[key], depth + 1)) == NULL)
+            return NULL;
+
+        position = skip_json_spaces(position);
+        if (*position == '}')
+            return position + 1;
+        if (*position != ',')
+            return NULL;
+        position = skip_json_spaces(position + 1);
+    }
+}
+
+/**
+ * @brief Parse the elements of a JSON array, position is on the opening bracket
+ */
+static const char *parse_json_array(const char *position, struct json_value *value, int depth)
+{
+    value->type = JSON_ARRAY;
+    position = skip_json_spaces(position + 1);
+    if (*position == ']')
+        return position + 1;
+
+    for (;;)
+    {
+        value->array.emplace_back();
+        if ((position = parse_json_value(position, &value->array.back(), depth + 1)) == NULL)
+            return NULL;
+
+        position = skip_json_spaces(position);
+        if (*position == ']')
+            return position + 1;
+        if (*position != ',')
+            return NULL;
+        position++;
+    }
+}
+
+/**
+ * @brief Parse a JSON value
+ *
+ * @return const char* position after the value, NULL on error
+ */
+static const char *parse_json_value(const char *position, struct json_value *value, int depth)
+{
+    if (depth > FLEET_JSON_MAX_DEPTH)
+        return NULL;
+
+    position = skip_json_spaces(position);
+    switch (*position)
+    {
+    case '{':
+        return parse_json_object(position, value, depth);
+    case '[':
+        return parse_json_array(position, value, depth);
+    case '"':
+        value->type = JSON_STRING;
+        return parse_json_string(position, &value->string);
+    case 't':
+    case 'f':
+        value->type = JSON_BOOL;
+        value->boolean = *position == 't';
+        if (strncmp(position, value->boolean ? "true" : "false", value->boolean ? 4 : 5) != 0)
+            return NULL;
+        return position + (value->boolean ? 4 : 5);
+    case 'n':
+        value->type = JSON_NULL;
+        return strncmp(position, "null", 4) == 0 ? position + 4 : NULL;
+    default:
+    {
+        char *end;
+        value->type = JSON_NUMBER;
+        value->number = strtod(position, &end);
+        return end != position ? end : NULL;
+    }
+    }
+}
+
+/**
+ * @brief Parse a whole JSON message
+ *
+ * @return int 0 on success, -1 on failure
+ */
+static int parse_json(const char *message, struct json_value *value)
+{
+    const char *end = parse_json_value(message, value, 0);
+    return end != NULL && *skip_json_spaces(end) == '\0' ? 0 : -1;
+}
+
+/**
+ * @brief Get a member of a JSON object, NULL if there is none
+ */
+static const struct json_value *json_member(const struct json_value &value, const char *key)
+{
+    auto member = value.object.find(key);
+    return member != value.object.end() ? &member->second : NULL;
+}
+
+static std::string json_member_string(const struct json_value &value, const char *key)
+{
+    const struct json_value *member = json_member(value, key);
+    return member != NULL && member->type == JSON_STRING ? member->string : "";
+}
+
+static double json_member_number(const struct json_value &value, const char *key)
+{
+    const struct json_value *member = json_member(value, key);
+    return member != NULL && member->type == JSON_NUMBER ? member->number : 0;
+}
+
+static bool json_member_bool(const struct json_value &value, const char *key)
+{
+    const struct json_value *member = json_member(value, key);
+    return member != NULL && member->type == JSON_BOOL && member->boolean;
+}
+
+static const std::vector<struct json_value> &json_member_array(const struct json_value &value, const char *key)
+{
+    static const std::vector<struct json_value> empty;
+    const struct json_value *member = json_member(value, key);
+    return member != NULL && member->type == JSON_ARRAY ? member->array : empty;
+}
+
+/**
+ * @brief Current monotonic time in milliseconds
+ */
+static long long monotonic_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Resolve the address of a node: "unix:/path", "tcp:host:port" or "host:port", an empty host is the loopback
+ *
+ * @return struct addrinfo* resolved addresses to free with freeaddrinfo(), NULL on failure
+ */
+static struct addrinfo *resolve_address(const char *address, struct sockaddr_un *unix_address)
+{
+    struct addrinfo hints, *result = NULL;
+    char host[FLEET_ADDRESS_SIZE];
+
+    if (strncmp(address, "unix:", 5) == 0)
+    {
+        memset(unix_address, 0, sizeof(*unix_address));
+        unix_address->sun_family = AF_UNIX;
+        if (strlen(address + 5) >= sizeof(unix_address->sun_path))
+            return NULL;
+        strcpy(unix_address->sun_path, address + 5);
+
+        // A single entry pointing to the unix address, allocated like getaddrinfo() does
+        result = (struct addrinfo *)calloc(1, sizeof(struct addrinfo));
+        if (result == NULL)
+            return NULL;
+        result->ai_family = AF_UNIX;
+        result->ai_socktype = SOCK_STREAM;
+        result->ai_addr = (struct sockaddr *)unix_address;
+        result->ai_addrlen = sizeof(*unix_address);
+        return result;
+    }
+
+    if (strncmp(address, "tcp:", 4) == 0)
+        address += 4;
+    if (snprintf(host, sizeof(host), "%s", address) >= (int)sizeof(host))
+        return NULL;
+
+    char *port = strrchr(host, ':');
+    if (port == NULL)
+        return NULL;
+    *port++ = '\0';
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    // An empty host is the loopback, listening on every interface takes an explicit 0.0.0.0 or ::
+    if (getaddrinfo(host[0] != '\0' ? host : "127.0.0.1", port, &hints, &result) != 0)
+        return NULL;
+
+    return result;
+}
+
+/**
+ * @brief Free the result of resolve_address()
+ */
+static void free_address(struct addrinfo *addresses)
+{
+    if (addresses != NULL && addresses->ai_family == AF_UNIX)
+        free(addresses);
+    else if (addresses != NULL)
+        freeaddrinfo(addresses);
+}
+
+/**
+ * @brief Connect to a node without blocking for more than FLEET_CONNECT_TIMEOUT_MS
+ *
+ * @return int non-blocking socket, -1 on failure
+ */
+static int connect_to_node(const struct fleet_node *node, std::string *error)
+{
+    struct sockaddr_un unix_address;
+    struct addrinfo *addresses = resolve_address(node->address, &unix_address);
+    int fd = -1;
+
+    if (addresses == NULL)
+    {
+        *error = "invalid address";
+        return -1;
+    }
+
+    for (struct addrinfo *address = addresses; address != NULL && fd < 0; address = address->ai_next)
+    {
+        fd = socket(address->ai_family, address->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+            continue;
+
+        if (connect(fd, address->ai_addr, address->ai_addrlen) < 0 && errno != EINPROGRESS)
+        {
+            *error = strerror(errno);
+            close(fd);
+            fd = -1;
+            continue;
+        }
+
+        struct pollfd poll_fd = {fd, POLLOUT, 0};
+        int socket_error = 0;
+        socklen_t length = sizeof(socket_error);
+        if (poll(&poll_fd, 1, FLEET_CONNECT_TIMEOUT_MS) <= 0 || getsockopt(fd, SOL_SOCKET, SO_ERROR, &socket_error, &length) < 0 || socket_error != 0)
+        {
+            *error = socket_error != 0 ? strerror(socket_error) : "connection timed out";
+            close(fd);
+            fd = -1;
+        }
+    }
+
+    free_address(addresses);
+    return fd;
+}
+
+/**
+ * @brief Write a whole message to a socket before a deadline (0 for none)
+ *
+ * @return int 0 on success, -1 on failure
+ */
+static int send_message(int fd, const std::string &message, long long deadline_ms)
+{
+    for (size_t sent = 0; sent < message.size();)
+    {
+        ssize_t length = send(fd, message.data() + sent, message.size() - sent, MSG_NOSIGNAL);
+        if (length > 0)
+        {
+            sent += length;
+            continue;
+        }
+        if (length < 0 && errno != EAGAIN && errno != EINTR)
+            return -1;
+
+        struct pollfd poll_fd = {fd, POLLOUT, 0};
+        int wait_ms = deadline_ms > 0 ? (int)(deadline_ms - monotonic_ms()) : -1;
+        if ((deadline_ms > 0 && wait_ms <= 0) || poll(&poll_fd, 1, wait_ms) == 0)
+            return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Read one line from a socket before a deadline (0 for none), buffer keeps what follows it
+ *
+ * @return int 0 on success, -1 on failure or end of the connection
+ */
+static int receive_line(int fd, std::string &buffer, std::string *line, long long deadline_ms)
+{
+    char chunk[FLEET_BUFFER_SIZE];
+
+    for (;;)
+    {
+        size_t end = buffer.find('\n');
+        if (end != std::string::npos)
+        {
+            line->assign(buffer, 0, end);
+            buffer.erase(0, end + 1);
+            return 0;
+        }
+        if (buffer.size() > FLEET_MESSAGE_MAX_SIZE)
+            return -1;
+
+        ssize_t length = recv(fd, chunk, sizeof(chunk), 0);
+        if (length > 0)
+        {
+            buffer.append(chunk, length);
+            continue;
+        }
+        if (length == 0 || (errno != EAGAIN && errno != EINTR))
+            return -1;
+
+        struct pollfd poll_fd = {fd, POLLIN, 0};
+        int wait_ms = deadline_ms > 0 ? (int)(deadline_ms - monotonic_ms()) : -1;
+        if ((deadline_ms > 0 && wait_ms <= 0) || poll(&poll_fd, 1, wait_ms) == 0)
+            return -1;
+    }
+}
+
+int load_fleet_nodes(const char *path, struct fleet_node *nodes, int max_nodes)
+{
+    char line[FLEET_NODE_NAME_SIZE + FLEET_ADDRESS_SIZE + 8];
+    int number_of_nodes = 0;
+
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Failed to open the list of nodes %s\n", path);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), file) != NULL && number_of_nodes < max_nodes)
+    {
+        struct fleet_node *node = &nodes[number_of_nodes];
+        if (sscanf(line, " %63[^ =#] = %255s", node->name, node->address) == 2)
+            number_of_nodes++;
+    }
+
+    fclose(file);
+    return number_of_nodes;
+}
+
+int parse_fleet_nodes(const char *list, struct fleet_node *nodes, int max_nodes)
+{
+    std::string nodes_list = list;
+    int number_of_nodes = 0;
+
+    for (size_t start = 0; start <= nodes_list.size() && number_of_nodes < max_nodes;)
+    {
+        size_t end = nodes_list.find(',', start);
+        if (end == std::string::npos)
+            end = nodes_list.size();
+
+        std::string entry = nodes_list.substr(start, end - start);
+        start = end + 1;
+        if (entry.empty())
+            continue;
+
+        // "name=address", or only the address which is also the name
+        size_t equals = entry.find('=');
+        std::string name = equals != std::string::npos ? entry.substr(0, equals) : entry;
+        std::string address = equals != std::string::npos ? entry.substr(equals + 1) : entry;
+        if (address.size() >= FLEET_ADDRESS_SIZE)
+        {
+            fprintf(stderr, "The address %s is too long\n", address.c_str());
+            return -1;
+        }
+
+        snprintf(nodes[number_of_nodes].name, FLEET_NODE_NAME_SIZE, "%s", name.c_str());
+        snprintf(nodes[number_of_nodes].address, FLEET_ADDRESS_SIZE, "%s", address.c_str());
+        number_of_nodes++;
+    }
+
+    return number_of_nodes;
+}
+
+int load_fleet_token(const char *path, char *token, size_t size)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+        return -1;
+
+    int result = fgets(token, size, file) != NULL ? 0 : -1;
+    fclose(file);
+    if (result < 0)
+        return -1;
+
+    token[strcspn(token, "\r\n")] = '\0';
+    if (token[0] == '\0')
+    {
+        fprintf(stderr, "The token file %s is empty\n", path);
+        return -1;
+    }
+    if (strlen(token) + 1 >= size)
+    {
+        fprintf(stderr, "The token in %s is too long\n", path);
+        return -1;
+    }
+
+    return 0;
+}
+
+int set_fleet_token(const char *token)
+{
+    if (token == NULL)
+    {
+        fleet_token[0] = '\0';
+        return 0;
+    }
+    if (snprintf(fleet_token, sizeof(fleet_token), "%s", token) >= (int)sizeof(fleet_token))
+    {
+        fleet_token[0] = '\0';
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Compare a received token with the one of the agent in a time that does not depend on where they differ
+ */
+static bool is_same_token(const std::string &received, const char *token)
+{
+    size_t length = strlen(token);
+    unsigned char difference = received.size() != length;
+
+    for (size_t index = 0; index < length; index++)
+        difference |= (unsigned char)(index < received.size() ? received[index] : 0) ^ (unsigned char)token[index];
+
+    return difference == 0;
+}
+
+/**
+ * @brief Check that the peer of a unix socket runs as root or as the user of the agent
+ */
+static bool is_allowed_peer(int fd)
+{
+    struct ucred credentials;
+    socklen_t length = sizeof(credentials);
+
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) < 0)
+        return false;
+    return credentials.uid == 0 || credentials.uid == geteuid();
+}
+
+/**
+ * @brief Run an operation of the library with its standard output and error captured in a memory file
+ *
+ * @return int result of the operation
+ */
+static int run_captured(int capture_fd, const std::function<int(void)> &operation, std::string *output)
+{
+    char buffer[FLEET_BUFFER_SIZE];
+    ssize_t length;
+
+    fflush(stdout);
+    fflush(stderr);
+    int saved_stdout = dup(STDOUT_FILENO), saved_stderr = dup(STDERR_FILENO);
+    ftruncate(capture_fd, 0);
+    lseek(capture_fd, 0, SEEK_SET);
+    dup2(capture_fd, STDOUT_FILENO);
+    dup2(capture_fd, STDERR_FILENO);
+
+    int result = operation();
+
+    fflush(stdout);
+    fflush(stderr);
+    dup2(saved_stdout, STDOUT_FILENO);
+    dup2(saved_stderr, STDERR_FILENO);
+    close(saved_stdout);
+    close(saved_stderr);
+
+    output->clear();
+    for (off_t offset = 0; (length = pread(capture_fd, buffer, sizeof(buffer), offset)) > 0; offset += length)
+    {
+        size_t kept = std::min((size_t)length, FLEET_OUTPUT_MAX_SIZE - output->size());
+        output->append(buffer, kept);
+        if (kept < (size_t)length)
+        {
+            *output += "\n[output truncated]\n";
+            break;
+        }
+    }
+
+    return result;
+}
+
+/**
+ * @brief Check that a container name from a request cannot leave the lxcpath
+ */
+static bool is_valid_container_name(const std::string &name)
+{
+    return !name.empty() && name.size() < FILENAME_MAX && name.find('/') == std::string::npos && name != "." && name != "..";
+}
+
+/**
+ * @brief Read a field of /proc/meminfo, in bytes
+ */
+static unsigned long long read_meminfo(const char *field)
+{
+    char line[256];
+    unsigned long long value = 0;
+    size_t field_length = strlen(field);
+
+    FILE *file = fopen("/proc/meminfo", "r");
+    if (file == NULL)
+        return 0;
+
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        if (strncmp(line, field, field_length) == 0 && line[field_length] == ':')
+        {
+            value = strtoull(line + field_length + 1, NULL, 10) * 1024;
+            break;
+        }
+    }
+
+    fclose(file);
+    return value;
+}
+
+/**
+ * @brief Memory used by a running container, in bytes
+ */
+static unsigned long long container_memory_usage(struct lxc_container *container)
+{
+    char *value = read_cgroup_item(container, "memory.current");
+    if (value == NULL)
+        value = read_cgroup_item(container, "memory.usage_in_bytes"); // cgroup v1
+
+    unsigned long long usage = value != NULL ? strtoull(value, NULL, 10) : 0;
+    free(value);
+    return usage;
+}
+
+/**
+ * @brief Answer a "list" or "resources" request: the containers of the agent and, for resources, the free CPU and memory
+ */
+static std::string describe_node(const struct fleet_agent_options *options, bool with_resources)
+{
+    struct lxc_container **containers = NULL;
+    char **containers_names = NULL;
+    unsigned long long used_memory = 0;
+    int running = 0;
+    std::string containers_list = "[";
+
+    int number_of_containers = list_defined_containers(get_containers_path(), &containers_names, &containers);
+    for (int index = 0; index < number_of_containers; index++)
+    {
+        struct lxc_container *container = containers[index];
+        bool is_running = container->is_running(container);
+        unsigned long long memory = is_running ? container_memory_usage(container) : 0;
+
+        running += is_running;
+        used_memory += memory;
+
+        containers_list += containers_list.size() > 1 ? ",{" : "{";
+        append_json_member(containers_list, "name", containers_names[index]);
+        append_json_member(containers_list, "state", container->state(container));
+        append_json_member(containers_list, "pid", is_running ? (long long)container->init_pid(container) : 0);
+        append_json_member(containers_list, "memory", (long long)memory);
+        containers_list += '}';
+
+        free(containers_names[index]);
+        lxc_container_put(container);
+    }
+    free(containers_names);
+    free(containers);
+    containers_list += ']';
+
+    std::string answer = "{\"ok\":true";
+    append_json_member(answer, "containers_path", get_containers_path());
+    append_json_member(answer, "running", running);
+
+    if (with_resources)
+    {
+        double load = 0;
+        long host_cpus = std::max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+        getloadavg(&load, 1);
+
+        // An agent offering a share of the host gets the same share of its load, and its containers use its memory
+        unsigned int cpus = options->cpus > 0 ? options->cpus : (unsigned int)host_cpus;
+        load = load * cpus / host_cpus;
+
+        unsigned long long memory_total = read_meminfo("MemTotal"), memory_available = read_meminfo("MemAvailable");
+        if (options->memory > 0)
+        {
+            memory_total = options->memory;
+            memory_available = std::min(memory_available, used_memory < memory_total ? memory_total - used_memory : 0);
+        }
+
+        append_json_member(answer, "cpus", cpus);
+        append_json_member(answer, "load_milli", (long long)(load * 1000));
+        append_json_member(answer, "memory_total", (long long)memory_total);
+        append_json_member(answer, "memory_available", (long long)memory_available);
+    }
+
+    answer += ",\"containers\":" + containers_list + "}";
+    return answer;
+}
+
+/**
+ * @brief Build the answer to an operation of the library
+ */
+static std::string describe_result(int result, const std::string &output)
+{
+    std::string answer = "{\"ok\":true";
+    append_json_member(answer, "status", result);
+    append_json_member(answer, "output", output);
+    return answer + "}";
+}
+
+/**
+ * @brief Build an error answer
+ */
+static std::string describe_error(const char *error)
+{
+    std::string answer = "{\"ok\":false";
+    append_json_member(answer, "error", error);
+    return answer + "}";
+}
+
+/**
+ * @brief Run an operation on every running container of the agent, the answer holds one result per container
+ */
+static std::string run_on_running_containers(int capture_fd, const std::function<int(const char *)> &operation)
+{
+    struct lxc_container **containers = NULL;
+    char **containers_names = NULL;
+    std::string results = "[";
+
+    int number_of_containers = list_active_containers(get_containers_path(), &containers_names, &containers);
+    for (int index = 0; index < number_of_containers; index++)
+    {
+        std::string output;
+        const char *container_name = containers_names[index];
+        int result = run_captured(capture_fd, [&]() { return operation(container_name); }, &output);
+
+        results += results.size() > 1 ? ",{" : "{";
+        append_json_member(results, "name", container_name);
+        append_json_member(results, "status", result);
+        append_json_member(results, "output", output);
+        results += '}';
+
+        free(containers_names[index]);
+        lxc_container_put(containers[index]);
+    }
+    free(containers_names);
+    free(containers);
+
+    return "{\"ok\":true,\"results\":" + results + "]}";
+}
+
+/**
+ * @brief Answer a request of the coordinator
+ */
+static std::string handle_request(const std::string &line, const struct fleet_agent_options *options, int capture_fd)
+{
+    struct json_value request;
+    std::string output;
+
+    if (parse_json(line.c_str(), &request) < 0 || request.type != JSON_OBJECT)
+        return describe_error("invalid request");
+
+    if (options->token != NULL && !is_same_token(json_member_string(request, "token"), options->token))
+        return describe_error("unauthorized");
+
+    std::string operation = json_member_string(request, "op");
+    std::string name = json_member_string(request, "name");
+    std::string command = json_member_string(request, "command");
+    std::string key = json_member_string(request, "key"), value = json_member_string(request, "value");
+
+    if (operation == "resources" || operation == "list")
+        return describe_node(options, operation == "resources");
+
+    if (operation == "exec_all")
+    {
+        return run_on_running_containers(capture_fd, [&](const char *container_name) {
+            std::vector<char> arguments(command.begin(), command.end());
+            arguments.push_back('\0');
+            return run_command_in_container(container_name, arguments.data()); // tokenizes the command in place
+        });
+    }
+
+    if (operation == "limit_all")
+    {
+        return run_on_running_containers(capture_fd, [&](const char *container_name) {
+            return define_limits_of_system_resources(container_name, key.c_str(), value.c_str());
+        });
+    }
+
+    if (!is_valid_container_name(name))
+        return describe_error("invalid container name");
+
+    int result;
+    if (operation == "create")
+    {
+        bool layered = json_member_bool(request, "layered");
+        result = run_captured(capture_fd, [&]() { return layered ? create_layered_container(name.c_str()) : create_new_container(name.c_str()); }, &output);
+    }
+    else if (operation == "remove")
+    {
+        result = run_captured(capture_fd, [&]() { return remove_container(name.c_str()); }, &output);
+    }
+    else if (operation == "exec")
+    {
+        std::vector<char> arguments(command.begin(), command.end());
+        arguments.push_back('\0');
+        result = run_captured(capture_fd, [&]() { return run_command_in_container(name.c_str(), arguments.data()); }, &output);
+    }
+    else if (operation == "limit")
+    {
+        result = run_captured(capture_fd, [&]() { return define_limits_of_system_resources(name.c_str(), key.c_str(), value.c_str()); }, &output);
+    }
+    else
+    {
+        return describe_error("unknown operation");
+    }
+
+    return describe_result(result, output);
+}
+
+/**
+ * @brief Serve the requests of one connection, in a child process of the agent
+ *
+ * A coordinator that sends nothing, or does not read the answer, for FLEET_AGENT_IDLE_TIMEOUT_MS is disconnected
+ */
+static void serve_connection(int fd, const struct fleet_agent_options *options)
+{
+    std::string buffer, line;
+
+    int capture_fd = memfd_create("fleet-output", MFD_CLOEXEC);
+    if (capture_fd < 0)
+        return;
+
+    // Keep the messages of the library in order with the output of the commands it runs
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    while (receive_line(fd, buffer, &line, monotonic_ms() + FLEET_AGENT_IDLE_TIMEOUT_MS) == 0)
+    {
+        std::string answer = handle_request(line, options, capture_fd) + "\n";
+        if (send_message(fd, answer, monotonic_ms() + FLEET_AGENT_IDLE_TIMEOUT_MS) < 0)
+            break;
+    }
+
+    close(capture_fd);
+}
+
+/**
+ * @brief Stop the agent on SIGINT and SIGTERM
+ */
+static void stop_fleet_agent(int signal_number)
+{
+    (void)signal_number;
+    fleet_agent_stopping = 1;
+}
+
+int run_fleet_agent(const struct fleet_agent_options *options)
+{
+    struct sockaddr_un unix_address;
+    struct sigaction action;
+    char log_message[LOG_MESSAGE_SIZE] = {0};
+    int listen_fd = -1, result = 0, one = 1, connections = 0;
+
+    if (options->containers_path != NULL)
+    {
+        if (mkdir(options->containers_path, 0755) < 0 && errno != EEXIST)
+        {
+            fprintf(stderr, "Failed to create the containers path %s\n", options->containers_path);
+            return -1;
+        }
+        if (set_containers_path(options->containers_path) < 0)
+            return -1;
+    }
+
+    struct addrinfo *addresses = resolve_address(options->address, &unix_address);
+    if (addresses == NULL)
+    {
+        fprintf(stderr, "Invalid address %s, expected unix:PATH or [tcp:]HOST:PORT\n", options->address);
+        return -1;
+    }
+
+    // Anyone who reaches a TCP port could run commands in the containers, only the holders of the token may
+    if (addresses->ai_family != AF_UNIX && (options->token == NULL || options->token[0] == '\0'))
+    {
+        fprintf(stderr, "A TCP agent needs the token of the fleet, use --token-file or %s\n", FLEET_TOKEN_FILE);
+        free_address(addresses);
+        return -1;
+    }
+
+    if (addresses->ai_family == AF_UNIX)
+        unlink(unix_address.sun_path); // left by a previous agent
+
+    listen_fd = socket(addresses->ai_family, addresses->ai_socktype | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0)
+    {
+        fprintf(stderr, "Failed to create the socket of the agent\n");
+        result = -1;
+        goto out;
+    }
+
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(listen_fd, addresses->ai_addr, addresses->ai_addrlen) < 0 || listen(listen_fd, SOMAXCONN) < 0)
+    {
+        fprintf(stderr, "Failed to listen on %s: %s\n", options->address, strerror(errno));
+        result = -1;
+        goto out;
+    }
+
+    // Only the user of the agent may connect to its unix socket, the peers are checked again on every connection
+    if (addresses->ai_family == AF_UNIX && chmod(unix_address.sun_path, 0600) < 0)
+    {
+        fprintf(stderr, "Failed to restrict the socket %s: %s\n", unix_address.sun_path, strerror(errno));
+        result = -1;
+        goto out;
+    }
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stop_fleet_agent;
+    fleet_agent_stopping = 0;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    printf("Fleet agent listening on %s, serving %s\n", options->address, get_containers_path());
+    snprintf(log_message, LOG_MESSAGE_SIZE, "Fleet agent listening on %s", options->address);
+    log_activity("INFO", "fleet", NULL, log_message);
+
+    while (!fleet_agent_stopping)
+    {
+        struct pollfd poll_fd = {listen_fd, POLLIN, 0};
+        int ready = poll(&poll_fd, 1, 1000);
+
+        while (waitpid(-1, NULL, WNOHANG) > 0) // finished connections
+            connections--;
+
+        if (ready <= 0)
+            continue;
+
+        // Non-blocking, so the deadlines of serve_connection() hold
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+        if (fd < 0)
+            continue;
+
+        if (addresses->ai_family == AF_UNIX && !is_allowed_peer(fd))
+        {
+            send_message(fd, describe_error("unauthorized") + "\n", monotonic_ms() + FLEET_CONNECT_TIMEOUT_MS);
+            close(fd);
+            continue;
+        }
+
+        if (connections >= FLEET_AGENT_MAX_CONNECTIONS)
+        {
+            send_message(fd, describe_error("too many connections") + "\n", monotonic_ms() + FLEET_CONNECT_TIMEOUT_MS);
+            close(fd);
+            continue;
+        }
+
+        // Each connection gets its own process, the coordinator opens one per request
+        pid_t child = fork();
+        if (child == 0)
+        {
+            signal(SIGINT, SIG_DFL);
+            signal(SIGTERM, SIG_DFL);
+            close(listen_fd);
+            serve_connection(fd, options);
+            close(fd);
+            _exit(0);
+        }
+        if (child > 0)
+            connections++;
+        close(fd);
+    }
+
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    printf("Fleet agent stopped\n");
+
+out:
+    if (listen_fd >= 0)
+        close(listen_fd);
+    if (addresses->ai_family == AF_UNIX)
+        unlink(unix_address.sun_path);
+    free_address(addresses);
+    return result;
+}
+
+/**
+ * @brief Send a request to a node and wait for its answer
+ */
+static void send_request(const struct fleet_node *node, const std::string &request, struct fleet_reply *reply)
+{
+    std::string buffer, line;
+    long long deadline_ms = monotonic_ms() + FLEET_REQUEST_TIMEOUT_MS;
+
+    int fd = connect_to_node(node, &reply->error);
+    if (fd < 0)
+        return;
+
+    // The token goes first, every request is an object
+    std::string message = request;
+    if (fleet_token[0] != '\0')
+    {
+        message = "{";
+        append_json_member(message, "token", fleet_token);
+        message += "," + request.substr(1);
+    }
+
+    if (send_message(fd, message + "\n", deadline_ms) < 0 || receive_line(fd, buffer, &line, deadline_ms) < 0)
+        reply->error = "no answer";
+    else if (parse_json(line.c_str(), &reply->value) < 0 || reply->value.type != JSON_OBJECT)
+        reply->error = "invalid answer";
+    else if (!json_member_bool(reply->value, "ok"))
+        reply->error = json_member_string(reply->value, "error");
+    else
+        reply->ok = true;
+
+    close(fd);
+}
+
+/**
+ * @brief Send the same request to every node at the same time and wait for all the answers
+ */
+static std::vector<struct fleet_reply> send_to_all_nodes(const struct fleet_node *nodes, int number_of_nodes, const std::string &request)
+{
+    TRACE_SPAN("fleet.fan_out");
+    std::vector<struct fleet_reply> replies(number_of_nodes);
+    std::vector<std::thread> threads;
+
+    for (int index = 0; index < number_of_nodes; index++)
+        threads.emplace_back(send_request, &nodes[index], std::cref(request), &replies[index]);
+    for (std::thread &thread : threads)
+        thread.join();
+
+    return replies;
+}
+
+/**
+ * @brief Print the nodes that did not answer
+ *
+ * @return int number of nodes that did not answer
+ */
+static int report_unreachable_nodes(const struct fleet_node *nodes, const std::vector<struct fleet_reply> &replies)
+{
+    int failures = 0;
+    for (size_t index = 0; index < replies.size(); index++)
+    {
+        if (!replies[index].ok)
+        {
+            fprintf(stderr, "Node %s (%s): %s\n", nodes[index].name, nodes[index].address, replies[index].error.c_str());
+            failures++;
+        }
+    }
+    return failures;
+}
+
+/**
+ * @brief Find the node that has a container
+ *
+ * @return int index of the node, -1 if no node has it
+ */
+static int find_container_node(const struct fleet_node *nodes, int number_of_nodes, const char *container_name)
+{
+    std::vector<struct fleet_reply> replies = send_to_all_nodes(nodes, number_of_nodes, "{\"op\":\"list\"}");
+    int found = -1;
+
+    report_unreachable_nodes(nodes, replies);
+    for (int index = 0; index < number_of_nodes; index++)
+    {
+        for (const struct json_value &container : json_member_array(replies[index].value, "containers"))
+        {
+            if (json_member_string(container, "name") != container_name)
+                continue;
+            if (found >= 0)
+                fprintf(stderr, "Container %s is on nodes %s and %s, using %s\n", container_name, nodes[found].name, nodes[index].name, nodes[found].name);
+            else
+                found = index;
+        }
+    }
+
+    if (found < 0)
+        fprintf(stderr, "There's no container with the name %s in the fleet\n", container_name);
+    return found;
+}
+
+/**
+ * @brief Send a request about one container to the node that has it and print the output of the operation
+ *
+ * @return int 0 if the operation succeeded, -1 otherwise
+ */
+static int send_to_container_node(const struct fleet_node *nodes, int number_of_nodes, const char *container_name, const std::string &request)
+{
+    struct fleet_reply reply;
+
+    int node = find_container_node(nodes, number_of_nodes, container_name);
+    if (node < 0)
+        return -1;
+
+    send_request(&nodes[node], request, &reply);
+    if (!reply.ok)
+    {
+        fprintf(stderr, "Node %s (%s): %s\n", nodes[node].name, nodes[node].address, reply.error.c_str());
+        return -1;
+    }
+
+    printf("[%s/%s]\n%s", nodes[node].name, container_name, json_member_string(reply.value, "output").c_str());
+    return json_member_number(reply.value, "status") == 0 ? 0 : -1;
+}
+
+/**
+ * @brief Send a request to every node and print the result of the operation on each container
+ *
+ * @return int 0 if the operation succeeded everywhere, -1 otherwise
+ */
+static int send_to_all_containers(const struct fleet_node *nodes, int number_of_nodes, const std::string &request)
+{
+    std::vector<struct fleet_reply> replies = send_to_all_nodes(nodes, number_of_nodes, request);
+    int containers = 0, failures = 0;
+
+    for (int index = 0; index < number_of_nodes; index++)
+    {
+        for (const struct json_value &result : json_member_array(replies[index].value, "results"))
+        {
+            int status = (int)json_member_number(result, "status");
+            printf("--- %s/%s: %s ---\n%s", nodes[index].name, json_member_string(result, "name").c_str(), status == 0 ? "ok" : "failed",
+                   json_member_string(result, "output").c_str());
+            containers++;
+            failures += status != 0;
+        }
+    }
+
+    int unreachable = report_unreachable_nodes(nodes, replies);
+    printf("\nSucceeded in %d of %d containers on %d nodes", containers - failures, containers, number_of_nodes - unreachable);
+    if (unreachable > 0)
+        printf(" (%d nodes unreachable)", unreachable);
+    printf("\n");
+
+    return failures == 0 && unreachable == 0 ? 0 : -1;
+}
+
+int show_fleet_nodes(const struct fleet_node *nodes, int number_of_nodes)
+{
+    TRACE_SPAN("show_fleet_nodes");
+    std::vector<struct fleet_reply> replies = send_to_all_nodes(nodes, number_of_nodes, "{\"op\":\"resources\"}");
+
+    printf("%-16s %-32s %-5s %-6s %-21s %-10s %s\n", "NODE", "ADDRESS", "CPUS", "LOAD", "MEMORY FREE/TOTAL", "CONTAINERS", "RUNNING");
+    for (int index = 0; index < number_of_nodes; index++)
+    {
+        if (!replies[index].ok)
+            continue;
+
+        const struct json_value &value = replies[index].value;
+        char memory[32];
+        snprintf(memory, sizeof(memory), "%.0f/%.0f MB", json_member_number(value, "memory_available") / (1024 * 1024), json_member_number(value, "memory_total") / (1024 * 1024));
+        printf("%-16s %-32s %-5.0f %-6.2f %-21s %-10zu %.0f\n", nodes[index].name, nodes[index].address, json_member_number(value, "cpus"),
+               json_member_number(value, "load_milli") / 1000, memory, json_member_array(value, "containers").size(), json_member_number(value, "running"));
+    }
+
+    return report_unreachable_nodes(nodes, replies) == 0 ? 0 : -1;
+}
+
+int list_fleet_containers(const struct fleet_node *nodes, int number_of_nodes)
+{
+    TRACE_SPAN("list_fleet_containers");
+    std::vector<struct fleet_reply> replies = send_to_all_nodes(nodes, number_of_nodes, "{\"op\":\"list\"}");
+    int number_of_containers = 0, running = 0;
+
+    printf("%-16s %-24s %-10s %-8s %s\n", "NODE", "NAME", "STATE", "PID", "MEMORY");
+    for (int index = 0; index < number_of_nodes; index++)
+    {
+        for (const struct json_value &container : json_member_array(replies[index].value, "containers"))
+        {
+            std::string state = json_member_string(container, "state");
+            printf("%-16s %-24s %-10s %-8.0f %.1f MB\n", nodes[index].name, json_member_string(container, "name").c_str(), state.c_str(),
+                   json_member_number(container, "pid"), json_member_number(container, "memory") / (1024 * 1024));
+            number_of_containers++;
+            running += state == "RUNNING";
+        }
+    }
+
+    int unreachable = report_unreachable_nodes(nodes, replies);
+    printf("\n%d containers (%d running) on %d nodes\n", number_of_containers, running, number_of_nodes - unreachable);
+
+    return unreachable == 0 ? 0 : -1;
+}
+
+int create_fleet_container(const struct fleet_node *nodes, int number_of_nodes, const char *container_name, int layered)
+{
+    TRACE_SPAN_ARGUMENT("create_fleet_container", container_name);
+    std::vector<struct fleet_reply> replies = send_to_all_nodes(nodes, number_of_nodes, "{\"op\":\"resources\"}");
+    char log_message[LOG_MESSAGE_SIZE] = {0};
+    double best_score = -1;
+    size_t best_containers = 0;
+    int best = -1;
+
+    report_unreachable_nodes(nodes, replies);
+    for (int index = 0; index < number_of_nodes; index++)
+    {
+        if (!replies[index].ok)
+            continue;
+
+        const struct json_value &value = replies[index].value;
+        const std::vector<struct json_value> &containers = json_member_array(value, "containers");
+        for (const struct json_value &container : containers)
+        {
+            if (json_member_string(container, "name") == container_name)
+            {
+                fprintf(stderr, "Container %s already exists on node %s\n", container_name, nodes[index].name);
+                return -1;
+            }
+        }
+
+        // Free fraction of the CPUs plus free fraction of the memory, the node with fewer containers wins a tie
+        double cpus = std::max(1.0, json_member_number(value, "cpus"));
+        double free_cpus = std::max(0.0, cpus - json_member_number(value, "load_milli") / 1000);
+        double memory_total = std::max(1.0, json_member_number(value, "memory_total"));
+        double score = free_cpus / cpus + json_member_number(value, "memory_available") / memory_total;
+
+        if (best < 0 || score > best_score + 0.01 || (score > best_score - 0.01 && containers.size() < best_containers))
+        {
+            best = index;
+            best_score = score;
+            best_containers = containers.size();
+        }
+    }
+
+    if (best < 0)
+    {
+        fprintf(stderr, "No node of the fleet is reachable\n");
+        return -1;
+    }
+
+    printf("Placing container %s on node %s\n", container_name, nodes[best].name);
+
+    std::string request = "{";
+    append_json_member(request, "op", "create");
+    append_json_member(request, "name", container_name);
+    request += layered ? ",\"layered\":true}" : "}";
+
+    struct fleet_reply reply;
+    send_request(&nodes[best], request, &reply);
+    printf("%s", json_member_string(reply.value, "output").c_str());
+    if (!reply.ok || json_member_number(reply.value, "status") != 0)
+    {
+        fprintf(stderr, "Failed to create container %s on node %s%s%s\n", container_name, nodes[best].name, reply.ok ? "" : ": ", reply.error.c_str());
+        return -1;
+    }
+
+    snprintf(log_message, LOG_MESSAGE_SIZE, "Container %s placed on node %s", container_name, nodes[best].name);
+    log_activity("INFO", "fleet", container_name, log_message);
+
+    return 0;
+}
+
+int remove_fleet_container(const struct fleet_node *nodes, int number_of_nodes, const char *container_name)
+{
+    TRACE_SPAN_ARGUMENT("remove_fleet_container", container_name);
+    std::string request = "{";
+    append_json_member(request, "op", "remove");
+    append_json_member(request, "name", container_name);
+    request += "}";
+
+    return send_to_container_node(nodes, number_of_nodes, container_name, request);
+}
+
+int run_fleet_command(const struct fleet_node *nodes, int number_of_nodes, const char *container_name, const char *command)
+{
+    TRACE_SPAN_ARGUMENT("run_fleet_command", container_name);
+    std::string request = "{";
+    append_json_member(request, "op", container_name != NULL ? "exec" : "exec_all");
+    if (container_name != NULL)
+        append_json_member(request, "name", container_name);
+    append_json_member(request, "command", command);
+    request += "}";
+
+    if (container_name != NULL)
+        return send_to_container_node(nodes, number_of_nodes, container_name, request);
+    return send_to_all_containers(nodes, number_of_nodes, request);
+}
+
+int define_fleet_limits(const struct fleet_node *nodes, int number_of_nodes, const char *container_name, const char *cgroup_subsystem, const char *cgroup_value)
+{
+    TRACE_SPAN_ARGUMENT("define_fleet_limits", container_name);
+    std::string request = "{";
+    append_json_member(request, "op", container_name != NULL ? "limit" : "limit_all");
+    if (container_name != NULL)
+        append_json_member(request, "name", container_name);
+    append_json_member(request, "key", cgroup_subsystem);
+    append_json_member(request, "value", cgroup_value);
+    request += "}";
+
+    if (container_name != NULL)
+        return send_to_container_node(nodes, number_of_nodes, container_name, request);
+    return send_to_all_containers(nodes, number_of_nodes, request);
+}
@@ -0,0 +1,185 @@
+#ifndef FLEET_H
+#define FLEET_H
+
+/**
+ * @file fleet.h
+ * @brief This file contains the definitions of the functions used in fleet.cpp regarding a fleet of nodes running LXC containers
+ *
+ * Every node runs an agent (this program in agent mode) that serves the containers of one lxcpath with the operations of the library.
+ * The coordinator sends one JSON object per line to the agents, over unix or TCP sockets, and they answer with one JSON object per line.
+ * Fleet-wide operations are sent to every node at the same time and the answers are merged, so they take as long as the slowest
+ * node and not the sum of the nodes. New containers are placed on the node with the most free CPU and memory.
+ * Every request carries the shared token of the fleet; an agent only serves the requests with its token, and the ones of the
+ * local users allowed to use its unix socket when it has no token
+ *
+ * @author Simão Andrade
+ * @date 2024-06-13
+ */
+
+#include <stddef.h>
+
+/**
+ * @brief File listing the nodes of the fleet, one "name = address" per line
+ */
+#define FLEET_NODES_FILE "fleet.conf"
+
+/**
+ * @brief File with the shared token of the fleet, read by the agents and the coordinator without --token-file
+ */
+#define FLEET_TOKEN_FILE "fleet.token"
+
+/**
+ * @brief Maximum number of nodes and sizes of their fields
+ */
+#define FLEET_MAX_NODES 64
+#define FLEET_NODE_NAME_SIZE 64
+#define FLEET_ADDRESS_SIZE 256
+#define FLEET_TOKEN_SIZE 256
+
+/**
+ * @brief Time to connect to an agent and to get the answer to a request, in milliseconds (a creation downloads the template)
+ */
+#define FLEET_CONNECT_TIMEOUT_MS 2000
+#define FLEET_REQUEST_TIMEOUT_MS (15 * 60 * 1000)
+
+/**
+ * @brief Time an agent waits for a request or for the coordinator to read an answer, in milliseconds, and maximum number of
+ * connections it serves at the same time
+ */
+#define FLEET_AGENT_IDLE_TIMEOUT_MS 30000
+#define FLEET_AGENT_MAX_CONNECTIONS 32
+
+/**
+ * @brief Maximum size of a request or answer, and of the output of an operation sent back by an agent
+ */
+#define FLEET_MESSAGE_MAX_SIZE (4 * 1024 * 1024)
+#define FLEET_OUTPUT_MAX_SIZE (256 * 1024)
+
+/**
+ * @brief A node of the fleet
+ */
+struct fleet_node
+{
+    char name[FLEET_NODE_NAME_SIZE];
+    char address[FLEET_ADDRESS_SIZE]; // "unix:/path", "tcp:host:port" or "host:port"
+};
+
+/**
+ * @brief Options of an agent
+ */
+struct fleet_agent_options
+{
+    const char *address;         // address to listen on, "HOST:PORT" with an empty host listens on the loopback
+    const char *token;           // shared token of the fleet, NULL for none (only allowed on unix sockets)
+    const char *containers_path; // lxcpath served by the agent, NULL for the one of the LXC configuration
+    unsigned int cpus;           // CPUs offered to the fleet, 0 for the CPUs of the host
+    unsigned long long memory;   // bytes of memory offered to the fleet, 0 for the memory of the host
+};
+
+/**
+ * @brief Read the nodes of the fleet from a file with one "name = address" per line
+ *
+ * @param path path of the file
+ * @param nodes read nodes
+ * @param max_nodes size of nodes
+ *
+ * @return int number of nodes, -1 on failure
+ */
+int load_fleet_nodes(const char *path, struct fleet_node *nodes, int max_nodes);
+
+/**
+ * @brief Read the nodes of the fleet from a comma-separated list of "name=address" or addresses
+ *
+ * @param list list of nodes
+ * @param nodes read nodes
+ * @param max_nodes size of nodes
+ *
+ * @return int number of nodes, -1 on failure
+ */
+int parse_fleet_nodes(const char *list, struct fleet_node *nodes, int max_nodes);
+
+/**
+ * @brief Read the shared token of the fleet from the first line of a file
+ *
+ * @param path path of the file
+ * @param token read token
+ * @param size size of token
+ *
+ * @return int 0 on success, -1 if the file can't be read or has no token
+ */
+int load_fleet_token(const char *path, char *token, size_t size);
+
+/**
+ * @brief Use a token in the requests sent by the coordinator of this process
+ *
+ * @param token shared token of the fleet, NULL for none
+ *
+ * @return int 0 on success, -1 if the token is too long
+ */
+int set_fleet_token(const char *token);
+
+/**
+ * @brief Serve the requests of the coordinator until interrupted
+ *
+ * A TCP agent refuses to start without a token. Each connection is served by a child process, at most FLEET_AGENT_MAX_CONNECTIONS
+ * at the same time, and is closed when it stays idle for FLEET_AGENT_IDLE_TIMEOUT_MS
+ *
+ * @param options options of the agent
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int run_fleet_agent(const struct fleet_agent_options *options);
+
+/**
+ * @brief Show the free CPU and memory and the number of containers of every node
+ *
+ * @return int 0 if every node answered, -1 otherwise
+ */
+int show_fleet_nodes(const struct fleet_node *nodes, int number_of_nodes);
+
+/**
+ * @brief List the containers of every node
+ *
+ * @return int 0 if every node answered, -1 otherwise
+ */
+int list_fleet_containers(const struct fleet_node *nodes, int number_of_nodes);
+
+/**
+ * @brief Create and start a container on the node with the most free CPU and memory
+ *
+ * @param container_name name of the container, unique in the fleet
+ * @param layered 1 to create it on the shared base layer of the node
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int create_fleet_container(const struct fleet_node *nodes, int number_of_nodes, const char *container_name, int layered);
+
+/**
+ * @brief Remove a container from the node that has it
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int remove_fleet_container(const struct fleet_node *nodes, int number_of_nodes, const char *container_name);
+
+/**
+ * @brief Run a command in a container of the fleet, or in every running container of every node
+ *
+ * @param container_name name of the container, NULL for every running container
+ * @param command command to run
+ *
+ * @return int 0 if the command succeeded everywhere, -1 otherwise
+ */
+int run_fleet_command(const struct fleet_node *nodes, int number_of_nodes, const char *container_name, const char *command);
+
+/**
+ * @brief Define a limit of system resources of a container of the fleet, or of every running container of every node
+ *
+ * @param container_name name of the container, NULL for every running container
+ * @param cgroup_subsystem cgroup subsystem to limit
+ * @param cgroup_value value of the limit
+ *
+ * @return int 0 if the limit was defined everywhere, -1 otherwise
+ */
+int define_fleet_limits(const struct fleet_node *nodes, int number_of_nodes, const char *container_name, const char *cgroup_subsystem, const char *cgroup_value);
+
+#endif // FLEET_H
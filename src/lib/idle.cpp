@@ -0,0 +1,757 @@
+/**
+ * @file idle.cpp
+ * @brief Automatic freeze/thaw of idle LXC containers
+ *
+ * This file contains the implementation of the idle manager. Every interval it reads the CPU usage (cpu.stat or cpuacct.usage)
+ * and IO bytes (io.stat or blkio.throttle.io_service_bytes) of each running container; a container whose usage stays below
+ * its policy, with no activity recorded by the library, for idle_seconds is frozen with the cgroup freezer.
+ * Activity is the modification time of a file in the directory of the container, so it is shared by every process using the library.
+ * Open sessions hold a shared lock on another file of the container, and the manager only freezes a container whose lock it can take
+ * exclusively, holding it until the freeze is done; a lock dies with its process, so a crashed session never keeps a container awake.
+ * The freeze statistics are updated under an exclusive lock because the manager and the library update them concurrently.
+ *
+ * @author Simão Andrade
+ * @date 2024-06-13
+ */
+
+#include "idle.h"
+#include "lib.h"
+#include "inspect.h"
+#include "trace.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <lxc/lxccontainer.h>
+#include <map>
+#include <string>
+
+/**
+ * @brief Maximum size of a line of the policy and statistics files, and of the statistics file
+ */
+#define IDLE_LINE_SIZE 128
+#define IDLE_STATS_BUFFER_SIZE 1024
+
+/**
+ * @brief Last sample of a running container
+ */
+struct idle_sample
+{
+    double time;                // monotonic time of the sample, in seconds
+    unsigned long long cpu_usec;
+    unsigned long long io_bytes;
+    double idle_since;          // monotonic time at which the container became idle, negative while it is busy
+};
+
+/**
+ * @brief Set by SIGINT and SIGTERM to stop the idle manager
+ */
+static volatile sig_atomic_t idle_manager_stopping = 0;
+
+/**
+ * @brief Current monotonic time in seconds
+ */
+static double monotonic_seconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Build the path of a file in the directory of a container
+ */
+static void get_container_file_path(const char *container_name, const char *file_name, char *path, size_t path_size)
+{
+    snprintf(path, path_size, "%s/%s/%s", get_containers_path(), container_name, file_name);
+}
+
+void idle_default_policy(struct idle_policy *policy)
+{
+    policy->cpu_percent = IDLE_DEFAULT_CPU_PERCENT;
+    policy->io_bytes_per_second = IDLE_DEFAULT_IO_BYTES_PER_SECOND;
+    policy->idle_seconds = IDLE_DEFAULT_SECONDS;
+}
+
+int load_container_idle_policy(const char *container_name, struct idle_policy *policy)
+{
+    char path[FILENAME_MAX], line[IDLE_LINE_SIZE], key[IDLE_LINE_SIZE];
+    double value;
+
+    idle_default_policy(policy);
+
+    get_container_file_path(container_name, IDLE_POLICY_FILE, path, sizeof(path));
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+        return -1;
+
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        if (sscanf(line, " %127[a-z_] = %lf", key, &value) != 2)
+            continue;
+
+        if (strcmp(key, "cpu_percent") == 0)
+            policy->cpu_percent = value;
+        else if (strcmp(key, "io_bytes_per_second") == 0)
+            policy->io_bytes_per_second = (unsigned long long)value;
+        else if (strcmp(key, "idle_seconds") == 0)
+            policy->idle_seconds = (unsigned int)value;
+    }
+
+    fclose(file);
+    return 0;
+}
+
+int set_container_idle_policy(const char *container_name, const struct idle_policy *policy)
+{
+    char path[FILENAME_MAX], log_message[LOG_MESSAGE_SIZE] = {0};
+
+    if (policy->cpu_percent < 0 || policy->idle_seconds == 0)
+    {
+        fprintf(stderr, "The CPU threshold must be positive and the idle time at least 1 second\n");
+        return -1;
+    }
+
+    get_container_file_path(container_name, IDLE_POLICY_FILE, path, sizeof(path));
+    FILE *file = fopen(path, "w");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Failed to save the idle policy of container %s\n", container_name);
+        return -1;
+    }
+
+    fprintf(file, "# Idle policy: frozen after idle_seconds below both thresholds\n");
+    fprintf(file, "cpu_percent = %g\n", policy->cpu_percent);
+    fprintf(file, "io_bytes_per_second = %llu\n", policy->io_bytes_per_second);
+    fprintf(file, "idle_seconds = %u\n", policy->idle_seconds);
+
+    if (fclose(file) != 0)
+        return -1;
+
+    snprintf(log_message, LOG_MESSAGE_SIZE, "Idle policy of container %s set (%g%% CPU, %u s)", container_name, policy->cpu_percent, policy->idle_seconds);
+    log_activity("INFO", "idle", container_name, log_message);
+
+    return 0;
+}
+
+/**
+ * @brief Parse the statistics file
+ */
+static void parse_idle_stats(const char *content, struct idle_stats *stats)
+{
+    char key[IDLE_LINE_SIZE];
+    long long value;
+    int consumed = 0;
+
+    memset(stats, 0, sizeof(*stats));
+    for (const char *line = content; sscanf(line, " %127[a-z_] = %lld%n", key, &value, &consumed) == 2; line += consumed)
+    {
+        if (strcmp(key, "freezes") == 0)
+            stats->freezes = value;
+        else if (strcmp(key, "thaws") == 0)
+            stats->thaws = value;
+        else if (strcmp(key, "last_thaw_latency_us") == 0)
+            stats->last_thaw_latency_us = value;
+        else if (strcmp(key, "max_thaw_latency_us") == 0)
+            stats->max_thaw_latency_us = value;
+        else if (strcmp(key, "total_thaw_latency_us") == 0)
+            stats->total_thaw_latency_us = value;
+        else if (strcmp(key, "frozen_seconds") == 0)
+            stats->frozen_seconds = value;
+        else if (strcmp(key, "frozen_since") == 0)
+            stats->frozen_since = value;
+    }
+}
+
+/**
+ * @brief Open and lock the statistics file of a container, and load its statistics
+ *
+ * @return int locked file descriptor, -1 on failure
+ */
+static int lock_idle_stats(const char *container_name, struct idle_stats *stats)
+{
+    char path[FILENAME_MAX], content[IDLE_STATS_BUFFER_SIZE];
+
+    get_container_file_path(container_name, IDLE_STATS_FILE, path, sizeof(path));
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return -1;
+
+    if (flock(fd, LOCK_EX) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    ssize_t length = pread(fd, content, sizeof(content) - 1, 0);
+    content[length > 0 ? length : 0] = '\0';
+    parse_idle_stats(content, stats);
+
+    return fd;
+}
+
+/**
+ * @brief Write the statistics of a container and release the lock
+ *
+ * @return int 0 on success, -1 on failure
+ */
+static int save_idle_stats(int fd, const struct idle_stats *stats)
+{
+    char content[IDLE_STATS_BUFFER_SIZE];
+
+    int length = snprintf(content, sizeof(content),
+                          "freezes = %llu\nthaws = %llu\nlast_thaw_latency_us = %llu\nmax_thaw_latency_us = %llu\n"
+                          "total_thaw_latency_us = %llu\nfrozen_seconds = %llu\nfrozen_since = %lld\n",
+                          stats->freezes, stats->thaws, stats->last_thaw_latency_us, stats->max_thaw_latency_us,
+                          stats->total_thaw_latency_us, stats->frozen_seconds, stats->frozen_since);
+
+    int result = ftruncate(fd, 0) == 0 && pwrite(fd, content, length, 0) == length ? 0 : -1;
+    close(fd); // releases the lock
+    return result;
+}
+
+int load_container_idle_stats(const char *container_name, struct idle_stats *stats)
+{
+    char path[FILENAME_MAX], content[IDLE_STATS_BUFFER_SIZE];
+
+    memset(stats, 0, sizeof(*stats));
+
+    get_container_file_path(container_name, IDLE_STATS_FILE, path, sizeof(path));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return errno == ENOENT ? 0 : -1;
+
+    flock(fd, LOCK_SH);
+    ssize_t length = pread(fd, content, sizeof(content) - 1, 0);
+    close(fd);
+
+    content[length > 0 ? length : 0] = '\0';
+    parse_idle_stats(content, stats);
+    return 0;
+}
+
+int mark_container_activity(const char *container_name)
+{
+    char path[FILENAME_MAX];
+
+    get_container_file_path(container_name, IDLE_ACTIVITY_FILE, path, sizeof(path));
+    int fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return -1;
+
+    int result = futimens(fd, NULL); // now
+    close(fd);
+    return result;
+}
+
+int open_container_session(const char *container_name)
+{
+    char path[FILENAME_MAX];
+
+    get_container_file_path(container_name, IDLE_SESSION_FILE, path, sizeof(path));
+    int fd = open(path, O_RDONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return -1;
+
+    // Waits only while the manager is freezing the container, the caller thaws it right after
+    while (flock(fd, LOCK_SH) < 0)
+    {
+        if (errno != EINTR)
+        {
+            close(fd);
+            return -1;
+        }
+    }
+
+    return fd;
+}
+
+void close_container_session(int session_fd)
+{
+    if (session_fd >= 0)
+        close(session_fd);
+}
+
+/**
+ * @brief Take the session lock of a container exclusively, which fails while a session is open
+ *
+ * @return int descriptor holding the lock, -1 if a session is open or the lock cannot be taken
+ */
+static int lock_container_sessions(const char *container_name)
+{
+    char path[FILENAME_MAX];
+
+    get_container_file_path(container_name, IDLE_SESSION_FILE, path, sizeof(path));
+    int fd = open(path, O_RDONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return -1;
+
+    if (flock(fd, LOCK_EX | LOCK_NB) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/**
+ * @brief Get the time of the last activity on a container
+ *
+ * @return time_t seconds since the epoch, 0 if there was none
+ */
+static time_t get_last_activity(const char *container_name)
+{
+    char path[FILENAME_MAX];
+    struct stat info;
+
+    get_container_file_path(container_name, IDLE_ACTIVITY_FILE, path, sizeof(path));
+    return stat(path, &info) == 0 ? info.st_mtime : 0;
+}
+
+/**
+ * @brief Check if a container is frozen or being frozen
+ */
+static bool is_frozen(struct lxc_container *container)
+{
+    const char *state = container->state(container);
+    return state != NULL && (strcmp(state, "FROZEN") == 0 || strcmp(state, "FREEZING") == 0);
+}
+
+/**
+ * @brief Freeze a container and record it
+ *
+ * @return int 0 on success, -1 on failure
+ */
+static int freeze_container(struct lxc_container *container, const char *container_name, const char *reason)
+{
+    char log_message[LOG_MESSAGE_SIZE] = {0};
+    struct idle_stats stats;
+
+    if (!TRACE_CALL("lxc.freeze", container_name, container->freeze(container)))
+    {
+        fprintf(stderr, "Failed to freeze container %s: %s\n", container_name, container->error_string ? container->error_string : "unknown error");
+        return -1;
+    }
+
+    int fd = lock_idle_stats(container_name, &stats);
+    if (fd >= 0)
+    {
+        stats.freezes++;
+        stats.frozen_since = (long long)time(NULL);
+        save_idle_stats(fd, &stats);
+    }
+
+    printf("Container %s frozen (%s)\n", container_name, reason);
+    snprintf(log_message, LOG_MESSAGE_SIZE, "Container %s frozen (%s)", container_name, reason);
+    log_activity("INFO", "idle", container_name, log_message);
+
+    return 0;
+}
+
+/**
+ * @brief Thaw a container and record how long it took
+ *
+ * @return int 0 on success, -1 on failure
+ */
+static int thaw_container(struct lxc_container *container, const char *container_name)
+{
+    char log_message[LOG_MESSAGE_SIZE] = {0};
+    struct idle_stats stats;
+
+    // liblxc returns once the freezer reports the cgroup as thawed
+    double start = monotonic_seconds();
+    bool thawed = TRACE_CALL("lxc.unfreeze", container_name, container->unfreeze(container));
+    unsigned long long latency_us = (unsigned long long)((monotonic_seconds() - start) * 1e6);
+
+    if (!thawed)
+    {
+        fprintf(stderr, "Failed to thaw container %s: %s\n", container_name, container->error_string ? container->error_string : "unknown error");
+        return -1;
+    }
+
+    int fd = lock_idle_stats(container_name, &stats);
+    if (fd >= 0)
+    {
+        stats.thaws++;
+        stats.last_thaw_latency_us = latency_us;
+        stats.total_thaw_latency_us += latency_us;
+        if (latency_us > stats.max_thaw_latency_us)
+            stats.max_thaw_latency_us = latency_us;
+        if (stats.frozen_since > 0)
+            stats.frozen_seconds += (unsigned long long)(time(NULL) - stats.frozen_since);
+        stats.frozen_since = 0;
+        save_idle_stats(fd, &stats);
+    }
+
+    snprintf(log_message, LOG_MESSAGE_SIZE, "Container %s thawed in %llu us", container_name, latency_us);
+    log_activity("INFO", "idle", container_name, log_message);
+
+    return 0;
+}
+
+int wake_idle_container(struct lxc_container *container)
+{
+    TRACE_SPAN_ARGUMENT("wake_idle_container", container->name);
+
+    mark_container_activity(container->name);
+
+    if (!container->is_running(container) || !is_frozen(container))
+        return 0;
+
+    return thaw_container(container, container->name);
+}
+
+int freeze_idle_container(const char *container_name)
+{
+    TRACE_SPAN_ARGUMENT("freeze_idle_container", container_name);
+    struct lxc_container *container;
+    int result = -1;
+
+    container = lxc_container_new(container_name, get_containers_path());
+    if (container == NULL)
+    {
+        fprintf(stderr, "Failed to setup lxc_container struct\n");
+        return -1;
+    }
+
+    if (!container->is_running(container) || is_frozen(container))
+    {
+        fprintf(stderr, "Container %s is not running or already frozen\n", container_name);
+        goto out;
+    }
+
+    result = freeze_container(container, container_name, "on request");
+
+out:
+    lxc_container_put(container);
+    return result;
+}
+
+int thaw_idle_container(const char *container_name)
+{
+    TRACE_SPAN_ARGUMENT("thaw_idle_container", container_name);
+    struct lxc_container *container;
+    int result = -1;
+
+    container = lxc_container_new(container_name, get_containers_path());
+    if (container == NULL)
+    {
+        fprintf(stderr, "Failed to setup lxc_container struct\n");
+        return -1;
+    }
+
+    if (!container->is_running(container) || !is_frozen(container))
+    {
+        fprintf(stderr, "Container %s is not frozen\n", container_name);
+        goto out;
+    }
+
+    mark_container_activity(container_name);
+    result = thaw_container(container, container_name);
+    if (result == 0)
+        printf("Container %s thawed\n", container_name);
+
+out:
+    lxc_container_put(container);
+    return result;
+}
+
+int clear_container_idle_policy(const char *container_name)
+{
+    char path[FILENAME_MAX], log_message[LOG_MESSAGE_SIZE] = {0};
+    struct lxc_container *container;
+
+    get_container_file_path(container_name, IDLE_POLICY_FILE, path, sizeof(path));
+    if (unlink(path) < 0 && errno != ENOENT)
+    {
+        fprintf(stderr, "Failed to remove the idle policy of container %s\n", container_name);
+        return -1;
+    }
+
+    container = lxc_container_new(container_name, get_containers_path());
+    if (container != NULL)
+    {
+        wake_idle_container(container);
+        lxc_container_put(container);
+    }
+
+    snprintf(log_message, LOG_MESSAGE_SIZE, "Idle policy of container %s removed", container_name);
+    log_activity("INFO", "idle", container_name, log_message);
+
+    return 0;
+}
+
+/**
+ * @brief Read the CPU time used by a container, in microseconds
+ *
+ * @return int 0 on success, -1 on failure
+ */
+static int read_cpu_usage(struct lxc_container *container, unsigned long long *usage_usec)
+{
+    char *value = read_cgroup_item(container, "cpu.stat");
+    char *usage = value != NULL ? strstr(value, "usage_usec ") : NULL;
+    int result = 0;
+
+    if (usage != NULL)
+    {
+        *usage_usec = strtoull(usage + strlen("usage_usec "), NULL, 10);
+    }
+    else
+    {
+        // cgroup v1: cpu.stat has no usage, cpuacct.usage is in nanoseconds
+        free(value);
+        value = read_cgroup_item(container, "cpuacct.usage");
+        if (value != NULL)
+            *usage_usec = strtoull(value, NULL, 10) / 1000;
+        else
+            result = -1;
+    }
+
+    free(value);
+    return result;
+}
+
+/**
+ * @brief Read the bytes read and written by a container
+ *
+ * @return int 0 on success, -1 on failure
+ */
+static int read_io_bytes(struct lxc_container *container, unsigned long long *bytes)
+{
+    char *value = read_cgroup_item(container, "io.stat");
+
+    *bytes = 0;
+    if (value != NULL)
+    {
+        // "8:0 rbytes=1 wbytes=2 rios=3 wios=4 ..." for each device
+        for (char *field = value; (field = strstr(field, "bytes=")) != NULL; field += strlen("bytes="))
+            *bytes += strtoull(field + strlen("bytes="), NULL, 10);
+        free(value);
+        return 0;
+    }
+
+    // cgroup v1: the last line is "Total <bytes>"
+    value = read_cgroup_item(container, "blkio.throttle.io_service_bytes");
+    if (value == NULL)
+        return -1;
+
+    char *total = strstr(value, "Total ");
+    if (total != NULL)
+        *bytes = strtoull(total + strlen("Total "), NULL, 10);
+
+    free(value);
+    return 0;
+}
+
+/**
+ * @brief Stop the idle manager on SIGINT and SIGTERM
+ */
+static void stop_idle_manager(int signal_number)
+{
+    (void)signal_number;
+    idle_manager_stopping = 1;
+}
+
+/**
+ * @brief Sample a running container and freeze it if it has been idle for long enough
+ *
+ * @param sample previous sample of the container, updated
+ * @param has_sample false for the first sample of the container
+ *
+ * @return bool true if the container was frozen
+ */
+static bool check_idle_container(struct lxc_container *container, const char *container_name, const struct idle_policy *policy, struct idle_sample *sample, bool has_sample)
+{
+    char reason[LOG_MESSAGE_SIZE];
+    unsigned long long cpu_usec = 0, io_bytes = 0;
+    double now = monotonic_seconds();
+
+    if (read_cpu_usage(container, &cpu_usec) < 0)
+        return false;
+    read_io_bytes(container, &io_bytes); // a container without IO accounting only counts CPU
+
+    if (has_sample && now > sample->time)
+    {
+        double elapsed = now - sample->time;
+        double cpu_percent = (cpu_usec - sample->cpu_usec) / 1e6 / elapsed * 100;
+        double io_rate = (io_bytes - sample->io_bytes) / elapsed;
+        bool recent_activity = (double)(time(NULL) - get_last_activity(container_name)) < elapsed;
+        int sessions_fd = lock_container_sessions(container_name); // -1 while a console, command or job is open
+
+        if (cpu_percent <= policy->cpu_percent && io_rate <= policy->io_bytes_per_second && !recent_activity && sessions_fd >= 0)
+        {
+            if (sample->idle_since < 0)
+                sample->idle_since = sample->time;
+
+            if (now - sample->idle_since >= policy->idle_seconds)
+            {
+                snprintf(reason, sizeof(reason), "idle for %.0f s", now - sample->idle_since);
+                bool frozen = freeze_container(container, container_name, reason) == 0;
+                close(sessions_fd); // a session waiting for the lock thaws the container now
+                return frozen;
+            }
+        }
+        else
+        {
+            sample->idle_since = -1;
+        }
+
+        if (sessions_fd >= 0)
+            close(sessions_fd);
+    }
+    else
+    {
+        sample->idle_since = -1;
+    }
+
+    sample->time = now;
+    sample->cpu_usec = cpu_usec;
+    sample->io_bytes = io_bytes;
+    return false;
+}
+
+int run_idle_manager(const struct idle_policy *default_policy, int interval_seconds)
+{
+    TRACE_SPAN("run_idle_manager");
+    std::map<std::string, struct idle_sample> samples;
+    struct sigaction action;
+
+    if (interval_seconds <= 0)
+        interval_seconds = IDLE_DEFAULT_CHECK_INTERVAL;
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stop_idle_manager;
+    idle_manager_stopping = 0;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    printf("Idle manager sampling every %d s%s, press Ctrl-C to stop\n", interval_seconds, default_policy != NULL ? " (every container)" : " (containers with a policy)");
+
+    while (!idle_manager_stopping)
+    {
+        std::map<std::string, struct idle_sample> current_samples;
+        struct lxc_container **containers = NULL;
+        char **containers_names = NULL;
+
+        int number_of_active_containers = list_active_containers(get_containers_path(), &containers_names, &containers);
+        for (int index = 0; index < number_of_active_containers; index++)
+        {
+            struct idle_policy policy;
+            const char *container_name = containers_names[index];
+
+            bool managed = load_container_idle_policy(container_name, &policy) == 0;
+            if (!managed && default_policy != NULL)
+            {
+                policy = *default_policy;
+                managed = true;
+            }
+
+            if (managed && !is_frozen(containers[index]))
+            {
+                auto previous = samples.find(container_name);
+                struct idle_sample sample = previous != samples.end() ? previous->second : idle_sample{0, 0, 0, -1};
+
+                // A frozen container starts a new idle period once thawed
+                if (!check_idle_container(containers[index], container_name, &policy, &sample, previous != samples.end()))
+                    current_samples[container_name] = sample;
+            }
+
+            free(containers_names[index]);
+            lxc_container_put(containers[index]);
+        }
+        free(containers_names);
+        free(containers);
+
+        samples.swap(current_samples);
+        sleep(interval_seconds); // interrupted by the signals
+    }
+
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    printf("Idle manager stopped\n");
+
+    return 0;
+}
+
+/**
+ * @brief Print the idle status of a container
+ */
+static void print_idle_status(struct lxc_container *container, const char *container_name)
+{
+    struct idle_policy policy;
+    struct idle_stats stats;
+    bool has_policy = load_container_idle_policy(container_name, &policy) == 0;
+
+    load_container_idle_stats(container_name, &stats);
+
+    printf("--- Container %s ---\n", container_name);
+    if (container->is_running(container) && is_frozen(container))
+        printf("State: FROZEN%s\n", stats.frozen_since > 0 ? "" : " (outside the idle manager)");
+    else
+        printf("State: %s\n", container->state(container));
+
+    if (has_policy)
+        printf("Policy: frozen after %u s below %g%% CPU and %llu B/s of IO\n", policy.idle_seconds, policy.cpu_percent, policy.io_bytes_per_second);
+    else
+        printf("Policy: none\n");
+
+    time_t last_activity = get_last_activity(container_name);
+    if (last_activity > 0)
+        printf("Last activity: %lld s ago\n", (long long)(time(NULL) - last_activity));
+
+    unsigned long long frozen_seconds = stats.frozen_seconds + (stats.frozen_since > 0 ? (unsigned long long)(time(NULL) - stats.frozen_since) : 0);
+    printf("Freezes: %llu, thaws: %llu, time frozen: %llu s\n", stats.freezes, stats.thaws, frozen_seconds);
+    if (stats.thaws > 0)
+        printf("Thaw latency: last %.2f ms, average %.2f ms, max %.2f ms\n", stats.last_thaw_latency_us / 1000.0,
+               stats.total_thaw_latency_us / 1000.0 / stats.thaws, stats.max_thaw_latency_us / 1000.0);
+    printf("\n");
+}
+
+int show_idle_status(const char *container_name)
+{
+    struct lxc_container **containers = NULL;
+    char **containers_names = NULL, path[FILENAME_MAX];
+
+    if (container_name != NULL)
+    {
+        struct lxc_container *container = lxc_container_new(container_name, get_containers_path());
+        if (container == NULL || !container->is_defined(container))
+        {
+            fprintf(stderr, "Container does not exist\n");
+            if (container != NULL)
+                lxc_container_put(container);
+            return -1;
+        }
+
+        print_idle_status(container, container_name);
+        lxc_container_put(container);
+        return 0;
+    }
+
+    int number_of_containers = list_defined_containers(get_containers_path(), &containers_names, &containers);
+    for (int index = 0; index < number_of_containers; index++)
+    {
+        // Only the containers the idle manager knows about
+        get_container_file_path(containers_names[index], IDLE_POLICY_FILE, path, sizeof(path));
+        bool known = access(path, F_OK) == 0;
+        get_container_file_path(containers_names[index], IDLE_STATS_FILE, path, sizeof(path));
+        known = known || access(path, F_OK) == 0;
+
+        if (known)
+            print_idle_status(containers[index], containers_names[index]);
+
+        free(containers_names[index]);
+        lxc_container_put(containers[index]);
+    }
+    free(containers_names);
+    free(containers);
+
+    return 0;
+}
@@ -0,0 +1,184 @@
+#ifndef IDLE_H
+#define IDLE_H
+
+/**
+ * @file idle.h
+ * @brief This file contains the definitions of the functions used in idle.cpp regarding freezing idle LXC containers
+ *
+ * The idle manager samples the CPU and IO counters of the cgroup of each container and freezes, with the cgroup freezer,
+ * the containers that stayed below the thresholds of their policy with no console or exec activity for long enough.
+ * A container with an open session (console, relay viewer, command or job) is never frozen, however quiet it is.
+ * The library thaws a frozen container transparently before running a command in it, connecting to it or copying a file to it,
+ * and records how long each thaw took
+ *
+ * @author Simão Andrade
+ * @date 2024-06-13
+ */
+
+/**
+ * @brief Files, in the directory of a container, holding its idle policy, its freeze statistics, the time of its last activity
+ * and the lock held by its open sessions
+ */
+#define IDLE_POLICY_FILE "idle-policy.conf"
+#define IDLE_STATS_FILE "idle-stats.conf"
+#define IDLE_ACTIVITY_FILE "idle.activity"
+#define IDLE_SESSION_FILE "idle.session"
+
+/**
+ * @brief Default policy: a container using less than 1% of a CPU and 4 KB/s of IO for 5 minutes is frozen
+ */
+#define IDLE_DEFAULT_CPU_PERCENT 1.0
+#define IDLE_DEFAULT_IO_BYTES_PER_SECOND 4096
+#define IDLE_DEFAULT_SECONDS 300
+
+/**
+ * @brief Default time between two samples of the idle manager, in seconds
+ */
+#define IDLE_DEFAULT_CHECK_INTERVAL 10
+
+struct lxc_container;
+
+/**
+ * @brief When a container counts as idle
+ */
+struct idle_policy
+{
+    double cpu_percent;                        // CPU usage, in percent of one CPU, below which the container is idle
+    unsigned long long io_bytes_per_second;    // IO below which the container is idle
+    unsigned int idle_seconds;                 // time a container must stay idle before being frozen
+};
+
+/**
+ * @brief Freeze statistics of a container
+ */
+struct idle_stats
+{
+    unsigned long long freezes;
+    unsigned long long thaws;
+    unsigned long long last_thaw_latency_us;
+    unsigned long long max_thaw_latency_us;
+    unsigned long long total_thaw_latency_us;
+    unsigned long long frozen_seconds;         // total time spent frozen, not counting the current freeze
+    long long frozen_since;                    // seconds since the epoch, 0 when not frozen by the idle manager
+};
+
+/**
+ * @brief Fill a policy with the defaults
+ *
+ * @param policy policy to fill
+ */
+void idle_default_policy(struct idle_policy *policy);
+
+/**
+ * @brief Save the idle policy of a LXC container, the idle manager only freezes containers with a policy unless told to manage them all
+ *
+ * @param container_name name of the container
+ * @param policy policy to save
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int set_container_idle_policy(const char *container_name, const struct idle_policy *policy);
+
+/**
+ * @brief Remove the idle policy of a LXC container, thawing it if it is frozen
+ *
+ * @param container_name name of the container
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int clear_container_idle_policy(const char *container_name);
+
+/**
+ * @brief Load the idle policy of a LXC container
+ *
+ * @param container_name name of the container
+ * @param policy loaded policy, the defaults if the container has none
+ *
+ * @return int 0 if the container has a policy, -1 otherwise
+ */
+int load_container_idle_policy(const char *container_name, struct idle_policy *policy);
+
+/**
+ * @brief Load the freeze statistics of a LXC container
+ *
+ * @param container_name name of the container
+ * @param stats loaded statistics, all zero if the container was never frozen
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int load_container_idle_stats(const char *container_name, struct idle_stats *stats);
+
+/**
+ * @brief Record console or exec activity on a LXC container, which restarts its idle period
+ *
+ * @param container_name name of the container
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int mark_container_activity(const char *container_name);
+
+/**
+ * @brief Open a session on a LXC container, the idle manager does not freeze it until the session is closed
+ *
+ * Called before the container is woken up, so the manager cannot freeze it between the thaw and the start of the session
+ *
+ * @param container_name name of the container
+ *
+ * @return int descriptor of the session, -1 on failure (the container is then only protected by its activity time)
+ */
+int open_container_session(const char *container_name);
+
+/**
+ * @brief Close a session opened with open_container_session
+ *
+ * @param session_fd descriptor of the session, -1 is ignored
+ */
+void close_container_session(int session_fd);
+
+/**
+ * @brief Thaw a LXC container if it is frozen and record the activity, called before using a container
+ *
+ * @param container container about to be used
+ *
+ * @return int 0 on success (or if the container was not frozen), -1 on failure
+ */
+int wake_idle_container(struct lxc_container *container);
+
+/**
+ * @brief Freeze a running LXC container now
+ *
+ * @param container_name name of the container
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int freeze_idle_container(const char *container_name);
+
+/**
+ * @brief Thaw a frozen LXC container now
+ *
+ * @param container_name name of the container
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int thaw_idle_container(const char *container_name);
+
+/**
+ * @brief Sample the running containers and freeze the idle ones until interrupted
+ *
+ * @param default_policy policy of the containers without one, NULL to only manage the containers with a policy
+ * @param interval_seconds time between two samples
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int run_idle_manager(const struct idle_policy *default_policy, int interval_seconds);
+
+/**
+ * @brief Show the state, policy and freeze statistics (thaw latency) of a LXC container, or of every container with statistics
+ *
+ * @param container_name name of the container, NULL for every container
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int show_idle_status(const char *container_name);
+
+#endif // IDLE_H
@@ -0,0 +1,487 @@
+/**
+ * @file inspect.cpp
+ * @brief Offline inspection of LXC containers
+ *
+ * This file contains the implementation of the functions that inspect containers from their on-disk config.
+ * Nothing here starts a container: cgroup limits, rootfs and network configuration are read from the config file
+ * and the configs of the whole lxcpath are parsed in parallel.
+ *
+ * @author Simão Andrade
+ * @date 2024-06-13
+ */
+
+#include "inspect.h"
+#include "lib.h"
+#include "trace.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <ftw.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <lxc/lxccontainer.h>
+#include <atomic>
+#include <thread>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+/**
+ * @brief Maximum size of a line of a config file
+ */
+#define CONFIG_LINE_SIZE 512
+
+/**
+ * @brief Maximum number of file descriptors used by nftw while walking a rootfs
+ */
+#define ROOTFS_WALK_MAX_FDS 16
+
+/**
+ * @brief Accumulator of the rootfs walk, one per thread since nftw has no user data argument
+ */
+static thread_local unsigned long long rootfs_walk_total = 0;
+
+/**
+ * @brief lxcpath set with set_containers_path(), empty for the one of the LXC configuration
+ */
+static char containers_path_override[FILENAME_MAX];
+
+const char *get_containers_path(void)
+{
+    if (containers_path_override[0] != '\0')
+        return containers_path_override;
+    return lxc_get_global_config_item("lxc.lxcpath");
+}
+
+int set_containers_path(const char *path)
+{
+    if (path != NULL && strlen(path) >= sizeof(containers_path_override))
+    {
+        fprintf(stderr, "The containers path is too long\n");
+        return -1;
+    }
+
+    snprintf(containers_path_override, sizeof(containers_path_override), "%s", path != NULL ? path : "");
+    return 0;
+}
+
+const char *get_cgroup_config_prefix(void)
+{
+    return access("/sys/fs/cgroup/cgroup.controllers", F_OK) == 0 ? "lxc.cgroup2." : "lxc.cgroup.";
+}
+
+/**
+ * @brief Conversion of the value of a cgroup limit between the two cgroup versions
+ */
+enum limit_conversion
+{
+    LIMIT_SAME,         // same meaning and range
+    LIMIT_MAX,          // -1 (unlimited) on v1 is "max" on v2
+    LIMIT_CPU_QUOTA,    // cpu.cfs_quota_us on v1, "quota period" in cpu.max on v2 (with the default period)
+    LIMIT_CPU_WEIGHT,   // cpu.shares (2..262144) on v1, cpu.weight (1..10000) on v2
+    LIMIT_BLKIO_WEIGHT, // blkio.weight (10..1000) on v1, io.weight (1..10000) on v2
+};
+
+/**
+ * @brief Limits that have another name on the other cgroup version
+ */
+static const struct
+{
+    const char *v1_name;
+    const char *v2_name;
+    enum limit_conversion conversion;
+} cgroup_limit_names[] = {
+    {"memory.limit_in_bytes", "memory.max", LIMIT_MAX},
+    {"memory.soft_limit_in_bytes", "memory.low", LIMIT_MAX},
+    {"cpu.cfs_quota_us", "cpu.max", LIMIT_CPU_QUOTA},
+    {"cpu.shares", "cpu.weight", LIMIT_CPU_WEIGHT},
+    {"blkio.weight", "io.weight", LIMIT_BLKIO_WEIGHT},
+};
+
+/**
+ * @brief Default period of the CPU bandwidth controller, in microseconds
+ */
+#define CPU_PERIOD_DEFAULT 100000
+
+/**
+ * @brief Convert the value of a limit to the cgroup version of the host (only LIMIT_MAX is converted from v2 to v1)
+ *
+ * @param cgroup2 1 to convert a cgroup v1 value to cgroup v2, 0 for the opposite
+ *
+ * @return int 0 on success, -1 if the value is invalid or does not fit
+ */
+static int convert_limit_value(enum limit_conversion conversion, int cgroup2, const char *value, char *host_value, size_t size)
+{
+    char *end;
+    long long number = strtoll(value, &end, 10);
+    int numeric = end != value, length;
+
+    while (isspace((unsigned char)*end))
+        end++;
+    numeric = numeric && *end == 0;
+
+    if (conversion == LIMIT_MAX && !cgroup2 && strcmp(value, "max") == 0)
+        length = snprintf(host_value, size, "-1");
+    else if (conversion == LIMIT_SAME || (conversion == LIMIT_MAX && (!numeric || !cgroup2)))
+        length = snprintf(host_value, size, "%s", value);
+    else if (!numeric)
+        return -1;
+    else if (conversion == LIMIT_MAX)
+        length = number < 0 ? snprintf(host_value, size, "max") : snprintf(host_value, size, "%lld", number);
+    else if (conversion == LIMIT_CPU_QUOTA)
+        length = number < 0 ? snprintf(host_value, size, "max %d", CPU_PERIOD_DEFAULT) : snprintf(host_value, size, "%lld %d", number, CPU_PERIOD_DEFAULT);
+    else if (conversion == LIMIT_CPU_WEIGHT) // the formula used by systemd and runc
+        length = snprintf(host_value, size, "%lld", 1 + ((std::clamp(number, 2LL, 262144LL) - 2) * 9999) / 262142);
+    else
+        length = snprintf(host_value, size, "%lld", 1 + ((std::clamp(number, 10LL, 1000LL) - 10) * 9999) / 990);
+
+    return length > 0 && (size_t)length < size ? 0 : -1;
+}
+
+/**
+ * @brief Check if a controller is enabled in the cgroup v2 hierarchy of this host
+ */
+static int has_cgroup2_controller(const char *subsystem)
+{
+    char line[CONFIG_LINE_SIZE], controller[INSPECT_KEY_SIZE];
+    size_t length = strcspn(subsystem, ".");
+    int found = 0;
+
+    if (length == 0 || length >= sizeof(controller) || subsystem[length] != '.')
+        return 0;
+    memcpy(controller, subsystem, length);
+    controller[length] = 0;
+
+    FILE *file = fopen("/sys/fs/cgroup/cgroup.controllers", "r");
+    if (file == NULL)
+        return 0;
+
+    if (fgets(line, sizeof(line), file) != NULL)
+        for (char *saveptr = NULL, *token = strtok_r(line, " \n", &saveptr); token != NULL && !found; token = strtok_r(NULL, " \n", &saveptr))
+            found = strcmp(token, controller) == 0;
+    fclose(file);
+
+    return found;
+}
+
+int resolve_cgroup_limit(const char *subsystem, const char *value, char *host_subsystem, size_t subsystem_size, char *host_value, size_t value_size)
+{
+    char path[CONFIG_LINE_SIZE];
+    int cgroup2 = strcmp(get_cgroup_config_prefix(), "lxc.cgroup2.") == 0;
+    enum limit_conversion conversion = LIMIT_SAME;
+    const char *name = subsystem;
+
+    if (subsystem[0] == 0 || subsystem[0] == '.' || strchr(subsystem, '/') != NULL)
+        return -1;
+
+    for (const auto &names : cgroup_limit_names)
+    {
+        if (cgroup2 && strcmp(subsystem, names.v1_name) == 0)
+        {
+            name = names.v2_name;
+            conversion = names.conversion;
+        }
+        else if (!cgroup2 && strcmp(subsystem, names.v2_name) == 0 && names.conversion == LIMIT_MAX)
+        {
+            name = names.v1_name;
+            conversion = LIMIT_MAX;
+        }
+    }
+
+    if (cgroup2)
+    {
+        // The interface files of a controller only exist below the root cgroup, so the controller is what can be checked
+        if (!has_cgroup2_controller(name) || strstr(name, "_in_bytes") != NULL || strstr(name, "_us") != NULL || strstr(name, ".memsw.") != NULL)
+            return -1;
+    }
+    else
+    {
+        // Every cgroup v1 hierarchy has the files of its controllers in its root
+        snprintf(path, sizeof(path), "/sys/fs/cgroup/%.*s/%s", (int)strcspn(name, "."), name, name);
+        if (access(path, F_OK) < 0)
+            return -1;
+    }
+
+    if (snprintf(host_subsystem, subsystem_size, "%s", name) >= (int)subsystem_size)
+        return -1;
+
+    return value == NULL ? 0 : convert_limit_value(conversion, cgroup2, value, host_value, value_size);
+}
+
+/**
+ * @brief Remove leading and trailing whitespace of a string in place
+ *
+ * @param text string to trim
+ *
+ * @return char* pointer to the first non whitespace character
+ */
+static char *trim(char *text)
+{
+    while (isspace((unsigned char)*text))
+        text++;
+
+    char *end = text + strlen(text);
+    while (end > text && isspace((unsigned char)end[-1]))
+        end--;
+    *end = '\0';
+
+    return text;
+}
+
+/**
+ * @brief Store a key/value pair in a list of config entries, ignoring it when the list is full
+ */
+static void add_config_entry(struct config_entry *entries, int *number_of_entries, const char *key, const char *value)
+{
+    if (*number_of_entries >= INSPECT_MAX_ENTRIES)
+        return;
+
+    snprintf(entries[*number_of_entries].key, INSPECT_KEY_SIZE, "%s", key);
+    snprintf(entries[*number_of_entries].value, INSPECT_VALUE_SIZE, "%s", value);
+    (*number_of_entries)++;
+}
+
+int parse_container_config(const char *config_path, struct container_inspection *inspection)
+{
+    char line[CONFIG_LINE_SIZE];
+
+    FILE *file = fopen(config_path, "r");
+    if (file == NULL)
+        return -1;
+
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        char *key = trim(line);
+        if (*key == '#' || *key == '\0') // comment or empty line
+            continue;
+
+        char *separator = strchr(key, '=');
+        if (separator == NULL)
+            continue;
+
+        *separator = '\0';
+        char *value = trim(separator + 1);
+        key = trim(key);
+
+        if (strncmp(key, "lxc.cgroup.", 11) == 0 || strncmp(key, "lxc.cgroup2.", 12) == 0)
+        {
+            add_config_entry(inspection->cgroup_limits, &inspection->number_of_cgroup_limits, key, value);
+        }
+        else if (strncmp(key, "lxc.net.", 8) == 0 || strncmp(key, "lxc.network.", 12) == 0)
+        {
+            add_config_entry(inspection->network, &inspection->number_of_network_entries, key, value);
+        }
+        else if (strcmp(key, "lxc.rootfs.path") == 0 || strcmp(key, "lxc.rootfs") == 0)
+        {
+            const char *path = value;
+            if (strncmp(path, "dir:", 4) == 0) // strip the storage backend
+                path += 4;
+            snprintf(inspection->rootfs_path, INSPECT_VALUE_SIZE, "%s", path);
+        }
+    }
+
+    fclose(file);
+    return 0;
+}
+
+/**
+ * @brief nftw callback adding the disk usage of each entry to the thread accumulator
+ */
+static int add_rootfs_entry_size(const char *path, const struct stat *info, int type, struct FTW *ftw_buffer)
+{
+    (void)path;
+    (void)type;
+    (void)ftw_buffer;
+
+    rootfs_walk_total += (unsigned long long)info->st_blocks * 512;
+    return 0;
+}
+
+unsigned long long get_rootfs_size(const char *rootfs_path)
+{
+    struct stat info;
+
+    // Only the upper layer of an overlay rootfs belongs to the container, the lower layer is shared
+    if (strncmp(rootfs_path, "overlay:", 8) == 0 || strncmp(rootfs_path, "overlayfs:", 10) == 0)
+        rootfs_path = strrchr(rootfs_path, ':') + 1;
+
+    if (rootfs_path[0] != '/' || stat(rootfs_path, &info) < 0 || !S_ISDIR(info.st_mode))
+        return 0;
+
+    rootfs_walk_total = 0;
+    nftw(rootfs_path, add_rootfs_entry_size, ROOTFS_WALK_MAX_FDS, FTW_PHYS | FTW_MOUNT);
+    return rootfs_walk_total;
+}
+
+/**
+ * @brief Fill the inspection of a container stored in the lxcpath
+ *
+ * @return int 0 on success, -1 on failure
+ */
+static int load_inspection(const char *containers_path, const char *container_name, int with_rootfs_size, struct container_inspection *inspection)
+{
+    char config_path[FILENAME_MAX] = {0};
+
+    memset(inspection, 0, sizeof(*inspection));
+    snprintf(inspection->name, INSPECT_NAME_SIZE, "%s", container_name);
+    snprintf(config_path, sizeof(config_path), "%s/%s/config", containers_path, container_name);
+
+    if (TRACE_CALL("config.parse", container_name, parse_container_config(config_path, inspection)) < 0)
+        return -1;
+
+    if (with_rootfs_size)
+        inspection->rootfs_size = TRACE_CALL("rootfs.size", container_name, get_rootfs_size(inspection->rootfs_path));
+
+    return 0;
+}
+
+/**
+ * @brief Print the inspection of a container
+ */
+static void print_inspection(const struct container_inspection *inspection, int with_rootfs_size)
+{
+    printf("--- Container %s ---\n", inspection->name);
+    printf("State: %s\n", inspection->running ? "RUNNING" : "STOPPED");
+    printf("Rootfs: %s\n", inspection->rootfs_path[0] ? inspection->rootfs_path : "N/A");
+    if (with_rootfs_size)
+        printf("Rootfs size: %.1f MB%s\n", inspection->rootfs_size / (1024.0 * 1024.0), strncmp(inspection->rootfs_path, "overlay", 7) == 0 ? " (private upper layer)" : "");
+
+    if (inspection->number_of_cgroup_limits == 0)
+        printf("Limits: none (host defaults)\n");
+    for (int index = 0; index < inspection->number_of_cgroup_limits; index++)
+        printf("Limit: %s = %s\n", inspection->cgroup_limits[index].key, inspection->cgroup_limits[index].value);
+
+    for (int index = 0; index < inspection->number_of_network_entries; index++)
+        printf("Network: %s = %s\n", inspection->network[index].key, inspection->network[index].value);
+
+    printf("\n");
+}
+
+int inspect_container(const char *container_name)
+{
+    TRACE_SPAN_ARGUMENT("inspect_container", container_name);
+    struct lxc_container *container;
+    struct container_inspection inspection;
+    char log_message[LOG_MESSAGE_SIZE] = {0};
+    const char *containers_path = get_containers_path();
+    int result = 0;
+
+    if (load_inspection(containers_path, container_name, 1, &inspection) < 0)
+    {
+        fprintf(stderr, "Container does not exist\n");
+        return -1;
+    }
+
+    container = lxc_container_new(container_name, get_containers_path());
+    if (container == NULL)
+    {
+        fprintf(stderr, "Failed to setup lxc_container struct\n");
+        result = -1;
+        goto out;
+    }
+
+    inspection.running = container->is_running(container) ? 1 : 0; // only queries the monitor, never starts it
+    print_inspection(&inspection, 1);
+
+    snprintf(log_message, LOG_MESSAGE_SIZE, "Container %s inspected", container_name);
+    log_activity("INFO", "inspect", container_name, log_message);
+
+out:
+    lxc_container_put(container);
+    return result;
+}
+
+int inspect_all_containers(int with_rootfs_size)
+{
+    TRACE_SPAN("inspect_all_containers");
+    std::vector<struct container_inspection> inspections;
+    std::vector<std::string> names;
+    std::vector<std::thread> workers;
+    std::atomic<size_t> next_index(0);
+    char **active_names = NULL, log_message[LOG_MESSAGE_SIZE] = {0};
+    const char *containers_path = get_containers_path();
+    struct dirent *entry;
+    int number_of_active_containers = 0;
+
+    DIR *directory = opendir(containers_path);
+    if (directory == NULL)
+    {
+        fprintf(stderr, "Failed to open %s\n", containers_path);
+        return -1;
+    }
+
+    while ((entry = readdir(directory)) != NULL)
+    {
+        char config_path[FILENAME_MAX] = {0};
+        if (entry->d_name[0] == '.')
+            continue;
+
+        snprintf(config_path, sizeof(config_path), "%s/%s/config", containers_path, entry->d_name);
+        if (access(config_path, R_OK) == 0)
+            names.push_back(entry->d_name);
+    }
+    closedir(directory);
+
+    if (names.empty())
+    {
+        printf("No containers found!\n\n");
+        return 0;
+    }
+
+    std::sort(names.begin(), names.end());
+    inspections.resize(names.size());
+
+    unsigned int number_of_workers = std::max(1u, std::min((unsigned int)names.size(), std::thread::hardware_concurrency()));
+    for (unsigned int worker = 0; worker < number_of_workers; worker++)
+    {
+        workers.emplace_back([&]()
+                             {
+            size_t index;
+            while ((index = next_index++) < names.size())
+                load_inspection(containers_path, names[index].c_str(), with_rootfs_size, &inspections[index]); });
+    }
+    for (std::thread &worker : workers)
+        worker.join();
+
+    // A single query for the running set instead of one per container
+    number_of_active_containers = TRACE_CALL("lxc.list_active", NULL, list_active_containers(containers_path, &active_names, NULL));
+    for (int index = 0; index < number_of_active_containers; index++)
+    {
+        auto found = std::lower_bound(names.begin(), names.end(), active_names[index]);
+        if (found != names.end() && *found == active_names[index])
+            inspections[found - names.begin()].running = 1;
+        free(active_names[index]);
+    }
+    free(active_names);
+
+    printf("NUMBER OF CONTAINERS: %zu\n\n", names.size());
+    for (const struct container_inspection &inspection : inspections)
+        print_inspection(&inspection, with_rootfs_size);
+
+    snprintf(log_message, LOG_MESSAGE_SIZE, "Inspected %zu containers", names.size());
+    log_activity("INFO", "inspect", NULL, log_message);
+
+    return 0;
+}
+
+char *read_cgroup_item(struct lxc_container *container, const char *subsystem)
+{
+    // Without a buffer liblxc returns the size of the value
+    int length = container->get_cgroup_item(container, subsystem, NULL, 0);
+    if (length <= 0)
+        return NULL;
+
+    char *value = (char *)calloc(length + 1, 1);
+    if (value == NULL)
+        return NULL;
+
+    if (container->get_cgroup_item(container, subsystem, value, length + 1) < 0)
+    {
+        free(value);
+        return NULL;
+    }
+
+    return value;
+}
@@ -0,0 +1,140 @@
+#ifndef INSPECT_H
+#define INSPECT_H
+
+/**
+ * @file inspect.h
+ * @brief This file contains the definitions of the functions used in inspect.cpp regarding offline inspection of LXC containers
+ *
+ * The functions answer questions about containers (cgroup limits, rootfs and network configuration) straight from their on-disk config,
+ * so a stopped container never has to be booted just to be inspected
+ *
+ * @author Simão Andrade
+ * @date 2024-06-13
+ */
+
+#include <stddef.h>
+
+struct lxc_container;
+
+/**
+ * @brief Maximum number of entries of each kind kept for an inspected container
+ */
+#define INSPECT_MAX_ENTRIES 32
+
+/**
+ * @brief Sizes of the buffers used to store a config key, a config value and a container name
+ */
+#define INSPECT_KEY_SIZE 64
+#define INSPECT_VALUE_SIZE 256
+#define INSPECT_NAME_SIZE 100
+
+/**
+ * @brief A single "key = value" line of a container config
+ */
+struct config_entry
+{
+    char key[INSPECT_KEY_SIZE];
+    char value[INSPECT_VALUE_SIZE];
+};
+
+/**
+ * @brief Everything known about a container without starting it
+ */
+struct container_inspection
+{
+    char name[INSPECT_NAME_SIZE];
+    char rootfs_path[INSPECT_VALUE_SIZE];
+    unsigned long long rootfs_size;                          // in bytes, 0 when not computed
+    struct config_entry cgroup_limits[INSPECT_MAX_ENTRIES];  // lxc.cgroup.* and lxc.cgroup2.* keys
+    int number_of_cgroup_limits;
+    struct config_entry network[INSPECT_MAX_ENTRIES];        // lxc.net.* keys
+    int number_of_network_entries;
+    int running;                                             // 1 if the container is running, 0 otherwise
+};
+
+/**
+ * @brief Get the directory where the LXC containers are stored (lxcpath)
+ *
+ * @return const char* path of the containers directory
+ */
+const char *get_containers_path(void);
+
+/**
+ * @brief Use another directory for the LXC containers of this process, every operation of the library uses it
+ *
+ * @param path lxcpath, NULL to go back to the one of the LXC configuration
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int set_containers_path(const char *path);
+
+/**
+ * @brief Get the config key prefix used for cgroup limits on this host
+ *
+ * @return const char* "lxc.cgroup2." on cgroup v2 hosts, "lxc.cgroup." otherwise
+ */
+const char *get_cgroup_config_prefix(void);
+
+/**
+ * @brief Translate a cgroup limit to the hierarchy of this host and check that the host has it
+ *
+ * The names of the other cgroup version are mapped with their value (e.g. memory.limit_in_bytes=-1 is memory.max=max on
+ * cgroup v2), so a limit saved for a stopped container never keeps a key that would stop it from booting
+ *
+ * @param subsystem requested cgroup subsystem (e.g. memory.limit_in_bytes)
+ * @param value requested value, NULL when only the name is translated
+ * @param host_subsystem subsystem of this host
+ * @param host_value value for this host, not written when value is NULL
+ *
+ * @return int 0 on success, -1 if this host has no such limit or a buffer is too small
+ */
+int resolve_cgroup_limit(const char *subsystem, const char *value, char *host_subsystem, size_t subsystem_size, char *host_value, size_t value_size);
+
+/**
+ * @brief Parse the on-disk config of a container
+ *
+ * @param config_path path of the config file
+ * @param inspection structure filled with the parsed values
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int parse_container_config(const char *config_path, struct container_inspection *inspection);
+
+/**
+ * @brief Inspect a single LXC container without starting it
+ *
+ * @param container_name name of the container
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int inspect_container(const char *container_name);
+
+/**
+ * @brief Inspect every container of the lxcpath, parsing their configs in parallel
+ *
+ * @param with_rootfs_size 1 to also compute the size of each rootfs (walks every file), 0 to skip it
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int inspect_all_containers(int with_rootfs_size);
+
+/**
+ * @brief Compute the disk usage of a rootfs, only the private upper layer is counted for an overlay rootfs
+ *
+ * @param rootfs_path path of the rootfs (lxc.rootfs.path)
+ *
+ * @return unsigned long long size in bytes, 0 if the rootfs is not a directory
+ */
+unsigned long long get_rootfs_size(const char *rootfs_path);
+
+/**
+ * @brief Read a cgroup file of a running container, whatever its size
+ *
+ * @param container running container
+ * @param subsystem cgroup file (e.g. memory.stat)
+ *
+ * @return char* contents to free, NULL on failure
+ */
+char *read_cgroup_item(struct lxc_container *container, const char *subsystem);
+
+#endif // INSPECT_H
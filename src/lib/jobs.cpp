@@ -0,0 +1,1384 @@
+/**
+ * @file jobs.cpp
+ * @brief Background jobs in LXC containers
+ *
+ * This file contains the implementation of the job queue. Every job is a directory of the store holding its state (job.conf),
+ * its output and, while it is cancelled, a "cancel" file; the queue directory holds one marker per unfinished job.
+ * The worker process is the only one that runs jobs (it holds the lock of the workers): it finds the queued jobs with inotify
+ * on the queue directory and hands them to a pool of threads, skipping the jobs of containers that are already running as many
+ * jobs as allowed, so the other containers keep the workers busy. The state of a job is changed under a lock on its directory,
+ * because cancel_job() changes it from other processes.
+ * The command of a job leads its own process group, so a timeout or a cancellation kills everything it started; a job left
+ * "running" by a worker process that died has that group killed before it runs again.
+ *
+ * @author Simão Andrade
+ * @date 2024-06-13
+ */
+
+#include "jobs.h"
+#include "lib.h"
+#include "idle.h"
+#include "layers.h"
+#include "netqos.h"
+#include "inspect.h"
+#include "trace.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/file.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <lxc/lxccontainer.h>
+#include <zlib.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Files of the store
+ */
+#define JOB_NEXT_ID_FILE JOB_STORE_DIRECTORY "/next-id"
+#define JOB_WORKERS_LOCK_FILE JOB_STORE_DIRECTORY "/workers.lock"
+#define JOB_STATE_FILE "job.conf"
+#define JOB_OUTPUT_FILE "output.log"
+#define JOB_COMPRESSED_OUTPUT_FILE "output.gz"
+#define JOB_CANCEL_FILE "cancel"
+
+/**
+ * @brief Maximum size of a path in the store, of a line of job.conf and of a read of the output
+ */
+#define JOB_PATH_SIZE 256
+#define JOB_LINE_SIZE (JOB_COMMAND_SIZE + 64)
+#define JOB_BUFFER_SIZE 65536
+
+/**
+ * @brief Time between two checks for a cancellation or a new chunk of output to tail, in milliseconds
+ */
+#define JOB_CHECK_INTERVAL_MS 1000
+#define JOB_TAIL_INTERVAL_MS 200
+
+/**
+ * @brief A queued job waiting for a worker
+ */
+struct pending_job
+{
+    long long id;
+    std::string container_name;
+    long long not_before_ms;
+};
+
+/**
+ * @brief State shared by the dispatcher and the workers
+ */
+struct job_pool
+{
+    struct job_pool_options options;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<struct pending_job> pending;  // in submission order, retried jobs at the end
+    std::set<long long> known;                // pending or running
+    std::map<std::string, unsigned int> running_per_container;
+    std::map<std::string, std::mutex> start_mutexes; // one start of a container at a time
+    unsigned int running = 0;
+    bool stopping = false;
+};
+
+/**
+ * @brief Set by SIGINT and SIGTERM to stop the workers
+ */
+static volatile sig_atomic_t job_workers_stopping = 0;
+
+/**
+ * @brief The activity log is not thread-safe
+ */
+static std::mutex job_log_mutex;
+
+/**
+ * @brief Current time in milliseconds since the epoch
+ */
+static long long now_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Add a message about a job to the activity log
+ */
+static void log_job(const char *level, const char *container_name, const char *format, ...)
+{
+    char log_message[LOG_MESSAGE_SIZE] = {0};
+    va_list arguments;
+
+    va_start(arguments, format);
+    vsnprintf(log_message, LOG_MESSAGE_SIZE, format, arguments);
+    va_end(arguments);
+
+    std::lock_guard<std::mutex> lock(job_log_mutex);
+    log_activity(level, "job", container_name, log_message);
+}
+
+/**
+ * @brief Build the path of a file of a job, or of its directory when file_name is NULL
+ */
+static void job_path(long long id, const char *file_name, char *path)
+{
+    if (file_name == NULL)
+        snprintf(path, JOB_PATH_SIZE, "%s/%08lld", JOB_STORE_DIRECTORY, id);
+    else
+        snprintf(path, JOB_PATH_SIZE, "%s/%08lld/%s", JOB_STORE_DIRECTORY, id, file_name);
+}
+
+/**
+ * @brief Build the path of the queue marker of a job
+ */
+static void queue_marker_path(long long id, char *path)
+{
+    snprintf(path, JOB_PATH_SIZE, "%s/%08lld", JOB_QUEUE_DIRECTORY, id);
+}
+
+/**
+ * @brief Check if a state is final
+ */
+static bool is_final_state(const char *state)
+{
+    return strcmp(state, "queued") != 0 && strcmp(state, "running") != 0;
+}
+
+/**
+ * @brief Create the directories of the store
+ *
+ * @return int 0 on success, -1 on failure
+ */
+static int create_store(void)
+{
+    if ((mkdir(JOB_STORE_DIRECTORY, 0755) < 0 && errno != EEXIST) || (mkdir(JOB_QUEUE_DIRECTORY, 0755) < 0 && errno != EEXIST))
+    {
+        fprintf(stderr, "Failed to create the job store %s\n", JOB_STORE_DIRECTORY);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Lock the directory of a job while its state changes
+ *
+ * @return int file descriptor of the lock, -1 on failure
+ */
+static int lock_job(long long id)
+{
+    char path[JOB_PATH_SIZE];
+
+    job_path(id, NULL, path);
+    int lock_fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (lock_fd < 0)
+        return -1;
+
+    if (flock(lock_fd, LOCK_EX) < 0)
+    {
+        close(lock_fd);
+        return -1;
+    }
+
+    return lock_fd;
+}
+
+/**
+ * @brief Write the state of a job, replacing the previous one atomically
+ *
+ * @return int 0 on success, -1 on failure
+ */
+static int save_job(const struct job *job)
+{
+    char path[JOB_PATH_SIZE], temporary_path[JOB_PATH_SIZE + 8];
+
+    job_path(job->id, JOB_STATE_FILE, path);
+    snprintf(temporary_path, sizeof(temporary_path), "%s.tmp", path);
+
+    FILE *file = fopen(temporary_path, "w");
+    if (file == NULL)
+        return -1;
+
+    fprintf(file, "container = %s\n", job->container_name);
+    fprintf(file, "command = %s\n", job->command);
+    fprintf(file, "state = %s\n", job->state);
+    fprintf(file, "attempts = %u\n", job->attempts);
+    fprintf(file, "max_retries = %u\n", job->max_retries);
+    fprintf(file, "timeout_seconds = %u\n", job->timeout_seconds);
+    fprintf(file, "output_limit = %llu\n", job->output_limit);
+    fprintf(file, "exit_code = %d\n", job->exit_code);
+    fprintf(file, "pid = %d\n", job->pid);
+    fprintf(file, "pid_start = %llu\n", job->pid_start);
+    fprintf(file, "submitted_ms = %lld\n", job->submitted_ms);
+    fprintf(file, "started_ms = %lld\n", job->started_ms);
+    fprintf(file, "finished_ms = %lld\n", job->finished_ms);
+    fprintf(file, "not_before_ms = %lld\n", job->not_before_ms);
+    fprintf(file, "output_bytes = %llu\n", job->output_bytes);
+    fprintf(file, "output_dropped = %llu\n", job->output_dropped);
+    fprintf(file, "stored_bytes = %llu\n", job->stored_bytes);
+
+    if (fclose(file) != 0 || rename(temporary_path, path) < 0)
+    {
+        unlink(temporary_path);
+        return -1;
+    }
+
+    return 0;
+}
+
+int load_job(long long id, struct job *job)
+{
+    char path[JOB_PATH_SIZE], line[JOB_LINE_SIZE], key[32];
+
+    memset(job, 0, sizeof(*job));
+    job->id = id;
+    job->exit_code = -1;
+
+    job_path(id, JOB_STATE_FILE, path);
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+        return -1;
+
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        int offset = 0;
+        if (sscanf(line, "%31[a-z_] = %n", key, &offset) != 1 || offset == 0)
+            continue;
+
+        char *value = line + offset;
+        value[strcspn(value, "\n")] = '\0';
+
+        if (strcmp(key, "container") == 0)
+            snprintf(job->container_name, sizeof(job->container_name), "%s", value);
+        else if (strcmp(key, "command") == 0)
+            snprintf(job->command, sizeof(job->command), "%s", value);
+        else if (strcmp(key, "state") == 0)
+            snprintf(job->state, sizeof(job->state), "%s", value);
+        else if (strcmp(key, "attempts") == 0)
+            job->attempts = (unsigned int)strtoul(value, NULL, 10);
+        else if (strcmp(key, "max_retries") == 0)
+            job->max_retries = (unsigned int)strtoul(value, NULL, 10);
+        else if (strcmp(key, "timeout_seconds") == 0)
+            job->timeout_seconds = (unsigned int)strtoul(value, NULL, 10);
+        else if (strcmp(key, "output_limit") == 0)
+            job->output_limit = strtoull(value, NULL, 10);
+        else if (strcmp(key, "exit_code") == 0)
+            job->exit_code = atoi(value);
+        else if (strcmp(key, "pid") == 0)
+            job->pid = atoi(value);
+        else if (strcmp(key, "pid_start") == 0)
+            job->pid_start = strtoull(value, NULL, 10);
+        else if (strcmp(key, "submitted_ms") == 0)
+            job->submitted_ms = strtoll(value, NULL, 10);
+        else if (strcmp(key, "started_ms") == 0)
+            job->started_ms = strtoll(value, NULL, 10);
+        else if (strcmp(key, "finished_ms") == 0)
+            job->finished_ms = strtoll(value, NULL, 10);
+        else if (strcmp(key, "not_before_ms") == 0)
+            job->not_before_ms = strtoll(value, NULL, 10);
+        else if (strcmp(key, "output_bytes") == 0)
+            job->output_bytes = strtoull(value, NULL, 10);
+        else if (strcmp(key, "output_dropped") == 0)
+            job->output_dropped = strtoull(value, NULL, 10);
+        else if (strcmp(key, "stored_bytes") == 0)
+            job->stored_bytes = strtoull(value, NULL, 10);
+    }
+
+    fclose(file);
+    return job->state[0] != '\0' ? 0 : -1;
+}
+
+void job_default_options(struct job_options *options)
+{
+    options->timeout_seconds = JOB_DEFAULT_TIMEOUT;
+    options->max_retries = JOB_DEFAULT_RETRIES;
+    options->output_limit = JOB_DEFAULT_OUTPUT_LIMIT;
+}
+
+void job_pool_default_options(struct job_pool_options *options)
+{
+    options->workers = 0;
+    options->per_container = JOB_DEFAULT_PER_CONTAINER;
+    options->follow = 0;
+}
+
+/**
+ * @brief Allocate the ID of a new job
+ *
+ * @return long long ID, -1 on failure
+ */
+static long long allocate_job_id(void)
+{
+    char content[32] = {0};
+
+    int fd = open(JOB_NEXT_ID_FILE, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return -1;
+
+    if (flock(fd, LOCK_EX) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    ssize_t length = pread(fd, content, sizeof(content) - 1, 0);
+    long long id = length > 0 ? strtoll(content, NULL, 10) : 1;
+
+    int size = snprintf(content, sizeof(content), "%lld\n", id + 1);
+    if (ftruncate(fd, 0) < 0 || pwrite(fd, content, size, 0) != size)
+        id = -1;
+
+    close(fd); // releases the lock
+    return id;
+}
+
+long long submit_job(const char *container_name, const char *command, const struct job_options *options)
+{
+    TRACE_SPAN_ARGUMENT("submit_job", container_name);
+    char path[JOB_PATH_SIZE];
+    struct job_options default_options;
+    struct job job;
+
+    if (options == NULL)
+    {
+        job_default_options(&default_options);
+        options = &default_options;
+    }
+
+    if (strlen(container_name) >= JOB_CONTAINER_NAME_SIZE || strlen(command) >= JOB_COMMAND_SIZE || strchr(command, '\n') != NULL || command[0] == '\0')
+    {
+        fprintf(stderr, "The command must be a single line of less than %d characters\n", JOB_COMMAND_SIZE);
+        return -1;
+    }
+
+    struct lxc_container *container = TRACE_CALL("lxc.new", container_name, lxc_container_new(container_name, get_containers_path()));
+    bool defined = container != NULL && container->is_defined(container);
+    if (container != NULL)
+        lxc_container_put(container);
+    if (!defined)
+    {
+        fprintf(stderr, "There's no container with the name %s\n", container_name);
+        return -1;
+    }
+
+    if (create_store() < 0)
+        return -1;
+
+    memset(&job, 0, sizeof(job));
+    job.id = allocate_job_id();
+    if (job.id < 0)
+    {
+        fprintf(stderr, "Failed to allocate a job ID\n");
+        return -1;
+    }
+
+    snprintf(job.container_name, sizeof(job.container_name), "%s", container_name);
+    snprintf(job.command, sizeof(job.command), "%s", command);
+    snprintf(job.state, sizeof(job.state), "queued");
+    job.max_retries = options->max_retries;
+    job.timeout_seconds = options->timeout_seconds;
+    job.output_limit = options->output_limit;
+    job.exit_code = -1;
+    job.submitted_ms = now_ms();
+
+    job_path(job.id, NULL, path);
+    if (mkdir(path, 0755) < 0 || save_job(&job) < 0)
+    {
+        fprintf(stderr, "Failed to save job %lld\n", job.id);
+        return -1;
+    }
+
+    // The marker is created last, once the job is complete, because it is what the workers watch
+    queue_marker_path(job.id, path);
+    int fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Failed to queue job %lld\n", job.id);
+        return -1;
+    }
+    close(fd);
+
+    log_job("INFO", container_name, "Job %lld submitted to container %s", job.id, container_name);
+
+    return job.id;
+}
+
+int cancel_job(long long id)
+{
+    char path[JOB_PATH_SIZE];
+    struct job job;
+    int result = 0;
+
+    int lock_fd = lock_job(id);
+    if (lock_fd < 0 || load_job(id, &job) < 0)
+    {
+        fprintf(stderr, "There's no job with ID %lld\n", id);
+        if (lock_fd >= 0)
+            close(lock_fd);
+        return -1;
+    }
+
+    if (is_final_state(job.state))
+    {
+        fprintf(stderr, "Job %lld already finished (%s)\n", id, job.state);
+        result = -1;
+        goto out;
+    }
+
+    // A running job is killed by its worker, which checks for this file
+    job_path(id, JOB_CANCEL_FILE, path);
+    close(open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644));
+
+    if (strcmp(job.state, "queued") == 0)
+    {
+        snprintf(job.state, sizeof(job.state), "cancelled");
+        job.finished_ms = now_ms();
+        if (save_job(&job) < 0)
+        {
+            fprintf(stderr, "Failed to save job %lld\n", id);
+            result = -1;
+            goto out;
+        }
+
+        queue_marker_path(id, path);
+        unlink(path);
+    }
+
+    printf("Job %lld cancelled\n", id);
+    log_job("INFO", job.container_name, "Job %lld cancelled", id);
+
+out:
+    close(lock_fd);
+    return result;
+}
+
+/**
+ * @brief Compress the output of a job with gzip and remove the uncompressed output
+ *
+ * @return int 0 on success, -1 on failure
+ */
+static int compress_job_output(struct job *job)
+{
+    char path[JOB_PATH_SIZE], compressed_path[JOB_PATH_SIZE], temporary_path[JOB_PATH_SIZE + 8], buffer[JOB_BUFFER_SIZE];
+    struct stat info;
+    ssize_t length;
+    int result = 0;
+
+    job_path(job->id, JOB_OUTPUT_FILE, path);
+    job_path(job->id, JOB_COMPRESSED_OUTPUT_FILE, compressed_path);
+    snprintf(temporary_path, sizeof(temporary_path), "%s.tmp", compressed_path);
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0 && errno == ENOENT)
+        return 0; // the job never ran
+
+    gzFile compressed = gzopen(temporary_path, "wb");
+    if (fd < 0 || compressed == NULL)
+    {
+        if (fd >= 0)
+            close(fd);
+        if (compressed != NULL)
+            gzclose(compressed);
+        return -1;
+    }
+
+    while ((length = read(fd, buffer, sizeof(buffer))) > 0)
+    {
+        if (gzwrite(compressed, buffer, (unsigned int)length) != length)
+        {
+            result = -1;
+            break;
+        }
+    }
+    close(fd);
+
+    if (gzclose(compressed) != Z_OK || length < 0 || result < 0 || rename(temporary_path, compressed_path) < 0)
+    {
+        unlink(temporary_path);
+        return -1;
+    }
+
+    job->stored_bytes = stat(compressed_path, &info) == 0 ? (unsigned long long)info.st_size : 0;
+    unlink(path);
+    return 0;
+}
+
+/**
+ * @brief Put a job in its final state and remove it from the queue
+ */
+static void finish_job(struct job *job, const char *state)
+{
+    char path[JOB_PATH_SIZE];
+
+    if (compress_job_output(job) < 0)
+        log_job("WARNING", job->container_name, "Failed to compress the output of job %lld", job->id);
+
+    snprintf(job->state, sizeof(job->state), "%s", state);
+    job->pid = 0;
+    job->finished_ms = now_ms();
+    save_job(job);
+
+    queue_marker_path(job->id, path);
+    unlink(path);
+
+    log_job(strcmp(state, "succeeded") == 0 ? "INFO" : "ERROR", job->container_name, "Job %lld %s (exit code %d, %u attempts)", job->id, state, job->exit_code, job->attempts);
+}
+
+/**
+ * @brief Check if a job was cancelled
+ */
+static bool is_cancelled(long long id)
+{
+    char path[JOB_PATH_SIZE];
+    job_path(id, JOB_CANCEL_FILE, path);
+    return access(path, F_OK) == 0;
+}
+
+/**
+ * @brief Open a container, starting it if it is not running and thawing it if it is frozen
+ *
+ * @return struct lxc_container* container, NULL on failure
+ */
+static struct lxc_container *open_job_container(struct job_pool *pool, const char *container_name, int output_fd)
+{
+    struct lxc_container *container = TRACE_CALL("lxc.new", container_name, lxc_container_new(container_name, get_containers_path()));
+    if (container == NULL || !container->is_defined(container))
+    {
+        dprintf(output_fd, "There's no container with the name %s\n", container_name);
+        if (container != NULL)
+            lxc_container_put(container);
+        return NULL;
+    }
+
+    std::mutex *start_mutex;
+    {
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        start_mutex = &pool->start_mutexes[container_name];
+    }
+
+    // Jobs of the same container start it once, jobs of other containers are not held
+    std::lock_guard<std::mutex> start_lock(*start_mutex);
+    if (!container->is_running(container))
+    {
+        if (strcmp(container_name, LAYER_BASE_CONTAINER) == 0)
+        {
+            dprintf(output_fd, "%s is the base layer and is never started\n", LAYER_BASE_CONTAINER);
+            lxc_container_put(container);
+            return NULL;
+        }
+
+        if (!TRACE_CALL("lxc.start", container_name, container->start(container, 0, NULL)))
+        {
+            dprintf(output_fd, "Failed to start container %s\n", container_name);
+            lxc_container_put(container);
+            return NULL;
+        }
+
+        if (restore_container_network_qos(container) < 0)
+            dprintf(output_fd, "Warning: The network policy of container %s was not applied, it runs unlimited\n", container_name);
+    }
+
+    if (wake_idle_container(container) < 0)
+    {
+        dprintf(output_fd, "Failed to thaw container %s\n", container_name);
+        lxc_container_put(container);
+        return NULL;
+    }
+
+    return container;
+}
+
+/**
+ * @brief Read the start time of a process from /proc/<pid>/stat
+ *
+ * @return unsigned long long clock ticks since boot, 0 if the process does not exist
+ */
+static unsigned long long read_process_start_time(int pid)
+{
+    char path[JOB_PATH_SIZE], content[1024];
+    unsigned long long start_time = 0;
+
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return 0;
+
+    ssize_t length = read(fd, content, sizeof(content) - 1);
+    close(fd);
+    content[length > 0 ? length : 0] = '\0';
+
+    // The name of the command may hold spaces and parentheses, the fields after it start at the last ')'
+    const char *fields = strrchr(content, ')');
+    if (fields == NULL || sscanf(fields + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %*u %*u %*d %*d %*d %*d %*d %*d %llu", &start_time) != 1)
+        return 0;
+
+    return start_time;
+}
+
+/**
+ * @brief Kill the process group of an attempt, or only its leader if it has not created the group yet
+ */
+static void kill_job_attempt(int pid)
+{
+    if (kill(-pid, SIGKILL) < 0)
+        kill(pid, SIGKILL);
+}
+
+/**
+ * @brief Run the command of a job in the container as the leader of a new process group
+ */
+static int run_job_command(void *payload)
+{
+    setpgid(0, 0);
+    return lxc_attach_run_command(payload);
+}
+
+/**
+ * @brief Save the PID of the attached process of a running job, unless it was cancelled meanwhile
+ */
+static void save_job_pid(struct job *job, int pid)
+{
+    struct job current;
+
+    int lock_fd = lock_job(job->id);
+    if (lock_fd < 0)
+        return;
+
+    if (load_job(job->id, &current) == 0 && strcmp(current.state, "running") == 0)
+    {
+        job->pid = pid;
+        job->pid_start = read_process_start_time(pid);
+        save_job(job);
+    }
+    close(lock_fd);
+}
+
+/**
+ * @brief Run one attempt of a job, writing at most output_limit bytes of its output to output_fd
+ *
+ * @param timed_out set to true if the command was killed after the timeout
+ */
+static void run_job_attempt(struct job_pool *pool, struct job *job, int output_fd, bool *timed_out)
+{
+    TRACE_SPAN_ARGUMENT("run_job_attempt", job->container_name);
+    char buffer[JOB_BUFFER_SIZE];
+    char *arguments[] = {(char *)"/bin/sh", (char *)"-c", job->command, NULL};
+    lxc_attach_command_t command = {arguments[0], arguments};
+    lxc_attach_options_t options = LXC_ATTACH_OPTIONS_DEFAULT;
+    int pipe_fds[2] = {-1, -1}, null_fd = -1, status = 0;
+    pid_t pid = -1;
+    long long deadline_ms = job->timeout_seconds > 0 ? job->started_ms + job->timeout_seconds * 1000LL : 0;
+
+    // The idle manager does not freeze the container while the job runs
+    int session_fd = open_container_session(job->container_name);
+    struct lxc_container *container = open_job_container(pool, job->container_name, output_fd);
+    if (container == NULL)
+    {
+        close_container_session(session_fd);
+        return;
+    }
+
+    null_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (null_fd < 0 || pipe2(pipe_fds, O_CLOEXEC) < 0)
+    {
+        dprintf(output_fd, "Failed to create the output pipe of a job in container %s\n", job->container_name);
+        goto out;
+    }
+
+    options.stdin_fd = null_fd;
+    options.stdout_fd = pipe_fds[1];
+    options.stderr_fd = pipe_fds[1];
+
+    if (TRACE_CALL("lxc.attach", job->container_name, container->attach(container, run_job_command, &command, &options, &pid)) < 0)
+    {
+        dprintf(output_fd, "Failed to attach to container %s\n", job->container_name);
+        goto out;
+    }
+    close(pipe_fds[1]);
+    pipe_fds[1] = -1;
+
+    save_job_pid(job, pid);
+
+    // Copy the output until the command closes it, checking the timeout and for a cancellation every second
+    for (;;)
+    {
+        int wait_ms = JOB_CHECK_INTERVAL_MS;
+        if (deadline_ms > 0)
+        {
+            long long left_ms = deadline_ms - now_ms();
+            if (left_ms <= 0)
+            {
+                *timed_out = true;
+                break;
+            }
+            wait_ms = (int)std::min(left_ms, (long long)JOB_CHECK_INTERVAL_MS);
+        }
+
+        if (is_cancelled(job->id))
+            break;
+
+        struct pollfd poll_fd = {pipe_fds[0], POLLIN, 0};
+        int ready = poll(&poll_fd, 1, wait_ms);
+        if (ready < 0 && errno != EINTR)
+            break;
+        if (ready <= 0)
+            continue;
+
+        ssize_t length = read(pipe_fds[0], buffer, sizeof(buffer));
+        if (length < 0 && errno == EINTR)
+            continue;
+        if (length <= 0)
+            break; // closed by the command
+
+        unsigned long long kept = job->output_bytes < job->output_limit ? std::min((unsigned long long)length, job->output_limit - job->output_bytes) : 0;
+        if (kept > 0 && write(output_fd, buffer, kept) != (ssize_t)kept)
+            kept = 0;
+        job->output_dropped += length - kept;
+        job->output_bytes += length;
+    }
+
+    if (*timed_out || is_cancelled(job->id))
+        kill_job_attempt(pid);
+
+    // The command may close its output before exiting
+    for (useconds_t delay = 1000; waitpid(pid, &status, WNOHANG) == 0; delay = std::min(delay * 2, (useconds_t)100000))
+    {
+        if ((deadline_ms > 0 && now_ms() >= deadline_ms) || is_cancelled(job->id))
+        {
+            *timed_out = !is_cancelled(job->id);
+            kill_job_attempt(pid);
+            waitpid(pid, &status, 0);
+            break;
+        }
+        usleep(delay);
+    }
+
+    if (WIFEXITED(status))
+        job->exit_code = WEXITSTATUS(status);
+    else if (WIFSIGNALED(status))
+        job->exit_code = 128 + WTERMSIG(status);
+
+out:
+    if (null_fd >= 0)
+        close(null_fd);
+    if (pipe_fds[0] >= 0)
+        close(pipe_fds[0]);
+    if (pipe_fds[1] >= 0)
+        close(pipe_fds[1]);
+    close_container_session(session_fd);
+    lxc_container_put(container);
+}
+
+/**
+ * @brief Run a queued job
+ *
+ * @param not_before_ms time before which a retried job must not run again
+ *
+ * @return bool true if the job must run again
+ */
+static bool run_job(struct job_pool *pool, long long id, long long *not_before_ms)
+{
+    char path[JOB_PATH_SIZE], marker_path[JOB_PATH_SIZE];
+    struct job job;
+    bool timed_out = false;
+
+    // Claim the job, it may have been cancelled or finished since it was queued
+    int lock_fd = lock_job(id);
+    if (lock_fd < 0 || load_job(id, &job) < 0 || is_final_state(job.state))
+    {
+        if (lock_fd >= 0)
+            close(lock_fd);
+        queue_marker_path(id, marker_path);
+        unlink(marker_path);
+        return false;
+    }
+
+    // The worker process running this attempt died, its command may still run and must not run twice
+    if (strcmp(job.state, "running") == 0 && job.pid > 0 && job.pid_start != 0 && read_process_start_time(job.pid) == job.pid_start)
+    {
+        kill_job_attempt(job.pid);
+        log_job("WARNING", job.container_name, "Job %lld: killed the attempt left running by a stopped worker (pid %d)", id, job.pid);
+    }
+
+    if (is_cancelled(id))
+    {
+        finish_job(&job, "cancelled");
+        close(lock_fd);
+        return false;
+    }
+
+    snprintf(job.state, sizeof(job.state), "running");
+    job.attempts++;
+    job.started_ms = now_ms();
+    job.exit_code = -1;
+    job.pid = 0;
+    job.pid_start = 0;
+    job.output_bytes = job.output_dropped = 0;
+    save_job(&job);
+    close(lock_fd);
+
+    job_path(id, JOB_OUTPUT_FILE, path);
+    int output_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (output_fd >= 0)
+    {
+        run_job_attempt(pool, &job, output_fd, &timed_out);
+        close(output_fd);
+    }
+
+    lock_fd = lock_job(id);
+    if (is_cancelled(id))
+    {
+        finish_job(&job, "cancelled");
+    }
+    else if (job.exit_code == 0)
+    {
+        finish_job(&job, "succeeded");
+    }
+    else if (job.attempts <= job.max_retries)
+    {
+        // Linear backoff, the output of the failed attempt is replaced by the next one
+        snprintf(job.state, sizeof(job.state), "queued");
+        job.pid = 0;
+        job.pid_start = 0;
+        job.not_before_ms = *not_before_ms = now_ms() + job.attempts * 1000LL;
+        save_job(&job);
+        log_job("WARNING", job.container_name, "Job %lld %s (exit code %d), retrying", id, timed_out ? "timed out" : "failed", job.exit_code);
+        if (lock_fd >= 0)
+            close(lock_fd);
+        return true;
+    }
+    else
+    {
+        finish_job(&job, timed_out ? "timed_out" : "failed");
+    }
+
+    if (lock_fd >= 0)
+        close(lock_fd);
+    return false;
+}
+
+/**
+ * @brief Worker thread: run the first pending job whose container is below its limit, until the pool stops
+ */
+static void job_worker(struct job_pool *pool)
+{
+    std::unique_lock<std::mutex> lock(pool->mutex);
+
+    while (!pool->stopping)
+    {
+        long long now = now_ms(), next_ms = 0;
+        auto chosen = pool->pending.end();
+
+        for (auto pending = pool->pending.begin(); pending != pool->pending.end(); ++pending)
+        {
+            if (pool->running_per_container[pending->container_name] >= pool->options.per_container)
+                continue;
+            if (pending->not_before_ms > now)
+            {
+                next_ms = next_ms == 0 ? pending->not_before_ms : std::min(next_ms, pending->not_before_ms);
+                continue;
+            }
+            chosen = pending;
+            break;
+        }
+
+        if (chosen == pool->pending.end())
+        {
+            if (next_ms > 0)
+                pool->changed.wait_for(lock, std::chrono::milliseconds(next_ms - now));
+            else
+                pool->changed.wait(lock);
+            continue;
+        }
+
+        struct pending_job job = *chosen;
+        pool->pending.erase(chosen);
+        pool->running++;
+        pool->running_per_container[job.container_name]++;
+        lock.unlock();
+
+        bool retry = run_job(pool, job.id, &job.not_before_ms);
+
+        lock.lock();
+        pool->running--;
+        pool->running_per_container[job.container_name]--;
+        if (retry)
+            pool->pending.push_back(job);
+        else
+            pool->known.erase(job.id);
+        pool->changed.notify_all();
+    }
+}
+
+/**
+ * @brief Add a queued job to the pending jobs, if it is not pending or running already
+ */
+static void add_pending_job(struct job_pool *pool, long long id)
+{
+    char path[JOB_PATH_SIZE];
+    struct job job;
+
+    {
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        if (pool->known.count(id) > 0)
+            return;
+    }
+
+    if (load_job(id, &job) < 0 || is_final_state(job.state))
+    {
+        queue_marker_path(id, path);
+        unlink(path);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(pool->mutex);
+    pool->known.insert(id);
+    pool->pending.push_back({id, job.container_name, job.not_before_ms});
+    pool->changed.notify_all();
+}
+
+/**
+ * @brief Remove a cancelled job from the pending jobs
+ */
+static void remove_pending_job(struct job_pool *pool, long long id)
+{
+    std::lock_guard<std::mutex> lock(pool->mutex);
+    for (auto pending = pool->pending.begin(); pending != pool->pending.end(); ++pending)
+    {
+        if (pending->id == id)
+        {
+            pool->pending.erase(pending);
+            pool->known.erase(id);
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Add the jobs of the queue directory to the pending jobs, in ID order
+ *
+ * @return int number of markers found
+ */
+static int scan_queue(struct job_pool *pool)
+{
+    std::vector<long long> ids;
+    struct dirent *entry;
+
+    DIR *directory = opendir(JOB_QUEUE_DIRECTORY);
+    if (directory == NULL)
+        return 0;
+
+    while ((entry = readdir(directory)) != NULL)
+    {
+        char *end;
+        long long id = strtoll(entry->d_name, &end, 10);
+        if (entry->d_name[0] != '.' && *end == '\0')
+            ids.push_back(id);
+    }
+    closedir(directory);
+
+    std::sort(ids.begin(), ids.end());
+    for (long long id : ids)
+        add_pending_job(pool, id);
+
+    return (int)ids.size();
+}
+
+/**
+ * @brief Take the lock of the workers without waiting
+ *
+ * @return int file descriptor of the lock, -1 if another process holds it
+ */
+static int lock_workers(void)
+{
+    int lock_fd = open(JOB_WORKERS_LOCK_FILE, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (lock_fd < 0)
+        return -1;
+
+    if (flock(lock_fd, LOCK_EX | LOCK_NB) < 0)
+    {
+        close(lock_fd);
+        return -1;
+    }
+
+    return lock_fd;
+}
+
+/**
+ * @brief Stop the workers on SIGINT and SIGTERM
+ */
+static void stop_job_workers(int signal_number)
+{
+    (void)signal_number;
+    job_workers_stopping = 1;
+}
+
+int run_job_workers(const struct job_pool_options *options)
+{
+    TRACE_SPAN("run_job_workers");
+    struct job_pool pool;
+    struct sigaction action;
+    std::vector<std::thread> workers;
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    long long idle_since_ms = 0;
+    int inotify_fd = -1, lock_fd = -1, result = 0;
+
+    if (options != NULL)
+        pool.options = *options;
+    else
+        job_pool_default_options(&pool.options);
+    if (pool.options.workers == 0)
+        pool.options.workers = JOB_DEFAULT_WORKERS_PER_CPU * std::max(1u, std::thread::hardware_concurrency());
+    if (pool.options.per_container == 0)
+        pool.options.per_container = JOB_DEFAULT_PER_CONTAINER;
+
+    if (create_store() < 0)
+        return -1;
+
+    lock_fd = lock_workers();
+    if (lock_fd < 0)
+    {
+        printf("The job workers are already running\n");
+        return 0;
+    }
+
+    inotify_fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (inotify_fd < 0 || inotify_add_watch(inotify_fd, JOB_QUEUE_DIRECTORY, IN_CREATE | IN_MOVED_TO | IN_DELETE) < 0)
+    {
+        fprintf(stderr, "Failed to watch the job queue\n");
+        result = -1;
+        goto out;
+    }
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stop_job_workers;
+    job_workers_stopping = 0;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    // Jobs left running by a worker process that died are queued again
+    scan_queue(&pool);
+
+    printf("Running jobs with %u workers, at most %u per container\n", pool.options.workers, pool.options.per_container);
+    log_job("INFO", NULL, "Job workers started (%u workers, %u per container)", pool.options.workers, pool.options.per_container);
+
+    for (unsigned int index = 0; index < pool.options.workers; index++)
+        workers.emplace_back(job_worker, &pool);
+
+    while (!job_workers_stopping)
+    {
+        struct pollfd poll_fd = {inotify_fd, POLLIN, 0};
+        if (poll(&poll_fd, 1, JOB_CHECK_INTERVAL_MS) > 0)
+        {
+            ssize_t length;
+            while ((length = read(inotify_fd, events, sizeof(events))) > 0)
+            {
+                for (char *position = events; position < events + length; position += sizeof(struct inotify_event) + ((struct inotify_event *)position)->len)
+                {
+                    struct inotify_event *event = (struct inotify_event *)position;
+                    char *end;
+                    long long id = event->len > 0 ? strtoll(event->name, &end, 10) : 0;
+                    if (event->len == 0 || *end != '\0' || id <= 0)
+                        continue;
+
+                    if (event->mask & IN_DELETE)
+                        remove_pending_job(&pool, id);
+                    else
+                        add_pending_job(&pool, id);
+                }
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(pool.mutex);
+            if (!pool.pending.empty() || pool.running > 0)
+            {
+                idle_since_ms = 0;
+                continue;
+            }
+        }
+
+        if (pool.options.follow)
+            continue;
+        if (idle_since_ms == 0)
+            idle_since_ms = now_ms();
+        if (now_ms() - idle_since_ms < JOB_WORKERS_LINGER_SECONDS * 1000LL)
+            continue;
+
+        // A job submitted while the lock is released either starts another worker process or is found by this scan
+        close(lock_fd);
+        lock_fd = -1;
+        if (scan_queue(&pool) == 0)
+            break;
+        lock_fd = lock_workers();
+        if (lock_fd < 0)
+            break; // another worker process took over
+        idle_since_ms = 0;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.stopping = true;
+        pool.changed.notify_all();
+    }
+    for (std::thread &worker : workers)
+        worker.join();
+
+    log_job("INFO", NULL, "Job workers stopped");
+
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+
+out:
+    if (inotify_fd >= 0)
+        close(inotify_fd);
+    if (lock_fd >= 0)
+        close(lock_fd);
+    return result;
+}
+
+int start_job_workers(const struct job_pool_options *options)
+{
+    if (create_store() < 0)
+        return -1;
+
+    int lock_fd = lock_workers();
+    if (lock_fd < 0)
+        return 0; // already running
+    close(lock_fd);
+
+    // Double fork so the workers outlive this process without leaving a zombie
+    pid_t child = fork();
+    if (child == 0)
+    {
+        if (fork() == 0)
+        {
+            int null_fd = open("/dev/null", O_RDWR);
+            setsid();
+            dup2(null_fd, STDIN_FILENO);
+            dup2(null_fd, STDOUT_FILENO);
+            dup2(null_fd, STDERR_FILENO);
+            run_job_workers(options);
+            _exit(0);
+        }
+        _exit(0);
+    }
+    if (child < 0 || waitpid(child, NULL, 0) < 0)
+    {
+        fprintf(stderr, "Failed to start the job workers\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Format a duration in milliseconds
+ */
+static void format_duration(long long duration_ms, char *buffer, size_t buffer_size)
+{
+    if (duration_ms < 1000)
+        snprintf(buffer, buffer_size, "%lldms", duration_ms);
+    else if (duration_ms < 60000)
+        snprintf(buffer, buffer_size, "%.1fs", duration_ms / 1000.0);
+    else
+        snprintf(buffer, buffer_size, "%lldm%02llds", duration_ms / 60000, duration_ms / 1000 % 60);
+}
+
+/**
+ * @brief Duration of the last attempt of a job, up to now if it is running
+ */
+static long long job_duration_ms(const struct job *job)
+{
+    if (job->started_ms == 0)
+        return 0;
+    if (strcmp(job->state, "running") == 0)
+        return now_ms() - job->started_ms;
+    return job->finished_ms > job->started_ms ? job->finished_ms - job->started_ms : 0;
+}
+
+int list_jobs(const char *container_name, const char *state)
+{
+    std::vector<long long> ids;
+    std::map<std::string, int> states;
+    struct dirent *entry;
+    struct job job;
+    char duration[32];
+
+    DIR *directory = opendir(JOB_STORE_DIRECTORY);
+    if (directory == NULL)
+    {
+        printf("No jobs\n");
+        return 0;
+    }
+
+    while ((entry = readdir(directory)) != NULL)
+    {
+        char *end;
+        long long id = strtoll(entry->d_name, &end, 10);
+        if (entry->d_name[0] != '.' && *end == '\0' && id > 0)
+            ids.push_back(id);
+    }
+    closedir(directory);
+    std::sort(ids.begin(), ids.end());
+
+    printf("%-8s %-20s %-10s %-8s %-5s %-9s %-10s %s\n", "ID", "CONTAINER", "STATE", "ATTEMPTS", "EXIT", "DURATION", "OUTPUT", "COMMAND");
+    for (long long id : ids)
+    {
+        if (load_job(id, &job) < 0)
+            continue;
+        if ((container_name != NULL && strcmp(container_name, job.container_name) != 0) || (state != NULL && strcmp(state, job.state) != 0))
+            continue;
+
+        states[job.state]++;
+        format_duration(job_duration_ms(&job), duration, sizeof(duration));
+        printf("%-8lld %-20s %-10s %-8u %-5d %-9s %-10llu %.40s\n", job.id, job.container_name, job.state, job.attempts, job.exit_code, duration, job.output_bytes, job.command);
+    }
+
+    printf("\n");
+    for (const auto &count : states)
+        printf("%s: %d  ", count.first.c_str(), count.second);
+    printf("\n");
+
+    return 0;
+}
+
+int show_job(long long id)
+{
+    struct job job;
+    char duration[32], time_string[32];
+
+    if (load_job(id, &job) < 0)
+    {
+        fprintf(stderr, "There's no job with ID %lld\n", id);
+        return -1;
+    }
+
+    time_t submitted = (time_t)(job.submitted_ms / 1000);
+    strftime(time_string, sizeof(time_string), "%Y-%m-%d %H:%M:%S", localtime(&submitted));
+    format_duration(job_duration_ms(&job), duration, sizeof(duration));
+
+    printf("Job: %lld\n", job.id);
+    printf("Container: %s\n", job.container_name);
+    printf("Command: %s\n", job.command);
+    printf("State: %s\n", job.state);
+    printf("Submitted: %s\n", time_string);
+    if (job.started_ms > 0)
+    {
+        char waited[32];
+        format_duration(job.started_ms - job.submitted_ms, waited, sizeof(waited));
+        printf("Started after: %s\n", waited);
+        printf("Duration: %s\n", duration);
+    }
+    printf("Attempts: %u (at most %u retries)\n", job.attempts, job.max_retries);
+    printf("Timeout: %u s\n", job.timeout_seconds);
+    if (job.exit_code >= 0)
+        printf("Exit code: %d\n", job.exit_code);
+    printf("Output: %llu bytes", job.output_bytes);
+    if (job.output_dropped > 0)
+        printf(" (%llu dropped over the %llu bytes limit)", job.output_dropped, job.output_limit);
+    if (job.stored_bytes > 0)
+        printf(", %llu bytes compressed", job.stored_bytes);
+    printf("\n");
+
+    return 0;
+}
+
+/**
+ * @brief Print the compressed output of a finished job, skipping the bytes already printed
+ *
+ * @return int 0 on success, -1 on failure
+ */
+static int print_compressed_output(long long id, unsigned long long skip)
+{
+    char path[JOB_PATH_SIZE], buffer[JOB_BUFFER_SIZE];
+    int length;
+
+    job_path(id, JOB_COMPRESSED_OUTPUT_FILE, path);
+    gzFile compressed = gzopen(path, "rb");
+    if (compressed == NULL)
+        return -1;
+
+    while ((length = gzread(compressed, buffer, sizeof(buffer))) > 0)
+    {
+        unsigned long long skipped = std::min(skip, (unsigned long long)length);
+        fwrite(buffer + skipped, 1, length - skipped, stdout);
+        skip -= skipped;
+    }
+
+    gzclose(compressed);
+    return length < 0 ? -1 : 0;
+}
+
+int show_job_output(long long id, int follow)
+{
+    char path[JOB_PATH_SIZE], buffer[JOB_BUFFER_SIZE];
+    unsigned long long printed = 0;
+    unsigned int attempt = 0;
+    struct job job;
+
+    if (load_job(id, &job) < 0)
+    {
+        fprintf(stderr, "There's no job with ID %lld\n", id);
+        return -1;
+    }
+
+    job_path(id, JOB_OUTPUT_FILE, path);
+    for (;;)
+    {
+        if (load_job(id, &job) < 0)
+            return -1;
+
+        // The output is compressed before the job is saved in its final state
+        if (is_final_state(job.state))
+        {
+            if (print_compressed_output(id, job.attempts == attempt ? printed : 0) < 0 && job.attempts > 0)
+                fprintf(stderr, "The output of job %lld is not available\n", id);
+            break;
+        }
+
+        if (job.attempts != attempt)
+        {
+            if (printed > 0)
+                printf("\n--- attempt %u ---\n", job.attempts);
+            attempt = job.attempts;
+            printed = 0;
+        }
+
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd >= 0)
+        {
+            ssize_t length;
+            while ((length = pread(fd, buffer, sizeof(buffer), printed)) > 0)
+            {
+                fwrite(buffer, 1, length, stdout);
+                printed += length;
+            }
+            close(fd);
+        }
+        fflush(stdout);
+
+        if (!follow)
+            break;
+        usleep(JOB_TAIL_INTERVAL_MS * 1000);
+    }
+
+    fflush(stdout);
+    return 0;
+}
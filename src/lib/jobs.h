@@ -0,0 +1,185 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+/**
+ * @file jobs.h
+ * @brief This file contains the definitions of the functions used in jobs.cpp regarding background jobs in LXC containers
+ *
+ * A job is a shell command submitted for a container. It gets an ID and a directory in the job store, and a marker in the queue
+ * directory while it is not finished. A single worker process (started in the background on the first submission) runs the queued
+ * jobs on a pool of threads, with a global and a per-container limit of running jobs, a timeout and retries. The exit code, the
+ * timings and the output (capped and compressed with gzip once the job finishes) stay in the store to be queried or tailed
+ *
+ * @author Simão Andrade
+ * @date 2024-06-13
+ */
+
+/**
+ * @brief Directory of the job store, with one directory per job, and directory of the markers of the unfinished jobs
+ */
+#define JOB_STORE_DIRECTORY "jobs"
+#define JOB_QUEUE_DIRECTORY JOB_STORE_DIRECTORY "/queue"
+
+/**
+ * @brief Defaults of a job: 1 hour timeout, no retries and 1 MB of output kept
+ */
+#define JOB_DEFAULT_TIMEOUT 3600
+#define JOB_DEFAULT_RETRIES 0
+#define JOB_DEFAULT_OUTPUT_LIMIT (1024 * 1024)
+
+/**
+ * @brief Default number of jobs running at the same time in one container, and in total for each CPU
+ * (a worker mostly waits for its command, which runs in the container)
+ */
+#define JOB_DEFAULT_PER_CONTAINER 2
+#define JOB_DEFAULT_WORKERS_PER_CPU 2
+
+/**
+ * @brief Time the background worker process waits for new jobs once the queue is empty, in seconds
+ */
+#define JOB_WORKERS_LINGER_SECONDS 10
+
+/**
+ * @brief Sizes of the fields of a job
+ */
+#define JOB_CONTAINER_NAME_SIZE 100
+#define JOB_COMMAND_SIZE 1024
+#define JOB_STATE_SIZE 16
+
+/**
+ * @brief Options of a submitted job
+ */
+struct job_options
+{
+    unsigned int timeout_seconds;    // the command is killed after this time, 0 for no timeout
+    unsigned int max_retries;        // runs again after a failure or timeout, at most this many times
+    unsigned long long output_limit; // bytes of output kept, the rest is counted but dropped
+};
+
+/**
+ * @brief Options of the worker pool
+ */
+struct job_pool_options
+{
+    unsigned int workers;       // jobs running at the same time, 0 for JOB_DEFAULT_WORKERS_PER_CPU per CPU
+    unsigned int per_container; // jobs running at the same time in one container
+    int follow;                 // 1 to keep waiting for jobs when the queue is empty
+};
+
+/**
+ * @brief A job as kept in the store
+ */
+struct job
+{
+    long long id;
+    char container_name[JOB_CONTAINER_NAME_SIZE];
+    char command[JOB_COMMAND_SIZE];
+    char state[JOB_STATE_SIZE];      // queued, running, succeeded, failed, timed_out or cancelled
+    unsigned int attempts;
+    unsigned int max_retries;
+    unsigned int timeout_seconds;
+    unsigned long long output_limit;
+    int exit_code;                   // exit status of the last attempt, 128 + signal if killed, -1 if it did not run
+    int pid;                         // attached process of the running attempt, leader of its process group
+    unsigned long long pid_start;    // start time of that process in clock ticks since boot, tells it from a reused pid
+    long long submitted_ms;          // milliseconds since the epoch
+    long long started_ms;            // start of the last attempt
+    long long finished_ms;
+    long long not_before_ms;         // a retried job waits until this time
+    unsigned long long output_bytes; // bytes of output produced by the last attempt
+    unsigned long long output_dropped;
+    unsigned long long stored_bytes; // size of the compressed output
+};
+
+/**
+ * @brief Fill the options of a job with the defaults
+ *
+ * @param options options to fill
+ */
+void job_default_options(struct job_options *options);
+
+/**
+ * @brief Fill the options of the worker pool with the defaults
+ *
+ * @param options options to fill
+ */
+void job_pool_default_options(struct job_pool_options *options);
+
+/**
+ * @brief Queue a shell command to run in a LXC container
+ *
+ * @param container_name name of the container
+ * @param command command, run with /bin/sh -c
+ * @param options options of the job, NULL for the defaults
+ *
+ * @return long long ID of the job, -1 on failure
+ */
+long long submit_job(const char *container_name, const char *command, const struct job_options *options);
+
+/**
+ * @brief Load a job from the store
+ *
+ * @param id ID of the job
+ * @param job loaded job
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int load_job(long long id, struct job *job);
+
+/**
+ * @brief Cancel a job, killing it if it is running
+ *
+ * @param id ID of the job
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int cancel_job(long long id);
+
+/**
+ * @brief Start the worker process in the background unless it is already running
+ *
+ * @param options options of the worker pool, NULL for the defaults
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int start_job_workers(const struct job_pool_options *options);
+
+/**
+ * @brief Run the queued jobs in this process until the queue is empty (or until interrupted when following)
+ *
+ * @param options options of the worker pool, NULL for the defaults
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int run_job_workers(const struct job_pool_options *options);
+
+/**
+ * @brief List the jobs in the store
+ *
+ * @param container_name only the jobs of this container, NULL for every container
+ * @param state only the jobs in this state, NULL for every state
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int list_jobs(const char *container_name, const char *state);
+
+/**
+ * @brief Show the details of a job
+ *
+ * @param id ID of the job
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int show_job(long long id);
+
+/**
+ * @brief Print the output of a job
+ *
+ * @param id ID of the job
+ * @param follow 1 to keep printing the output until the job finishes
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int show_job_output(long long id, int follow);
+
+#endif // JOBS_H
@@ -0,0 +1,401 @@
+/**
+ * @file layers.cpp
+ * @brief Shared read-only base layers for LXC containers
+ *
+ * This file contains the implementation of the density mode. The base layer is a regular container created once from the
+ * Ubuntu bionic image and kept stopped; layered containers are overlay snapshots of it made with the clone API of liblxc, so
+ * LXC mounts the base rootfs as the lower layer and a per-container delta0 directory as the upper layer.
+ * Reads of unmodified files go to the lower inode, whose page cache is shared by every container.
+ *
+ * The report reads /proc/<pid>/smaps_rollup of every process of a container: PSS divides each shared page between its users,
+ * so the sum of the PSS is what the fleet really costs and RSS - PSS is what sharing saves.
+ *
+ * @author Simão Andrade
+ * @date 2024-06-13
+ */
+
+#include "layers.h"
+#include "lib.h"
+#include "inspect.h"
+#include "trace.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <lxc/lxccontainer.h>
+#include <vector>
+
+/**
+ * @brief Maximum size of a line of smaps_rollup and of the rootfs path
+ */
+#define SMAPS_LINE_SIZE 256
+#define ROOTFS_PATH_SIZE 1024
+
+/**
+ * @brief Bytes in a megabyte, for the report
+ */
+#define BYTES_PER_MB (1024.0 * 1024.0)
+
+int prepare_base_layer(void)
+{
+    TRACE_SPAN("prepare_base_layer");
+    struct lxc_container *base;
+    char log_message[LOG_MESSAGE_SIZE] = {0};
+    int result = 0;
+
+    base = TRACE_CALL("lxc.new", LAYER_BASE_CONTAINER, lxc_container_new(LAYER_BASE_CONTAINER, get_containers_path()));
+    if (base == NULL)
+    {
+        fprintf(stderr, "Failed to setup lxc_container struct\n");
+        return -1;
+    }
+
+    if (!base->is_defined(base))
+    {
+        printf("Creating the shared base layer %s...\n", LAYER_BASE_CONTAINER);
+        if (!TRACE_CALL("lxc.create", LAYER_BASE_CONTAINER, base->createl(base, "download", NULL, NULL, LXC_CREATE_QUIET, "-d", "ubuntu", "-r", "bionic", "-a", "amd64", NULL)))
+        {
+            fprintf(stderr, "Failed to create the base layer: %s\n", base->error_string ? base->error_string : "unknown error");
+            result = -1;
+            goto out;
+        }
+
+        snprintf(log_message, LOG_MESSAGE_SIZE, "Base layer %s created", LAYER_BASE_CONTAINER);
+        log_activity("INFO", "layers", LAYER_BASE_CONTAINER, log_message);
+    }
+
+    // The lower layer must not change under the containers built on it
+    if (base->is_running(base))
+    {
+        printf("Stopping the base layer %s, it must never run\n", LAYER_BASE_CONTAINER);
+        if (!TRACE_CALL("lxc.stop", LAYER_BASE_CONTAINER, base->stop(base)))
+        {
+            fprintf(stderr, "Failed to stop the base layer\n");
+            result = -1;
+        }
+    }
+
+out:
+    lxc_container_put(base);
+    return result;
+}
+
+int create_layered_container(const char *container_name)
+{
+    TRACE_SPAN_ARGUMENT("create_layered_container", container_name);
+    struct lxc_container *container = NULL, *base = NULL, *layered = NULL;
+    char log_message[LOG_MESSAGE_SIZE] = {0};
+    int result = 0;
+
+    if (strcmp(container_name, LAYER_BASE_CONTAINER) == 0)
+    {
+        fprintf(stderr, "%s is reserved for the base layer\n\n", LAYER_BASE_CONTAINER);
+        return -1;
+    }
+
+    container = TRACE_CALL("lxc.new", container_name, lxc_container_new(container_name, get_containers_path()));
+    if (container == NULL)
+    {
+        fprintf(stderr, "Failed to setup lxc_container struct\n\n");
+        result = -1;
+        goto out;
+    }
+
+    if (container->is_defined(container))
+    {
+        fprintf(stderr, "Container already exists\n\n");
+        result = -1;
+        goto out;
+    }
+
+    if (prepare_base_layer() < 0)
+    {
+        result = -1;
+        goto out;
+    }
+
+    base = lxc_container_new(LAYER_BASE_CONTAINER, get_containers_path());
+    if (base == NULL)
+    {
+        fprintf(stderr, "Failed to setup lxc_container struct\n\n");
+        result = -1;
+        goto out;
+    }
+
+    // Only the config and an empty upper layer are written, the rootfs is not copied
+    layered = TRACE_CALL("lxc.clone", container_name, base->clone(base, container_name, NULL, LXC_CLONE_SNAPSHOT, LAYER_BACKING_STORE, NULL, 0, NULL));
+    if (layered == NULL)
+    {
+        fprintf(stderr, "Failed to create the container on the base layer: %s\n\n", base->error_string ? base->error_string : "unknown error");
+        result = -1;
+        goto out;
+    }
+
+    snprintf(log_message, LOG_MESSAGE_SIZE, "Container %s created on the base layer", container_name);
+    log_activity("INFO", "create", container_name, log_message);
+
+    printf("Container %s created on the shared base layer %s\n", container_name, LAYER_BASE_CONTAINER);
+
+    if (!TRACE_CALL("lxc.start", container_name, layered->start(layered, 0, NULL)))
+    {
+        fprintf(stderr, "Failed to start the container: %s\n\n", layered->error_string ? layered->error_string : "unknown error");
+        result = -1;
+        goto out;
+    }
+
+    snprintf(log_message, LOG_MESSAGE_SIZE, "Container %s started", container_name);
+    log_activity("INFO", "create", container_name, log_message);
+
+    printf("Container %s started\n", container_name);
+    printf("Current state: %s\n", layered->state(layered));
+    printf("PID: %d\n", layered->init_pid(layered));
+
+out:
+    if (layered != NULL)
+        lxc_container_put(layered);
+    if (base != NULL)
+        lxc_container_put(base);
+    lxc_container_put(container);
+    return result;
+}
+
+/**
+ * @brief Get the PID namespace of a process, which identifies the container it runs in
+ *
+ * @return ino_t inode of the namespace, 0 on failure
+ */
+static ino_t get_pid_namespace(const char *pid)
+{
+    char path[SMAPS_LINE_SIZE];
+    struct stat info;
+
+    snprintf(path, sizeof(path), "/proc/%s/ns/pid", pid);
+    return stat(path, &info) == 0 ? info.st_ino : 0;
+}
+
+/**
+ * @brief Add the memory of a process, from /proc/<pid>/smaps_rollup, to the usage of its container
+ */
+static void add_process_memory(const char *pid, struct container_memory_usage *usage)
+{
+    char path[SMAPS_LINE_SIZE], line[SMAPS_LINE_SIZE], key[SMAPS_LINE_SIZE];
+    unsigned long long kilobytes;
+
+    snprintf(path, sizeof(path), "/proc/%s/smaps_rollup", pid);
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+        return; // the process exited
+
+    usage->processes++;
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        if (sscanf(line, "%255[^:]: %llu kB", key, &kilobytes) != 2)
+            continue;
+
+        if (strcmp(key, "Rss") == 0)
+            usage->rss += kilobytes * 1024;
+        else if (strcmp(key, "Pss") == 0)
+            usage->pss += kilobytes * 1024;
+        else if (strcmp(key, "Shared_Clean") == 0 || strcmp(key, "Shared_Dirty") == 0)
+            usage->shared += kilobytes * 1024;
+        else if (strcmp(key, "Private_Clean") == 0 || strcmp(key, "Private_Dirty") == 0)
+            usage->private_memory += kilobytes * 1024;
+    }
+
+    fclose(file);
+}
+
+/**
+ * @brief Add the memory of every process to the container running it, in a single walk of /proc
+ *
+ * The processes of a container are the ones in the PID namespace of its init, whatever the cgroup layout of the host
+ *
+ * @param namespaces PID namespace of each container
+ * @param usages usage of each container
+ * @param number_of_containers number of containers
+ */
+static void add_processes_memory(const std::vector<ino_t> &namespaces, struct container_memory_usage *usages, size_t number_of_containers)
+{
+    struct dirent *entry;
+
+    DIR *directory = opendir("/proc");
+    if (directory == NULL)
+        return;
+
+    while ((entry = readdir(directory)) != NULL)
+    {
+        if (entry->d_name[0] < '0' || entry->d_name[0] > '9')
+            continue;
+
+        ino_t pid_namespace = get_pid_namespace(entry->d_name);
+        for (size_t index = 0; pid_namespace != 0 && index < number_of_containers; index++)
+        {
+            if (namespaces[index] == pid_namespace)
+            {
+                add_process_memory(entry->d_name, &usages[index]);
+                break;
+            }
+        }
+    }
+
+    closedir(directory);
+}
+
+/**
+ * @brief Find the page cache charged to a container in its memory.stat ("file" on cgroup v2, "total_cache" on cgroup v1)
+ */
+static unsigned long long get_page_cache(const char *memory_stat)
+{
+    unsigned long long value = 0;
+    char key[SMAPS_LINE_SIZE];
+    int consumed = 0;
+
+    for (const char *line = memory_stat; sscanf(line, "%255s %llu%n", key, &value, &consumed) == 2; line += consumed)
+    {
+        if (strcmp(key, "file") == 0 || strcmp(key, "total_cache") == 0)
+            return value;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Fill everything but the process memory of the usage of a running container
+ *
+ * @param pid_namespace PID namespace of the container
+ *
+ * @return int 0 on success, -1 on failure
+ */
+static int load_container_usage(struct lxc_container *container, const char *container_name, struct container_memory_usage *usage, ino_t *pid_namespace)
+{
+    char rootfs_path[ROOTFS_PATH_SIZE] = {0}, pid[32];
+    char *memory_stat = NULL;
+
+    memset(usage, 0, sizeof(*usage));
+    snprintf(usage->name, sizeof(usage->name), "%s", container_name);
+
+    if (!container->is_running(container))
+        return -1;
+
+    snprintf(pid, sizeof(pid), "%d", container->init_pid(container));
+    *pid_namespace = get_pid_namespace(pid);
+    if (*pid_namespace == 0)
+        return -1;
+
+    if (container->get_config_item(container, "lxc.rootfs.path", rootfs_path, sizeof(rootfs_path)) > 0)
+    {
+        usage->layered = strncmp(rootfs_path, "overlay", 7) == 0;
+        usage->upper_size = get_rootfs_size(rootfs_path);
+    }
+
+    memory_stat = TRACE_CALL("cgroup.get", container_name, read_cgroup_item(container, "memory.stat"));
+    if (memory_stat != NULL)
+        usage->page_cache = get_page_cache(memory_stat);
+    free(memory_stat);
+
+    return 0;
+}
+
+int get_container_memory_usage(const char *container_name, struct container_memory_usage *usage)
+{
+    TRACE_SPAN_ARGUMENT("get_container_memory_usage", container_name);
+    struct lxc_container *container;
+    std::vector<ino_t> namespaces(1);
+    int result = 0;
+
+    container = lxc_container_new(container_name, get_containers_path());
+    if (container == NULL)
+    {
+        fprintf(stderr, "Failed to setup lxc_container struct\n");
+        return -1;
+    }
+
+    if (load_container_usage(container, container_name, usage, &namespaces[0]) < 0)
+    {
+        fprintf(stderr, "Container %s is not running\n", container_name);
+        result = -1;
+        goto out;
+    }
+
+    add_processes_memory(namespaces, usage, 1);
+
+out:
+    lxc_container_put(container);
+    return result;
+}
+
+/**
+ * @brief Print a line of the report
+ */
+static void print_memory_usage(const struct container_memory_usage *usage, const char *rootfs)
+{
+    printf("%-24s %-8s %6u %9.1f %9.1f %9.1f %10.1f %9.1f %9.1f\n", usage->name, rootfs, usage->processes,
+           usage->rss / BYTES_PER_MB, usage->pss / BYTES_PER_MB, usage->shared / BYTES_PER_MB, usage->private_memory / BYTES_PER_MB,
+           usage->page_cache / BYTES_PER_MB, usage->upper_size / BYTES_PER_MB);
+}
+
+int show_memory_sharing_report(const char *container_name)
+{
+    TRACE_SPAN_ARGUMENT("show_memory_sharing_report", container_name);
+    struct lxc_container **containers = NULL;
+    char **containers_names = NULL, log_message[LOG_MESSAGE_SIZE] = {0};
+    std::vector<struct container_memory_usage> usages;
+    std::vector<ino_t> namespaces;
+    struct container_memory_usage usage, total;
+    int number_of_active_containers = 0, number_of_layered_containers = 0;
+
+    if (container_name != NULL)
+    {
+        if (get_container_memory_usage(container_name, &usage) < 0)
+            return -1;
+
+        printf("%-24s %-8s %6s %9s %9s %9s %10s %9s %9s\n", "CONTAINER", "ROOTFS", "PROCS", "RSS MB", "PSS MB", "SHARED MB", "PRIVATE MB", "CACHE MB", "DISK MB");
+        print_memory_usage(&usage, usage.layered ? "layered" : "copy");
+        return 0;
+    }
+
+    number_of_active_containers = list_active_containers(get_containers_path(), &containers_names, &containers);
+    for (int index = 0; index < number_of_active_containers; index++)
+    {
+        ino_t pid_namespace = 0;
+        if (load_container_usage(containers[index], containers_names[index], &usage, &pid_namespace) == 0)
+        {
+            usages.push_back(usage);
+            namespaces.push_back(pid_namespace);
+        }
+
+        free(containers_names[index]);
+        lxc_container_put(containers[index]);
+    }
+    free(containers_names);
+    free(containers);
+
+    add_processes_memory(namespaces, usages.data(), usages.size());
+
+    memset(&total, 0, sizeof(total));
+    snprintf(total.name, sizeof(total.name), "TOTAL");
+
+    printf("%-24s %-8s %6s %9s %9s %9s %10s %9s %9s\n", "CONTAINER", "ROOTFS", "PROCS", "RSS MB", "PSS MB", "SHARED MB", "PRIVATE MB", "CACHE MB", "DISK MB");
+    for (const struct container_memory_usage &container_usage : usages)
+    {
+        print_memory_usage(&container_usage, container_usage.layered ? "layered" : "copy");
+        number_of_layered_containers += container_usage.layered;
+        total.processes += container_usage.processes;
+        total.rss += container_usage.rss;
+        total.pss += container_usage.pss;
+        total.shared += container_usage.shared;
+        total.private_memory += container_usage.private_memory;
+        total.page_cache += container_usage.page_cache;
+        total.upper_size += container_usage.upper_size;
+    }
+    print_memory_usage(&total, "");
+
+    printf("\n%zu containers (%d layered) use %.1f MB (PSS), sharing saves %.1f MB of resident memory (RSS - PSS)\n", usages.size(), number_of_layered_containers,
+           total.pss / BYTES_PER_MB, (total.rss - total.pss) / BYTES_PER_MB);
+
+    snprintf(log_message, LOG_MESSAGE_SIZE, "Memory sharing report of %zu containers", usages.size());
+    log_activity("INFO", "layers", NULL, log_message);
+
+    return 0;
+}
@@ -0,0 +1,82 @@
+#ifndef LAYERS_H
+#define LAYERS_H
+
+/**
+ * @file layers.h
+ * @brief This file contains the definitions of the functions used in layers.cpp regarding shared base layers of LXC containers
+ *
+ * In density mode a container does not get its own copy of the rootfs: it is an overlay snapshot of a base container that is never started.
+ * The base rootfs is the read-only lower layer shared by every container and each container only owns a small writable upper layer,
+ * so identical files (libc.so, binaries) are read once into the page cache and mapped by every container
+ *
+ * @author Simão Andrade
+ * @date 2024-06-13
+ */
+
+/**
+ * @brief Name of the container holding the shared base layer, it is never started
+ */
+#define LAYER_BASE_CONTAINER "cmt-base-ubuntu-bionic"
+
+/**
+ * @brief Backing store of the containers created on the base layer
+ */
+#define LAYER_BACKING_STORE "overlay"
+
+/**
+ * @brief Maximum size of a container name in a report
+ */
+#define LAYER_NAME_SIZE 100
+
+/**
+ * @brief Memory and disk used by a container, in bytes
+ */
+struct container_memory_usage
+{
+    char name[LAYER_NAME_SIZE];
+    int layered;                     // 1 if the rootfs is an overlay on the base layer
+    unsigned int processes;
+    unsigned long long rss;          // resident memory of the processes
+    unsigned long long pss;          // resident memory with shared pages divided between their users
+    unsigned long long shared;       // resident pages also mapped by other processes
+    unsigned long long private_memory; // resident pages mapped only by this container
+    unsigned long long page_cache;   // page cache charged to the container cgroup
+    unsigned long long upper_size;   // private disk usage (the upper layer of a layered container)
+};
+
+/**
+ * @brief Create the base container holding the shared layer if it does not exist, and make sure it is stopped
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int prepare_base_layer(void);
+
+/**
+ * @brief Create and start a LXC container as an overlay snapshot of the shared base layer (density mode)
+ *
+ * @param container_name name of the container
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int create_layered_container(const char *container_name);
+
+/**
+ * @brief Measure the shared and private memory of a running LXC container
+ *
+ * @param container_name name of the container
+ * @param usage measured usage
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int get_container_memory_usage(const char *container_name, struct container_memory_usage *usage);
+
+/**
+ * @brief Show the shared and private memory of a running LXC container, or of every running container
+ *
+ * @param container_name name of the container, NULL for every running container
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int show_memory_sharing_report(const char *container_name);
+
+#endif // LAYERS_H
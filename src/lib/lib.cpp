@@ -4,36 +4,26 @@
  * 
  * This file contains the implementation of the functions that interact with the LXC library.
  * The functions are responsible for creating, removing, listing, starting a connection, running a command, copying a file, defining limits of system resources and checking limits of system resources of a container.
+ * The operations are done by the typed API of container.h, these functions print their results and register them in the activity log.
  * 
  * @author Simão Andrade
  * @date 2024-06-13
  */
 
+#include "lib.h"
+#include "container.h"
+#include "idle.h"
+#include "logstore.h"
+#include "trace.h"
 #include <stdio.h>
 #include <string.h>
-#include <lxc/lxccontainer.h>
 #include <unistd.h>
 #include <time.h>
 
 /**
- * @brief Maximum number of arguments for a command
+ * @brief Maximum number of containers shown by list_containers()
  */
-#define MAX_COMMAND_ARGS 100
-
-/**
- * @brief Maximum size of a log message
- */
-#define LOG_MESSAGE_SIZE 100
-
-/**
- * @brief Name of the log file
- */
-#define LOG_FILE_NAME "log.txt"
-
-/**
- * @brief Size of the buffer to store the value of a cgroup
- */
-#define CGROUP_VALUE_BUFFER_SIZE 50
+#define MAX_LISTED_CONTAINERS 256
 
 int add_log_message(const char *message, const char *file_name)
 {
@@ -55,385 +45,395 @@ int add_log_message(const char *message, const char *file_name)
     return 0;
 }
 
-int create_new_container(const char *container_name)
+int log_activity(const char *level, const char *operation, const char *container_name, const char *message)
 {
-    struct lxc_container *container;
     char log_message[LOG_MESSAGE_SIZE] = {0};
-    int result = 0;
+    struct log_record record;
 
-    container = lxc_container_new(container_name, NULL);
-    if (container == NULL)
-    {
-        fprintf(stderr, "Failed to setup lxc_container struct\n\n");
-        result = -1;
-        goto out;
-    }
+    snprintf(log_message, LOG_MESSAGE_SIZE, "%s LOG: %s", level, message);
+    add_log_message(log_message, LOG_FILE_NAME);
 
-    if (container->is_defined(container))
+    memset(&record, 0, sizeof(record));
+    record.timestamp = (long long)time(NULL);
+    snprintf(record.level, sizeof(record.level), "%s", level);
+    snprintf(record.operation, sizeof(record.operation), "%s", operation);
+    snprintf(record.container_name, sizeof(record.container_name), "%s", container_name != NULL ? container_name : "");
+    snprintf(record.message, sizeof(record.message), "%s", message);
+
+    if (TRACE_CALL("log.append", container_name, log_store_append(&record)) < 0)
     {
-        fprintf(stderr, "Container already exists\n\n");
-        result = -1;
-        goto out;
+        fprintf(stderr, "Failed to append to the log store\n");
+        return -1;
     }
 
-    if (!container->createl(container, "download", NULL, NULL, LXC_CREATE_QUIET, "-d", "ubuntu", "-r", "bionic", "-a", "amd64", NULL))
+    return 0;
+}
+
+/**
+ * @brief Print the error of a failed operation
+ *
+ * @param error error returned by the typed API
+ */
+static void print_error(const cmt::error &error)
+{
+    if (error.detail[0] != 0)
+        fprintf(stderr, "%s: %s\n", cmt::error_message(error.code), error.detail);
+    else if (error.system_error != 0)
+        fprintf(stderr, "%s: %s\n", cmt::error_message(error.code), strerror(error.system_error));
+    else
+        fprintf(stderr, "%s\n", cmt::error_message(error.code));
+}
+
+int create_new_container(const char *container_name)
+{
+    TRACE_SPAN_ARGUMENT("create_new_container", container_name);
+    char log_message[LOG_MESSAGE_SIZE] = {0};
+
+    cmt::result<cmt::container> created = cmt::container::create(container_name);
+    if (!created)
     {
-        fprintf(stderr, "Failed to create container rootfs: %s\n\n", container->error_string ? container->error_string : "unknown error");
-        result = -1;
-        goto out;
+        print_error(created.error());
+        printf("\n");
+        return -1;
     }
+    cmt::container &container = created.value();
 
-    snprintf(log_message, LOG_MESSAGE_SIZE, "INFO LOG: Container %s created", container_name);
-    add_log_message(log_message, LOG_FILE_NAME);
+    snprintf(log_message, LOG_MESSAGE_SIZE, "Container %s created", container_name);
+    log_activity("INFO", "create", container_name, log_message);
 
     printf("Container %s created\n", container_name);
 
-    if (!container->start(container, 0, NULL))
+    cmt::result<void> started = container.start();
+    if (!started)
     {
-        fprintf(stderr, "Failed to start the container: %s\n\n", container->error_string ? container->error_string : "unknown error");
-        result = -1;
-        goto out;
+        print_error(started.error());
+        printf("\n");
+        return -1;
     }
 
-    snprintf(log_message, LOG_MESSAGE_SIZE, "INFO LOG: Container %s started", container_name);
-    add_log_message(log_message, LOG_FILE_NAME);
+    snprintf(log_message, LOG_MESSAGE_SIZE, "Container %s started", container_name);
+    log_activity("INFO", "create", container_name, log_message);
 
     printf("Container %s started\n", container_name);
-    printf("Current state: %s\n", container->state(container));
-    printf("PID: %d\n", container->init_pid(container));
+    printf("Current state: %s\n", cmt::state_name(container.state()));
+    printf("PID: %d\n", container.pid());
 
-out:
-    lxc_container_put(container);
-    return result;
+    return 0;
 }
 
 int remove_container(const char *container_name)
 {
-    struct lxc_container *container;
+    TRACE_SPAN_ARGUMENT("remove_container", container_name);
     char log_message[LOG_MESSAGE_SIZE] = {0};
-    int result = 0;
 
-    container = lxc_container_new(container_name, NULL);
-    if (container == NULL)
+    cmt::result<cmt::container> opened = cmt::container::open(container_name);
+    if (!opened)
     {
-        fprintf(stderr, "Failed to setup lxc_container struct\n");
-        result = -1;
-        goto out;
+        print_error(opened.error());
+        return -1;
     }
+    cmt::container &container = opened.value();
 
-    if (!container->is_defined(container))
+    if (!container.is_defined())
     {
         fprintf(stderr, "Container does not exist\n");
-        result = -1;
-        goto out;
+        return -1;
     }
 
-    if (!container->stop(container))
+    if (container.is_running())
     {
-        fprintf(stderr, "Failed to stop the container: %s\n", container->error_string ? container->error_string : "unknown error");
-        snprintf(log_message, LOG_MESSAGE_SIZE, "ERROR LOG: Failed to stop container %s", container_name);
-        add_log_message(log_message, LOG_FILE_NAME);
-        result = -1;
-        goto out;
-    }
+        cmt::result<void> stopped = container.stop();
+        if (!stopped)
+        {
+            print_error(stopped.error());
+            snprintf(log_message, LOG_MESSAGE_SIZE, "Failed to stop container %s", container_name);
+            log_activity("ERROR", "remove", container_name, log_message);
+            return -1;
+        }
 
-    snprintf(log_message, LOG_MESSAGE_SIZE, "WARNING LOG: Container %s stopped", container_name);
-    add_log_message(log_message, LOG_FILE_NAME);
+        snprintf(log_message, LOG_MESSAGE_SIZE, "Container %s stopped", container_name);
+        log_activity("WARNING", "remove", container_name, log_message);
 
-    printf("Container %s\n", container_name);
-    printf("Current state: %s\n", container->state(container));
+        printf("Container %s\n", container_name);
+        printf("Current state: %s\n", cmt::state_name(container.state()));
+    }
 
-    if (!container->destroy(container))
+    cmt::result<void> destroyed = container.destroy();
+    if (!destroyed)
     {
-        fprintf(stderr, "Failed to destroy the container: %s\n", container->error_string ? container->error_string : "unknown error");
-        snprintf(log_message, LOG_MESSAGE_SIZE, "ERROR LOG: Failed to destroy container %s", container_name);
-        add_log_message(log_message, LOG_FILE_NAME);
-        result = -1;
-        goto out;
+        print_error(destroyed.error());
+        snprintf(log_message, LOG_MESSAGE_SIZE, "Failed to destroy container %s", container_name);
+        log_activity("ERROR", "remove", container_name, log_message);
+        return -1;
     }
 
-    snprintf(log_message, LOG_MESSAGE_SIZE, "WARNING LOG: Container %s destroyed", container_name);
-    add_log_message(log_message, LOG_FILE_NAME);
+    snprintf(log_message, LOG_MESSAGE_SIZE, "Container %s destroyed", container_name);
+    log_activity("WARNING", "remove", container_name, log_message);
 
     printf("Container %s removed\n", container_name);
 
-out:
-    lxc_container_put(container);
-    return result;
+    return 0;
 }
 
 int list_containers(void)
 {
-    struct lxc_container **containers;
-    char **containers_names, log_message[LOG_MESSAGE_SIZE] = {0};
-    int number_of_active_containers = 0, result = 0;
+    TRACE_SPAN("list_containers");
+    static cmt::container_info containers[MAX_LISTED_CONTAINERS];
+    char log_message[LOG_MESSAGE_SIZE] = {0};
+    size_t number_of_active_containers, number_of_listed_containers;
 
-    number_of_active_containers = list_active_containers(NULL, &containers_names, &containers);
-    if (number_of_active_containers < 0)
+    cmt::result<size_t> listed = cmt::list_running(containers, MAX_LISTED_CONTAINERS);
+    if (!listed && listed.error().code != cmt::error_code::buffer_too_small)
     {
-        fprintf(stderr, "Failed to list containers\n\n");
-        result = -1;
-        goto out;
+        print_error(listed.error());
+        printf("\n");
+        return -1;
     }
+    number_of_active_containers = listed ? listed.value() : listed.error().size;
+    number_of_listed_containers = listed ? listed.value() : MAX_LISTED_CONTAINERS;
 
     if (number_of_active_containers == 0)
     {
         printf("No active containers found!\n\n");
-        goto out;
+        return 0;
     }
 
-    printf("NUMBER OF CONTAINERS: %d\n\n", number_of_active_containers);
-    for (int index = 0; index < number_of_active_containers; index++)
+    printf("NUMBER OF CONTAINERS: %zu\n\n", number_of_active_containers);
+    for (size_t index = 0; index < number_of_listed_containers; index++)
     {
-        printf("--- Container %d ---\n", index + 1);
-        printf("Name: %s\n", containers_names[index]);
-        printf("State: %s\n", containers[index]->state(containers[index]));
-        printf("PID: %d\n", containers[index]->init_pid(containers[index]));
-        char *ip = *containers[index]->get_ips(containers[index], "eth0", "inet", 0);
-        if (ip != NULL)
-        {
-            printf("IP: %s\n", ip);
-        }
-        else
-        {
-            printf("IP: N/A\n");
-        }
+        printf("--- Container %zu ---\n", index + 1);
+        printf("Name: %s\n", containers[index].name);
+        printf("State: %s\n", cmt::state_name(containers[index].state));
+        printf("PID: %d\n", containers[index].pid);
+        printf("IP: %s\n", containers[index].ip[0] != 0 ? containers[index].ip : "N/A");
+    }
+    if (number_of_listed_containers < number_of_active_containers)
+    {
+        printf("(%zu more not shown)\n", number_of_active_containers - number_of_listed_containers);
     }
     printf("\n");
 
-    snprintf(log_message, LOG_MESSAGE_SIZE, "INFO LOG: Listed %d active containers", number_of_active_containers);
-    add_log_message(log_message, LOG_FILE_NAME);
+    snprintf(log_message, LOG_MESSAGE_SIZE, "Listed %zu active containers", number_of_active_containers);
+    log_activity("INFO", "list", NULL, log_message);
 
-out:
-    free(containers_names);
-    return result;
+    return 0;
 }
 
 int start_connection(const char *container_name)
 {
-    struct lxc_container *container;
-    int result = 0, ttynum = -1; // allocate the first available tty
+    TRACE_SPAN_ARGUMENT("start_connection", container_name);
+    int ttynum = -1; // allocate the first available tty
     char log_message[LOG_MESSAGE_SIZE] = {0};
 
-    container = lxc_container_new(container_name, NULL);
-    if (container == NULL)
+    cmt::result<cmt::container> opened = cmt::container::open(container_name);
+    if (!opened)
     {
-        fprintf(stderr, "Failed to setup lxc_container struct\n\n");
-        result = -1;
-        goto out;
+        print_error(opened.error());
+        printf("\n");
+        return -1;
     }
+    cmt::container &container = opened.value();
 
-    if (!container->is_running(container)) // not running
+    if (!container.is_running()) // not running
     {
         printf("Starting the container\n\n");
-        if (!container->start(container, 0, NULL))
-        {
-            fprintf(stderr, "Failed to start the container: %s\n", container->error_string ? container->error_string : "unknown error");
-            snprintf(log_message, LOG_MESSAGE_SIZE, "ERROR LOG: Failed to start container %s", container_name);
-            add_log_message(log_message, LOG_FILE_NAME);
-            result = -1;
-            goto out;
-        }
+    }
+
+    int session_fd = open_container_session(container_name); // not frozen by the idle manager while connected
+    cmt::result<void> prepared = container.prepare(); // started if needed, thawed if frozen by the idle manager
+    if (!prepared)
+    {
+        close_container_session(session_fd);
+        print_error(prepared.error());
+        snprintf(log_message, LOG_MESSAGE_SIZE, "Failed to %s container %s", prepared.error().code == cmt::error_code::thaw_failed ? "thaw" : "start", container_name);
+        log_activity("ERROR", "connect", container_name, log_message);
+        return -1;
     }
 
     printf("Starting connection for container %s\n", container_name);
 
-    if (container->console(container, ttynum, STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO, 1) < 0)
+    cmt::result<void> connected = container.console(ttynum, STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO);
+    close_container_session(session_fd);
+    if (!connected)
     {
-        fprintf(stderr, "Failed to start connection: %s\n", container->error_string ? container->error_string : "unknown error");
-        snprintf(log_message, LOG_MESSAGE_SIZE, "ERROR LOG: Failed to start connection with container %s", container_name);
-        add_log_message(log_message, LOG_FILE_NAME);
-        result = -1;
-        goto out;
+        print_error(connected.error());
+        snprintf(log_message, LOG_MESSAGE_SIZE, "Failed to start connection with container %s", container_name);
+        log_activity("ERROR", "connect", container_name, log_message);
+        return -1;
     }
 
-    snprintf(log_message, LOG_MESSAGE_SIZE, "INFO LOG: Connection started for container %s", container_name);
-    add_log_message(log_message, LOG_FILE_NAME);
+    snprintf(log_message, LOG_MESSAGE_SIZE, "Connection started for container %s", container_name);
+    log_activity("INFO", "connect", container_name, log_message);
 
-out:
-    lxc_container_put(container);
-    return result;
+    return 0;
 }
 
 int run_command_in_container(const char *container_name, char *command)
 {
-    int result = 0, token_index = 0;
-    struct lxc_container *container;
-    char *arguments[MAX_COMMAND_ARGS] = {0}, *token, log_message[LOG_MESSAGE_SIZE] = {0};
+    TRACE_SPAN_ARGUMENT("run_command_in_container", container_name);
+    char log_message[LOG_MESSAGE_SIZE] = {0};
 
-    container = lxc_container_new(container_name, NULL);
-    if (container == NULL)
+    cmt::result<cmt::container> opened = cmt::container::open(container_name);
+    if (!opened)
     {
-        fprintf(stderr, "Failed to setup lxc_container struct\n");
-        result = -1;
-        goto out;
+        print_error(opened.error());
+        return -1;
     }
+    cmt::container &container = opened.value();
 
-    if (!container->is_running(container)) // not running
+    if (!container.is_running()) // not running
     {
         printf("Starting the container\n\n");
-        if (!container->start(container, 0, NULL))
-        {
-            fprintf(stderr, "Failed to start the container: %s\n", container->error_string ? container->error_string : "unknown error");
-            snprintf(log_message, LOG_MESSAGE_SIZE, "ERROR LOG: Failed to start container %s", container_name);
-            add_log_message(log_message, LOG_FILE_NAME);
-            result = -1;
-            goto out;
-        }
     }
 
-    printf("Executing command \"%s\" in container %s\n", command, container_name);
-
-    token = strtok(command, " "); // Tokenizing command
-    while (token != NULL)
+    int session_fd = open_container_session(container_name); // not frozen by the idle manager while the command runs
+    cmt::result<void> prepared = container.prepare(); // started if needed, thawed if frozen by the idle manager
+    if (!prepared)
     {
-        arguments[token_index++] = token;
-        token = strtok(NULL, " ");
+        close_container_session(session_fd);
+        print_error(prepared.error());
+        snprintf(log_message, LOG_MESSAGE_SIZE, "Failed to %s container %s", prepared.error().code == cmt::error_code::thaw_failed ? "thaw" : "start", container_name);
+        log_activity("ERROR", "exec", container_name, log_message);
+        return -1;
     }
-    arguments[token_index] = NULL; // Set the last argument to NULL
 
-    if (container->attach_run_wait(container, NULL, command, arguments) < 0) // Run the command
+    printf("Executing command \"%s\" in container %s\n", command, container_name);
+    fflush(stdout); // before the output of the command
+
+    // The command is split in place, the log keeps the whole of it
+    char logged_command[LOG_MESSAGE_SIZE] = {0};
+    snprintf(logged_command, sizeof(logged_command), "%s", command);
+
+    cmt::result<int> executed = container.run(command, command, strlen(command) + 1); // split in place
+    close_container_session(session_fd);
+    if (!executed)
     {
-        fprintf(stderr, "Failed to execute command: %s\n", container->error_string ? container->error_string : "unknown error");
-        snprintf(log_message, LOG_MESSAGE_SIZE, "ERROR LOG: Failed to execute command \"%s\" in container %s", command, container_name);
-        add_log_message(log_message, LOG_FILE_NAME);
-        result = -1;
-        goto out;
+        print_error(executed.error());
+        snprintf(log_message, LOG_MESSAGE_SIZE, "Failed to execute command \"%.40s\" in container %s", logged_command, container_name);
+        log_activity("ERROR", "exec", container_name, log_message);
+        return -1;
     }
 
-    snprintf(log_message, LOG_MESSAGE_SIZE, "INFO LOG: Command \"%s\" executed in container %s", command, container_name);
-    add_log_message(log_message, LOG_FILE_NAME);
+    snprintf(log_message, LOG_MESSAGE_SIZE, "Command \"%.40s\" executed in container %s", logged_command, container_name);
+    log_activity("INFO", "exec", container_name, log_message);
 
-out:
-    lxc_container_put(container);
-    return result;
+    return 0;
 }
 
 int copy_file_to_container(const char *container_name, const char *file_name)
 {
+    TRACE_SPAN_ARGUMENT("copy_file_to_container", container_name);
     char log_message[LOG_MESSAGE_SIZE] = {0};
-    char destination_path[1024] = {0}, copy_command[FILENAME_MAX] = {0};
 
-    struct lxc_container *container = lxc_container_new(container_name, NULL);
-    if (container == NULL) // container does not exist
+    cmt::result<cmt::container> opened = cmt::container::open(container_name);
+    if (!opened)
     {
-        fprintf(stderr, "There's no container with the name %s\n", container_name);
-        snprintf(log_message, LOG_MESSAGE_SIZE, "ERROR LOG: Failed to copy file to container %s", container_name);
-        add_log_message(log_message, LOG_FILE_NAME);
+        print_error(opened.error());
+        snprintf(log_message, LOG_MESSAGE_SIZE, "Failed to copy file to container %s", container_name);
+        log_activity("ERROR", "copy", container_name, log_message);
         return -1;
     }
 
-    snprintf(destination_path, sizeof(destination_path), "~/.local/share/lxc/%s/rootfs/home/ubuntu/", container_name);
-    snprintf(copy_command, sizeof(copy_command), "sudo cp %s %s", file_name, destination_path);
-
-    if (system(copy_command) < 0)
+    int session_fd = open_container_session(container_name); // not frozen by the idle manager while the file is written
+    cmt::result<size_t> copied = opened.value().copy_file(file_name);
+    close_container_session(session_fd);
+    if (!copied)
     {
-        fprintf(stderr, "Failed to copy file\n");
-        snprintf(log_message, LOG_MESSAGE_SIZE, "ERROR LOG: Failed to copy file %s to container %s", file_name, container_name);
-        add_log_message(log_message, LOG_FILE_NAME);
+        if (copied.error().code == cmt::error_code::not_defined)
+            fprintf(stderr, "There's no container with the name %s\n", container_name);
+        else
+            print_error(copied.error());
+        snprintf(log_message, LOG_MESSAGE_SIZE, "Failed to copy file %s to container %s", file_name, container_name);
+        log_activity("ERROR", "copy", container_name, log_message);
         return -1;
     }
 
     printf("File %s copied to container %s\n", file_name, container_name);
 
     // Add log message
-    snprintf(log_message, LOG_MESSAGE_SIZE, "INFO LOG: File %s copied to container %s", file_name, container_name);
-    add_log_message(log_message, LOG_FILE_NAME);
+    snprintf(log_message, LOG_MESSAGE_SIZE, "File %s copied to container %s", file_name, container_name);
+    log_activity("INFO", "copy", container_name, log_message);
 
     return 0;
 }
 
 int define_limits_of_system_resources(const char *container_name, const char *cgroup_subsystem, const char *cgroup_value)
 {
-    struct lxc_container *container;
+    TRACE_SPAN_ARGUMENT("define_limits_of_system_resources", container_name);
     char log_message[LOG_MESSAGE_SIZE] = {0};
-    int result = 0;
 
-    container = lxc_container_new(container_name, NULL);
-    if (container == NULL)
+    cmt::result<cmt::container> opened = cmt::container::open(container_name);
+    if (!opened)
     {
-        fprintf(stderr, "Failed to setup lxc_container struct\n");
-        result = -1;
-        goto out;
+        print_error(opened.error());
+        return -1;
     }
+    cmt::container &container = opened.value();
 
-    if (!container->is_running(container)) // not running
+    if (!container.is_defined())
     {
-        printf("Starting the container\n\n");
-        if (!container->start(container, 0, NULL))
-        {
-            fprintf(stderr, "Failed to start the container: %s\n", container->error_string ? container->error_string : "unknown error");
-            snprintf(log_message, LOG_MESSAGE_SIZE, "ERROR LOG: Failed to start container %s", container_name);
-            add_log_message(log_message, LOG_FILE_NAME);
-            result = -1;
-            goto out;
-        }
+        fprintf(stderr, "Container does not exist\n");
+        return -1;
     }
 
     printf("Defining limits of system resources (%s) for container %s\n", cgroup_subsystem, container_name);
 
-    if (!container->set_cgroup_item(container, cgroup_subsystem, cgroup_value))
+    cmt::result<cmt::limit_source> defined = container.set_limit(cgroup_subsystem, cgroup_value);
+    if (!defined)
     {
-        fprintf(stderr, "Failed to set cgroup: %s\n", container->error_string ? container->error_string : "unknown error");
-        snprintf(log_message, LOG_MESSAGE_SIZE, "ERROR LOG: Failed to define limits of system resources (%s) for container %s", cgroup_subsystem, container_name);
-        add_log_message(log_message, LOG_FILE_NAME);
-        result = -1;
-        goto out;
+        print_error(defined.error());
+        snprintf(log_message, LOG_MESSAGE_SIZE, "Failed to define limits of system resources (%s) for container %s", cgroup_subsystem, container_name);
+        log_activity("ERROR", "limit", container_name, log_message);
+        return -1;
     }
 
-    snprintf(log_message, LOG_MESSAGE_SIZE, "INFO LOG: The resource %s of the container %s was defined with value '%s'", cgroup_subsystem, container_name, cgroup_value);
-    add_log_message(log_message, LOG_FILE_NAME);
+    if (defined.value() != cmt::limit_source::live)
+    {
+        printf("Container %s is not running, the limit will be applied on the next boot\n", container_name);
+    }
+
+    snprintf(log_message, LOG_MESSAGE_SIZE, "The resource %s of the container %s was defined with value '%s'", cgroup_subsystem, container_name, cgroup_value);
+    log_activity("INFO", "limit", container_name, log_message);
 
-out:
-    lxc_container_put(container);
-    return result;
+    return 0;
 }
 
 int check_limits_of_system_resources(const char *container_name, const char *cgroup_subsystem)
 {
-    struct lxc_container *container;
-    int result = 0, container_pid = -1;
-    char cgroup_value[CGROUP_VALUE_BUFFER_SIZE] = {0};
-
-    container = lxc_container_new(container_name, NULL);
-    if (container == NULL)
-    {
-        fprintf(stderr, "Failed to setup lxc_container struct\n");
-        result = -1;
-        goto out;
-    }
+    TRACE_SPAN_ARGUMENT("check_limits_of_system_resources", container_name);
+    char cgroup_value[CONTAINER_VALUE_SIZE] = {0};
 
-    if (!container->is_running(container))
+    cmt::result<cmt::container> opened = cmt::container::open(container_name);
+    if (!opened)
     {
-        printf("Starting the container\n\n");
-        if (!container->start(container, 0, NULL))
-        {
-            fprintf(stderr, "Failed to start the container: %s\n", container->error_string ? container->error_string : "unknown error");
-            result = -1;
-            goto out;
-        }
+        print_error(opened.error());
+        return -1;
     }
+    cmt::container &container = opened.value();
 
-    container_pid = container->init_pid(container);
-    if (container_pid < 0)
+    if (!container.is_defined())
     {
-        fprintf(stderr, "Failed to get the PID of the container: %s\n", container->error_string ? container->error_string : "unknown error");
-        result = -1;
-        goto out;
+        fprintf(stderr, "Container does not exist\n");
+        return -1;
     }
 
-    printf("Checking limits of system resources (%s) for container %s\n with PID %d\n", cgroup_subsystem, container_name, container_pid);
+    if (container.is_running())
+        printf("Checking limits of system resources (%s) for container %s\n with PID %d\n", cgroup_subsystem, container_name, container.pid());
+    else // read the configured value instead of booting the container
+        printf("Checking limits of system resources (%s) for stopped container %s\n", cgroup_subsystem, container_name);
 
-    if (!container->get_cgroup_item(container, cgroup_subsystem, cgroup_value, sizeof(cgroup_value)))
+    cmt::result<cmt::limit_value> checked = container.get_limit(cgroup_subsystem, cgroup_value, sizeof(cgroup_value));
+    if (!checked)
     {
-        fprintf(stderr, "Failed to get cgroup: %s\n", container->error_string ? container->error_string : "unknown error");
-        result = -1;
-        goto out;
+        print_error(checked.error());
+        return -1;
     }
 
-    printf("Resource Value: %s\n", cgroup_value);
+    const cmt::limit_value &limit = checked.value();
+    if (limit.source == cmt::limit_source::unset)
+        printf("Resource Value: not set (host default)\n");
+    else
+        printf("Resource Value: %.*s%s\n", (int)limit.value.size(), limit.value.data(), limit.source == cmt::limit_source::configured ? " (applied on next boot)" : "");
 
-out:
-    lxc_container_put(container);
-    return result;
+    return 0;
 }
\ No newline at end of file
@@ -12,6 +12,38 @@
  * @date 2024-06-13
  */
 
+/**
+ * @brief Maximum size of a log message
+ */
+#define LOG_MESSAGE_SIZE 100
+
+/**
+ * @brief Name of the log file
+ */
+#define LOG_FILE_NAME "log.txt"
+
+/**
+ * @brief Append a timestamped message to the activity log
+ *
+ * @param message message to register
+ * @param file_name name of the log file
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int add_log_message(const char *message, const char *file_name);
+
+/**
+ * @brief Register an activity both in the log file and in the indexed log store
+ *
+ * @param level INFO, WARNING or ERROR
+ * @param operation operation that generated the activity (e.g. create, exec)
+ * @param container_name name of the container, NULL if the activity is not about a single container
+ * @param message description of the activity
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int log_activity(const char *level, const char *operation, const char *container_name, const char *message);
+
 /**
  * @brief Create a new LXC container object
  *
@@ -0,0 +1,885 @@
+/**
+ * @file logstore.cpp
+ * @brief Append-only segmented store for the activity log
+ *
+ * This file contains the implementation of the indexed activity log store.
+ * Records are appended as JSON lines to the active segment. When it reaches LOG_SEGMENT_MAX_BYTES it is sealed and an index
+ * is written next to it with the time range, a sparse time index, the record offsets of each container and the levels and
+ * operations present. Queries use the indexes to skip whole segments and to seek straight to the matching records.
+ *
+ * @author Simão Andrade
+ * @date 2024-06-13
+ */
+
+#include "logstore.h"
+#include "trace.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <errno.h>
+#include <ctype.h>
+#include <limits.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+/**
+ * @brief Number of records between two entries of the sparse time index
+ */
+#define LOG_INDEX_TIME_STRIDE 256
+
+/**
+ * @brief Lock file serializing sealing, compaction and retention against queries
+ */
+#define LOG_STORE_LOCK_FILE LOG_STORE_DIRECTORY "/.lock"
+
+/**
+ * @brief Maximum size of a segment file path
+ */
+#define SEGMENT_PATH_SIZE 256
+
+/**
+ * @brief Entry of the sparse time index of a segment
+ */
+struct time_mark
+{
+    long offset;          // offset of the record
+    long long max_before; // newest timestamp of the records before this offset
+    long long min_after;  // oldest timestamp of the records from this offset on
+};
+
+/**
+ * @brief In-memory view of the index of a sealed segment
+ */
+struct segment_index
+{
+    long long min_time = 0;
+    long long max_time = 0;
+    long count = 0;
+    std::map<std::string, std::vector<long>> containers;
+    std::set<std::string> levels;
+    std::set<std::string> operations;
+    std::vector<struct time_mark> time_marks;
+};
+
+/**
+ * @brief Number of the segment this process is appending to, -1 when it must be looked up again
+ */
+static int active_segment = -1;
+
+/**
+ * @brief Build the path of a segment data (".log") or index (".idx") file
+ */
+static void segment_path(int number, const char *suffix, char *path)
+{
+    snprintf(path, SEGMENT_PATH_SIZE, "%s/segment-%08d%s", LOG_STORE_DIRECTORY, number, suffix);
+}
+
+/**
+ * @brief Check if a segment was sealed (has an index)
+ */
+static bool is_sealed(int number)
+{
+    char path[SEGMENT_PATH_SIZE];
+    segment_path(number, ".idx", path);
+    return access(path, F_OK) == 0;
+}
+
+/**
+ * @brief List the numbers of the segments in the store, oldest first
+ */
+static std::vector<int> list_segments(void)
+{
+    std::vector<int> segments;
+    struct dirent *entry;
+    int number;
+    char suffix[8];
+
+    DIR *directory = opendir(LOG_STORE_DIRECTORY);
+    if (directory == NULL)
+        return segments;
+
+    while ((entry = readdir(directory)) != NULL)
+    {
+        if (sscanf(entry->d_name, "segment-%d.%7s", &number, suffix) == 2 && strcmp(suffix, "log") == 0)
+            segments.push_back(number);
+    }
+    closedir(directory);
+
+    std::sort(segments.begin(), segments.end());
+    return segments;
+}
+
+/**
+ * @brief Take the store lock, shared for readers and exclusive for writers of indexes
+ *
+ * @return int file descriptor of the lock, -1 on failure
+ */
+static int lock_store(int operation)
+{
+    int lock_fd = open(LOG_STORE_LOCK_FILE, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (lock_fd < 0)
+        return -1;
+
+    if (flock(lock_fd, operation) < 0)
+    {
+        close(lock_fd);
+        return -1;
+    }
+
+    return lock_fd;
+}
+
+/**
+ * @brief Release the store lock
+ */
+static void unlock_store(int lock_fd)
+{
+    if (lock_fd >= 0)
+        close(lock_fd); // also releases the flock
+}
+
+/**
+ * @brief Append a JSON string literal to a line
+ */
+static void append_json_string(std::string &line, const char *text)
+{
+    line += '"';
+    for (const char *character = text; *character; character++)
+    {
+        switch (*character)
+        {
+        case '"':
+            line += "\\\"";
+            break;
+        case '\\':
+            line += "\\\\";
+            break;
+        case '\n':
+            line += "\\n";
+            break;
+        case '\t':
+            line += "\\t";
+            break;
+        default:
+            if ((unsigned char)*character < 0x20)
+            {
+                char escaped[8];
+                snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned char)*character);
+                line += escaped;
+            }
+            else
+            {
+                line += *character;
+            }
+        }
+    }
+    line += '"';
+}
+
+/**
+ * @brief Encode a record as a single JSON line
+ */
+static std::string encode_record(const struct log_record *record)
+{
+    std::string line = "{\"ts\":" + std::to_string(record->timestamp);
+    line += ",\"level\":";
+    append_json_string(line, record->level);
+    line += ",\"op\":";
+    append_json_string(line, record->operation);
+    line += ",\"container\":";
+    append_json_string(line, record->container_name);
+    line += ",\"msg\":";
+    append_json_string(line, record->message);
+    line += "}\n";
+    return line;
+}
+
+/**
+ * @brief Parse a JSON string literal into a fixed size buffer, truncating it if needed
+ *
+ * @return const char* position after the closing quote, NULL on malformed input
+ */
+static const char *parse_json_string(const char *position, char *buffer, size_t buffer_size)
+{
+    size_t length = 0;
+
+    if (*position++ != '"')
+        return NULL;
+
+    while (*position && *position != '"')
+    {
+        char character = *position++;
+        if (character == '\\')
+        {
+            switch (*position++)
+            {
+            case 'n':
+                character = '\n';
+                break;
+            case 't':
+                character = '\t';
+                break;
+            case 'u':
+                // A record torn by a crash may end anywhere, the digits are checked one by one so the NUL is never passed
+                for (int digit = 0; digit < 4; digit++)
+                    if (!isxdigit((unsigned char)position[digit]))
+                        return NULL;
+                character = (char)strtol(std::string(position, 4).c_str(), NULL, 16);
+                position += 4;
+                break;
+            case '\0':
+                return NULL;
+            default:
+                character = position[-1];
+            }
+        }
+        if (buffer != NULL && length + 1 < buffer_size)
+            buffer[length++] = character;
+    }
+
+    if (*position != '"')
+        return NULL;
+    if (buffer != NULL)
+        buffer[length] = '\0';
+
+    return position + 1;
+}
+
+/**
+ * @brief Decode a JSON line written by encode_record
+ *
+ * @return int 0 on success, -1 on malformed input
+ */
+static int decode_record(const char *line, struct log_record *record)
+{
+    char key[16];
+
+    memset(record, 0, sizeof(*record));
+    if (*line++ != '{')
+        return -1;
+
+    while (*line && *line != '}')
+    {
+        if ((line = parse_json_string(line, key, sizeof(key))) == NULL || *line++ != ':')
+            return -1;
+
+        if (strcmp(key, "ts") == 0)
+        {
+            char *end;
+            record->timestamp = strtoll(line, &end, 10);
+            line = end;
+        }
+        else
+        {
+            char *buffer = NULL;
+            size_t buffer_size = 0;
+            if (strcmp(key, "level") == 0)
+                buffer = record->level, buffer_size = sizeof(record->level);
+            else if (strcmp(key, "op") == 0)
+                buffer = record->operation, buffer_size = sizeof(record->operation);
+            else if (strcmp(key, "container") == 0)
+                buffer = record->container_name, buffer_size = sizeof(record->container_name);
+            else if (strcmp(key, "msg") == 0)
+                buffer = record->message, buffer_size = sizeof(record->message);
+
+            if ((line = parse_json_string(line, buffer, buffer_size)) == NULL) // unknown keys are skipped
+                return -1;
+        }
+
+        if (*line == ',')
+            line++;
+    }
+
+    return *line == '}' ? 0 : -1;
+}
+
+/**
+ * @brief Check if a record matches the filters of a query
+ */
+static bool match_record(const struct log_query *query, const struct log_record *record)
+{
+    if (query->container_name != NULL && strcmp(query->container_name, record->container_name) != 0)
+        return false;
+    if (query->level != NULL && strcmp(query->level, record->level) != 0)
+        return false;
+    if (query->operation != NULL && strcmp(query->operation, record->operation) != 0)
+        return false;
+    if (query->from != 0 && record->timestamp < query->from)
+        return false;
+    if (query->to != 0 && record->timestamp > query->to)
+        return false;
+    return true;
+}
+
+/**
+ * @brief Build the index of a segment by scanning its data file
+ *
+ * @return int 0 on success, -1 on failure
+ */
+static int build_index(const char *data_path, struct segment_index *index)
+{
+    struct log_record record;
+    std::vector<long long> timestamps;
+    char *line = NULL;
+    size_t line_capacity = 0;
+
+    FILE *file = fopen(data_path, "r");
+    if (file == NULL)
+        return -1;
+
+    long offset = 0;
+    ssize_t line_length;
+    while ((line_length = getline(&line, &line_capacity, file)) > 0)
+    {
+        if (decode_record(line, &record) == 0)
+        {
+            if (index->count == 0 || record.timestamp < index->min_time)
+                index->min_time = record.timestamp;
+            if (index->count == 0 || record.timestamp > index->max_time)
+                index->max_time = record.timestamp;
+
+            if (index->count % LOG_INDEX_TIME_STRIDE == 0)
+                index->time_marks.push_back({offset, 0, 0});
+
+            index->containers[record.container_name].push_back(offset);
+            index->levels.insert(record.level);
+            index->operations.insert(record.operation);
+            timestamps.push_back(record.timestamp);
+            index->count++;
+        }
+        offset += line_length;
+    }
+
+    free(line);
+    fclose(file);
+
+    // Newest timestamp before each mark and oldest timestamp from each mark on
+    long long newest = LLONG_MIN, oldest = LLONG_MAX;
+    for (size_t record_index = 0; record_index < timestamps.size(); record_index++)
+    {
+        if (record_index % LOG_INDEX_TIME_STRIDE == 0)
+            index->time_marks[record_index / LOG_INDEX_TIME_STRIDE].max_before = newest;
+        newest = std::max(newest, timestamps[record_index]);
+    }
+    for (size_t record_index = timestamps.size(); record_index-- > 0;)
+    {
+        oldest = std::min(oldest, timestamps[record_index]);
+        if (record_index % LOG_INDEX_TIME_STRIDE == 0)
+            index->time_marks[record_index / LOG_INDEX_TIME_STRIDE].min_after = oldest;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Write an index to a file
+ *
+ * @return int 0 on success, -1 on failure (the file is removed)
+ */
+static int write_index_file(const char *path, const struct segment_index *index)
+{
+    FILE *file = fopen(path, "w");
+    if (file == NULL)
+        return -1;
+
+    fprintf(file, "range %lld %lld %ld\n", index->min_time, index->max_time, index->count);
+    for (const std::string &level : index->levels)
+        fprintf(file, "level %s\n", level.c_str());
+    for (const std::string &operation : index->operations)
+        fprintf(file, "operation %s\n", operation.c_str());
+    for (const struct time_mark &mark : index->time_marks)
+        fprintf(file, "time %ld %lld %lld\n", mark.offset, mark.max_before, mark.min_after);
+    for (const auto &container : index->containers)
+    {
+        fprintf(file, "container %zu", container.second.size());
+        for (long offset : container.second)
+            fprintf(file, " %ld", offset);
+        fprintf(file, " %s\n", container.first.c_str()); // name last, it is the only free-form field
+    }
+
+    if (fclose(file) != 0)
+    {
+        unlink(path);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Write the index of a segment, replacing the previous one atomically
+ *
+ * @return int 0 on success, -1 on failure
+ */
+static int write_index(int number, const struct segment_index *index)
+{
+    char path[SEGMENT_PATH_SIZE], temporary_path[SEGMENT_PATH_SIZE + 8];
+
+    segment_path(number, ".idx", path);
+    snprintf(temporary_path, sizeof(temporary_path), "%s.tmp", path);
+
+    if (write_index_file(temporary_path, index) < 0)
+        return -1;
+
+    if (rename(temporary_path, path) < 0)
+    {
+        unlink(temporary_path);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Load the index of a sealed segment
+ *
+ * @return int 0 on success, -1 if the segment has no index
+ */
+static int load_index(int number, struct segment_index *index)
+{
+    char path[SEGMENT_PATH_SIZE], *line = NULL;
+    size_t line_capacity = 0;
+
+    segment_path(number, ".idx", path);
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+        return -1;
+
+    while (getline(&line, &line_capacity, file) > 0)
+    {
+        line[strcspn(line, "\n")] = '\0';
+
+        if (strncmp(line, "range ", 6) == 0)
+        {
+            sscanf(line + 6, "%lld %lld %ld", &index->min_time, &index->max_time, &index->count);
+        }
+        else if (strncmp(line, "level ", 6) == 0)
+        {
+            index->levels.insert(line + 6);
+        }
+        else if (strncmp(line, "operation ", 10) == 0)
+        {
+            index->operations.insert(line + 10);
+        }
+        else if (strncmp(line, "time ", 5) == 0)
+        {
+            struct time_mark mark = {0, 0, 0};
+            sscanf(line + 5, "%ld %lld %lld", &mark.offset, &mark.max_before, &mark.min_after);
+            index->time_marks.push_back(mark);
+        }
+        else if (strncmp(line, "container ", 10) == 0)
+        {
+            char *position = line + 10, *end;
+            size_t number_of_offsets = strtoul(position, &end, 10);
+            std::vector<long> offsets;
+            offsets.reserve(number_of_offsets);
+            for (size_t offset_index = 0; offset_index < number_of_offsets; offset_index++)
+            {
+                position = end;
+                offsets.push_back(strtol(position, &end, 10));
+            }
+            if (*end == ' ')
+                end++;
+            index->containers[end] = std::move(offsets);
+        }
+    }
+
+    free(line);
+    fclose(file);
+    return 0;
+}
+
+/**
+ * @brief Seal a segment by writing its index
+ *
+ * @return int 0 on success, -1 on failure
+ */
+static int seal_segment(int number)
+{
+    struct segment_index index;
+    char path[SEGMENT_PATH_SIZE];
+
+    segment_path(number, ".log", path);
+    if (build_index(path, &index) < 0)
+        return -1;
+
+    return write_index(number, &index);
+}
+
+int log_store_append(const struct log_record *record)
+{
+    char path[SEGMENT_PATH_SIZE];
+    struct stat info;
+
+    if (mkdir(LOG_STORE_DIRECTORY, 0755) < 0 && errno != EEXIST)
+        return -1;
+
+    std::string line = encode_record(record);
+
+    // Appenders share the lock and sealing takes it exclusively, so no record is written to a segment after its index
+    int lock_fd = lock_store(LOCK_SH);
+    if (lock_fd < 0)
+        return -1;
+
+    if (active_segment < 0 || is_sealed(active_segment)) // another process may have sealed it
+    {
+        std::vector<int> segments = list_segments();
+        active_segment = segments.empty() ? 1 : segments.back();
+        if (is_sealed(active_segment))
+            active_segment++;
+    }
+
+    segment_path(active_segment, ".log", path);
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        unlock_store(lock_fd);
+        return -1;
+    }
+
+    // A single O_APPEND write keeps records whole when several processes log at once
+    if (write(fd, line.data(), line.size()) != (ssize_t)line.size() || fstat(fd, &info) < 0)
+    {
+        close(fd);
+        unlock_store(lock_fd);
+        return -1;
+    }
+    close(fd);
+    unlock_store(lock_fd);
+
+    if (info.st_size >= LOG_SEGMENT_MAX_BYTES)
+    {
+        lock_fd = lock_store(LOCK_EX);
+        if (lock_fd < 0)
+            return -1;
+        if (!is_sealed(active_segment))
+            TRACE_CALL("log.seal", NULL, seal_segment(active_segment));
+        unlock_store(lock_fd);
+        active_segment = -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Read the record stored at an offset of a segment
+ *
+ * @return int 0 on success, -1 on failure
+ */
+static int read_record_at(FILE *file, long offset, char **line, size_t *line_capacity, struct log_record *record)
+{
+    if (fseek(file, offset, SEEK_SET) < 0 || getline(line, line_capacity, file) <= 0)
+        return -1;
+    return decode_record(*line, record);
+}
+
+/**
+ * @brief Run a query over a single segment
+ *
+ * @return int number of matching records, or -1 - matches when the callback asked to stop
+ */
+static int query_segment(int number, const struct log_query *query, log_record_callback callback, void *user_data)
+{
+    struct segment_index index;
+    struct log_record record;
+    char path[SEGMENT_PATH_SIZE], *line = NULL;
+    size_t line_capacity = 0;
+    int matches = 0;
+    bool stopped = false;
+    bool indexed = load_index(number, &index) == 0;
+
+    if (indexed) // prune the whole segment with its index
+    {
+        if ((query->from != 0 && index.max_time < query->from) || (query->to != 0 && index.min_time > query->to))
+            return 0;
+        if (query->level != NULL && index.levels.count(query->level) == 0)
+            return 0;
+        if (query->operation != NULL && index.operations.count(query->operation) == 0)
+            return 0;
+        if (query->container_name != NULL && index.containers.count(query->container_name) == 0)
+            return 0;
+    }
+
+    segment_path(number, ".log", path);
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+        return 0; // removed by a compaction since it was listed
+
+    if (indexed && query->container_name != NULL) // only read the records of that container
+    {
+        for (long offset : index.containers[query->container_name])
+        {
+            if (read_record_at(file, offset, &line, &line_capacity, &record) == 0 && match_record(query, &record))
+            {
+                matches++;
+                if (callback != NULL && callback(&record, user_data) != 0)
+                {
+                    stopped = true;
+                    break;
+                }
+            }
+        }
+        goto out;
+    }
+
+    {
+        long start = 0, stop = -1;
+        if (indexed)
+        {
+            for (const struct time_mark &mark : index.time_marks)
+            {
+                if (query->from != 0 && mark.max_before < query->from)
+                    start = mark.offset; // nothing before this mark is recent enough
+                if (query->to != 0 && mark.min_after > query->to)
+                {
+                    stop = mark.offset; // nothing from this mark on is old enough
+                    break;
+                }
+            }
+        }
+
+        if (fseek(file, start, SEEK_SET) < 0)
+            goto out;
+
+        long offset = start;
+        ssize_t line_length;
+        while ((stop < 0 || offset < stop) && (line_length = getline(&line, &line_capacity, file)) > 0)
+        {
+            offset += line_length;
+            if (decode_record(line, &record) == 0 && match_record(query, &record))
+            {
+                matches++;
+                if (callback != NULL && callback(&record, user_data) != 0)
+                {
+                    stopped = true;
+                    break;
+                }
+            }
+        }
+    }
+
+out:
+    free(line);
+    fclose(file);
+    return stopped ? -1 - matches : matches;
+}
+
+int log_store_query(const struct log_query *query, log_record_callback callback, void *user_data)
+{
+    TRACE_SPAN_ARGUMENT("log_store_query", query->container_name);
+    int total = 0;
+
+    int lock_fd = lock_store(LOCK_SH);
+    if (lock_fd < 0)
+        return access(LOG_STORE_DIRECTORY, F_OK) == 0 ? -1 : 0; // an empty store has nothing to match
+
+    for (int number : list_segments())
+    {
+        int matches = query_segment(number, query, callback, user_data);
+        if (matches < 0)
+        {
+            total += -1 - matches;
+            break;
+        }
+        total += matches;
+    }
+
+    unlock_store(lock_fd);
+    return total;
+}
+
+/**
+ * @brief Print a record in the format of the flat log file
+ */
+static int print_record(const struct log_record *record, void *user_data)
+{
+    (void)user_data;
+
+    char time_string[26];
+    time_t timestamp = (time_t)record->timestamp;
+    strftime(time_string, sizeof(time_string), "%c", localtime(&timestamp));
+
+    printf("%s - %s %s [%s] %s\n", time_string, record->level, record->operation, record->container_name[0] ? record->container_name : "-", record->message);
+    return 0;
+}
+
+int print_log_query(const struct log_query *query)
+{
+    int matches = log_store_query(query, print_record, NULL);
+    if (matches < 0)
+    {
+        fprintf(stderr, "Failed to query the log store\n");
+        return -1;
+    }
+
+    printf("\nNUMBER OF RECORDS: %d\n\n", matches);
+    return 0;
+}
+
+/**
+ * @brief Get the size of a segment data file
+ */
+static long long segment_size(int number)
+{
+    char path[SEGMENT_PATH_SIZE];
+    struct stat info;
+
+    segment_path(number, ".log", path);
+    return stat(path, &info) == 0 ? (long long)info.st_size : 0;
+}
+
+/**
+ * @brief Delete the data and index files of a segment, index first so it never looks sealed without data
+ */
+static void remove_segment(int number)
+{
+    char path[SEGMENT_PATH_SIZE];
+
+    segment_path(number, ".idx", path);
+    unlink(path);
+    segment_path(number, ".log", path);
+    unlink(path);
+}
+
+/**
+ * @brief Merge a group of sealed segments into the first one of the group
+ *
+ * @return int 0 on success, -1 on failure
+ */
+static int merge_segments(const std::vector<int> &group)
+{
+    struct segment_index index;
+    char path[SEGMENT_PATH_SIZE], temporary_path[SEGMENT_PATH_SIZE + 8], buffer[BUFSIZ];
+    char index_path[SEGMENT_PATH_SIZE], temporary_index_path[SEGMENT_PATH_SIZE + 8];
+    size_t bytes;
+
+    segment_path(group.front(), ".log", path);
+    snprintf(temporary_path, sizeof(temporary_path), "%s.tmp", path);
+
+    FILE *output = fopen(temporary_path, "w");
+    if (output == NULL)
+        return -1;
+
+    for (int number : group)
+    {
+        char source_path[SEGMENT_PATH_SIZE];
+        segment_path(number, ".log", source_path);
+        FILE *input = fopen(source_path, "r");
+        if (input == NULL)
+            continue;
+        while ((bytes = fread(buffer, 1, sizeof(buffer), input)) > 0)
+            fwrite(buffer, 1, bytes, output);
+        fclose(input);
+    }
+
+    // The index is written before the data is replaced, so a failure leaves the group as it was
+    segment_path(group.front(), ".idx", index_path);
+    snprintf(temporary_index_path, sizeof(temporary_index_path), "%s.tmp", index_path);
+    if (fclose(output) != 0 || build_index(temporary_path, &index) < 0 || write_index_file(temporary_index_path, &index) < 0)
+    {
+        unlink(temporary_path);
+        return -1;
+    }
+
+    if (rename(temporary_path, path) < 0)
+    {
+        unlink(temporary_path);
+        unlink(temporary_index_path);
+        return -1;
+    }
+
+    if (rename(temporary_index_path, index_path) < 0)
+    {
+        unlink(temporary_index_path);
+        return seal_segment(group.front()); // index the merged data again, never keep the index of the old data
+    }
+
+    for (size_t member = 1; member < group.size(); member++)
+        remove_segment(group[member]);
+
+    return 0;
+}
+
+int log_store_compact(void)
+{
+    TRACE_SPAN("log_store_compact");
+    std::vector<int> group;
+    long long group_size = 0;
+    int removed = 0;
+
+    int lock_fd = lock_store(LOCK_EX);
+    if (lock_fd < 0)
+        return -1;
+
+    std::vector<int> segments = list_segments();
+    segments.push_back(-1); // sentinel that flushes the last group
+
+    for (int number : segments)
+    {
+        long long size = number < 0 ? 0 : segment_size(number);
+        bool fits = number >= 0 && is_sealed(number) && group_size + size <= LOG_COMPACTED_SEGMENT_MAX_BYTES;
+
+        if (!fits)
+        {
+            if (group.size() > 1 && merge_segments(group) == 0)
+                removed += (int)group.size() - 1;
+            group.clear();
+            group_size = 0;
+            if (number < 0 || !is_sealed(number))
+                continue;
+        }
+
+        group.push_back(number);
+        group_size += size;
+    }
+
+    unlock_store(lock_fd);
+    return removed;
+}
+
+int log_store_apply_retention(long long max_age_seconds, long long max_total_bytes)
+{
+    long long total_size = 0, oldest_allowed = (long long)time(NULL) - max_age_seconds;
+    int removed = 0;
+
+    int lock_fd = lock_store(LOCK_EX);
+    if (lock_fd < 0)
+        return -1;
+
+    std::vector<int> segments = list_segments();
+    std::vector<int> kept;
+
+    for (int number : segments)
+    {
+        struct segment_index index;
+        if (max_age_seconds > 0 && load_index(number, &index) == 0 && index.max_time < oldest_allowed)
+        {
+            remove_segment(number);
+            removed++;
+            continue;
+        }
+        kept.push_back(number);
+        total_size += segment_size(number);
+    }
+
+    for (int number : kept) // oldest first, the active segment is never removed
+    {
+        if (max_total_bytes <= 0 || total_size <= max_total_bytes || !is_sealed(number))
+            break;
+        total_size -= segment_size(number);
+        remove_segment(number);
+        removed++;
+    }
+
+    unlock_store(lock_fd);
+    return removed;
+}
@@ -0,0 +1,116 @@
+#ifndef LOGSTORE_H
+#define LOGSTORE_H
+
+/**
+ * @file logstore.h
+ * @brief This file contains the definitions of the functions used in logstore.cpp regarding the indexed activity log store
+ *
+ * The activity log is stored as append-only segments of JSON records. Every sealed segment has an index with its time range,
+ * the offsets of the records of each container and the levels and operations it contains, so a query only reads the segments
+ * (and the records) that can match
+ *
+ * @author Simão Andrade
+ * @date 2024-06-13
+ */
+
+/**
+ * @brief Directory where the log segments and their indexes are stored
+ */
+#define LOG_STORE_DIRECTORY "logs"
+
+/**
+ * @brief Size after which the active segment is sealed and indexed
+ */
+#define LOG_SEGMENT_MAX_BYTES (4 * 1024 * 1024)
+
+/**
+ * @brief Maximum size of a segment produced by compaction
+ */
+#define LOG_COMPACTED_SEGMENT_MAX_BYTES (16 * LOG_SEGMENT_MAX_BYTES)
+
+/**
+ * @brief Sizes of the fields of a log record
+ */
+#define LOG_LEVEL_SIZE 16
+#define LOG_OPERATION_SIZE 32
+#define LOG_CONTAINER_NAME_SIZE 100
+#define LOG_RECORD_MESSAGE_SIZE 256
+
+/**
+ * @brief A structured activity log record
+ */
+struct log_record
+{
+    long long timestamp; // seconds since the epoch
+    char level[LOG_LEVEL_SIZE];
+    char operation[LOG_OPERATION_SIZE];
+    char container_name[LOG_CONTAINER_NAME_SIZE];
+    char message[LOG_RECORD_MESSAGE_SIZE];
+};
+
+/**
+ * @brief Filters of a log query, NULL strings and 0 times match everything
+ */
+struct log_query
+{
+    const char *container_name;
+    const char *level;
+    const char *operation;
+    long long from; // inclusive
+    long long to;   // inclusive
+};
+
+/**
+ * @brief Callback called for each record matching a query
+ *
+ * @return int 0 to continue, any other value to stop the query
+ */
+typedef int (*log_record_callback)(const struct log_record *record, void *user_data);
+
+/**
+ * @brief Append a record to the active segment, sealing it when it gets too big
+ *
+ * @param record record to append
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int log_store_append(const struct log_record *record);
+
+/**
+ * @brief Run a query over the log store, in chronological segment order
+ *
+ * @param query filters of the query
+ * @param callback function called for each matching record
+ * @param user_data pointer given to the callback
+ *
+ * @return int number of matching records on success, -1 on failure
+ */
+int log_store_query(const struct log_query *query, log_record_callback callback, void *user_data);
+
+/**
+ * @brief Print the records matching a query
+ *
+ * @param query filters of the query
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int print_log_query(const struct log_query *query);
+
+/**
+ * @brief Merge consecutive sealed segments into bigger ones, up to LOG_COMPACTED_SEGMENT_MAX_BYTES
+ *
+ * @return int number of segments removed by the compaction on success, -1 on failure
+ */
+int log_store_compact(void);
+
+/**
+ * @brief Delete the sealed segments that fall outside the retention policy
+ *
+ * @param max_age_seconds segments whose newest record is older than this are deleted (0 disables it)
+ * @param max_total_bytes oldest segments are deleted while the store is bigger than this (0 disables it)
+ *
+ * @return int number of deleted segments on success, -1 on failure
+ */
+int log_store_apply_retention(long long max_age_seconds, long long max_total_bytes);
+
+#endif // LOGSTORE_H
@@ -0,0 +1,1112 @@
+/**
+ * @file netqos.cpp
+ * @brief Network bandwidth shaping and QoS for LXC containers
+ *
+ * This file contains the implementation of the network QoS of the containers. Traffic control objects are created with
+ * rtnetlink messages (no "tc" process is spawned):
+ * - traffic entering a container is shaped by an HTB class (rate, burst and priority) with an fq_codel leaf on the egress of the veth;
+ * - traffic leaving a container is redirected by a u32 filter with a mirred action from the ingress of the veth to an IFB device,
+ *   where it is shaped the same way (a policer would only drop packets, shaping queues them);
+ * - fair sharing uses one HTB class per container on the bridge, classified by the IPv4 address of the container, for the downloads,
+ *   and the same classes on an IFB device fed by the ingress of the bridge, classified by the source address, for the uploads;
+ * - a saved policy is applied again by the start paths, since the veth and its traffic control objects die with the container.
+ *
+ * @author Simão Andrade
+ * @date 2024-06-13
+ */
+
+#include "netqos.h"
+#include "lib.h"
+#include "inspect.h"
+#include "trace.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/pkt_sched.h>
+#include <linux/pkt_cls.h>
+#include <linux/if_link.h>
+#include <linux/tc_act/tc_mirred.h>
+#include <linux/gen_stats.h>
+#include <linux/if_ether.h>
+#include <lxc/lxccontainer.h>
+#include <vector>
+
+/**
+ * @brief Size of the attributes buffer of a netlink request and of the receive buffer
+ */
+#define NETLINK_BUFFER_SIZE 8192
+#define NETLINK_RECEIVE_BUFFER_SIZE 32768
+
+/**
+ * @brief Handles of the traffic control objects created on a veth
+ */
+#define HTB_ROOT_HANDLE TC_H_MAKE(0x1U << 16, 0)
+#define HTB_CONTAINER_CLASS TC_H_MAKE(0x1U << 16, 0x10)
+#define HTB_LEAF_HANDLE TC_H_MAKE(0x10U << 16, 0)
+#define INGRESS_HANDLE TC_H_MAKE(TC_H_INGRESS, 0)
+
+/**
+ * @brief Prefix of the IFB devices shaping the traffic sent by the containers, followed by the index of the veth
+ */
+#define IFB_NAME_PREFIX "cmtq"
+
+/**
+ * @brief Prefix of the IFB device sharing the uploads of the containers, followed by the index of the bridge
+ */
+#define FAIR_SHARE_IFB_NAME_PREFIX "cmtqb"
+
+/**
+ * @brief Handles of the fair share classes created on the bridge
+ */
+#define FAIR_SHARE_ROOT_CLASS TC_H_MAKE(0x1U << 16, 0x1)
+#define FAIR_SHARE_DEFAULT_CLASS 0x2
+#define FAIR_SHARE_FIRST_CLASS 0x100
+
+/**
+ * @brief Share of the bridge bandwidth kept for the traffic that does not belong to a container, in percent
+ */
+#define FAIR_SHARE_RESERVED_PERCENT 5
+
+/**
+ * @brief Largest packet size covered by a rate table
+ */
+#define RATE_TABLE_MTU 2047
+
+/**
+ * @brief Default burst: this much time worth of traffic, but never less than NETWORK_QOS_MIN_BURST bytes
+ */
+#define NETWORK_QOS_DEFAULT_BURST_MS 20
+#define NETWORK_QOS_MIN_BURST (16 * 1024)
+
+/**
+ * @brief Maximum size of a line of the policy file and of a sysfs path
+ */
+#define POLICY_LINE_SIZE 128
+#define SYSFS_PATH_SIZE 256
+
+/**
+ * @brief A netlink traffic control request
+ */
+struct netlink_request
+{
+    struct nlmsghdr header;
+    struct tcmsg tc;
+    char attributes[NETLINK_BUFFER_SIZE];
+};
+
+/**
+ * @brief A netlink link request
+ */
+struct link_request
+{
+    struct nlmsghdr header;
+    struct ifinfomsg link;
+    char attributes[NETLINK_BUFFER_SIZE];
+};
+
+/**
+ * @brief Microseconds of a traffic control clock tick, read from /proc/net/psched
+ */
+static double tick_in_usec = 0;
+
+/**
+ * @brief Read the traffic control clock parameters
+ *
+ * @return int 0 on success, -1 on failure
+ */
+static int load_psched(void)
+{
+    unsigned int t2us, us2t, clock_res;
+
+    if (tick_in_usec > 0)
+        return 0;
+
+    FILE *file = fopen("/proc/net/psched", "r");
+    if (file == NULL)
+        return -1;
+
+    int read_values = fscanf(file, "%08x%08x%08x", &t2us, &us2t, &clock_res);
+    fclose(file);
+    if (read_values != 3 || us2t == 0)
+        return -1;
+
+    if (clock_res == 1000000000)
+        t2us = us2t;
+
+    tick_in_usec = (double)t2us / us2t * ((double)clock_res / 1000000.0);
+    return 0;
+}
+
+/**
+ * @brief Time, in clock ticks, to send size bytes at a rate
+ */
+static unsigned int calculate_transmit_time(unsigned long long rate, unsigned long long size)
+{
+    double ticks = 1000000.0 * ((double)size / rate) * tick_in_usec;
+    return ticks > 0xFFFFFFFF ? 0xFFFFFFFF : (unsigned int)ticks;
+}
+
+/**
+ * @brief Fill a rate specification and its rate table (transmit time of each packet size)
+ */
+static void calculate_rate_table(struct tc_ratespec *specification, unsigned int table[256], unsigned long long rate)
+{
+    int cell_log = 0;
+    while ((RATE_TABLE_MTU >> cell_log) > 255)
+        cell_log++;
+
+    for (int cell = 0; cell < 256; cell++)
+        table[cell] = calculate_transmit_time(rate, (unsigned long long)(cell + 1) << cell_log);
+
+    memset(specification, 0, sizeof(*specification));
+    specification->cell_log = (unsigned char)cell_log;
+    specification->cell_align = -1;
+    specification->linklayer = TC_LINKLAYER_ETHERNET;
+    specification->rate = rate >= 0xFFFFFFFFULL ? 0xFFFFFFFFU : (unsigned int)rate;
+}
+
+/**
+ * @brief Default burst of a rate
+ */
+static unsigned long long default_burst(unsigned long long rate)
+{
+    unsigned long long burst = rate * NETWORK_QOS_DEFAULT_BURST_MS / 1000;
+    return burst < NETWORK_QOS_MIN_BURST ? NETWORK_QOS_MIN_BURST : burst;
+}
+
+/**
+ * @brief Append an attribute to a netlink message
+ *
+ * @param request request the message is built in, starting with its netlink header
+ * @param capacity size of the whole request
+ *
+ * @return struct rtattr* the attribute, used to close nested attributes, NULL if it does not fit in the request
+ */
+static struct rtattr *add_attribute(void *request, size_t capacity, unsigned short type, const void *data, size_t length)
+{
+    struct nlmsghdr *header = (struct nlmsghdr *)request;
+
+    if (NLMSG_ALIGN(header->nlmsg_len) + RTA_SPACE(length) > capacity)
+        return NULL;
+
+    struct rtattr *attribute = (struct rtattr *)((char *)header + NLMSG_ALIGN(header->nlmsg_len));
+
+    attribute->rta_type = type;
+    attribute->rta_len = (unsigned short)RTA_LENGTH(length);
+    if (length > 0)
+        memcpy(RTA_DATA(attribute), data, length);
+
+    header->nlmsg_len = NLMSG_ALIGN(header->nlmsg_len) + RTA_ALIGN(attribute->rta_len);
+    return attribute;
+}
+
+/**
+ * @brief Close a nested attribute opened with add_attribute(request, capacity, type, NULL, 0)
+ */
+static void end_nested_attribute(struct nlmsghdr *header, struct rtattr *nest)
+{
+    nest->rta_len = (unsigned short)((char *)header + header->nlmsg_len - (char *)nest);
+}
+
+/**
+ * @brief Prepare a traffic control request
+ */
+static void init_request(struct netlink_request *request, unsigned short type, unsigned short flags, int interface_index, unsigned int parent, unsigned int handle)
+{
+    memset(request, 0, sizeof(*request));
+    request->header.nlmsg_len = NLMSG_LENGTH(sizeof(struct tcmsg));
+    request->header.nlmsg_type = type;
+    request->header.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK | flags;
+    request->tc.tcm_family = AF_UNSPEC;
+    request->tc.tcm_ifindex = interface_index;
+    request->tc.tcm_parent = parent;
+    request->tc.tcm_handle = handle;
+}
+
+/**
+ * @brief Open a rtnetlink socket
+ *
+ * @return int socket file descriptor, -1 on failure
+ */
+static int open_netlink(void)
+{
+    struct sockaddr_nl local;
+
+    int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (fd < 0)
+        return -1;
+
+    memset(&local, 0, sizeof(local));
+    local.nl_family = AF_NETLINK;
+    if (bind(fd, (struct sockaddr *)&local, sizeof(local)) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/**
+ * @brief Send a request to the kernel and wait for its acknowledgement
+ *
+ * @return int 0 on success, a negative errno on failure
+ */
+static int netlink_talk(struct nlmsghdr *request)
+{
+    static unsigned int sequence = 0;
+    char buffer[NETLINK_RECEIVE_BUFFER_SIZE];
+    struct sockaddr_nl kernel;
+    int result = -EIO;
+
+    int fd = open_netlink();
+    if (fd < 0)
+        return -errno;
+
+    memset(&kernel, 0, sizeof(kernel));
+    kernel.nl_family = AF_NETLINK;
+    request->nlmsg_seq = ++sequence;
+
+    if (sendto(fd, request, request->nlmsg_len, 0, (struct sockaddr *)&kernel, sizeof(kernel)) < 0)
+    {
+        result = -errno;
+        close(fd);
+        return result;
+    }
+
+    ssize_t length = recv(fd, buffer, sizeof(buffer), 0);
+    for (struct nlmsghdr *reply = (struct nlmsghdr *)buffer; length > 0 && NLMSG_OK(reply, (unsigned int)length); reply = NLMSG_NEXT(reply, length))
+    {
+        if (reply->nlmsg_seq == request->nlmsg_seq && reply->nlmsg_type == NLMSG_ERROR)
+        {
+            result = ((struct nlmsgerr *)NLMSG_DATA(reply))->error; // 0 is the acknowledgement
+            break;
+        }
+    }
+
+    close(fd);
+    return result;
+}
+
+/**
+ * @brief Add a qdisc without options
+ *
+ * @return int 0 on success, a negative errno on failure
+ */
+static int add_simple_qdisc(int interface_index, unsigned int parent, unsigned int handle, const char *kind)
+{
+    struct netlink_request request;
+
+    init_request(&request, RTM_NEWQDISC, NLM_F_CREATE | NLM_F_EXCL, interface_index, parent, handle);
+    if (add_attribute(&request, sizeof(request), TCA_KIND, kind, strlen(kind) + 1) == NULL)
+        return -EMSGSIZE;
+
+    return netlink_talk(&request.header);
+}
+
+/**
+ * @brief Add an HTB root qdisc
+ *
+ * @return int 0 on success, a negative errno on failure
+ */
+static int add_htb_qdisc(int interface_index, unsigned int default_class)
+{
+    struct netlink_request request;
+    struct tc_htb_glob global;
+
+    memset(&global, 0, sizeof(global));
+    global.version = 3;
+    global.rate2quantum = 10;
+    global.defcls = default_class;
+
+    init_request(&request, RTM_NEWQDISC, NLM_F_CREATE | NLM_F_EXCL, interface_index, TC_H_ROOT, HTB_ROOT_HANDLE);
+    struct rtattr *options;
+    if (add_attribute(&request, sizeof(request), TCA_KIND, "htb", sizeof("htb")) == NULL ||
+        (options = add_attribute(&request, sizeof(request), TCA_OPTIONS, NULL, 0)) == NULL ||
+        add_attribute(&request, sizeof(request), TCA_HTB_INIT, &global, sizeof(global)) == NULL)
+        return -EMSGSIZE;
+    end_nested_attribute(&request.header, options);
+
+    return netlink_talk(&request.header);
+}
+
+/**
+ * @brief Add an HTB class
+ *
+ * @return int 0 on success, a negative errno on failure
+ */
+static int add_htb_class(int interface_index, unsigned int parent, unsigned int handle, unsigned long long rate, unsigned long long ceil, unsigned long long burst, unsigned int priority)
+{
+    struct netlink_request request;
+    struct tc_htb_opt options_parameters;
+    unsigned int rate_table[256], ceil_table[256];
+
+    memset(&options_parameters, 0, sizeof(options_parameters));
+    calculate_rate_table(&options_parameters.rate, rate_table, rate);
+    calculate_rate_table(&options_parameters.ceil, ceil_table, ceil);
+    options_parameters.buffer = calculate_transmit_time(rate, burst);
+    options_parameters.cbuffer = calculate_transmit_time(ceil, burst);
+    options_parameters.prio = priority;
+
+    init_request(&request, RTM_NEWTCLASS, NLM_F_CREATE | NLM_F_EXCL, interface_index, parent, handle);
+    struct rtattr *options;
+    if (add_attribute(&request, sizeof(request), TCA_KIND, "htb", sizeof("htb")) == NULL ||
+        (options = add_attribute(&request, sizeof(request), TCA_OPTIONS, NULL, 0)) == NULL ||
+        add_attribute(&request, sizeof(request), TCA_HTB_PARMS, &options_parameters, sizeof(options_parameters)) == NULL ||
+        add_attribute(&request, sizeof(request), TCA_HTB_RTAB, rate_table, sizeof(rate_table)) == NULL ||
+        add_attribute(&request, sizeof(request), TCA_HTB_CTAB, ceil_table, sizeof(ceil_table)) == NULL ||
+        (rate >= 0xFFFFFFFFULL && add_attribute(&request, sizeof(request), TCA_HTB_RATE64, &rate, sizeof(rate)) == NULL) ||
+        (ceil >= 0xFFFFFFFFULL && add_attribute(&request, sizeof(request), TCA_HTB_CEIL64, &ceil, sizeof(ceil)) == NULL))
+        return -EMSGSIZE;
+    end_nested_attribute(&request.header, options);
+
+    return netlink_talk(&request.header);
+}
+
+/**
+ * @brief Add a u32 filter matching every packet, or the packets to or from an IPv4 address
+ *
+ * @param address IPv4 address to match (network order), 0 to match every packet
+ * @param match_source true to match the source address, false to match the destination
+ * @param redirect_index interface the matching packets are redirected to, 0 to only classify them
+ *
+ * @return int 0 on success, a negative errno on failure
+ */
+static int add_u32_filter(int interface_index, unsigned int parent, unsigned int class_id, unsigned int address, bool match_source, int redirect_index)
+{
+    struct netlink_request request;
+    alignas(struct tc_u32_sel) char selector_buffer[sizeof(struct tc_u32_sel) + sizeof(struct tc_u32_key)] = {0};
+    struct tc_u32_sel *selector = (struct tc_u32_sel *)selector_buffer;
+
+    selector->flags = TC_U32_TERMINAL;
+    selector->nkeys = 1; // a single key, all zero matches every packet
+    if (address != 0)
+    {
+        selector->keys[0].mask = 0xFFFFFFFF;
+        selector->keys[0].val = address;
+        selector->keys[0].off = match_source ? 12 : 16; // source or destination address in the IPv4 header
+    }
+
+    init_request(&request, RTM_NEWTFILTER, NLM_F_CREATE | NLM_F_EXCL, interface_index, parent, 0);
+    request.tc.tcm_info = TC_H_MAKE(1U << 16, htons(address != 0 ? ETH_P_IP : ETH_P_ALL)); // priority 1
+    struct rtattr *options;
+    if (add_attribute(&request, sizeof(request), TCA_KIND, "u32", sizeof("u32")) == NULL ||
+        (options = add_attribute(&request, sizeof(request), TCA_OPTIONS, NULL, 0)) == NULL ||
+        add_attribute(&request, sizeof(request), TCA_U32_SEL, selector_buffer, sizeof(selector_buffer)) == NULL ||
+        add_attribute(&request, sizeof(request), TCA_U32_CLASSID, &class_id, sizeof(class_id)) == NULL)
+        return -EMSGSIZE;
+
+    if (redirect_index > 0)
+    {
+        struct tc_mirred mirred;
+
+        memset(&mirred, 0, sizeof(mirred));
+        mirred.action = TC_ACT_STOLEN;
+        mirred.eaction = TCA_EGRESS_REDIR;
+        mirred.ifindex = (unsigned int)redirect_index;
+
+        struct rtattr *actions, *action, *action_options;
+        if ((actions = add_attribute(&request, sizeof(request), TCA_U32_ACT, NULL, 0)) == NULL ||
+            (action = add_attribute(&request, sizeof(request), 1, NULL, 0)) == NULL || // first action
+            add_attribute(&request, sizeof(request), TCA_ACT_KIND, "mirred", sizeof("mirred")) == NULL ||
+            (action_options = add_attribute(&request, sizeof(request), TCA_ACT_OPTIONS, NULL, 0)) == NULL ||
+            add_attribute(&request, sizeof(request), TCA_MIRRED_PARMS, &mirred, sizeof(mirred)) == NULL)
+            return -EMSGSIZE;
+        end_nested_attribute(&request.header, action_options);
+        end_nested_attribute(&request.header, action);
+        end_nested_attribute(&request.header, actions);
+    }
+
+    end_nested_attribute(&request.header, options);
+    return netlink_talk(&request.header);
+}
+
+/**
+ * @brief Create an IFB device and bring it up
+ *
+ * @return int index of the device, a negative errno on failure
+ */
+static int create_ifb(const char *name)
+{
+    struct link_request request;
+
+    memset(&request, 0, sizeof(request));
+    request.header.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+    request.header.nlmsg_type = RTM_NEWLINK;
+    request.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK | NLM_F_CREATE | NLM_F_EXCL;
+    request.link.ifi_family = AF_UNSPEC;
+    request.link.ifi_flags = IFF_UP;
+    request.link.ifi_change = IFF_UP;
+
+    struct rtattr *link_info;
+    if (add_attribute(&request, sizeof(request), IFLA_IFNAME, name, strlen(name) + 1) == NULL ||
+        (link_info = add_attribute(&request, sizeof(request), IFLA_LINKINFO, NULL, 0)) == NULL ||
+        add_attribute(&request, sizeof(request), IFLA_INFO_KIND, "ifb", sizeof("ifb")) == NULL)
+        return -EMSGSIZE;
+    end_nested_attribute(&request.header, link_info);
+
+    int result = netlink_talk(&request.header);
+    if (result < 0)
+        return result;
+
+    int index = (int)if_nametoindex(name);
+    return index > 0 ? index : -ENODEV;
+}
+
+/**
+ * @brief Delete a network device, a missing device is not an error
+ *
+ * @return int 0 on success, a negative errno on failure
+ */
+static int delete_link(const char *name)
+{
+    struct link_request request;
+
+    int index = (int)if_nametoindex(name);
+    if (index == 0)
+        return 0;
+
+    memset(&request, 0, sizeof(request));
+    request.header.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+    request.header.nlmsg_type = RTM_DELLINK;
+    request.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+    request.link.ifi_family = AF_UNSPEC;
+    request.link.ifi_index = index;
+
+    return netlink_talk(&request.header);
+}
+
+/**
+ * @brief Build the name of the IFB device of a veth
+ */
+static void get_ifb_name(int interface_index, char *name)
+{
+    snprintf(name, IF_NAMESIZE, "%s%d", IFB_NAME_PREFIX, interface_index);
+}
+
+/**
+ * @brief Build the name of the IFB device sharing the uploads of a bridge
+ */
+static void get_fair_share_ifb_name(int interface_index, char *name)
+{
+    snprintf(name, IF_NAMESIZE, "%s%d", FAIR_SHARE_IFB_NAME_PREFIX, interface_index);
+}
+
+/**
+ * @brief Delete a qdisc, a missing qdisc is not an error
+ *
+ * @return int 0 on success, a negative errno on failure
+ */
+static int delete_qdisc(int interface_index, unsigned int parent, unsigned int handle)
+{
+    struct netlink_request request;
+
+    init_request(&request, RTM_DELQDISC, 0, interface_index, parent, handle);
+    int result = netlink_talk(&request.header);
+    return result == -ENOENT || result == -EINVAL ? 0 : result;
+}
+
+unsigned long long parse_network_rate(const char *text)
+{
+    char *unit;
+    double bytes_per_unit;
+
+    errno = 0;
+    double value = strtod(text, &unit);
+    if (unit == text || errno != 0 || !(value > 0)) // no number, out of range, NaN or not positive
+        return 0;
+
+    if (*unit == '\0' || strcasecmp(unit, "bps") == 0)
+        bytes_per_unit = 1;
+    else if (strcasecmp(unit, "kbit") == 0)
+        bytes_per_unit = 1000.0 / 8;
+    else if (strcasecmp(unit, "mbit") == 0)
+        bytes_per_unit = 1000000.0 / 8;
+    else if (strcasecmp(unit, "gbit") == 0)
+        bytes_per_unit = 1000000000.0 / 8;
+    else if (strcasecmp(unit, "kbps") == 0)
+        bytes_per_unit = 1000;
+    else if (strcasecmp(unit, "mbps") == 0)
+        bytes_per_unit = 1000000;
+    else if (strcasecmp(unit, "gbps") == 0)
+        bytes_per_unit = 1000000000;
+    else // unknown unit
+        return 0;
+
+    double rate = value * bytes_per_unit;
+    if (rate < 1 || rate >= 18446744073709551615.0) // less than a byte per second or does not fit
+        return 0;
+
+    return (unsigned long long)rate;
+}
+
+int clear_interface_qos(const char *interface)
+{
+    char ifb_name[IF_NAMESIZE];
+
+    int interface_index = (int)if_nametoindex(interface);
+    if (interface_index == 0)
+        return -1;
+
+    get_ifb_name(interface_index, ifb_name);
+    if (delete_qdisc(interface_index, TC_H_ROOT, 0) < 0 || delete_qdisc(interface_index, TC_H_INGRESS, INGRESS_HANDLE) < 0 || delete_link(ifb_name) < 0)
+        return -1;
+
+    return 0;
+}
+
+/**
+ * @brief Shape the traffic sent by an interface with an HTB class
+ *
+ * @return int 0 on success, a negative errno on failure
+ */
+static int shape_interface(int interface_index, unsigned long long rate, unsigned long long burst, unsigned int priority)
+{
+    int result;
+
+    if ((result = add_htb_qdisc(interface_index, 0x10)) < 0 ||
+        (result = add_htb_class(interface_index, HTB_ROOT_HANDLE, HTB_CONTAINER_CLASS, rate, rate, burst, priority)) < 0)
+        return result;
+
+    // fq_codel keeps the queue short and fair between flows, without it HTB falls back to a plain fifo
+    result = add_simple_qdisc(interface_index, HTB_CONTAINER_CLASS, HTB_LEAF_HANDLE, "fq_codel");
+    return result == -ENOENT ? 0 : result;
+}
+
+/**
+ * @brief Apply a policy to the host side of a veth without reporting the failure
+ *
+ * @param direction set to "to" or "from" when the traffic to or from the interface could not be shaped
+ *
+ * @return int 0 on success, a negative errno on failure
+ */
+static int shape_veth(const char *interface, const struct network_qos_policy *policy, const char **direction)
+{
+    char ifb_name[IF_NAMESIZE];
+    int result;
+
+    int interface_index = (int)if_nametoindex(interface);
+    if (interface_index == 0)
+        return -ENODEV;
+    if (load_psched() < 0 || clear_interface_qos(interface) < 0)
+        return -EINVAL;
+
+    if (policy->ingress_rate > 0) // shaped when leaving the veth towards the container
+    {
+        unsigned long long burst = policy->ingress_burst > 0 ? policy->ingress_burst : default_burst(policy->ingress_rate);
+
+        if ((result = shape_interface(interface_index, policy->ingress_rate, burst, policy->priority)) < 0)
+        {
+            *direction = "to";
+            clear_interface_qos(interface);
+            return result;
+        }
+    }
+
+    if (policy->egress_rate > 0) // redirected from the ingress of the veth to an IFB device and shaped there
+    {
+        unsigned long long burst = policy->egress_burst > 0 ? policy->egress_burst : default_burst(policy->egress_rate);
+        int ifb_index;
+
+        get_ifb_name(interface_index, ifb_name);
+        if ((result = ifb_index = create_ifb(ifb_name)) < 0 ||
+            (result = shape_interface(ifb_index, policy->egress_rate, burst, policy->priority)) < 0 ||
+            (result = add_simple_qdisc(interface_index, TC_H_INGRESS, INGRESS_HANDLE, "ingress")) < 0 ||
+            (result = add_u32_filter(interface_index, INGRESS_HANDLE, 1, 0, false, ifb_index)) < 0)
+        {
+            *direction = "from";
+            clear_interface_qos(interface);
+            return result;
+        }
+    }
+
+    return 0;
+}
+
+int apply_interface_qos(const char *interface, const struct network_qos_policy *policy)
+{
+    TRACE_SPAN_ARGUMENT("apply_interface_qos", interface);
+    const char *direction = NULL;
+
+    int result = shape_veth(interface, policy, &direction);
+    if (result < 0 && direction != NULL)
+        fprintf(stderr, "Failed to shape the traffic %s %s: %s\n", direction, interface, strerror(-result));
+
+    return result < 0 ? -1 : 0;
+}
+
+/**
+ * @brief Read a counter of an interface from sysfs
+ */
+static unsigned long long read_interface_counter(const char *interface, const char *counter)
+{
+    char path[SYSFS_PATH_SIZE];
+    unsigned long long value = 0;
+
+    snprintf(path, sizeof(path), "/sys/class/net/%s/statistics/%s", interface, counter);
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+        return 0;
+
+    if (fscanf(file, "%llu", &value) != 1)
+        value = 0;
+    fclose(file);
+
+    return value;
+}
+
+/**
+ * @brief Sum the drops of every qdisc of an interface, asking the kernel for a qdisc dump
+ */
+static unsigned long long read_qdisc_drops(int interface_index)
+{
+    struct netlink_request request;
+    struct sockaddr_nl kernel;
+    char buffer[NETLINK_RECEIVE_BUFFER_SIZE];
+    unsigned long long drops = 0;
+    bool done = false;
+
+    int fd = open_netlink();
+    if (fd < 0)
+        return 0;
+
+    init_request(&request, RTM_GETQDISC, NLM_F_DUMP, 0, 0, 0);
+    request.header.nlmsg_flags &= ~NLM_F_ACK;
+    memset(&kernel, 0, sizeof(kernel));
+    kernel.nl_family = AF_NETLINK;
+
+    if (sendto(fd, &request, request.header.nlmsg_len, 0, (struct sockaddr *)&kernel, sizeof(kernel)) < 0)
+    {
+        close(fd);
+        return 0;
+    }
+
+    while (!done)
+    {
+        ssize_t length = recv(fd, buffer, sizeof(buffer), 0);
+        if (length <= 0)
+            break;
+
+        for (struct nlmsghdr *reply = (struct nlmsghdr *)buffer; NLMSG_OK(reply, (unsigned int)length); reply = NLMSG_NEXT(reply, length))
+        {
+            if (reply->nlmsg_type == NLMSG_DONE || reply->nlmsg_type == NLMSG_ERROR)
+            {
+                done = true;
+                break;
+            }
+
+            struct tcmsg *tc = (struct tcmsg *)NLMSG_DATA(reply);
+            if (tc->tcm_ifindex != interface_index)
+                continue;
+
+            int attributes_length = (int)reply->nlmsg_len - (int)NLMSG_LENGTH(sizeof(*tc));
+            for (struct rtattr *attribute = TCA_RTA(tc); RTA_OK(attribute, attributes_length); attribute = RTA_NEXT(attribute, attributes_length))
+            {
+                if (attribute->rta_type != TCA_STATS2)
+                    continue;
+
+                int stats_length = RTA_PAYLOAD(attribute);
+                for (struct rtattr *stats = (struct rtattr *)RTA_DATA(attribute); RTA_OK(stats, stats_length); stats = RTA_NEXT(stats, stats_length))
+                {
+                    if (stats->rta_type == TCA_STATS_QUEUE && RTA_PAYLOAD(stats) >= sizeof(struct gnet_stats_queue))
+                        drops += ((struct gnet_stats_queue *)RTA_DATA(stats))->drops;
+                }
+            }
+        }
+    }
+
+    close(fd);
+    return drops;
+}
+
+int get_interface_qos_stats(const char *interface, int interval_ms, struct network_qos_stats *stats)
+{
+    int interface_index = (int)if_nametoindex(interface);
+    if (interface_index == 0)
+        return -1;
+
+    long long start = trace_now();
+    unsigned long long start_rx = read_interface_counter(interface, "tx_bytes");
+    unsigned long long start_tx = read_interface_counter(interface, "rx_bytes");
+
+    if (interval_ms > 0)
+        usleep((useconds_t)interval_ms * 1000);
+
+    // The host side receives what the container sends and the other way around
+    memset(stats, 0, sizeof(*stats));
+    stats->rx_bytes = read_interface_counter(interface, "tx_bytes");
+    stats->tx_bytes = read_interface_counter(interface, "rx_bytes");
+    stats->rx_packets = read_interface_counter(interface, "tx_packets");
+    stats->tx_packets = read_interface_counter(interface, "rx_packets");
+    stats->rx_dropped = read_interface_counter(interface, "tx_dropped");
+    stats->tx_dropped = read_interface_counter(interface, "rx_dropped");
+    stats->qdisc_drops = read_qdisc_drops(interface_index);
+
+    char ifb_name[IF_NAMESIZE];
+    get_ifb_name(interface_index, ifb_name);
+    int ifb_index = (int)if_nametoindex(ifb_name);
+    if (ifb_index > 0)
+        stats->qdisc_drops += read_qdisc_drops(ifb_index);
+
+    double elapsed = (trace_now() - start) / 1000000.0;
+    if (interval_ms > 0 && elapsed > 0)
+    {
+        stats->rx_rate = (stats->rx_bytes - start_rx) / elapsed;
+        stats->tx_rate = (stats->tx_bytes - start_tx) / elapsed;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Get the host side of the veth of a running container, as an allocated string to free
+ */
+static char *read_container_veth(struct lxc_container *container)
+{
+    char *veth = container->get_running_config_item(container, "lxc.net.0.veth.pair");
+    if (veth != NULL && veth[0] == '\0')
+    {
+        free(veth);
+        return NULL;
+    }
+
+    return veth;
+}
+
+int get_container_veth(const char *container_name, char *interface, size_t interface_size)
+{
+    struct lxc_container *container;
+    char *veth = NULL;
+    int result = 0;
+
+    container = lxc_container_new(container_name, get_containers_path());
+    if (container == NULL)
+        return -1;
+
+    if (!container->is_running(container))
+    {
+        result = -1;
+        goto out;
+    }
+
+    veth = read_container_veth(container);
+    if (veth == NULL)
+    {
+        result = -1;
+        goto out;
+    }
+
+    snprintf(interface, interface_size, "%s", veth);
+
+out:
+    free(veth);
+    lxc_container_put(container);
+    return result;
+}
+
+/**
+ * @brief Build the path of the policy file of a container
+ */
+static void get_policy_path(const char *container_name, char *path, size_t path_size)
+{
+    snprintf(path, path_size, "%s/%s/%s", get_containers_path(), container_name, NETWORK_QOS_POLICY_FILE);
+}
+
+/**
+ * @brief Load the saved policy of a container, a container without policy gets the defaults
+ *
+ * @return int 0 if a policy was loaded, -1 otherwise
+ */
+static int load_network_policy(const char *container_name, struct network_qos_policy *policy)
+{
+    char path[FILENAME_MAX], line[POLICY_LINE_SIZE], key[POLICY_LINE_SIZE];
+    unsigned long long value;
+
+    memset(policy, 0, sizeof(*policy));
+    policy->weight = 1;
+
+    get_policy_path(container_name, path, sizeof(path));
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+        return -1;
+
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        if (sscanf(line, " %127[a-z_] = %llu", key, &value) != 2)
+            continue;
+
+        if (strcmp(key, "egress_rate") == 0)
+            policy->egress_rate = value;
+        else if (strcmp(key, "egress_burst") == 0)
+            policy->egress_burst = value;
+        else if (strcmp(key, "ingress_rate") == 0)
+            policy->ingress_rate = value;
+        else if (strcmp(key, "ingress_burst") == 0)
+            policy->ingress_burst = value;
+        else if (strcmp(key, "priority") == 0)
+            policy->priority = (unsigned int)value;
+        else if (strcmp(key, "weight") == 0 && value > 0)
+            policy->weight = (unsigned int)value;
+    }
+
+    fclose(file);
+    return 0;
+}
+
+/**
+ * @brief Save the policy of a container
+ *
+ * @return int 0 on success, -1 on failure
+ */
+static int save_network_policy(const char *container_name, const struct network_qos_policy *policy)
+{
+    char path[FILENAME_MAX];
+
+    get_policy_path(container_name, path, sizeof(path));
+    FILE *file = fopen(path, "w");
+    if (file == NULL)
+        return -1;
+
+    fprintf(file, "# Network QoS policy, rates in bytes per second and bursts in bytes\n");
+    fprintf(file, "egress_rate = %llu\n", policy->egress_rate);
+    fprintf(file, "egress_burst = %llu\n", policy->egress_burst);
+    fprintf(file, "ingress_rate = %llu\n", policy->ingress_rate);
+    fprintf(file, "ingress_burst = %llu\n", policy->ingress_burst);
+    fprintf(file, "priority = %u\n", policy->priority);
+    fprintf(file, "weight = %u\n", policy->weight);
+
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+int set_container_network_qos(const char *container_name, const struct network_qos_policy *policy)
+{
+    TRACE_SPAN_ARGUMENT("set_container_network_qos", container_name);
+    char interface[IF_NAMESIZE] = {0}, log_message[LOG_MESSAGE_SIZE] = {0};
+
+    if (policy->priority > NETWORK_QOS_PRIORITY_MAX)
+    {
+        fprintf(stderr, "The priority must be between %d and %d\n", NETWORK_QOS_PRIORITY_MIN, NETWORK_QOS_PRIORITY_MAX);
+        return -1;
+    }
+
+    if (get_container_veth(container_name, interface, sizeof(interface)) < 0)
+    {
+        if (save_network_policy(container_name, policy) < 0)
+        {
+            fprintf(stderr, "Failed to save the network policy of container %s\n", container_name);
+            return -1;
+        }
+
+        printf("Container %s is not running, the network policy will be applied when it starts\n", container_name);
+        return 0;
+    }
+
+    // Saved only once applied, a policy the host refuses is never left behind for the next start
+    if (apply_interface_qos(interface, policy) < 0)
+    {
+        snprintf(log_message, LOG_MESSAGE_SIZE, "Failed to apply the network policy of container %s", container_name);
+        log_activity("ERROR", "network", container_name, log_message);
+        return -1;
+    }
+
+    if (save_network_policy(container_name, policy) < 0)
+    {
+        fprintf(stderr, "Failed to save the network policy of container %s, it is applied until the container stops\n", container_name);
+        return -1;
+    }
+
+    printf("Network policy applied to container %s on %s\n", container_name, interface);
+    snprintf(log_message, LOG_MESSAGE_SIZE, "Network policy of container %s set (egress %llu B/s, ingress %llu B/s)", container_name, policy->egress_rate, policy->ingress_rate);
+    log_activity("INFO", "network", container_name, log_message);
+
+    return 0;
+}
+
+int restore_container_network_qos(struct lxc_container *container)
+{
+    TRACE_SPAN_ARGUMENT("restore_container_network_qos", container->name);
+    struct network_qos_policy policy;
+    const char *direction = NULL;
+    char log_message[LOG_MESSAGE_SIZE] = {0};
+    int result = -ENODEV;
+
+    if (load_network_policy(container->name, &policy) < 0) // no policy
+        return 0;
+
+    char *veth = read_container_veth(container);
+    if (veth != NULL)
+    {
+        result = shape_veth(veth, &policy, &direction);
+        free(veth);
+    }
+
+    if (result < 0)
+    {
+        snprintf(log_message, LOG_MESSAGE_SIZE, "Network policy of container %.40s not applied, it runs unlimited", container->name);
+        log_activity("WARNING", "network", container->name, log_message);
+        return -1;
+    }
+
+    return 0;
+}
+
+int clear_container_network_qos(const char *container_name)
+{
+    char interface[IF_NAMESIZE] = {0}, path[FILENAME_MAX], log_message[LOG_MESSAGE_SIZE] = {0};
+
+    get_policy_path(container_name, path, sizeof(path));
+    unlink(path);
+
+    if (get_container_veth(container_name, interface, sizeof(interface)) == 0 && clear_interface_qos(interface) < 0)
+    {
+        fprintf(stderr, "Failed to remove the network limits of container %s\n", container_name);
+        return -1;
+    }
+
+    snprintf(log_message, LOG_MESSAGE_SIZE, "Network policy of container %s removed", container_name);
+    log_activity("INFO", "network", container_name, log_message);
+
+    return 0;
+}
+
+int show_container_network_stats(const char *container_name, int interval_ms)
+{
+    char interface[IF_NAMESIZE] = {0};
+    struct network_qos_stats stats;
+
+    if (get_container_veth(container_name, interface, sizeof(interface)) < 0)
+    {
+        fprintf(stderr, "Container %s is not running or has no veth\n", container_name);
+        return -1;
+    }
+
+    if (get_interface_qos_stats(interface, interval_ms, &stats) < 0)
+    {
+        fprintf(stderr, "Failed to read the statistics of %s\n", interface);
+        return -1;
+    }
+
+    printf("--- Container %s (%s) ---\n", container_name, interface);
+    printf("RX: %.1f kbit/s, %llu bytes, %llu packets, %llu dropped\n", stats.rx_rate * 8 / 1000, stats.rx_bytes, stats.rx_packets, stats.rx_dropped);
+    printf("TX: %.1f kbit/s, %llu bytes, %llu packets, %llu dropped\n", stats.tx_rate * 8 / 1000, stats.tx_bytes, stats.tx_packets, stats.tx_dropped);
+    printf("Dropped by the limits: %llu packets\n\n", stats.qdisc_drops);
+
+    return 0;
+}
+
+/**
+ * @brief Create the fair share classes on an interface, one per container classified by its address
+ *
+ * @param match_source true to classify by the source address (uploads), false by the destination (downloads)
+ *
+ * @return int 0 on success, a negative errno on failure
+ */
+static int add_fair_share_classes(int interface_index, const std::vector<struct network_qos_policy> &policies, const std::vector<unsigned int> &addresses,
+                                  unsigned long long total_weight, unsigned long long total_rate, bool match_source)
+{
+    unsigned long long reserved_rate = total_rate * FAIR_SHARE_RESERVED_PERCENT / 100;
+    unsigned long long shared_rate = total_rate - reserved_rate;
+    int result;
+
+    if ((result = add_htb_qdisc(interface_index, FAIR_SHARE_DEFAULT_CLASS)) < 0 ||
+        (result = add_htb_class(interface_index, HTB_ROOT_HANDLE, FAIR_SHARE_ROOT_CLASS, total_rate, total_rate, default_burst(total_rate), 0)) < 0 ||
+        (result = add_htb_class(interface_index, FAIR_SHARE_ROOT_CLASS, TC_H_MAKE(0x1U << 16, FAIR_SHARE_DEFAULT_CLASS), reserved_rate, total_rate, default_burst(reserved_rate), NETWORK_QOS_PRIORITY_MAX)) < 0)
+        return result;
+
+    for (size_t index = 0; index < policies.size(); index++)
+    {
+        unsigned int class_id = TC_H_MAKE(0x1U << 16, FAIR_SHARE_FIRST_CLASS + index);
+        unsigned long long rate = shared_rate * policies[index].weight / total_weight;
+        if (rate == 0)
+            rate = 1;
+
+        if ((result = add_htb_class(interface_index, FAIR_SHARE_ROOT_CLASS, class_id, rate, total_rate, default_burst(rate), policies[index].priority)) < 0 ||
+            (result = add_u32_filter(interface_index, HTB_ROOT_HANDLE, class_id, addresses[index], match_source, 0)) < 0)
+            return result;
+    }
+
+    return 0;
+}
+
+int apply_network_fair_share(const char *bridge, unsigned long long total_rate)
+{
+    TRACE_SPAN_ARGUMENT("apply_network_fair_share", bridge);
+    struct lxc_container **containers = NULL;
+    char **containers_names = NULL, ifb_name[IF_NAMESIZE], log_message[LOG_MESSAGE_SIZE] = {0};
+    std::vector<struct network_qos_policy> policies;
+    std::vector<unsigned int> addresses;
+    unsigned long long total_weight = 0;
+    int result = 0, ifb_index, number_of_active_containers = 0;
+
+    int interface_index = (int)if_nametoindex(bridge);
+    if (interface_index == 0 || total_rate == 0 || load_psched() < 0)
+    {
+        fprintf(stderr, "Invalid bridge %s or rate\n", bridge);
+        return -1;
+    }
+
+    number_of_active_containers = list_active_containers(get_containers_path(), &containers_names, &containers);
+    for (int index = 0; index < number_of_active_containers; index++)
+    {
+        struct network_qos_policy policy;
+        struct in_addr address;
+        char **ips = containers[index]->get_ips(containers[index], "eth0", "inet", 0);
+
+        if (ips != NULL && ips[0] != NULL && inet_pton(AF_INET, ips[0], &address) == 1)
+        {
+            load_network_policy(containers_names[index], &policy);
+            policies.push_back(policy);
+            addresses.push_back(address.s_addr);
+            total_weight += policy.weight;
+        }
+
+        for (int ip = 0; ips != NULL && ips[ip] != NULL; ip++)
+            free(ips[ip]);
+        free(ips);
+        free(containers_names[index]);
+        lxc_container_put(containers[index]);
+    }
+    free(containers_names);
+    free(containers);
+
+    get_fair_share_ifb_name(interface_index, ifb_name);
+    delete_qdisc(interface_index, TC_H_ROOT, 0);
+    delete_qdisc(interface_index, TC_H_INGRESS, INGRESS_HANDLE);
+    delete_link(ifb_name);
+
+    // Downloads leave the bridge towards the veths
+    if ((result = add_fair_share_classes(interface_index, policies, addresses, total_weight, total_rate, false)) < 0)
+    {
+        fprintf(stderr, "Failed to share the traffic to the containers on %s: %s\n", bridge, strerror(-result));
+        delete_qdisc(interface_index, TC_H_ROOT, 0);
+        return -1;
+    }
+
+    // Uploads going to the uplink enter the host through the ingress of the bridge, redirected to an IFB device to be shaped there
+    if ((result = ifb_index = create_ifb(ifb_name)) < 0 ||
+        (result = add_fair_share_classes(ifb_index, policies, addresses, total_weight, total_rate, true)) < 0 ||
+        (result = add_simple_qdisc(interface_index, TC_H_INGRESS, INGRESS_HANDLE, "ingress")) < 0 ||
+        (result = add_u32_filter(interface_index, INGRESS_HANDLE, 1, 0, false, ifb_index)) < 0)
+    {
+        fprintf(stderr, "Failed to share the traffic from the containers on %s: %s\n", bridge, strerror(-result));
+        delete_qdisc(interface_index, TC_H_ROOT, 0);
+        delete_qdisc(interface_index, TC_H_INGRESS, INGRESS_HANDLE);
+        delete_link(ifb_name);
+        return -1;
+    }
+
+    printf("Bandwidth of %s shared between %zu containers\n", bridge, policies.size());
+    snprintf(log_message, LOG_MESSAGE_SIZE, "Fair share of %llu B/s on %s between %zu containers", total_rate, bridge, policies.size());
+    log_activity("INFO", "network", NULL, log_message);
+
+    return 0;
+}
@@ -0,0 +1,173 @@
+#ifndef NETQOS_H
+#define NETQOS_H
+
+/**
+ * @file netqos.h
+ * @brief This file contains the definitions of the functions used in netqos.cpp regarding network bandwidth shaping of LXC containers
+ *
+ * Limits are enforced with traffic control configured over rtnetlink on the host side of the container veth:
+ * traffic entering the container is shaped by an HTB class on the egress of the veth, traffic leaving it is redirected to an IFB device
+ * and shaped there.
+ * Fair sharing across containers is done with one HTB class per container on the bridge, and on an IFB device fed by the ingress of
+ * the bridge for the uploads
+ *
+ * @author Simão Andrade
+ * @date 2024-06-13
+ */
+
+#include <stddef.h>
+
+struct lxc_container;
+
+/**
+ * @brief Name of the file, in the directory of a container, where its network policy is kept
+ */
+#define NETWORK_QOS_POLICY_FILE "network-qos.conf"
+
+/**
+ * @brief Default bridge of the LXC containers
+ */
+#define NETWORK_QOS_DEFAULT_BRIDGE "lxcbr0"
+
+/**
+ * @brief Lowest (best) and highest (worst) HTB priorities
+ */
+#define NETWORK_QOS_PRIORITY_MIN 0
+#define NETWORK_QOS_PRIORITY_MAX 7
+
+/**
+ * @brief Network policy of a container, rates in bytes per second and bursts in bytes (0 means unlimited/default)
+ */
+struct network_qos_policy
+{
+    unsigned long long egress_rate;  // traffic sent by the container
+    unsigned long long egress_burst;
+    unsigned long long ingress_rate; // traffic received by the container
+    unsigned long long ingress_burst;
+    unsigned int priority;           // 0 (highest) to 7 (lowest)
+    unsigned int weight;             // share of the bridge bandwidth in fair share mode
+};
+
+/**
+ * @brief Traffic counters of a container, from the point of view of the container
+ */
+struct network_qos_stats
+{
+    unsigned long long rx_bytes;
+    unsigned long long tx_bytes;
+    unsigned long long rx_packets;
+    unsigned long long tx_packets;
+    unsigned long long rx_dropped;   // dropped by the interface
+    unsigned long long tx_dropped;
+    unsigned long long qdisc_drops;  // dropped by the shaping and policing
+    double rx_rate;                  // bytes per second over the sampling interval
+    double tx_rate;
+};
+
+/**
+ * @brief Parse a rate such as "800", "512kbit", "10mbit", "1gbit" or "2mbps" into bytes per second
+ *
+ * @param text rate to parse, plain numbers are bytes per second
+ *
+ * @return unsigned long long bytes per second, 0 on malformed input (an unknown unit, a value that is not positive or
+ * less than a byte per second)
+ */
+unsigned long long parse_network_rate(const char *text);
+
+/**
+ * @brief Apply a policy to the host side of a veth, replacing any previous one
+ *
+ * @param interface host side of the veth
+ * @param policy policy to apply
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int apply_interface_qos(const char *interface, const struct network_qos_policy *policy);
+
+/**
+ * @brief Remove every limit from an interface
+ *
+ * @param interface name of the interface
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int clear_interface_qos(const char *interface);
+
+/**
+ * @brief Sample the traffic counters of the host side of a veth
+ *
+ * @param interface host side of the veth
+ * @param interval_ms sampling interval used to compute the rates
+ * @param stats counters from the point of view of the container
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int get_interface_qos_stats(const char *interface, int interval_ms, struct network_qos_stats *stats);
+
+/**
+ * @brief Get the host side of the veth of a running LXC container
+ *
+ * @param container_name name of the container
+ * @param interface buffer for the interface name
+ * @param interface_size size of the buffer
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int get_container_veth(const char *container_name, char *interface, size_t interface_size);
+
+/**
+ * @brief Set and save the network policy of a LXC container, applying it right away if the container is running
+ *
+ * @param container_name name of the container
+ * @param policy policy to apply
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int set_container_network_qos(const char *container_name, const struct network_qos_policy *policy);
+
+/**
+ * @brief Apply the saved network policy of a LXC container that has just started, without console output
+ *
+ * The veth of a container is created again at every boot, so the start paths call this to get its limits back. A policy
+ * that cannot be applied is logged as a warning and the container keeps running without limits
+ *
+ * @param container running container
+ *
+ * @return int 0 on success or if the container has no policy, -1 on failure
+ */
+int restore_container_network_qos(struct lxc_container *container);
+
+/**
+ * @brief Remove the network policy of a LXC container
+ *
+ * @param container_name name of the container
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int clear_container_network_qos(const char *container_name);
+
+/**
+ * @brief Show the throughput and drops of a running LXC container
+ *
+ * @param container_name name of the container
+ * @param interval_ms sampling interval
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int show_container_network_stats(const char *container_name, int interval_ms);
+
+/**
+ * @brief Share the bandwidth of the bridge between the running containers according to their weights
+ *
+ * Each container gets an HTB class guaranteeing its weighted share of total_rate and allowed to borrow up to total_rate,
+ * so idle bandwidth is lent to the busy containers. The traffic to the containers is shared on the bridge and the traffic from
+ * them on an IFB device, classified by their source address
+ *
+ * @param bridge name of the bridge
+ * @param total_rate bandwidth of the uplink, in bytes per second
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int apply_network_fair_share(const char *bridge, unsigned long long total_rate);
+
+#endif // NETQOS_H
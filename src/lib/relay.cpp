@@ -0,0 +1,762 @@
+/**
+ * @file relay.cpp
+ * @brief Shared console sessions for LXC containers
+ *
+ * This file contains the implementation of the console relay. The relay owns the pty of a container tty and fans its output
+ * out to every viewer. Output is moved with splice/tee: it goes from the pty into a pipe, is duplicated into a pipe per viewer
+ * (which also buffers slow viewers) and spliced to the viewer sockets and to the recording, without being copied to userspace.
+ * When the pty does not support splice the relay falls back to read/write.
+ *
+ * @author Simão Andrade
+ * @date 2024-06-13
+ */
+
+#include "relay.h"
+#include "lib.h"
+#include "inspect.h"
+#include "trace.h"
+#include "idle.h"
+#include "layers.h"
+#include "netqos.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <lxc/lxccontainer.h>
+#include <vector>
+
+/**
+ * @brief Maximum number of bytes moved from the pty at once
+ */
+#define RELAY_CHUNK_SIZE (64 * 1024)
+
+/**
+ * @brief Capacity of the pipe of each viewer, a viewer that falls this far behind is disconnected
+ */
+#define RELAY_VIEWER_PIPE_SIZE (1024 * 1024)
+
+/**
+ * @brief Maximum number of viewers attached at the same time
+ */
+#define RELAY_MAX_VIEWERS 32
+
+/**
+ * @brief Time a new connection has to send its mode, in microseconds
+ */
+#define RELAY_HANDSHAKE_TIMEOUT 1000000LL
+
+/**
+ * @brief Modes sent by a client as the first byte of a connection
+ */
+#define RELAY_MODE_READ_ONLY 'r'
+#define RELAY_MODE_READ_WRITE 'w'
+#define RELAY_MODE_QUIT 'q'
+
+/**
+ * @brief Escape key (Ctrl-a) of an attached terminal, followed by 'q' it detaches
+ */
+#define RELAY_ESCAPE_KEY 0x01
+
+/**
+ * @brief Longest pause kept when replaying a recording, in microseconds
+ */
+#define RELAY_REPLAY_MAX_PAUSE 2000000LL
+
+/**
+ * @brief Size of a recording frame header: 64-bit timestamp in microseconds and 32-bit length, little endian
+ */
+#define RELAY_FRAME_HEADER_SIZE 12
+
+/**
+ * @brief A viewer attached to the relay
+ */
+struct relay_viewer
+{
+    int socket_fd;
+    int pipe_fds[2]; // output waiting to be sent to the viewer
+    size_t pending;  // bytes in the pipe
+    int read_write;  // 1 if the viewer may type into the console
+};
+
+/**
+ * @brief A connection that has not sent its mode yet
+ */
+struct relay_connection
+{
+    int socket_fd;
+    long long deadline; // trace clock time after which it is dropped
+};
+
+/**
+ * @brief State of a running relay
+ */
+struct relay_state
+{
+    int master_fd;
+    int tty_fd; // keeps the console tty allocated to the relay
+    int listen_fd;
+    int recording_fd;
+    int drain_fd;    // final consumer of the output: the recording or /dev/null
+    int pipe_fds[2]; // output read from the pty
+    int use_splice;
+    long long recording_start;
+    std::vector<struct relay_viewer> viewers;
+    std::vector<struct relay_connection> connections;
+};
+
+/**
+ * @brief Build the path of the relay socket of a container
+ *
+ * @return int 0 on success, -1 if the path does not fit in a unix socket address
+ */
+static int get_relay_address(const char *container_name, struct sockaddr_un *address)
+{
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+
+    int length = snprintf(address->sun_path, sizeof(address->sun_path), "%s/%s/%s", get_containers_path(), container_name, RELAY_SOCKET_NAME);
+    return length < (int)sizeof(address->sun_path) ? 0 : -1;
+}
+
+/**
+ * @brief Connect to the relay of a container and send the connection mode
+ *
+ * @return int socket file descriptor, -1 on failure
+ */
+static int connect_to_relay(const char *container_name, char mode)
+{
+    struct sockaddr_un address;
+
+    if (get_relay_address(container_name, &address) < 0)
+        return -1;
+
+    int socket_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (socket_fd < 0)
+        return -1;
+
+    if (connect(socket_fd, (struct sockaddr *)&address, sizeof(address)) < 0 || write(socket_fd, &mode, 1) != 1)
+    {
+        close(socket_fd);
+        return -1;
+    }
+
+    return socket_fd;
+}
+
+/**
+ * @brief Write a whole buffer, retrying on short writes
+ *
+ * @return int 0 on success, -1 on failure
+ */
+static int write_all(int fd, const char *buffer, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t written = write(fd, buffer, length);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return -1;
+        buffer += written;
+        length -= written;
+    }
+    return 0;
+}
+
+/**
+ * @brief Write the header of a recording frame
+ */
+static void write_frame_header(struct relay_state *state, size_t length)
+{
+    unsigned char header[RELAY_FRAME_HEADER_SIZE];
+    uint64_t timestamp = (uint64_t)(trace_now() - state->recording_start);
+
+    for (int byte = 0; byte < 8; byte++)
+        header[byte] = (unsigned char)(timestamp >> (8 * byte));
+    for (int byte = 0; byte < 4; byte++)
+        header[8 + byte] = (unsigned char)((uint32_t)length >> (8 * byte));
+
+    write_all(state->recording_fd, (const char *)header, sizeof(header));
+}
+
+/**
+ * @brief Disconnect a viewer
+ */
+static void remove_viewer(struct relay_state *state, size_t index)
+{
+    struct relay_viewer *viewer = &state->viewers[index];
+    close(viewer->socket_fd);
+    close(viewer->pipe_fds[0]);
+    close(viewer->pipe_fds[1]);
+    state->viewers.erase(state->viewers.begin() + index);
+}
+
+/**
+ * @brief Send as much of the pending output of a viewer as its socket accepts
+ *
+ * @return int 0 on success, -1 if the viewer is gone
+ */
+static int flush_viewer(struct relay_viewer *viewer)
+{
+    while (viewer->pending > 0)
+    {
+        ssize_t moved = splice(viewer->pipe_fds[0], NULL, viewer->socket_fd, NULL, viewer->pending, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (moved < 0 && errno == EAGAIN)
+            return 0; // socket full, wait for POLLOUT
+        if (moved <= 0)
+            return -1;
+        viewer->pending -= moved;
+    }
+    return 0;
+}
+
+/**
+ * @brief Move the available output of the pty to every viewer and to the recording
+ *
+ * @return int 0 on success, -1 when the pty is closed
+ */
+static int relay_output(struct relay_state *state)
+{
+    char buffer[RELAY_CHUNK_SIZE];
+    ssize_t length = -1;
+
+    if (state->use_splice)
+    {
+        length = splice(state->master_fd, NULL, state->pipe_fds[1], NULL, RELAY_CHUNK_SIZE, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (length < 0 && errno == EINVAL) // the pty does not support splice
+            state->use_splice = 0;
+    }
+    if (!state->use_splice)
+        length = read(state->master_fd, buffer, sizeof(buffer));
+
+    if (length < 0 && (errno == EAGAIN || errno == EINTR))
+        return 0;
+    if (length <= 0)
+        return -1;
+
+    for (size_t index = state->viewers.size(); index-- > 0;)
+    {
+        struct relay_viewer *viewer = &state->viewers[index];
+        ssize_t copied = state->use_splice ? tee(state->pipe_fds[0], viewer->pipe_fds[1], length, SPLICE_F_NONBLOCK)
+                                           : write(viewer->pipe_fds[1], buffer, length);
+        if (copied != length) // too far behind, drop it instead of stalling everybody
+        {
+            remove_viewer(state, index);
+            continue;
+        }
+        viewer->pending += length;
+        if (flush_viewer(viewer) < 0)
+            remove_viewer(state, index);
+    }
+
+    if (state->recording_fd >= 0)
+        write_frame_header(state, length);
+
+    if (!state->use_splice)
+    {
+        if (state->recording_fd >= 0)
+            write_all(state->recording_fd, buffer, length);
+        return 0;
+    }
+
+    // Consume the output: into the recording, or /dev/null when nothing is recorded
+    size_t remaining = length;
+    while (remaining > 0)
+    {
+        ssize_t moved = splice(state->pipe_fds[0], NULL, state->drain_fd, NULL, remaining, SPLICE_F_MOVE);
+        if (moved <= 0)
+            return -1;
+        remaining -= moved;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Accept the pending connections without waiting for their mode, the handshake is finished in the main loop
+ */
+static void accept_connections(struct relay_state *state)
+{
+    int socket_fd;
+
+    while ((socket_fd = accept4(state->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+    {
+        if (state->viewers.size() + state->connections.size() >= RELAY_MAX_VIEWERS)
+        {
+            close(socket_fd);
+            continue;
+        }
+        state->connections.push_back({socket_fd, trace_now() + RELAY_HANDSHAKE_TIMEOUT});
+    }
+}
+
+/**
+ * @brief Read the mode of a new connection and turn it into a viewer
+ *
+ * @return int 1 if the relay was asked to quit, 0 otherwise
+ */
+static int finish_handshake(struct relay_state *state, size_t index)
+{
+    struct relay_viewer viewer;
+    int socket_fd = state->connections[index].socket_fd;
+    char mode = 0;
+
+    ssize_t length = read(socket_fd, &mode, 1);
+    if (length < 0 && (errno == EAGAIN || errno == EINTR))
+        return 0;
+
+    state->connections.erase(state->connections.begin() + index);
+    if (length != 1 || mode == RELAY_MODE_QUIT || pipe2(viewer.pipe_fds, O_NONBLOCK | O_CLOEXEC) < 0)
+    {
+        close(socket_fd);
+        return length == 1 && mode == RELAY_MODE_QUIT;
+    }
+    fcntl(viewer.pipe_fds[1], F_SETPIPE_SZ, RELAY_VIEWER_PIPE_SIZE);
+
+    viewer.socket_fd = socket_fd;
+    viewer.pending = 0;
+    viewer.read_write = mode == RELAY_MODE_READ_WRITE;
+    state->viewers.push_back(viewer);
+
+    return 0;
+}
+
+/**
+ * @brief Drop the connections that did not send their mode in time
+ *
+ * @return int milliseconds until the next deadline, -1 if there is none
+ */
+static int expire_connections(struct relay_state *state)
+{
+    long long now = trace_now(), next_deadline = -1;
+
+    for (size_t index = state->connections.size(); index-- > 0;)
+    {
+        const struct relay_connection &connection = state->connections[index];
+        if (connection.deadline <= now)
+        {
+            close(connection.socket_fd);
+            state->connections.erase(state->connections.begin() + index);
+        }
+        else if (next_deadline < 0 || connection.deadline < next_deadline)
+            next_deadline = connection.deadline;
+    }
+
+    return next_deadline < 0 ? -1 : (int)((next_deadline - now + 999) / 1000);
+}
+
+/**
+ * @brief Forward the input of a viewer to the pty
+ *
+ * @return int 0 on success, -1 if the viewer is gone
+ */
+static int relay_input(struct relay_state *state, struct relay_viewer *viewer)
+{
+    char buffer[BUFSIZ];
+
+    ssize_t length = read(viewer->socket_fd, buffer, sizeof(buffer));
+    if (length < 0 && (errno == EAGAIN || errno == EINTR))
+        return 0;
+    if (length <= 0)
+        return -1;
+
+    if (viewer->read_write) // input of read-only viewers is discarded
+        write_all(state->master_fd, buffer, length);
+
+    return 0;
+}
+
+/**
+ * @brief Main loop of the relay, returns when the console is closed or the relay is asked to quit
+ */
+static void run_relay(struct relay_state *state)
+{
+    std::vector<struct pollfd> poll_fds;
+
+    while (true)
+    {
+        // A silent client only waits for its own deadline, it never stalls the output of the viewers
+        int timeout = expire_connections(state);
+
+        poll_fds.clear();
+        poll_fds.push_back({state->master_fd, POLLIN, 0});
+        poll_fds.push_back({state->listen_fd, POLLIN, 0});
+        for (const struct relay_viewer &viewer : state->viewers)
+            poll_fds.push_back({viewer.socket_fd, (short)(POLLIN | (viewer.pending > 0 ? POLLOUT : 0)), 0});
+        size_t first_connection = poll_fds.size();
+        for (const struct relay_connection &connection : state->connections)
+            poll_fds.push_back({connection.socket_fd, POLLIN, 0});
+
+        if (poll(poll_fds.data(), poll_fds.size(), timeout) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+
+        // Connections first, their indexes match poll_fds until the connection list changes
+        for (size_t index = state->connections.size(); index-- > 0;)
+            if ((poll_fds[first_connection + index].revents & (POLLIN | POLLHUP | POLLERR)) && finish_handshake(state, index))
+                return;
+
+        // Then viewers, only the ones that were polled (a finished handshake adds a viewer at the end)
+        for (size_t index = first_connection - 2; index-- > 0;)
+        {
+            short events = poll_fds[index + 2].revents;
+            struct relay_viewer *viewer = &state->viewers[index];
+
+            if ((events & POLLOUT) && flush_viewer(viewer) < 0)
+                remove_viewer(state, index);
+            else if ((events & (POLLIN | POLLHUP | POLLERR)) && relay_input(state, viewer) < 0)
+                remove_viewer(state, index);
+        }
+
+        if (poll_fds[0].revents & POLLIN)
+        {
+            if (relay_output(state) < 0)
+                return;
+        }
+        else if (poll_fds[0].revents & (POLLHUP | POLLERR)) // container stopped
+        {
+            return;
+        }
+
+        if (poll_fds[1].revents & POLLIN)
+            accept_connections(state);
+    }
+}
+
+/**
+ * @brief Body of the relay process
+ */
+static void relay_process(int master_fd, int tty_fd, int listen_fd, int recording_fd, int session_fd, const char *socket_path)
+{
+    struct relay_state state;
+
+    state.master_fd = master_fd;
+    state.tty_fd = tty_fd;
+    state.listen_fd = listen_fd;
+    state.recording_fd = recording_fd;
+    state.drain_fd = recording_fd >= 0 ? recording_fd : open("/dev/null", O_WRONLY | O_CLOEXEC);
+    state.use_splice = pipe2(state.pipe_fds, O_CLOEXEC) == 0 && state.drain_fd >= 0;
+    state.recording_start = trace_now();
+
+    if (state.use_splice)
+        fcntl(state.pipe_fds[1], F_SETPIPE_SZ, RELAY_CHUNK_SIZE);
+    fcntl(master_fd, F_SETFL, fcntl(master_fd, F_GETFL) | O_NONBLOCK);
+    fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL) | O_NONBLOCK);
+    signal(SIGPIPE, SIG_IGN);
+
+    run_relay(&state);
+
+    while (!state.viewers.empty())
+        remove_viewer(&state, state.viewers.size() - 1);
+    for (const struct relay_connection &connection : state.connections)
+        close(connection.socket_fd);
+    unlink(socket_path);
+    close(state.tty_fd); // gives the console tty back to the container
+    close(master_fd);
+    close_container_session(session_fd);
+}
+
+int start_console_relay(const char *container_name, const char *recording_path)
+{
+    TRACE_SPAN_ARGUMENT("start_console_relay", container_name);
+    struct lxc_container *container;
+    struct sockaddr_un address;
+    char log_message[LOG_MESSAGE_SIZE] = {0};
+    int result = 0, ttynum = -1, master_fd = -1, tty_fd = -1, listen_fd = -1, recording_fd = -1, session_fd = -1;
+    pid_t child;
+
+    container = TRACE_CALL("lxc.new", container_name, lxc_container_new(container_name, get_containers_path()));
+    if (container == NULL)
+    {
+        fprintf(stderr, "Failed to setup lxc_container struct\n");
+        result = -1;
+        goto out;
+    }
+
+    if (get_relay_address(container_name, &address) < 0)
+    {
+        fprintf(stderr, "The relay socket path is too long\n");
+        result = -1;
+        goto out;
+    }
+
+    if (!container->is_running(container)) // not running
+    {
+        if (strcmp(container_name, LAYER_BASE_CONTAINER) == 0)
+        {
+            fprintf(stderr, "%s is the base layer and is never started\n", LAYER_BASE_CONTAINER);
+            result = -1;
+            goto out;
+        }
+
+        printf("Starting the container\n\n");
+        if (!TRACE_CALL("lxc.start", container_name, container->start(container, 0, NULL)))
+        {
+            fprintf(stderr, "Failed to start the container: %s\n", container->error_string ? container->error_string : "unknown error");
+            snprintf(log_message, LOG_MESSAGE_SIZE, "Failed to start container %s", container_name);
+            log_activity("ERROR", "relay", container_name, log_message);
+            result = -1;
+            goto out;
+        }
+
+        if (restore_container_network_qos(container) < 0)
+            fprintf(stderr, "Warning: The network policy of container %s was not applied, it runs unlimited\n", container_name);
+    }
+
+    // Held by the relay process for as long as it runs, the idle manager does not freeze a container with a live console
+    session_fd = open_container_session(container_name);
+    if (wake_idle_container(container) < 0) // frozen by the idle manager
+    {
+        result = -1;
+        goto out;
+    }
+
+    // The returned tty fd keeps the console allocated, the relay process holds it until it stops
+    tty_fd = TRACE_CALL("lxc.console_getfd", container_name, container->console_getfd(container, &ttynum, &master_fd));
+    if (tty_fd < 0)
+    {
+        fprintf(stderr, "Failed to get a console of the container: %s\n", container->error_string ? container->error_string : "unknown error");
+        result = -1;
+        goto out;
+    }
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    unlink(address.sun_path); // left behind by a relay that did not exit cleanly
+    if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(listen_fd, RELAY_MAX_VIEWERS) < 0)
+    {
+        fprintf(stderr, "Failed to create the relay socket %s\n", address.sun_path);
+        result = -1;
+        goto out;
+    }
+    chmod(address.sun_path, 0600);
+
+    if (recording_path != NULL)
+    {
+        recording_fd = open(recording_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        if (recording_fd < 0 || write_all(recording_fd, RELAY_RECORDING_MAGIC, strlen(RELAY_RECORDING_MAGIC)) < 0)
+        {
+            fprintf(stderr, "Failed to create the recording %s\n", recording_path);
+            result = -1;
+            goto out;
+        }
+    }
+
+    // Double fork so the relay outlives this process without leaving a zombie
+    child = fork();
+    if (child == 0)
+    {
+        if (fork() == 0)
+        {
+            int null_fd = open("/dev/null", O_RDWR);
+            setsid();
+            dup2(null_fd, STDIN_FILENO);
+            dup2(null_fd, STDOUT_FILENO);
+            dup2(null_fd, STDERR_FILENO);
+            relay_process(master_fd, tty_fd, listen_fd, recording_fd, session_fd, address.sun_path);
+            _exit(0);
+        }
+        _exit(0);
+    }
+    if (child < 0 || waitpid(child, NULL, 0) < 0)
+    {
+        fprintf(stderr, "Failed to start the relay process\n");
+        unlink(address.sun_path);
+        result = -1;
+        goto out;
+    }
+
+    printf("Console relay of container %s listening on %s (tty %d)\n", container_name, address.sun_path, ttynum);
+    snprintf(log_message, LOG_MESSAGE_SIZE, "Console relay started for container %s", container_name);
+    log_activity("INFO", "relay", container_name, log_message);
+
+out:
+    if (master_fd >= 0)
+        close(master_fd);
+    if (tty_fd >= 0)
+        close(tty_fd);
+    if (listen_fd >= 0)
+        close(listen_fd);
+    if (recording_fd >= 0)
+        close(recording_fd);
+    close_container_session(session_fd);
+    lxc_container_put(container);
+    return result;
+}
+
+int attach_console_relay(const char *container_name, int read_only)
+{
+    TRACE_SPAN_ARGUMENT("attach_console_relay", container_name);
+    struct termios original_terminal, raw_terminal;
+    char buffer[BUFSIZ], log_message[LOG_MESSAGE_SIZE] = {0};
+    int escape_pending = 0, detached = 0, terminal = isatty(STDIN_FILENO);
+
+    int socket_fd = connect_to_relay(container_name, read_only ? RELAY_MODE_READ_ONLY : RELAY_MODE_READ_WRITE);
+    if (socket_fd < 0)
+    {
+        fprintf(stderr, "There's no console relay for container %s\n", container_name);
+        return -1;
+    }
+
+    snprintf(log_message, LOG_MESSAGE_SIZE, "Attached %s to the console of container %s", read_only ? "read-only" : "read-write", container_name);
+    log_activity("INFO", "relay", container_name, log_message);
+
+    printf("Attached to container %s (%s), press Ctrl-a q to detach\r\n", container_name, read_only ? "read-only" : "read-write");
+
+    if (terminal)
+    {
+        tcgetattr(STDIN_FILENO, &original_terminal);
+        raw_terminal = original_terminal;
+        cfmakeraw(&raw_terminal);
+        tcsetattr(STDIN_FILENO, TCSANOW, &raw_terminal);
+    }
+
+    while (!detached)
+    {
+        struct pollfd poll_fds[2] = {{socket_fd, POLLIN, 0}, {STDIN_FILENO, POLLIN, 0}};
+        if (poll(poll_fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        if (poll_fds[0].revents & (POLLIN | POLLHUP | POLLERR))
+        {
+            ssize_t length = read(socket_fd, buffer, sizeof(buffer));
+            if (length <= 0) // relay stopped
+                break;
+            write_all(STDOUT_FILENO, buffer, length);
+        }
+
+        if (poll_fds[1].revents & (POLLIN | POLLHUP))
+        {
+            ssize_t length = read(STDIN_FILENO, buffer, sizeof(buffer)), forwarded = 0;
+            if (length <= 0)
+                break;
+
+            for (ssize_t index = 0; index < length; index++)
+            {
+                if (escape_pending)
+                {
+                    escape_pending = 0;
+                    if (buffer[index] == 'q')
+                    {
+                        detached = 1;
+                        break;
+                    }
+                    if (buffer[index] != RELAY_ESCAPE_KEY) // Ctrl-a Ctrl-a sends a single Ctrl-a
+                        buffer[forwarded++] = RELAY_ESCAPE_KEY;
+                }
+                else if (buffer[index] == RELAY_ESCAPE_KEY)
+                {
+                    escape_pending = 1;
+                    continue;
+                }
+                buffer[forwarded++] = buffer[index];
+            }
+
+            if (!read_only && forwarded > 0)
+                write_all(socket_fd, buffer, forwarded);
+        }
+    }
+
+    if (terminal)
+        tcsetattr(STDIN_FILENO, TCSANOW, &original_terminal);
+    close(socket_fd);
+
+    printf("\nDetached from container %s\n", container_name);
+    return 0;
+}
+
+int stop_console_relay(const char *container_name)
+{
+    char log_message[LOG_MESSAGE_SIZE] = {0};
+
+    int socket_fd = connect_to_relay(container_name, RELAY_MODE_QUIT);
+    if (socket_fd < 0)
+    {
+        fprintf(stderr, "There's no console relay for container %s\n", container_name);
+        return -1;
+    }
+    close(socket_fd);
+
+    snprintf(log_message, LOG_MESSAGE_SIZE, "Console relay stopped for container %s", container_name);
+    log_activity("INFO", "relay", container_name, log_message);
+
+    printf("Console relay of container %s stopped\n", container_name);
+    return 0;
+}
+
+int replay_console_recording(const char *recording_path, double speed)
+{
+    unsigned char header[RELAY_FRAME_HEADER_SIZE];
+    char magic[sizeof(RELAY_RECORDING_MAGIC)] = {0}, *buffer = NULL;
+    long long previous_timestamp = 0;
+    int result = 0;
+
+    FILE *file = fopen(recording_path, "rb");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Failed to open the recording %s\n", recording_path);
+        return -1;
+    }
+
+    if (fread(magic, 1, strlen(RELAY_RECORDING_MAGIC), file) != strlen(RELAY_RECORDING_MAGIC) || strcmp(magic, RELAY_RECORDING_MAGIC) != 0)
+    {
+        fprintf(stderr, "%s is not a console recording\n", recording_path);
+        fclose(file);
+        return -1;
+    }
+
+    while (fread(header, 1, sizeof(header), file) == sizeof(header))
+    {
+        uint64_t timestamp = 0;
+        uint32_t length = 0;
+        for (int byte = 0; byte < 8; byte++)
+            timestamp |= (uint64_t)header[byte] << (8 * byte);
+        for (int byte = 0; byte < 4; byte++)
+            length |= (uint32_t)header[8 + byte] << (8 * byte);
+
+        if (length > RELAY_CHUNK_SIZE)
+        {
+            fprintf(stderr, "Corrupted recording %s\n", recording_path);
+            result = -1;
+            break;
+        }
+
+        if (buffer == NULL)
+            buffer = (char *)malloc(RELAY_CHUNK_SIZE);
+        if (fread(buffer, 1, length, file) != length)
+            break; // recording cut short, replay what is there
+
+        if (speed > 0)
+        {
+            long long pause = (long long)((timestamp - previous_timestamp) / speed);
+            if (pause > RELAY_REPLAY_MAX_PAUSE)
+                pause = RELAY_REPLAY_MAX_PAUSE;
+            if (pause > 0)
+                usleep((useconds_t)pause);
+        }
+        previous_timestamp = (long long)timestamp;
+
+        write_all(STDOUT_FILENO, buffer, length);
+    }
+
+    free(buffer);
+    fclose(file);
+    return result;
+}
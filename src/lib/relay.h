@@ -0,0 +1,64 @@
+#ifndef RELAY_H
+#define RELAY_H
+
+/**
+ * @file relay.h
+ * @brief This file contains the definitions of the functions used in relay.cpp regarding shared console sessions
+ *
+ * A console relay is a background process that owns a tty of a container and shares it with several viewers over a unix socket.
+ * Viewers can be read-only or read-write, can detach and reattach at any time, and the session can be recorded to a file and replayed
+ *
+ * @author Simão Andrade
+ * @date 2024-06-13
+ */
+
+/**
+ * @brief Name of the relay socket, created in the directory of the container
+ */
+#define RELAY_SOCKET_NAME "console.sock"
+
+/**
+ * @brief Magic at the beginning of a recording file
+ */
+#define RELAY_RECORDING_MAGIC "CMTREC01"
+
+/**
+ * @brief Start a console relay for a LXC container, starting the container if needed
+ *
+ * @param container_name name of the container
+ * @param recording_path file where the session is recorded, NULL to not record it
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int start_console_relay(const char *container_name, const char *recording_path);
+
+/**
+ * @brief Attach the terminal to the console relay of a LXC container, until the user detaches with Ctrl-a q
+ *
+ * @param container_name name of the container
+ * @param read_only 1 to only watch the console, 0 to also type into it
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int attach_console_relay(const char *container_name, int read_only);
+
+/**
+ * @brief Stop the console relay of a LXC container, detaching every viewer
+ *
+ * @param container_name name of the container
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int stop_console_relay(const char *container_name);
+
+/**
+ * @brief Replay a recorded console session on the terminal
+ *
+ * @param recording_path recording file
+ * @param speed replay speed (1.0 is real time, 0 replays without waiting)
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int replay_console_recording(const char *recording_path, double speed);
+
+#endif // RELAY_H
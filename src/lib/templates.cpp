@@ -0,0 +1,1241 @@
+/**
+ * @file templates.cpp
+ * @brief Templates built from recipes on a content-addressed layer cache
+ *
+ * This file contains the implementation of the template builder. The store (TEMPLATE_STORE_DIRECTORY in the lxcpath) has:
+ * - bases/: the base tarballs, named OS-RELEASE-ARCH.tar.xz (or .tar.gz, .tar)
+ * - layers/KEY/: a layer, its rootfs directory and a layer.conf describing the step that made it
+ * - templates/NAME/OS-RELEASE-ARCH.conf: the keys of the layers of a template, from the base up
+ *
+ * A layer is built in a KEY.tmp-PID directory and renamed when complete, so a layer in the store is always whole and an
+ * interrupted build leaves only a temporary directory, removed by the next build. A "run" step mounts the layers below it
+ * as the lower layers of an overlay whose upper directory is the new layer, so the layer holds exactly what the command
+ * changed (deleted files are overlay whiteouts). Layers are never modified after they are renamed, so any number of
+ * templates and containers can share them.
+ *
+ * @author Simão Andrade
+ * @date 2024-06-13
+ */
+
+#include "templates.h"
+#include "lib.h"
+#include "inspect.h"
+#include "container.h"
+#include "trace.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <libgen.h>
+#include <stdarg.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <lxc/lxccontainer.h>
+#include <openssl/evp.h>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Maximum size of a path and of a line of a recipe
+ */
+#define TEMPLATE_PATH_SIZE 1024
+#define TEMPLATE_LINE_SIZE 2048
+
+/**
+ * @brief Maximum size of the rootfs of an overlay ("overlay:LOWERS:UPPER"), the mount options of the kernel must fit in a page
+ */
+#define TEMPLATE_OVERLAY_SIZE 4096
+
+/**
+ * @brief Size of the buffer used to hash files
+ */
+#define HASH_BUFFER_SIZE (64 * 1024)
+
+/**
+ * @brief Directory of the configuration files shipped with LXC, included by the containers built here
+ */
+#define LXC_SHARED_CONFIG_DIRECTORY "/usr/share/lxc/config"
+
+/**
+ * @brief Extensions of the base tarballs, tried in order
+ */
+static const char *tarball_extensions[] = {".tar.xz", ".tar.gz", ".tar.zst", ".tar"};
+
+/**
+ * @brief Kind of step of a recipe
+ */
+enum template_step_type
+{
+    STEP_COPY,
+    STEP_RUN,
+};
+
+/**
+ * @brief A step of a recipe
+ */
+struct template_step
+{
+    enum template_step_type type;
+    char source[TEMPLATE_PATH_SIZE];      // copy: host path, relative paths are relative to the recipe
+    char destination[TEMPLATE_PATH_SIZE]; // copy: absolute path in the rootfs
+    char command[TEMPLATE_LINE_SIZE];     // run: shell command
+};
+
+/**
+ * @brief Bytes counted by count_entry(), nftw has no argument for its callback
+ */
+static unsigned long long counted_bytes;
+
+/**
+ * @brief Format a path, failing instead of truncating it
+ *
+ * @return int 0 on success, -1 (errno is ENAMETOOLONG) if it does not fit
+ */
+static int __attribute__((format(printf, 3, 4))) format_path(char *path, size_t size, const char *format, ...)
+{
+    va_list arguments;
+
+    va_start(arguments, format);
+    int length = vsnprintf(path, size, format, arguments);
+    va_end(arguments);
+
+    if (length < 0 || (size_t)length >= size)
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Get a directory of the store, creating the store if needed
+ *
+ * @param subdirectory directory in the store, NULL for the store itself
+ *
+ * @return int 0 on success, -1 on failure
+ */
+static int get_store_path(const char *subdirectory, char *path, size_t size)
+{
+    const char *subdirectories[] = {"bases", "layers", "templates", "build"};
+    char store[TEMPLATE_PATH_SIZE];
+
+    if (format_path(store, sizeof(store), "%s/%s", get_containers_path(), TEMPLATE_STORE_DIRECTORY) < 0 || (mkdir(store, 0755) < 0 && errno != EEXIST))
+    {
+        fprintf(stderr, "Failed to create the template store %s: %s\n", store, strerror(errno));
+        return -1;
+    }
+
+    for (const char *name : subdirectories)
+    {
+        if (format_path(path, size, "%s/%s", store, name) < 0 || (mkdir(path, 0755) < 0 && errno != EEXIST))
+        {
+            fprintf(stderr, "Failed to create %s: %s\n", path, strerror(errno));
+            return -1;
+        }
+    }
+
+    if (subdirectory == NULL)
+        return format_path(path, size, "%s", store);
+    return format_path(path, size, "%s/%s", store, subdirectory);
+}
+
+/**
+ * @brief Remove one entry of a directory tree, called by nftw
+ */
+static int remove_entry(const char *path, const struct stat *, int type, struct FTW *)
+{
+    return type == FTW_DP ? rmdir(path) : unlink(path);
+}
+
+/**
+ * @brief Remove a directory tree, without crossing into other file systems
+ */
+static void remove_tree(const char *path)
+{
+    nftw(path, remove_entry, 16, FTW_DEPTH | FTW_PHYS | FTW_MOUNT);
+}
+
+/**
+ * @brief Add the size of one entry of a directory tree to counted_bytes, called by nftw
+ */
+static int count_entry(const char *, const struct stat *entry_stat, int type, struct FTW *)
+{
+    if (type == FTW_F)
+        counted_bytes += (unsigned long long)entry_stat->st_blocks * 512;
+    return 0;
+}
+
+/**
+ * @brief Check that a field of a platform can be used in a file name
+ */
+static int is_valid_field(const char *field)
+{
+    if (field[0] == 0 || field[0] == '.')
+        return 0;
+
+    for (const char *character = field; *character != 0; character++)
+        if (!isalnum((unsigned char)*character) && *character != '.' && *character != '_' && *character != '-')
+            return 0;
+
+    return 1;
+}
+
+/**
+ * @brief Fill the empty fields of a platform with the ones of another one
+ */
+static void merge_platform(struct template_platform *platform, const struct template_platform *fallback)
+{
+    if (platform->os[0] == 0)
+        snprintf(platform->os, sizeof(platform->os), "%s", fallback->os);
+    if (platform->release[0] == 0)
+        snprintf(platform->release, sizeof(platform->release), "%s", fallback->release);
+    if (platform->architecture[0] == 0)
+        snprintf(platform->architecture, sizeof(platform->architecture), "%s", fallback->architecture);
+}
+
+/**
+ * @brief Resolve the platform asked by the caller, taking the missing fields from the recipe and then from the defaults
+ *
+ * @return int 0 on success, -1 if a field is invalid
+ */
+static int resolve_platform(struct template_platform *resolved, const struct template_platform *requested, const struct template_platform *recipe)
+{
+    struct template_platform defaults;
+
+    snprintf(defaults.os, sizeof(defaults.os), "%s", TEMPLATE_DEFAULT_OS);
+    snprintf(defaults.release, sizeof(defaults.release), "%s", TEMPLATE_DEFAULT_RELEASE);
+    snprintf(defaults.architecture, sizeof(defaults.architecture), "%s", TEMPLATE_DEFAULT_ARCHITECTURE);
+
+    memset(resolved, 0, sizeof(*resolved));
+    if (requested != NULL)
+        *resolved = *requested;
+    if (recipe != NULL)
+        merge_platform(resolved, recipe);
+    merge_platform(resolved, &defaults);
+
+    if (!is_valid_field(resolved->os) || !is_valid_field(resolved->release) || !is_valid_field(resolved->architecture))
+    {
+        fprintf(stderr, "Invalid platform %s-%s-%s\n", resolved->os, resolved->release, resolved->architecture);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Convert a digest to a key of the store
+ */
+static void digest_to_key(const unsigned char *digest, unsigned int length, char key[TEMPLATE_KEY_SIZE])
+{
+    for (unsigned int index = 0; index < length && index * 2 + 2 < TEMPLATE_KEY_SIZE; index++)
+        snprintf(key + index * 2, 3, "%02x", digest[index]);
+}
+
+/**
+ * @brief Add the content of a file to a hash
+ *
+ * @return int 0 on success, -1 on failure
+ */
+static int hash_file(EVP_MD_CTX *context, const char *path)
+{
+    static char buffer[HASH_BUFFER_SIZE];
+    ssize_t length;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+        return -1;
+
+    while ((length = read(fd, buffer, sizeof(buffer))) > 0)
+        EVP_DigestUpdate(context, buffer, (size_t)length);
+    close(fd);
+
+    return length < 0 ? -1 : 0;
+}
+
+/**
+ * @brief Add a file or a directory tree to a hash: the names, modes, link targets and contents, in sorted order
+ *
+ * @param path path of the file or directory
+ * @param name name recorded in the hash (relative to the root of the tree)
+ *
+ * @return int 0 on success, -1 on failure
+ */
+static int hash_tree(EVP_MD_CTX *context, const char *path, const char *name)
+{
+    char header[TEMPLATE_PATH_SIZE + 32], child_path[TEMPLATE_PATH_SIZE], child_name[TEMPLATE_PATH_SIZE], target[TEMPLATE_PATH_SIZE];
+    struct dirent **entries;
+    struct stat entry_stat;
+    int number_of_entries, result = 0;
+
+    if (lstat(path, &entry_stat) < 0)
+        return -1;
+
+    int header_length = snprintf(header, sizeof(header), "%s%c%o", name, 0, (unsigned int)entry_stat.st_mode);
+    EVP_DigestUpdate(context, header, (size_t)header_length + 1);
+
+    if (S_ISREG(entry_stat.st_mode))
+        return hash_file(context, path);
+
+    if (S_ISLNK(entry_stat.st_mode))
+    {
+        ssize_t length = readlink(path, target, sizeof(target));
+        if (length < 0)
+            return -1;
+        EVP_DigestUpdate(context, target, (size_t)length);
+        return 0;
+    }
+
+    if (!S_ISDIR(entry_stat.st_mode))
+        return 0;
+
+    number_of_entries = scandir(path, &entries, NULL, alphasort);
+    if (number_of_entries < 0)
+        return -1;
+
+    for (int index = 0; index < number_of_entries; index++)
+    {
+        if (result == 0 && strcmp(entries[index]->d_name, ".") != 0 && strcmp(entries[index]->d_name, "..") != 0)
+        {
+            if (format_path(child_path, sizeof(child_path), "%s/%s", path, entries[index]->d_name) < 0 ||
+                format_path(child_name, sizeof(child_name), "%s/%s", name, entries[index]->d_name) < 0)
+                result = -1;
+            else
+                result = hash_tree(context, child_path, child_name);
+        }
+        free(entries[index]);
+    }
+    free(entries);
+
+    return result;
+}
+
+/**
+ * @brief Compute the key of a layer: the key of the layer below, the step and the digest of its content
+ *
+ * @param parent key of the layer below, NULL for the base layer
+ * @param description description of the step (e.g. "run apt-get update")
+ * @param content file or directory whose content is part of the key, NULL for none
+ * @param key computed key
+ *
+ * @return int 0 on success, -1 on failure
+ */
+static int compute_layer_key(const char *parent, const char *description, const char *content, char key[TEMPLATE_KEY_SIZE])
+{
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int digest_length = 0;
+    int result = 0;
+
+    EVP_MD_CTX *context = EVP_MD_CTX_new();
+    if (context == NULL || !EVP_DigestInit_ex(context, EVP_sha256(), NULL))
+    {
+        EVP_MD_CTX_free(context);
+        return -1;
+    }
+
+    EVP_DigestUpdate(context, parent != NULL ? parent : "", parent != NULL ? strlen(parent) + 1 : 1);
+    EVP_DigestUpdate(context, description, strlen(description) + 1);
+    if (content != NULL && TRACE_CALL("template.hash", description, hash_tree(context, content, "")) < 0)
+        result = -1;
+
+    if (result == 0 && EVP_DigestFinal_ex(context, digest, &digest_length))
+        digest_to_key(digest, digest_length, key);
+    else
+        result = -1;
+
+    EVP_MD_CTX_free(context);
+    return result;
+}
+
+/**
+ * @brief Get the path of a layer of the store, or of its rootfs
+ *
+ * @return int 0 on success, -1 if it does not fit
+ */
+static int get_layer_path(const char *layers, const char *key, const char *suffix, char *path, size_t size)
+{
+    return format_path(path, size, "%s/%s%s", layers, key, suffix);
+}
+
+/**
+ * @brief Check if a complete layer is in the store
+ */
+static int layer_exists(const char *layers, const char *key)
+{
+    char path[TEMPLATE_PATH_SIZE];
+    return get_layer_path(layers, key, "/layer.conf", path, sizeof(path)) == 0 && access(path, F_OK) == 0;
+}
+
+/**
+ * @brief Remove the temporary layers of builds whose process is gone
+ */
+static void remove_stale_layers(const char *layers)
+{
+    char path[TEMPLATE_PATH_SIZE];
+    struct dirent *entry;
+    DIR *directory = opendir(layers);
+
+    if (directory == NULL)
+        return;
+
+    while ((entry = readdir(directory)) != NULL)
+    {
+        const char *marker = strstr(entry->d_name, ".tmp-");
+        if (marker == NULL)
+            continue;
+
+        pid_t pid = (pid_t)atoi(marker + strlen(".tmp-"));
+        if (pid > 0 && (kill(pid, 0) == 0 || errno == EPERM))
+            continue;
+
+        if (format_path(path, sizeof(path), "%s/%s", layers, entry->d_name) == 0)
+            remove_tree(path);
+    }
+    closedir(directory);
+}
+
+/**
+ * @brief Create the temporary directory of a layer being built, with an empty rootfs
+ *
+ * @return int 0 on success, -1 on failure
+ */
+static int start_layer(const char *layers, const char *key, char *temporary, size_t size)
+{
+    char rootfs[TEMPLATE_PATH_SIZE];
+
+    if (format_path(temporary, size, "%s/%s.tmp-%d", layers, key, (int)getpid()) < 0 || format_path(rootfs, sizeof(rootfs), "%s/rootfs", temporary) < 0)
+    {
+        fprintf(stderr, "The path of the layer %s is too long\n", key);
+        return -1;
+    }
+    remove_tree(temporary);
+
+    if (mkdir(temporary, 0755) < 0 || mkdir(rootfs, 0755) < 0)
+    {
+        fprintf(stderr, "Failed to create the layer %s: %s\n", temporary, strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Describe a built layer and move it to its place in the store
+ *
+ * @return int 0 on success, -1 on failure
+ */
+static int finish_layer(const char *layers, const char *key, const char *parent, const char *description, const char *temporary)
+{
+    char path[TEMPLATE_PATH_SIZE], final_path[TEMPLATE_PATH_SIZE];
+    FILE *file;
+
+    // The work directory of the overlay is not part of the layer
+    if (format_path(path, sizeof(path), "%s/olwork", temporary) == 0)
+        remove_tree(path);
+
+    file = format_path(path, sizeof(path), "%s/layer.conf", temporary) == 0 ? fopen(path, "w") : NULL;
+    if (file == NULL)
+    {
+        fprintf(stderr, "Failed to describe the layer %s\n", key);
+        return -1;
+    }
+    fprintf(file, "key = %s\n", key);
+    fprintf(file, "parent = %s\n", parent != NULL ? parent : "");
+    fprintf(file, "step = %s\n", description);
+    fprintf(file, "created = %lld\n", (long long)time(NULL));
+    fclose(file);
+
+    if (get_layer_path(layers, key, "", final_path, sizeof(final_path)) < 0 || rename(temporary, final_path) < 0)
+    {
+        if (layer_exists(layers, key)) // built at the same time by another build
+        {
+            remove_tree(temporary);
+            return 0;
+        }
+        fprintf(stderr, "Failed to store the layer %s: %s\n", key, strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Find the base tarball of a platform in the store
+ *
+ * @return int 0 on success, -1 if there is none
+ */
+static int find_base_tarball(const struct template_platform *platform, char *path, size_t size)
+{
+    char bases[TEMPLATE_PATH_SIZE];
+
+    if (get_store_path("bases", bases, sizeof(bases)) < 0)
+        return -1;
+
+    for (const char *extension : tarball_extensions)
+    {
+        if (format_path(path, size, "%s/%s-%s-%s%s", bases, platform->os, platform->release, platform->architecture, extension) == 0 && access(path, R_OK) == 0)
+            return 0;
+    }
+
+    fprintf(stderr, "No base tarball for %s-%s-%s: put its rootfs in %s/%s-%s-%s.tar.xz (e.g. rootfs.tar.xz of images.linuxcontainers.org) or use --tarball\n",
+            platform->os, platform->release, platform->architecture, bases, platform->os, platform->release, platform->architecture);
+    return -1;
+}
+
+/**
+ * @brief Extract a tarball into a directory with tar, keeping owners and permissions
+ *
+ * @return int 0 on success, -1 on failure
+ */
+static int extract_tarball(const char *tarball, const char *directory)
+{
+    int status;
+    pid_t pid;
+
+    fflush(NULL);
+    pid = fork();
+    if (pid < 0)
+        return -1;
+
+    if (pid == 0)
+    {
+        execlp("tar", "tar", "--numeric-owner", "-xpf", tarball, "-C", directory, (char *)NULL);
+        fprintf(stderr, "Failed to run tar: %s\n", strerror(errno));
+        _exit(127);
+    }
+
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        fprintf(stderr, "Failed to extract %s\n", tarball);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Copy a file or a directory tree, keeping modes and symbolic links
+ *
+ * @return int 0 on success, -1 on failure
+ */
+static int copy_tree(const char *source, const char *destination)
+{
+    char source_child[TEMPLATE_PATH_SIZE], destination_child[TEMPLATE_PATH_SIZE], target[TEMPLATE_PATH_SIZE];
+    struct dirent **entries;
+    struct stat source_stat;
+    int number_of_entries, result = 0;
+
+    if (lstat(source, &source_stat) < 0)
+        return -1;
+
+    if (S_ISLNK(source_stat.st_mode))
+    {
+        ssize_t length = readlink(source, target, sizeof(target) - 1);
+        if (length < 0)
+            return -1;
+        target[length] = 0;
+        unlink(destination);
+        return symlink(target, destination);
+    }
+
+    if (S_ISREG(source_stat.st_mode))
+    {
+        int source_fd = open(source, O_RDONLY | O_CLOEXEC);
+        if (source_fd < 0)
+            return -1;
+
+        int destination_fd = open(destination, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, source_stat.st_mode & 07777);
+        if (destination_fd < 0 || cmt::copy_file_contents(source_fd, destination_fd) < 0 || fchmod(destination_fd, source_stat.st_mode & 07777) < 0)
+            result = -1;
+
+        if (destination_fd >= 0)
+            close(destination_fd);
+        close(source_fd);
+        return result;
+    }
+
+    if (!S_ISDIR(source_stat.st_mode))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (mkdir(destination, source_stat.st_mode & 07777) < 0 && errno != EEXIST)
+        return -1;
+
+    number_of_entries = scandir(source, &entries, NULL, alphasort);
+    if (number_of_entries < 0)
+        return -1;
+
+    for (int index = 0; index < number_of_entries; index++)
+    {
+        if (result == 0 && strcmp(entries[index]->d_name, ".") != 0 && strcmp(entries[index]->d_name, "..") != 0)
+        {
+            if (format_path(source_child, sizeof(source_child), "%s/%s", source, entries[index]->d_name) < 0 ||
+                format_path(destination_child, sizeof(destination_child), "%s/%s", destination, entries[index]->d_name) < 0)
+                result = -1;
+            else
+                result = copy_tree(source_child, destination_child);
+        }
+        free(entries[index]);
+    }
+    free(entries);
+
+    return result;
+}
+
+/**
+ * @brief Create the parent directories of a path in a new layer, with the mode and owner they have in the layers below
+ *
+ * @param rootfs rootfs of the new layer
+ * @param lowers rootfs of the layers below, from the top
+ * @param path absolute path in the rootfs
+ *
+ * @return int 0 on success, -1 on failure
+ */
+static int make_parent_directories(const char *rootfs, const std::vector<std::string> &lowers, const char *path)
+{
+    char partial[TEMPLATE_PATH_SIZE], layer_path[TEMPLATE_PATH_SIZE];
+    struct stat directory_stat;
+
+    if (format_path(partial, sizeof(partial), "%s", path) < 0)
+        return -1;
+    for (char *slash = strchr(partial + 1, '/'); slash != NULL; slash = strchr(slash + 1, '/'))
+    {
+        *slash = 0;
+
+        directory_stat.st_mode = 0755;
+        directory_stat.st_uid = 0;
+        directory_stat.st_gid = 0;
+        for (const std::string &lower : lowers)
+        {
+            if (format_path(layer_path, sizeof(layer_path), "%s%s", lower.c_str(), partial) == 0 && stat(layer_path, &directory_stat) == 0)
+                break;
+        }
+
+        if (format_path(layer_path, sizeof(layer_path), "%s%s", rootfs, partial) < 0)
+            return -1;
+        if (mkdir(layer_path, directory_stat.st_mode & 07777) == 0)
+        {
+            if (chown(layer_path, directory_stat.st_uid, directory_stat.st_gid) < 0)
+                return -1;
+        }
+        else if (errno != EEXIST)
+            return -1;
+
+        *slash = '/';
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Make the rootfs of an overlay from the rootfs of the layers below and the upper directory ("overlay:TOP:...:BASE:UPPER")
+ *
+ * @return int 0 on success, -1 if the layers do not fit in the options of an overlay mount
+ */
+static int make_overlay_rootfs(const std::vector<std::string> &lowers, const char *upper, char *rootfs, size_t size)
+{
+    std::string joined = "overlay";
+
+    for (const std::string &lower : lowers)
+        joined += ":" + lower;
+    joined += ":";
+    joined += upper;
+
+    if (format_path(rootfs, size, "%s", joined.c_str()) < 0)
+    {
+        fprintf(stderr, "The %zu layers do not fit in an overlay (%zu bytes of at most %zu)\n", lowers.size() + 1, joined.size(), size - 1);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Set the configuration shared by the build containers and the containers created from a template
+ *
+ * @return int 0 on success, -1 on failure
+ */
+static int configure_container(struct lxc_container *container, const char *container_name, const struct template_platform *platform, const char *rootfs)
+{
+    char include[TEMPLATE_PATH_SIZE];
+
+    // Network and id mappings come from the default config, like for a container created with the download template
+    const char *default_config = lxc_get_global_config_item("lxc.default_config");
+    if (default_config != NULL && access(default_config, R_OK) == 0 && !container->load_config(container, default_config))
+    {
+        fprintf(stderr, "Failed to load the default config %s for container %s\n", default_config, container_name);
+        return -1;
+    }
+
+    // The configuration the download template would have included for this distribution, when LXC ships it
+    snprintf(include, sizeof(include), "%s/%s.common.conf", LXC_SHARED_CONFIG_DIRECTORY, platform->os);
+    if (access(include, R_OK) < 0)
+        snprintf(include, sizeof(include), "%s/common.conf", LXC_SHARED_CONFIG_DIRECTORY);
+
+    if ((access(include, R_OK) == 0 && !container->set_config_item(container, "lxc.include", include)) ||
+        !container->set_config_item(container, "lxc.arch", platform->architecture) ||
+        !container->set_config_item(container, "lxc.uts.name", container_name) ||
+        !container->set_config_item(container, "lxc.rootfs.path", rootfs))
+    {
+        fprintf(stderr, "Failed to configure container %s: %s\n", container_name, container->error_string ? container->error_string : "unknown error");
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Run a "run" step in a build container whose rootfs is an overlay of the layers below and of the new layer
+ *
+ * @param lowers rootfs of the layers below, from the top
+ * @param upper rootfs of the new layer
+ * @param command command, run with /bin/sh -c as the init of the container
+ *
+ * The wait status of the command comes back through a pipe, so any exit code of the command is told apart from a build
+ * container that did not start
+ *
+ * @return int exit status of the command (128 + signal if it was killed), -1 if it did not run
+ */
+static int run_build_step(const std::vector<std::string> &lowers, const char *upper, const struct template_platform *platform, const char *command)
+{
+    char build[TEMPLATE_PATH_SIZE], container_path[TEMPLATE_PATH_SIZE], container_name[TEMPLATE_NAME_SIZE], rootfs[TEMPLATE_OVERLAY_SIZE];
+    struct lxc_container *container = NULL;
+    int pipe_fds[2] = {-1, -1}, status, result = -1;
+    ssize_t length;
+    pid_t pid;
+
+    if (get_store_path("build", build, sizeof(build)) < 0 || make_overlay_rootfs(lowers, upper, rootfs, sizeof(rootfs)) < 0)
+        return -1;
+
+    snprintf(container_name, sizeof(container_name), "cmt-build-%d", (int)getpid());
+    if (format_path(container_path, sizeof(container_path), "%s/%s", build, container_name) < 0)
+        return -1;
+    remove_tree(container_path);
+    if (mkdir(container_path, 0770) < 0)
+    {
+        fprintf(stderr, "Failed to create the build container: %s\n", strerror(errno));
+        return -1;
+    }
+
+    container = lxc_container_new(container_name, build);
+    if (container == NULL || configure_container(container, container_name, platform, rootfs) < 0 || !container->save_config(container, NULL))
+    {
+        fprintf(stderr, "Failed to set up the build container\n");
+        goto out;
+    }
+    lxc_container_put(container);
+    container = NULL;
+
+    if (pipe2(pipe_fds, O_CLOEXEC) < 0)
+        goto out;
+
+    fflush(NULL);
+    pid = fork();
+    if (pid < 0)
+        goto out;
+
+    if (pid == 0)
+    {
+        const char *arguments[] = {"/bin/sh", "-c", command, NULL};
+        struct lxc_container *step = lxc_container_new(container_name, build);
+
+        close(pipe_fds[0]);
+        if (step == NULL)
+            _exit(1);
+
+        step->want_daemonize(step, false);
+        if (!TRACE_CALL("lxc.execute", container_name, step->start(step, 1, (char *const *)arguments)))
+        {
+            fprintf(stderr, "Failed to start the build container: %s\n", step->error_string ? step->error_string : "unknown error");
+            _exit(1);
+        }
+
+        status = step->error_num; // wait status of the init of the container
+        if (write(pipe_fds[1], &status, sizeof(status)) != (ssize_t)sizeof(status))
+            _exit(1);
+        _exit(0);
+    }
+
+    // Closed without data if the container did not start
+    close(pipe_fds[1]);
+    pipe_fds[1] = -1;
+    while ((length = read(pipe_fds[0], &status, sizeof(status))) < 0 && errno == EINTR)
+        ;
+    waitpid(pid, NULL, 0);
+
+    if (length == (ssize_t)sizeof(status))
+        result = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+
+out:
+    if (pipe_fds[0] >= 0)
+        close(pipe_fds[0]);
+    if (pipe_fds[1] >= 0)
+        close(pipe_fds[1]);
+    if (container != NULL)
+        lxc_container_put(container);
+    remove_tree(container_path); // only the configuration, the layers are not part of the build container
+    return result;
+}
+
+/**
+ * @brief Read a recipe
+ *
+ * @param recipe_path path of the recipe
+ * @param platform platform of the "from" line, empty if there is none
+ * @param steps read steps
+ *
+ * @return int 0 on success, -1 on failure
+ */
+static int load_recipe(const char *recipe_path, struct template_platform *platform, std::vector<struct template_step> &steps)
+{
+    char line[TEMPLATE_LINE_SIZE], recipe_directory[TEMPLATE_PATH_SIZE], directory_copy[TEMPLATE_PATH_SIZE];
+    int line_number = 0, result = 0;
+    FILE *file;
+
+    file = fopen(recipe_path, "r");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Failed to open the recipe %s: %s\n", recipe_path, strerror(errno));
+        return -1;
+    }
+
+    if (format_path(directory_copy, sizeof(directory_copy), "%s", recipe_path) < 0 || format_path(recipe_directory, sizeof(recipe_directory), "%s", dirname(directory_copy)) < 0)
+    {
+        fprintf(stderr, "The path of the recipe %s is too long\n", recipe_path);
+        fclose(file);
+        return -1;
+    }
+    memset(platform, 0, sizeof(*platform));
+
+    while (result == 0 && fgets(line, sizeof(line), file) != NULL)
+    {
+        char *instruction = line, *argument;
+        struct template_step step;
+
+        line_number++;
+        line[strcspn(line, "\r\n")] = 0;
+        while (isspace((unsigned char)*instruction))
+            instruction++;
+        if (*instruction == 0 || *instruction == '#')
+            continue;
+
+        argument = instruction + strcspn(instruction, " \t");
+        if (*argument != 0)
+            *argument++ = 0;
+        while (isspace((unsigned char)*argument))
+            argument++;
+
+        memset(&step, 0, sizeof(step));
+        if (strcmp(instruction, "from") == 0 && steps.empty())
+        {
+            if (sscanf(argument, "%31s %31s %31s", platform->os, platform->release, platform->architecture) != 3)
+                result = -1;
+            continue;
+        }
+
+        if (strcmp(instruction, "run") == 0 && *argument != 0)
+        {
+            step.type = STEP_RUN;
+            snprintf(step.command, sizeof(step.command), "%s", argument);
+        }
+        else if (strcmp(instruction, "copy") == 0)
+        {
+            char source[TEMPLATE_PATH_SIZE] = {0};
+
+            step.type = STEP_COPY;
+            if (sscanf(argument, "%1023s %1023s", source, step.destination) != 2 || step.destination[0] != '/' || strstr(step.destination, "..") != NULL)
+            {
+                result = -1;
+                continue;
+            }
+            if (source[0] == '/')
+                snprintf(step.source, sizeof(step.source), "%s", source);
+            else if (format_path(step.source, sizeof(step.source), "%s/%s", recipe_directory, source) < 0)
+                result = -1;
+        }
+        else
+            result = -1;
+
+        if (result == 0)
+            steps.push_back(step);
+    }
+    fclose(file);
+
+    if (result < 0)
+        fprintf(stderr, "Invalid instruction in line %d of the recipe %s\n", line_number, recipe_path);
+    else if (steps.size() > TEMPLATE_MAX_STEPS)
+    {
+        fprintf(stderr, "The recipe %s has more than %d steps\n", recipe_path, TEMPLATE_MAX_STEPS);
+        result = -1;
+    }
+
+    return result;
+}
+
+/**
+ * @brief Get the path of the file describing a template for a platform
+ *
+ * @param create 1 to create the directory of the template
+ *
+ * @return int 0 on success, -1 on failure
+ */
+static int get_template_path(const char *template_name, const struct template_platform *platform, int create, char *path, size_t size)
+{
+    char templates[TEMPLATE_PATH_SIZE];
+
+    if (!is_valid_field(template_name) || get_store_path("templates", templates, sizeof(templates)) < 0)
+    {
+        fprintf(stderr, "Invalid template name %s\n", template_name);
+        return -1;
+    }
+
+    if (format_path(path, size, "%s/%s", templates, template_name) < 0 || (create && mkdir(path, 0755) < 0 && errno != EEXIST))
+        return -1;
+
+    return format_path(path, size, "%s/%s/%s-%s-%s.conf", templates, template_name, platform->os, platform->release, platform->architecture);
+}
+
+/**
+ * @brief Read the keys of the layers of a template, from the base up
+ *
+ * @return int 0 on success, -1 on failure
+ */
+static int load_template_layers(const char *path, std::vector<std::string> &keys, long long *built)
+{
+    char line[TEMPLATE_LINE_SIZE], key[TEMPLATE_KEY_SIZE];
+    FILE *file = fopen(path, "r");
+
+    if (file == NULL)
+        return -1;
+
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        if (sscanf(line, "layer = %64s", key) == 1)
+            keys.push_back(key);
+        else if (built != NULL)
+            sscanf(line, "built = %lld", built);
+    }
+    fclose(file);
+
+    return keys.empty() ? -1 : 0;
+}
+
+int build_template(const char *template_name, const char *recipe_path, const struct template_platform *platform, const char *tarball_path)
+{
+    TRACE_SPAN_ARGUMENT("build_template", template_name);
+    std::vector<struct template_step> steps;
+    std::vector<std::string> keys, lowers;
+    struct template_platform recipe_platform, resolved;
+    char layers[TEMPLATE_PATH_SIZE], tarball[TEMPLATE_PATH_SIZE], temporary[TEMPLATE_PATH_SIZE], path[TEMPLATE_PATH_SIZE];
+    char key[TEMPLATE_KEY_SIZE] = {0}, description[TEMPLATE_LINE_SIZE + 16], log_message[LOG_MESSAGE_SIZE] = {0};
+    int reused = 0, built = 0;
+    FILE *file;
+
+    if (load_recipe(recipe_path, &recipe_platform, steps) < 0 || resolve_platform(&resolved, platform, &recipe_platform) < 0)
+        return -1;
+
+    if (get_template_path(template_name, &resolved, 1, path, sizeof(path)) < 0 || get_store_path("layers", layers, sizeof(layers)) < 0)
+        return -1;
+
+    if (tarball_path != NULL && format_path(tarball, sizeof(tarball), "%s", tarball_path) < 0)
+    {
+        fprintf(stderr, "The path of the tarball %s is too long\n", tarball_path);
+        return -1;
+    }
+    if (tarball_path == NULL && find_base_tarball(&resolved, tarball, sizeof(tarball)) < 0)
+        return -1;
+
+    // The last "run" step mounts every layer, refuse a recipe whose overlay would not fit before building any of them
+    size_t layer_path_length = strlen(layers) + strlen("/") + TEMPLATE_KEY_SIZE - 1 + strlen(".tmp-2147483647/rootfs") + strlen(":");
+    if (strlen("overlay") + (steps.size() + 1) * layer_path_length >= TEMPLATE_OVERLAY_SIZE)
+    {
+        fprintf(stderr, "The recipe %s has too many steps for an overlay of its layers in %s\n", recipe_path, layers);
+        return -1;
+    }
+
+    remove_stale_layers(layers);
+    printf("Building template %s for %s-%s-%s from %s\n", template_name, resolved.os, resolved.release, resolved.architecture, recipe_path);
+
+    // The base layer is keyed by the platform and the content of the tarball
+    snprintf(description, sizeof(description), "base %s-%s-%s", resolved.os, resolved.release, resolved.architecture);
+    if (compute_layer_key(NULL, description, tarball, key) < 0)
+    {
+        fprintf(stderr, "Failed to read the base tarball %s\n", tarball);
+        return -1;
+    }
+
+    printf("Step 0/%zu: %s (%.12s)", steps.size(), description, key);
+    if (layer_exists(layers, key))
+    {
+        printf(" cached\n");
+        reused++;
+    }
+    else
+    {
+        printf(" extracting %s\n", tarball);
+        if (start_layer(layers, key, temporary, sizeof(temporary)) < 0 || format_path(path, sizeof(path), "%s/rootfs", temporary) < 0 || TRACE_CALL("template.extract", template_name, extract_tarball(tarball, path)) < 0 ||
+            finish_layer(layers, key, NULL, description, temporary) < 0)
+        {
+            remove_tree(temporary);
+            return -1;
+        }
+        built++;
+    }
+    keys.push_back(key);
+
+    for (size_t index = 0; index < steps.size(); index++)
+    {
+        const struct template_step *step = &steps[index];
+        char parent[TEMPLATE_KEY_SIZE], rootfs[TEMPLATE_PATH_SIZE];
+
+        if (get_layer_path(layers, keys.back().c_str(), "/rootfs", rootfs, sizeof(rootfs)) < 0)
+            return -1;
+        lowers.insert(lowers.begin(), rootfs);
+        snprintf(parent, sizeof(parent), "%s", keys.back().c_str());
+
+        if (step->type == STEP_RUN)
+            snprintf(description, sizeof(description), "run %s", step->command);
+        else
+            snprintf(description, sizeof(description), "copy %s %s", step->source, step->destination);
+
+        if (compute_layer_key(parent, step->type == STEP_RUN ? description : step->destination, step->type == STEP_COPY ? step->source : NULL, key) < 0)
+        {
+            fprintf(stderr, "Failed to read %s\n", step->source);
+            return -1;
+        }
+
+        printf("Step %zu/%zu: %s (%.12s)", index + 1, steps.size(), description, key);
+        if (layer_exists(layers, key))
+        {
+            printf(" cached\n");
+            keys.push_back(key);
+            reused++;
+            continue;
+        }
+        printf("\n");
+
+        if (start_layer(layers, key, temporary, sizeof(temporary)) < 0)
+            return -1;
+        format_path(rootfs, sizeof(rootfs), "%s/rootfs", temporary); // checked by start_layer()
+
+        if (step->type == STEP_COPY)
+        {
+            if (format_path(path, sizeof(path), "%s%s", rootfs, step->destination) < 0 || make_parent_directories(rootfs, lowers, step->destination) < 0 || TRACE_CALL("template.copy", template_name, copy_tree(step->source, path)) < 0)
+            {
+                fprintf(stderr, "Failed to copy %s to %s: %s\n", step->source, step->destination, strerror(errno));
+                remove_tree(temporary);
+                return -1;
+            }
+        }
+        else
+        {
+            int exit_code = TRACE_CALL("template.run", template_name, run_build_step(lowers, rootfs, &resolved, step->command));
+            if (exit_code != 0)
+            {
+                fprintf(stderr, "Step %zu failed (exit code %d), the layers of the previous steps are kept\n", index + 1, exit_code);
+                remove_tree(temporary);
+                snprintf(log_message, LOG_MESSAGE_SIZE, "Build of template %s failed at step %zu", template_name, index + 1);
+                log_activity("ERROR", "template", NULL, log_message);
+                return -1;
+            }
+        }
+
+        if (finish_layer(layers, key, parent, description, temporary) < 0)
+        {
+            remove_tree(temporary);
+            return -1;
+        }
+        keys.push_back(key);
+        built++;
+    }
+
+    // Written aside and renamed, so the template is never seen half written or empty if the build is interrupted
+    if (get_template_path(template_name, &resolved, 1, path, sizeof(path)) < 0 || format_path(temporary, sizeof(temporary), "%s.tmp-%d", path, (int)getpid()) < 0 ||
+        (file = fopen(temporary, "w")) == NULL)
+    {
+        fprintf(stderr, "Failed to save the template %s\n", template_name);
+        return -1;
+    }
+    fprintf(file, "recipe = %s\n", recipe_path);
+    fprintf(file, "built = %lld\n", (long long)time(NULL));
+    for (const std::string &layer : keys)
+        fprintf(file, "layer = %s\n", layer.c_str());
+    if (ferror(file) || fflush(file) != 0 || fsync(fileno(file)) < 0 || fclose(file) != 0 || rename(temporary, path) < 0)
+    {
+        fprintf(stderr, "Failed to save the template %s: %s\n", template_name, strerror(errno));
+        unlink(temporary);
+        return -1;
+    }
+
+    printf("Template %s built: %d layers reused, %d built\n", template_name, reused, built);
+
+    snprintf(log_message, LOG_MESSAGE_SIZE, "Template %s built (%d layers reused, %d built)", template_name, reused, built);
+    log_activity("INFO", "template", NULL, log_message);
+
+    return 0;
+}
+
+int create_container_from_template(const char *container_name, const char *template_name, const struct template_platform *platform)
+{
+    TRACE_SPAN_ARGUMENT("create_container_from_template", container_name);
+    std::vector<std::string> keys, lowers;
+    struct template_platform resolved;
+    struct lxc_container *container = NULL;
+    char path[TEMPLATE_PATH_SIZE], layers[TEMPLATE_PATH_SIZE], container_path[TEMPLATE_PATH_SIZE];
+    char rootfs[TEMPLATE_OVERLAY_SIZE], log_message[LOG_MESSAGE_SIZE] = {0};
+    int result = -1, created = 0;
+
+    if (resolve_platform(&resolved, platform, NULL) < 0 || get_template_path(template_name, &resolved, 0, path, sizeof(path)) < 0 ||
+        get_store_path("layers", layers, sizeof(layers)) < 0)
+        return -1;
+
+    if (load_template_layers(path, keys, NULL) < 0)
+    {
+        fprintf(stderr, "Template %s is not built for %s-%s-%s\n\n", template_name, resolved.os, resolved.release, resolved.architecture);
+        return -1;
+    }
+
+    for (const std::string &key : keys)
+    {
+        if (!layer_exists(layers, key.c_str()))
+        {
+            fprintf(stderr, "Layer %.12s of template %s is missing, build it again\n\n", key.c_str(), template_name);
+            return -1;
+        }
+        if (get_layer_path(layers, key.c_str(), "/rootfs", path, sizeof(path)) < 0)
+            return -1;
+        lowers.insert(lowers.begin(), path);
+    }
+
+    container = TRACE_CALL("lxc.new", container_name, lxc_container_new(container_name, get_containers_path()));
+    if (container == NULL)
+    {
+        fprintf(stderr, "Failed to setup lxc_container struct\n\n");
+        return -1;
+    }
+
+    if (container->is_defined(container))
+    {
+        fprintf(stderr, "Container already exists\n\n");
+        goto out;
+    }
+
+    // The layers are the read-only lower layers, the container only owns delta0
+    if (format_path(container_path, sizeof(container_path), "%s/%s", get_containers_path(), container_name) < 0 || format_path(path, sizeof(path), "%s/delta0", container_path) < 0 ||
+        make_overlay_rootfs(lowers, path, rootfs, sizeof(rootfs)) < 0)
+    {
+        fprintf(stderr, "Failed to create the directory of the container: %s\n\n", strerror(errno));
+        goto out;
+    }
+
+    if (mkdir(container_path, 0770) < 0 || mkdir(path, 0755) < 0)
+    {
+        fprintf(stderr, "Failed to create the directory of the container: %s\n\n", strerror(errno));
+        goto out;
+    }
+    created = 1;
+
+    if (configure_container(container, container_name, &resolved, rootfs) < 0 || !TRACE_CALL("config.save", container_name, container->save_config(container, NULL)))
+    {
+        fprintf(stderr, "Failed to save the config of the container\n\n");
+        goto out;
+    }
+
+    snprintf(log_message, LOG_MESSAGE_SIZE, "Container %s created from template %s", container_name, template_name);
+    log_activity("INFO", "create", container_name, log_message);
+
+    printf("Container %s created from template %s (%s-%s-%s, %zu layers)\n", container_name, template_name, resolved.os, resolved.release, resolved.architecture, keys.size());
+    result = 0;
+
+    if (!TRACE_CALL("lxc.start", container_name, container->start(container, 0, NULL)))
+    {
+        fprintf(stderr, "Failed to start the container: %s\n\n", container->error_string ? container->error_string : "unknown error");
+        result = -1;
+        goto out;
+    }
+
+    snprintf(log_message, LOG_MESSAGE_SIZE, "Container %s started", container_name);
+    log_activity("INFO", "create", container_name, log_message);
+
+    printf("Container %s started\n", container_name);
+    printf("Current state: %s\n", container->state(container));
+    printf("PID: %d\n", container->init_pid(container));
+
+out:
+    if (result < 0 && created && !container->is_defined(container))
+        remove_tree(container_path);
+    lxc_container_put(container);
+    return result;
+}
+
+int list_templates(void)
+{
+    TRACE_SPAN("list_templates");
+    char templates[TEMPLATE_PATH_SIZE], layers[TEMPLATE_PATH_SIZE], path[TEMPLATE_PATH_SIZE], built_time[32];
+    struct dirent *template_entry, *platform_entry;
+    int number_of_templates = 0;
+    DIR *template_directory, *platform_directory;
+
+    if (get_store_path("templates", templates, sizeof(templates)) < 0 || get_store_path("layers", layers, sizeof(layers)) < 0)
+        return -1;
+
+    template_directory = opendir(templates);
+    if (template_directory == NULL)
+    {
+        fprintf(stderr, "Failed to open %s: %s\n", templates, strerror(errno));
+        return -1;
+    }
+
+    printf("%-20s %-28s %-7s %-10s %s\n", "TEMPLATE", "PLATFORM", "LAYERS", "SIZE", "BUILT");
+    while ((template_entry = readdir(template_directory)) != NULL)
+    {
+        if (template_entry->d_name[0] == '.')
+            continue;
+
+        platform_directory = format_path(path, sizeof(path), "%s/%s", templates, template_entry->d_name) == 0 ? opendir(path) : NULL;
+        if (platform_directory == NULL)
+            continue;
+
+        while ((platform_entry = readdir(platform_directory)) != NULL)
+        {
+            std::vector<std::string> keys;
+            char platform_name[TEMPLATE_NAME_SIZE + 1];
+            long long built = 0;
+            size_t length = strlen(platform_entry->d_name);
+
+            if (length <= strlen(".conf") || length - strlen(".conf") > TEMPLATE_NAME_SIZE || strcmp(platform_entry->d_name + length - strlen(".conf"), ".conf") != 0)
+                continue;
+
+            if (format_path(path, sizeof(path), "%s/%s/%s", templates, template_entry->d_name, platform_entry->d_name) < 0 || load_template_layers(path, keys, &built) < 0)
+                continue;
+
+            counted_bytes = 0;
+            for (const std::string &key : keys)
+            {
+                if (get_layer_path(layers, key.c_str(), "", path, sizeof(path)) == 0)
+                    nftw(path, count_entry, 16, FTW_PHYS | FTW_MOUNT);
+            }
+
+            time_t built_seconds = (time_t)built;
+            strftime(built_time, sizeof(built_time), "%Y-%m-%d %H:%M", localtime(&built_seconds));
+            snprintf(platform_name, sizeof(platform_name), "%.*s", (int)(length - strlen(".conf")), platform_entry->d_name);
+            printf("%-20s %-28s %-7zu %-10.1f %s\n", template_entry->d_name, platform_name, keys.size(), counted_bytes / (1024.0 * 1024.0), built_time);
+            number_of_templates++;
+        }
+        closedir(platform_directory);
+    }
+    closedir(template_directory);
+
+    if (number_of_templates == 0)
+        printf("No templates built\n");
+    printf("(sizes in MB, layers shared between templates are counted in each)\n");
+
+    return 0;
+}
@@ -0,0 +1,85 @@
+#ifndef TEMPLATES_H
+#define TEMPLATES_H
+
+/**
+ * @file templates.h
+ * @brief This file contains the definitions of the functions used in templates.cpp regarding templates built from recipes
+ *
+ * A recipe starts from the rootfs of a base tarball (one per distribution, release and architecture, so builds work offline)
+ * and applies steps: "copy" puts host files in the rootfs and "run" runs a command in a build container. The result of every
+ * step is a layer (the overlay upper directory of the step) stored under the SHA-256 of its inputs: the key of the layer below,
+ * the step and the content of the copied files. A rebuild reuses every layer whose key did not change and only runs the steps
+ * from the first change on. Containers created from a template mount its layers as the read-only lower layers of an overlay
+ *
+ * @author Simão Andrade
+ * @date 2024-06-13
+ */
+
+/**
+ * @brief Directory of the lxcpath holding the base tarballs, the layers and the templates
+ */
+#define TEMPLATE_STORE_DIRECTORY "cmt-templates"
+
+/**
+ * @brief Platform of a template when neither the recipe nor the caller choose one
+ */
+#define TEMPLATE_DEFAULT_OS "ubuntu"
+#define TEMPLATE_DEFAULT_RELEASE "bionic"
+#define TEMPLATE_DEFAULT_ARCHITECTURE "amd64"
+
+/**
+ * @brief Maximum number of steps of a recipe (each layer is a lower layer of the overlay) and sizes of the fields of a template
+ */
+#define TEMPLATE_MAX_STEPS 32
+#define TEMPLATE_NAME_SIZE 64
+#define TEMPLATE_PLATFORM_FIELD_SIZE 32
+
+/**
+ * @brief Size of the hexadecimal SHA-256 key of a layer, with the terminator
+ */
+#define TEMPLATE_KEY_SIZE 65
+
+/**
+ * @brief Distribution, release and architecture of a template, an empty field takes the one of the recipe or the default
+ */
+struct template_platform
+{
+    char os[TEMPLATE_PLATFORM_FIELD_SIZE];
+    char release[TEMPLATE_PLATFORM_FIELD_SIZE];
+    char architecture[TEMPLATE_PLATFORM_FIELD_SIZE];
+};
+
+/**
+ * @brief Build a template from a recipe, reusing the cached layers of the unchanged steps
+ *
+ * The recipe has one instruction per line: "from OS RELEASE ARCH" (optional, first), "copy SOURCE DESTINATION" (a host file
+ * or directory, relative to the recipe, to an absolute path of the rootfs) and "run COMMAND" (run with /bin/sh -c)
+ *
+ * @param template_name name of the template
+ * @param recipe_path path of the recipe
+ * @param platform platform of the build, NULL to use the one of the recipe
+ * @param tarball_path base tarball, NULL for STORE/bases/OS-RELEASE-ARCH.tar.*
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int build_template(const char *template_name, const char *recipe_path, const struct template_platform *platform, const char *tarball_path);
+
+/**
+ * @brief Create and start a LXC container on the layers of a built template
+ *
+ * @param container_name name of the container
+ * @param template_name name of the template
+ * @param platform platform of the template, NULL for the default one
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int create_container_from_template(const char *container_name, const char *template_name, const struct template_platform *platform);
+
+/**
+ * @brief List the built templates with their platform, layers and size
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int list_templates(void);
+
+#endif // TEMPLATES_H
@@ -0,0 +1,232 @@
+/**
+ * @file trace.cpp
+ * @brief Tracing spans and Chrome trace-event export
+ *
+ * This file contains the implementation of the span recorder. Each thread appends its spans to its own chain of fixed-size
+ * chunks and publishes them with an atomic count, so recording never takes a lock: a lock is only taken by the first span
+ * of a thread, to register its buffer, and by the export, which reads the published spans and frees the chunks the thread
+ * has left behind.
+ *
+ * @author Simão Andrade
+ * @date 2024-06-13
+ */
+
+#include "trace.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <mutex>
+#include <vector>
+
+/**
+ * @brief Number of spans of a chunk of a thread buffer
+ */
+#define TRACE_CHUNK_EVENTS 1024
+
+/**
+ * @brief Maximum size of the trace file path
+ */
+#define TRACE_PATH_SIZE 1024
+
+/**
+ * @brief A finished span
+ */
+struct trace_event
+{
+    const char *name;
+    long long start;
+    long long duration;
+    char argument[TRACE_ARGUMENT_SIZE];
+};
+
+/**
+ * @brief A chunk of spans, written only by its thread and read by the export up to the published count
+ */
+struct trace_chunk
+{
+    struct trace_event events[TRACE_CHUNK_EVENTS];
+    std::atomic<int> count{0};                      // spans published by the thread
+    std::atomic<struct trace_chunk *> next{nullptr}; // set by the thread once the chunk is full
+    int exported = 0;                               // spans already exported, only used by the export
+};
+
+/**
+ * @brief Spans recorded by a single thread
+ */
+struct trace_buffer
+{
+    int thread_id;
+    struct trace_chunk *head; // oldest chunk still kept, only used by the export
+    struct trace_chunk *tail; // chunk being written, only used by the thread
+};
+
+std::atomic<bool> trace_enabled(false);
+
+/**
+ * @brief Buffers of every thread that recorded a span, kept after the thread exits until they are exported
+ */
+static std::vector<struct trace_buffer *> trace_buffers;
+static std::mutex trace_buffers_mutex;
+static char trace_output_path[TRACE_PATH_SIZE] = {0};
+static bool trace_exit_handler_registered = false;
+
+static thread_local struct trace_buffer *thread_buffer = nullptr;
+
+long long trace_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+void trace_record(const char *name, const char *argument, long long start, long long end)
+{
+    if (thread_buffer == nullptr) // first span of this thread
+    {
+        thread_buffer = new trace_buffer;
+        thread_buffer->thread_id = (int)syscall(SYS_gettid);
+        thread_buffer->head = thread_buffer->tail = new trace_chunk;
+
+        std::lock_guard<std::mutex> lock(trace_buffers_mutex);
+        trace_buffers.push_back(thread_buffer);
+    }
+
+    struct trace_chunk *chunk = thread_buffer->tail;
+    int index = chunk->count.load(std::memory_order_relaxed);
+    if (index == TRACE_CHUNK_EVENTS) // the export frees the full chunk once it is exported
+    {
+        struct trace_chunk *next = new trace_chunk;
+        chunk->next.store(next, std::memory_order_release);
+        thread_buffer->tail = chunk = next;
+        index = 0;
+    }
+
+    struct trace_event *event = &chunk->events[index];
+    event->name = name;
+    event->start = start;
+    event->duration = end - start;
+    snprintf(event->argument, TRACE_ARGUMENT_SIZE, "%s", argument != nullptr ? argument : "");
+    chunk->count.store(index + 1, std::memory_order_release); // publish the span to the export
+}
+
+/**
+ * @brief Write a JSON string literal to the trace file
+ */
+static void write_json_string(FILE *file, const char *text)
+{
+    fputc('"', file);
+    for (; *text; text++)
+    {
+        if (*text == '"' || *text == '\\')
+            fprintf(file, "\\%c", *text);
+        else if ((unsigned char)*text < 0x20)
+            fprintf(file, "\\u%04x", (unsigned char)*text);
+        else
+            fputc(*text, file);
+    }
+    fputc('"', file);
+}
+
+/**
+ * @brief Write every recorded span to the trace file and clear the buffers
+ *
+ * @return int number of exported spans on success, -1 on failure
+ */
+static int trace_export(void)
+{
+    int exported = 0;
+    int process_id = (int)getpid();
+
+    FILE *file = fopen(trace_output_path, "w");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Failed to open trace file %s\n", trace_output_path);
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(trace_buffers_mutex);
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (struct trace_buffer *buffer : trace_buffers)
+    {
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}", exported++ ? ",\n" : "", process_id, buffer->thread_id, buffer->thread_id);
+
+        for (struct trace_chunk *chunk = buffer->head, *next; chunk != nullptr; chunk = next)
+        {
+            int count = chunk->count.load(std::memory_order_acquire);
+            for (; chunk->exported < count; chunk->exported++)
+            {
+                const struct trace_event &event = chunk->events[chunk->exported];
+                fprintf(file, ",\n{\"name\":");
+                write_json_string(file, event.name);
+                fprintf(file, ",\"cat\":\"cmt\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,\"pid\":%d,\"tid\":%d", event.start, event.duration, process_id, buffer->thread_id);
+                if (event.argument[0] != '\0')
+                {
+                    fprintf(file, ",\"args\":{\"container\":");
+                    write_json_string(file, event.argument);
+                    fprintf(file, "}");
+                }
+                fprintf(file, "}");
+                exported++;
+            }
+
+            // A full chunk with a successor is never written again, the earlier ones were already freed
+            next = chunk->next.load(std::memory_order_acquire);
+            if (next != nullptr && count == TRACE_CHUNK_EVENTS)
+            {
+                buffer->head = next;
+                delete chunk;
+            }
+        }
+    }
+    fprintf(file, "\n]}\n");
+
+    if (fclose(file) != 0)
+        return -1;
+
+    return exported - (int)trace_buffers.size(); // do not count the thread name metadata
+}
+
+/**
+ * @brief Export the trace when the program exits without calling trace_stop()
+ */
+static void trace_exit_handler(void)
+{
+    if (trace_enabled.load())
+        trace_stop();
+}
+
+int trace_start(const char *output_path)
+{
+    if (output_path == NULL || output_path[0] == '\0')
+        return -1;
+
+    snprintf(trace_output_path, TRACE_PATH_SIZE, "%s", output_path);
+
+    if (!trace_exit_handler_registered)
+    {
+        atexit(trace_exit_handler);
+        trace_exit_handler_registered = true;
+    }
+
+    trace_enabled.store(true);
+    return 0;
+}
+
+int trace_start_from_environment(void)
+{
+    const char *output_path = getenv(TRACE_ENVIRONMENT_VARIABLE);
+    if (output_path == NULL || output_path[0] == '\0')
+        return 0;
+
+    return trace_start(output_path);
+}
+
+int trace_stop(void)
+{
+    trace_enabled.store(false);
+    return trace_export();
+}
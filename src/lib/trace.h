@@ -0,0 +1,124 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/**
+ * @file trace.h
+ * @brief This file contains the definitions of the tracing spans used across the library
+ *
+ * A span measures the time spent in a scope. Spans are recorded in per-thread buffers and exported as Chrome trace-event JSON,
+ * which can be loaded in Perfetto (ui.perfetto.dev) or chrome://tracing. When tracing is disabled a span costs a single load and branch
+ *
+ * @author Simão Andrade
+ * @date 2024-06-13
+ */
+
+#include <atomic>
+
+/**
+ * @brief Environment variable with the path of the trace file, tracing is enabled at startup when it is set
+ */
+#define TRACE_ENVIRONMENT_VARIABLE "CMT_TRACE"
+
+/**
+ * @brief Size of the argument (usually a container name) attached to a span
+ */
+#define TRACE_ARGUMENT_SIZE 48
+
+/**
+ * @brief Whether spans are being recorded, only read through trace_is_enabled()
+ */
+extern std::atomic<bool> trace_enabled;
+
+/**
+ * @brief Check if spans are being recorded
+ *
+ * @return true if tracing is enabled
+ */
+inline bool trace_is_enabled(void)
+{
+    return __builtin_expect(trace_enabled.load(std::memory_order_relaxed), 0);
+}
+
+/**
+ * @brief Get the current time of the trace clock
+ *
+ * @return long long microseconds of the monotonic clock
+ */
+long long trace_now(void);
+
+/**
+ * @brief Record a finished span in the buffer of the calling thread
+ *
+ * @param name name of the span, must be a string literal (it is not copied)
+ * @param argument optional argument shown with the span (copied, may be NULL)
+ * @param start start time in microseconds
+ * @param end end time in microseconds
+ */
+void trace_record(const char *name, const char *argument, long long start, long long end);
+
+/**
+ * @brief Start recording spans
+ *
+ * @param output_path file where the trace is written by trace_stop() or at exit
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int trace_start(const char *output_path);
+
+/**
+ * @brief Start recording spans if TRACE_ENVIRONMENT_VARIABLE is set
+ *
+ * @return int 0 on success (or if tracing is not requested), -1 on failure
+ */
+int trace_start_from_environment(void);
+
+/**
+ * @brief Stop recording spans and write the trace file
+ *
+ * @return int number of exported spans on success, -1 on failure
+ */
+int trace_stop(void);
+
+/**
+ * @brief Scope guard recording a span from its construction to its destruction
+ */
+struct trace_span
+{
+    const char *name;
+    const char *argument;
+    long long start;
+
+    explicit trace_span(const char *span_name, const char *span_argument = nullptr)
+        : name(span_name), argument(span_argument), start(trace_is_enabled() ? trace_now() : -1)
+    {
+    }
+
+    ~trace_span()
+    {
+        if (start >= 0)
+            trace_record(name, argument, start, trace_now());
+    }
+
+    trace_span(const trace_span &) = delete;
+    trace_span &operator=(const trace_span &) = delete;
+};
+
+#define TRACE_CONCATENATE_(a, b) a##b
+#define TRACE_CONCATENATE(a, b) TRACE_CONCATENATE_(a, b)
+
+/**
+ * @brief Trace the rest of the current scope
+ */
+#define TRACE_SPAN(name) struct trace_span TRACE_CONCATENATE(trace_span_, __LINE__)(name)
+
+/**
+ * @brief Trace the rest of the current scope, attaching an argument (e.g. the container name)
+ */
+#define TRACE_SPAN_ARGUMENT(name, argument) struct trace_span TRACE_CONCATENATE(trace_span_, __LINE__)(name, argument)
+
+/**
+ * @brief Trace a single call (or any expression) and return its value
+ */
+#define TRACE_CALL(name, argument, ...) ([&]() { TRACE_SPAN_ARGUMENT(name, argument); return __VA_ARGS__; }())
+
+#endif // TRACE_H
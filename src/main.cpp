@@ -11,14 +11,29 @@
  */
 
 #include "lib/lib.h"
+#include "lib/inspect.h"
+#include "lib/logstore.h"
+#include "lib/trace.h"
+#include "lib/relay.h"
+#include "lib/netqos.h"
+#include "lib/events.h"
+#include "lib/layers.h"
+#include "lib/idle.h"
+#include "lib/jobs.h"
+#include "lib/fleet.h"
+#include "lib/ephemeral.h"
+#include "lib/templates.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
+#include <ctype.h>
+#include <errno.h>
 
 /**
  * @brief Constants for the options menu
  */
-#define EXIT_OPTION 10
+#define EXIT_OPTION 20
 
 /**
  * @brief Buffer sizes for input and output
@@ -27,6 +42,11 @@
 #define COMMAND_BUFFER_SIZE 1024
 #define CGROUP_LIMITS_BUFFER_SIZE 10
 #define FILENAME_BUFFER_SIZE 100
+#define LOG_FILTER_BUFFER_SIZE 32
+#define ANSWER_BUFFER_SIZE 10
+#define RATE_BUFFER_SIZE 32
+#define MAX_EVENT_ACTIONS 16
+#define MAX_EVENT_CONTAINERS 256
 
 /**
  * @brief Clear the terminal screen
@@ -70,7 +90,18 @@ int show_options_menu(void)
     printf("6. Check limits of system resources\n");
     printf("7. Establish connection with a Container\n");
     printf("8. Copy a file to a Container\n");
-    printf("10. Exit\n\n");
+    printf("9. Inspect Containers (without starting them)\n");
+    printf("10. Query the activity log\n");
+    printf("11. Share the console of a Container (relay)\n");
+    printf("12. Attach to a shared console\n");
+    printf("13. Set network bandwidth limits\n");
+    printf("14. Show network statistics\n");
+    printf("15. Watch memory and pressure events\n");
+    printf("16. Show shared and private memory of Containers\n");
+    printf("17. Show idle status of Containers\n");
+    printf("18. Submit a background job to a Container\n");
+    printf("19. List background jobs\n");
+    printf("20. Exit\n\n");
     printf("Choose an option: ");
 
     if (scanf("%d", &option) != 1)
@@ -105,8 +136,957 @@ int read_input(char *buffer, int buffer_size)
     return 0;
 }
 
-int main(void)
+/**
+ * @brief Convert a string to upper case in place
+ *
+ * @param text string to convert
+ */
+void to_upper_case(char *text)
+{
+    for (; *text; text++)
+        *text = (char)toupper((unsigned char)*text);
+}
+
+/**
+ * @brief Parse a time given as seconds since the epoch, "YYYY-MM-DD" or "YYYY-MM-DD HH:MM:SS"
+ *
+ * @param text time to parse
+ *
+ * @return long long seconds since the epoch, -1 on failure
+ */
+long long parse_time_argument(const char *text)
+{
+    struct tm time_info;
+    char *end;
+
+    long long seconds = strtoll(text, &end, 10);
+    if (*end == '\0')
+        return seconds;
+
+    memset(&time_info, 0, sizeof(time_info));
+    end = strptime(text, "%Y-%m-%d", &time_info);
+    if (end == NULL)
+        return -1;
+    if (*end != '\0' && strptime(end, " %H:%M:%S", &time_info) == NULL)
+        return -1;
+
+    time_info.tm_isdst = -1;
+    return (long long)mktime(&time_info);
+}
+
+/**
+ * @brief Parse a whole number given on the command line
+ *
+ * @param text number to parse
+ * @param value parsed number
+ *
+ * @return int 0 on success, -1 if text is not a whole number
+ */
+int parse_count_argument(const char *text, unsigned long long *value)
+{
+    char *end;
+
+    if (!isdigit((unsigned char)text[0]))
+        return -1;
+
+    errno = 0;
+    *value = strtoull(text, &end, 10);
+    return *end == '\0' && errno == 0 ? 0 : -1;
+}
+
+/**
+ * @brief Run the "log" command line: query, compact or apply the retention policy to the activity log store
+ *
+ * @param argc number of arguments (after "log")
+ * @param argv arguments (after "log")
+ *
+ * @return int 0 on success, 1 on failure
+ */
+int run_log_command(int argc, char *argv[])
+{
+    if (argc < 1)
+    {
+        fprintf(stderr, "Usage: program log query [--container NAME] [--level LEVEL] [--operation OP] [--from TIME] [--to TIME]\n");
+        fprintf(stderr, "       program log compact\n");
+        fprintf(stderr, "       program log retain [--max-age-days DAYS] [--max-size-mb MB]\n");
+        return 1;
+    }
+
+    if (strcmp(argv[0], "query") == 0)
+    {
+        struct log_query query = {NULL, NULL, NULL, 0, 0};
+        for (int index = 1; index < argc; index += 2)
+        {
+            if (index + 1 >= argc)
+            {
+                fprintf(stderr, "Error: Missing value of %s\n", argv[index]);
+                return 1;
+            }
+
+            if (strcmp(argv[index], "--container") == 0)
+                query.container_name = argv[index + 1];
+            else if (strcmp(argv[index], "--level") == 0)
+                to_upper_case(argv[index + 1]), query.level = argv[index + 1];
+            else if (strcmp(argv[index], "--operation") == 0)
+                query.operation = argv[index + 1];
+            else if (strcmp(argv[index], "--from") == 0)
+                query.from = parse_time_argument(argv[index + 1]);
+            else if (strcmp(argv[index], "--to") == 0)
+                query.to = parse_time_argument(argv[index + 1]);
+            else
+            {
+                fprintf(stderr, "Error: Unknown option %s\n", argv[index]);
+                return 1;
+            }
+        }
+
+        if (query.from < 0 || query.to < 0)
+        {
+            fprintf(stderr, "Error: Invalid time, use seconds since the epoch or YYYY-MM-DD [HH:MM:SS]\n");
+            return 1;
+        }
+
+        return print_log_query(&query) == 0 ? 0 : 1;
+    }
+
+    if (strcmp(argv[0], "compact") == 0)
+    {
+        int removed = log_store_compact();
+        if (removed < 0)
+        {
+            fprintf(stderr, "Error: Failed to compact the log store\n");
+            return 1;
+        }
+        printf("Log store compacted, %d segments merged\n", removed);
+        return 0;
+    }
+
+    if (strcmp(argv[0], "retain") == 0)
+    {
+        long long max_age_seconds = 0, max_total_bytes = 0;
+        for (int index = 1; index < argc; index += 2)
+        {
+            if (index + 1 >= argc)
+            {
+                fprintf(stderr, "Error: Missing value of %s\n", argv[index]);
+                return 1;
+            }
+
+            if (strcmp(argv[index], "--max-age-days") == 0)
+                max_age_seconds = atoll(argv[index + 1]) * 24 * 60 * 60;
+            else if (strcmp(argv[index], "--max-size-mb") == 0)
+                max_total_bytes = atoll(argv[index + 1]) * 1024 * 1024;
+            else
+            {
+                fprintf(stderr, "Error: Unknown option %s\n", argv[index]);
+                return 1;
+            }
+        }
+
+        int removed = log_store_apply_retention(max_age_seconds, max_total_bytes);
+        if (removed < 0)
+        {
+            fprintf(stderr, "Error: Failed to apply the retention policy\n");
+            return 1;
+        }
+        printf("Retention policy applied, %d segments deleted\n", removed);
+        return 0;
+    }
+
+    fprintf(stderr, "Error: Unknown log command %s\n", argv[0]);
+    return 1;
+}
+
+/**
+ * @brief Run the "console" command line: start, attach to, stop a console relay or replay a recording
+ *
+ * @param argc number of arguments (after "console")
+ * @param argv arguments (after "console")
+ *
+ * @return int 0 on success, 1 on failure
+ */
+int run_console_command(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: program console relay CONTAINER [--record FILE]\n");
+        fprintf(stderr, "       program console attach CONTAINER [--read-only]\n");
+        fprintf(stderr, "       program console stop CONTAINER\n");
+        fprintf(stderr, "       program console replay FILE [--speed SPEED]\n");
+        return 1;
+    }
+
+    if (strcmp(argv[0], "relay") == 0)
+    {
+        const char *recording_path = argc > 3 && strcmp(argv[2], "--record") == 0 ? argv[3] : NULL;
+        return start_console_relay(argv[1], recording_path) == 0 ? 0 : 1;
+    }
+
+    if (strcmp(argv[0], "attach") == 0)
+        return attach_console_relay(argv[1], argc > 2 && strcmp(argv[2], "--read-only") == 0) == 0 ? 0 : 1;
+
+    if (strcmp(argv[0], "stop") == 0)
+        return stop_console_relay(argv[1]) == 0 ? 0 : 1;
+
+    if (strcmp(argv[0], "replay") == 0)
+    {
+        double speed = argc > 3 && strcmp(argv[2], "--speed") == 0 ? atof(argv[3]) : 1.0;
+        return replay_console_recording(argv[1], speed) == 0 ? 0 : 1;
+    }
+
+    fprintf(stderr, "Error: Unknown console command %s\n", argv[0]);
+    return 1;
+}
+
+/**
+ * @brief Run the "net" command line: set, clear or show the network limits of a container, or share the bridge between containers
+ *
+ * @param argc number of arguments (after "net")
+ * @param argv arguments (after "net")
+ *
+ * @return int 0 on success, 1 on failure
+ */
+int run_net_command(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: program net set CONTAINER [--egress RATE] [--ingress RATE] [--egress-burst BYTES] [--ingress-burst BYTES] [--priority 0-7] [--weight N]\n");
+        fprintf(stderr, "       program net clear CONTAINER\n");
+        fprintf(stderr, "       program net stats CONTAINER [--interval MS]\n");
+        fprintf(stderr, "       program net fair-share RATE [--bridge BRIDGE]\n");
+        fprintf(stderr, "Rates are bytes per second or use a unit: kbit, mbit, gbit, kbps, mbps, gbps\n");
+        return 1;
+    }
+
+    if (strcmp(argv[0], "set") == 0)
+    {
+        struct network_qos_policy policy;
+        memset(&policy, 0, sizeof(policy));
+        policy.weight = 1;
+
+        for (int index = 2; index < argc; index++)
+        {
+            unsigned long long number = 0;
+
+            if (index + 1 >= argc)
+            {
+                fprintf(stderr, "Error: Missing value of %s\n", argv[index]);
+                return 1;
+            }
+
+            const char *option = argv[index], *value = argv[++index];
+            if (strcmp(option, "--egress") == 0 || strcmp(option, "--ingress") == 0)
+            {
+                unsigned long long rate = parse_network_rate(value);
+                if (rate == 0)
+                {
+                    fprintf(stderr, "Error: Invalid rate %s, use a positive number of bytes per second or a unit: kbit, mbit, gbit, kbps, mbps, gbps\n", value);
+                    return 1;
+                }
+                if (strcmp(option, "--egress") == 0)
+                    policy.egress_rate = rate;
+                else
+                    policy.ingress_rate = rate;
+                continue;
+            }
+
+            if (strcmp(option, "--egress-burst") != 0 && strcmp(option, "--ingress-burst") != 0 && strcmp(option, "--priority") != 0 && strcmp(option, "--weight") != 0)
+            {
+                fprintf(stderr, "Error: Unknown option %s\n", option);
+                return 1;
+            }
+
+            if (parse_count_argument(value, &number) < 0 || (strcmp(option, "--weight") == 0 && number == 0) || number > 0xFFFFFFFFULL)
+            {
+                fprintf(stderr, "Error: Invalid value %s of %s\n", value, option);
+                return 1;
+            }
+
+            if (strcmp(option, "--egress-burst") == 0)
+                policy.egress_burst = number;
+            else if (strcmp(option, "--ingress-burst") == 0)
+                policy.ingress_burst = number;
+            else if (strcmp(option, "--priority") == 0)
+                policy.priority = (unsigned int)number;
+            else
+                policy.weight = (unsigned int)number;
+        }
+
+        return set_container_network_qos(argv[1], &policy) == 0 ? 0 : 1;
+    }
+
+    if (strcmp(argv[0], "clear") == 0)
+        return clear_container_network_qos(argv[1]) == 0 ? 0 : 1;
+
+    if (strcmp(argv[0], "stats") == 0)
+    {
+        int interval_ms = argc > 3 && strcmp(argv[2], "--interval") == 0 ? atoi(argv[3]) : 1000;
+        return show_container_network_stats(argv[1], interval_ms) == 0 ? 0 : 1;
+    }
+
+    if (strcmp(argv[0], "fair-share") == 0)
+    {
+        const char *bridge = NETWORK_QOS_DEFAULT_BRIDGE;
+
+        if (argc > 2 && (strcmp(argv[2], "--bridge") != 0 || argc != 4))
+        {
+            fprintf(stderr, argc == 3 && strcmp(argv[2], "--bridge") == 0 ? "Error: Missing value of %s\n" : "Error: Unknown option %s\n", argv[2]);
+            return 1;
+        }
+        if (argc == 4)
+            bridge = argv[3];
+
+        unsigned long long total_rate = parse_network_rate(argv[1]);
+        if (total_rate == 0)
+        {
+            fprintf(stderr, "Error: Invalid rate %s, use a positive number of bytes per second or a unit: kbit, mbit, gbit, kbps, mbps, gbps\n", argv[1]);
+            return 1;
+        }
+
+        return apply_network_fair_share(bridge, total_rate) == 0 ? 0 : 1;
+    }
+
+    fprintf(stderr, "Error: Unknown net command %s\n", argv[0]);
+    return 1;
+}
+
+/**
+ * @brief Run the "events" command line: watch the memory-pressure and OOM events of containers
+ *
+ * @param argc number of arguments (after "events")
+ * @param argv arguments (after "events")
+ *
+ * @return int 0 on success, 1 on failure
+ */
+int run_events_command(int argc, char *argv[])
+{
+    struct event_monitor_options options;
+    struct event_action actions[MAX_EVENT_ACTIONS];
+    const char *container_names[MAX_EVENT_CONTAINERS];
+    int number_of_containers = 0, number_of_actions = 0;
+
+    if (argc < 1 || strcmp(argv[0], "watch") != 0)
+    {
+        fprintf(stderr, "Usage: program events watch [CONTAINER...] [--json FILE] [--memory-stall US] [--cpu-stall US] [--io-stall US] [--window US] [--action EVENTS=ACTION]...\n");
+        fprintf(stderr, "Events: memory_pressure, cpu_pressure, io_pressure, high, max, oom, oom_kill, started, stopped, all\n");
+        fprintf(stderr, "Actions: raise:PERCENT[:CEILING], dump, exec:COMMAND\n");
+        return 1;
+    }
+
+    event_monitor_default_options(&options);
+
+    for (int index = 1; index < argc; index++)
+    {
+        if (strncmp(argv[index], "--", 2) != 0)
+        {
+            if (number_of_containers == MAX_EVENT_CONTAINERS)
+            {
+                fprintf(stderr, "Error: At most %d containers, give none to watch them all\n", MAX_EVENT_CONTAINERS);
+                return 1;
+            }
+            container_names[number_of_containers++] = argv[index];
+            continue;
+        }
+
+        if (index + 1 >= argc)
+        {
+            fprintf(stderr, "Error: Missing value of %s\n", argv[index]);
+            return 1;
+        }
+
+        const char *value = argv[++index];
+        if (strcmp(argv[index - 1], "--json") == 0)
+            options.json_path = value;
+        else if (strcmp(argv[index - 1], "--memory-stall") == 0)
+            options.memory_stall_us = strtoull(value, NULL, 10);
+        else if (strcmp(argv[index - 1], "--cpu-stall") == 0)
+            options.cpu_stall_us = strtoull(value, NULL, 10);
+        else if (strcmp(argv[index - 1], "--io-stall") == 0)
+            options.io_stall_us = strtoull(value, NULL, 10);
+        else if (strcmp(argv[index - 1], "--window") == 0)
+            options.window_us = strtoull(value, NULL, 10);
+        else if (strcmp(argv[index - 1], "--action") == 0)
+        {
+            if (number_of_actions == MAX_EVENT_ACTIONS || parse_event_action(value, &actions[number_of_actions]) < 0)
+            {
+                fprintf(stderr, "Error: Invalid action %s\n", value);
+                return 1;
+            }
+            number_of_actions++;
+        }
+        else
+        {
+            fprintf(stderr, "Error: Unknown option %s\n", argv[index - 1]);
+            return 1;
+        }
+    }
+
+    return watch_container_events(container_names, number_of_containers, &options, actions, number_of_actions) == 0 ? 0 : 1;
+}
+
+/**
+ * @brief Run the "layers" command line: prepare the shared base layer, create containers on it or report the memory sharing
+ *
+ * @param argc number of arguments (after "layers")
+ * @param argv arguments (after "layers")
+ *
+ * @return int 0 on success, 1 on failure
+ */
+int run_layers_command(int argc, char *argv[])
+{
+    if (argc < 1)
+    {
+        fprintf(stderr, "Usage: program layers base\n");
+        fprintf(stderr, "       program layers create CONTAINER\n");
+        fprintf(stderr, "       program layers report [CONTAINER]\n");
+        return 1;
+    }
+
+    if (strcmp(argv[0], "base") == 0)
+        return prepare_base_layer() == 0 ? 0 : 1;
+
+    if (strcmp(argv[0], "create") == 0 && argc > 1)
+        return create_layered_container(argv[1]) == 0 ? 0 : 1;
+
+    if (strcmp(argv[0], "report") == 0)
+        return show_memory_sharing_report(argc > 1 ? argv[1] : NULL) == 0 ? 0 : 1;
+
+    fprintf(stderr, "Error: Unknown layers command %s\n", argv[0]);
+    return 1;
+}
+
+/**
+ * @brief Run the "idle" command line: set the idle policies, freeze or thaw containers and run the idle manager
+ *
+ * @param argc number of arguments (after "idle")
+ * @param argv arguments (after "idle")
+ *
+ * @return int 0 on success, 1 on failure
+ */
+int run_idle_command(int argc, char *argv[])
+{
+    if (argc < 1)
+    {
+        fprintf(stderr, "Usage: program idle set CONTAINER [--cpu-percent P] [--io-bytes B] [--idle-seconds S]\n");
+        fprintf(stderr, "       program idle clear|freeze|thaw CONTAINER\n");
+        fprintf(stderr, "       program idle status [CONTAINER]\n");
+        fprintf(stderr, "       program idle manage [--all] [--interval S]\n");
+        return 1;
+    }
+
+    if (strcmp(argv[0], "status") == 0)
+        return show_idle_status(argc > 1 ? argv[1] : NULL) == 0 ? 0 : 1;
+
+    if (strcmp(argv[0], "manage") == 0)
+    {
+        struct idle_policy default_policy;
+        int manage_all = 0, interval_seconds = IDLE_DEFAULT_CHECK_INTERVAL;
+
+        for (int index = 1; index < argc; index++)
+        {
+            if (strcmp(argv[index], "--all") == 0)
+                manage_all = 1;
+            else if (strcmp(argv[index], "--interval") == 0 && index + 1 < argc)
+                interval_seconds = atoi(argv[++index]);
+            else
+            {
+                fprintf(stderr, "Error: Unknown option %s\n", argv[index]);
+                return 1;
+            }
+        }
+
+        idle_default_policy(&default_policy);
+        return run_idle_manager(manage_all ? &default_policy : NULL, interval_seconds) == 0 ? 0 : 1;
+    }
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "Error: Missing the name of the container\n");
+        return 1;
+    }
+
+    if (strcmp(argv[0], "set") == 0)
+    {
+        struct idle_policy policy;
+
+        load_container_idle_policy(argv[1], &policy); // the defaults if there is none
+        for (int index = 2; index < argc; index += 2)
+        {
+            if (index + 1 >= argc)
+            {
+                fprintf(stderr, "Error: Missing value of %s\n", argv[index]);
+                return 1;
+            }
+
+            if (strcmp(argv[index], "--cpu-percent") == 0)
+                policy.cpu_percent = atof(argv[index + 1]);
+            else if (strcmp(argv[index], "--io-bytes") == 0)
+                policy.io_bytes_per_second = strtoull(argv[index + 1], NULL, 10);
+            else if (strcmp(argv[index], "--idle-seconds") == 0)
+                policy.idle_seconds = (unsigned int)atoi(argv[index + 1]);
+            else
+            {
+                fprintf(stderr, "Error: Unknown option %s\n", argv[index]);
+                return 1;
+            }
+        }
+
+        return set_container_idle_policy(argv[1], &policy) == 0 ? 0 : 1;
+    }
+
+    if (strcmp(argv[0], "clear") == 0)
+        return clear_container_idle_policy(argv[1]) == 0 ? 0 : 1;
+
+    if (strcmp(argv[0], "freeze") == 0)
+        return freeze_idle_container(argv[1]) == 0 ? 0 : 1;
+
+    if (strcmp(argv[0], "thaw") == 0)
+        return thaw_idle_container(argv[1]) == 0 ? 0 : 1;
+
+    fprintf(stderr, "Error: Unknown idle command %s\n", argv[0]);
+    return 1;
+}
+
+/**
+ * @brief Run the "jobs" command line: submit background jobs, run the workers and query the results
+ *
+ * @param argc number of arguments (after "jobs")
+ * @param argv arguments (after "jobs")
+ *
+ * @return int 0 on success, 1 on failure
+ */
+int run_jobs_command(int argc, char *argv[])
+{
+    if (argc < 1)
+    {
+        fprintf(stderr, "Usage: program jobs submit CONTAINER [--timeout S] [--retries N] [--output-limit BYTES] -- COMMAND...\n");
+        fprintf(stderr, "       program jobs work [--workers N] [--per-container N] [--follow]\n");
+        fprintf(stderr, "       program jobs list [--container CONTAINER] [--state STATE]\n");
+        fprintf(stderr, "       program jobs show|output|tail|cancel ID\n");
+        return 1;
+    }
+
+    if (strcmp(argv[0], "submit") == 0 && argc > 1)
+    {
+        struct job_options options;
+        char command[JOB_COMMAND_SIZE] = {0};
+        int index = 2;
+
+        job_default_options(&options);
+        for (; index < argc && strcmp(argv[index], "--") != 0; index += 2)
+        {
+            if (index + 1 >= argc)
+            {
+                fprintf(stderr, "Error: Missing value of %s\n", argv[index]);
+                return 1;
+            }
+
+            if (strcmp(argv[index], "--timeout") == 0)
+                options.timeout_seconds = (unsigned int)atoi(argv[index + 1]);
+            else if (strcmp(argv[index], "--retries") == 0)
+                options.max_retries = (unsigned int)atoi(argv[index + 1]);
+            else if (strcmp(argv[index], "--output-limit") == 0)
+                options.output_limit = strtoull(argv[index + 1], NULL, 10);
+            else
+            {
+                fprintf(stderr, "Error: Unknown option %s\n", argv[index]);
+                return 1;
+            }
+        }
+
+        for (index++; index < argc; index++) // the command follows "--"
+        {
+            strncat(command, argv[index], sizeof(command) - strlen(command) - 1);
+            if (index + 1 < argc)
+                strncat(command, " ", sizeof(command) - strlen(command) - 1);
+        }
+
+        long long id = submit_job(argv[1], command, &options);
+        if (id < 0 || start_job_workers(NULL) < 0)
+            return 1;
+
+        printf("Job %lld queued\n", id);
+        return 0;
+    }
+
+    if (strcmp(argv[0], "work") == 0)
+    {
+        struct job_pool_options options;
+
+        job_pool_default_options(&options);
+        for (int index = 1; index < argc; index++)
+        {
+            if (strcmp(argv[index], "--follow") == 0)
+                options.follow = 1;
+            else if (strcmp(argv[index], "--workers") == 0 && index + 1 < argc)
+                options.workers = (unsigned int)atoi(argv[++index]);
+            else if (strcmp(argv[index], "--per-container") == 0 && index + 1 < argc)
+                options.per_container = (unsigned int)atoi(argv[++index]);
+            else
+            {
+                fprintf(stderr, "Error: Unknown option %s\n", argv[index]);
+                return 1;
+            }
+        }
+
+        return run_job_workers(&options) == 0 ? 0 : 1;
+    }
+
+    if (strcmp(argv[0], "list") == 0)
+    {
+        const char *container_name = NULL, *state = NULL;
+
+        for (int index = 1; index + 1 < argc; index += 2)
+        {
+            if (strcmp(argv[index], "--container") == 0)
+                container_name = argv[index + 1];
+            else if (strcmp(argv[index], "--state") == 0)
+                state = argv[index + 1];
+        }
+
+        return list_jobs(container_name, state) == 0 ? 0 : 1;
+    }
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "Error: Missing the ID of the job\n");
+        return 1;
+    }
+
+    long long id = atoll(argv[1]);
+    if (strcmp(argv[0], "show") == 0)
+        return show_job(id) == 0 ? 0 : 1;
+
+    if (strcmp(argv[0], "output") == 0)
+        return show_job_output(id, 0) == 0 ? 0 : 1;
+
+    if (strcmp(argv[0], "tail") == 0)
+        return show_job_output(id, 1) == 0 ? 0 : 1;
+
+    if (strcmp(argv[0], "cancel") == 0)
+        return cancel_job(id) == 0 ? 0 : 1;
+
+    fprintf(stderr, "Error: Unknown jobs command %s\n", argv[0]);
+    return 1;
+}
+
+/**
+ * @brief Run the "run" command line: run a one-shot command in a throwaway container
+ *
+ * @param argc number of arguments (after "run")
+ * @param argv arguments (after "run")
+ *
+ * @return int exit status of the command, 125 if it could not run
+ */
+int run_ephemeral_command_line(int argc, char *argv[])
+{
+    struct ephemeral_options options;
+    int index = 0, exit_code = 0;
+
+    if (argc == 1 && strcmp(argv[0], "clean") == 0)
+        return clean_ephemeral_containers() < 0 ? 1 : 0;
+
+    if (argc < 1 || strcmp(argv[0], "--rm") != 0)
+    {
+        fprintf(stderr, "Usage: program run --rm [--base CONTAINER] [--input FILE]... [--collect PATH]... [--limit SUBSYSTEM=VALUE]...\n");
+        fprintf(stderr, "                        [--timeout S] [--on-disk] [--output FILE] -- COMMAND...\n");
+        fprintf(stderr, "       program run clean\n");
+        return 125;
+    }
+
+    ephemeral_default_options(&options);
+    for (index = 1; index < argc && strcmp(argv[index], "--") != 0; index++)
+    {
+        if (strcmp(argv[index], "--on-disk") == 0)
+        {
+            options.on_disk = 1;
+            continue;
+        }
+
+        if (index + 1 >= argc)
+        {
+            fprintf(stderr, "Error: Missing value of %s\n", argv[index]);
+            return 125;
+        }
+
+        const char *value = argv[++index];
+        if (strcmp(argv[index - 1], "--base") == 0)
+            options.base_container = value;
+        else if (strcmp(argv[index - 1], "--input") == 0 && options.number_of_inputs < EPHEMERAL_MAX_FILES)
+            options.inputs[options.number_of_inputs++] = value;
+        else if (strcmp(argv[index - 1], "--collect") == 0 && options.number_of_collected < EPHEMERAL_MAX_FILES)
+            options.collect[options.number_of_collected++] = value;
+        else if (strcmp(argv[index - 1], "--limit") == 0 && options.number_of_limits < EPHEMERAL_MAX_LIMITS && strchr(value, '=') != NULL)
+        {
+            char *separator = strchr(argv[index], '=');
+            *separator = 0;
+            options.limits[options.number_of_limits].subsystem = argv[index];
+            options.limits[options.number_of_limits++].value = separator + 1;
+        }
+        else if (strcmp(argv[index - 1], "--timeout") == 0)
+            options.timeout_seconds = (unsigned int)atoi(value);
+        else if (strcmp(argv[index - 1], "--output") == 0)
+            options.output_path = value;
+        else
+        {
+            fprintf(stderr, "Error: Unknown option or too many %s\n", argv[index - 1]);
+            return 125;
+        }
+    }
+
+    if (index + 1 >= argc)
+    {
+        fprintf(stderr, "Error: Missing the command after --\n");
+        return 125;
+    }
+
+    // The words after "--" are passed on as they are (argv ends with NULL), so their quoting is kept
+    if (run_ephemeral_command(argv + index + 1, &options, &exit_code) < 0)
+        return 125;
+
+    return exit_code;
+}
+
+/**
+ * @brief Run the "fleet" command line: run a node agent, or coordinate the nodes of the fleet
+ *
+ * @param argc number of arguments (after "fleet")
+ * @param argv arguments (after "fleet")
+ *
+ * @return int 0 on success, 1 on failure
+ */
+int run_fleet_command_line(int argc, char *argv[])
+{
+    struct fleet_node nodes[FLEET_MAX_NODES];
+    char token[FLEET_TOKEN_SIZE] = {0};
+    const char *token_file = NULL, *nodes_list = NULL;
+    int number_of_nodes = -1;
+
+    if (argc > 0 && strcmp(argv[0], "agent") == 0)
+    {
+        struct fleet_agent_options options = {NULL, NULL, NULL, 0, 0};
+
+        for (int index = 1; index + 1 < argc; index += 2)
+        {
+            if (strcmp(argv[index], "--listen") == 0)
+                options.address = argv[index + 1];
+            else if (strcmp(argv[index], "--token-file") == 0)
+                token_file = argv[index + 1];
+            else if (strcmp(argv[index], "--lxcpath") == 0)
+                options.containers_path = argv[index + 1];
+            else if (strcmp(argv[index], "--cpus") == 0)
+                options.cpus = (unsigned int)atoi(argv[index + 1]);
+            else if (strcmp(argv[index], "--memory") == 0)
+                options.memory = strtoull(argv[index + 1], NULL, 10);
+            else
+            {
+                fprintf(stderr, "Error: Unknown option %s\n", argv[index]);
+                return 1;
+            }
+        }
+
+        if (options.address == NULL)
+        {
+            fprintf(stderr, "Error: Missing --listen unix:PATH or [tcp:]HOST:PORT\n");
+            return 1;
+        }
+
+        // The token file of the fleet is optional, an agent on a unix socket may run without it
+        if (load_fleet_token(token_file != NULL ? token_file : FLEET_TOKEN_FILE, token, sizeof(token)) == 0)
+            options.token = token;
+        else if (token_file != NULL)
+        {
+            fprintf(stderr, "Error: Failed to read the token from %s\n", token_file);
+            return 1;
+        }
+
+        return run_fleet_agent(&options) == 0 ? 0 : 1;
+    }
+
+    while (argc > 1 && (strcmp(argv[0], "--nodes") == 0 || strcmp(argv[0], "--token-file") == 0))
+    {
+        if (strcmp(argv[0], "--nodes") == 0)
+            nodes_list = argv[1];
+        else
+            token_file = argv[1];
+        argc -= 2;
+        argv += 2;
+    }
+
+    if (argc > 0)
+        number_of_nodes = nodes_list != NULL ? parse_fleet_nodes(nodes_list, nodes, FLEET_MAX_NODES) : load_fleet_nodes(FLEET_NODES_FILE, nodes, FLEET_MAX_NODES);
+
+    if (token_file != NULL && load_fleet_token(token_file, token, sizeof(token)) < 0)
+    {
+        fprintf(stderr, "Error: Failed to read the token from %s\n", token_file);
+        return 1;
+    }
+    if (token_file != NULL || load_fleet_token(FLEET_TOKEN_FILE, token, sizeof(token)) == 0)
+        set_fleet_token(token);
+
+    if (argc < 1)
+    {
+        fprintf(stderr, "Usage: program fleet agent --listen ADDRESS [--token-file FILE] [--lxcpath DIR] [--cpus N] [--memory BYTES]\n");
+        fprintf(stderr, "       program fleet [--nodes NAME=ADDRESS,...] [--token-file FILE] nodes|list\n");
+        fprintf(stderr, "       program fleet [--nodes NAME=ADDRESS,...] [--token-file FILE] create CONTAINER [--layered]\n");
+        fprintf(stderr, "       program fleet [--nodes NAME=ADDRESS,...] [--token-file FILE] remove CONTAINER\n");
+        fprintf(stderr, "       program fleet [--nodes NAME=ADDRESS,...] [--token-file FILE] exec CONTAINER|--all -- COMMAND...\n");
+        fprintf(stderr, "       program fleet [--nodes NAME=ADDRESS,...] [--token-file FILE] limit CONTAINER|--all SUBSYSTEM VALUE\n");
+        fprintf(stderr, "Addresses: unix:PATH or [tcp:]HOST:PORT (an empty HOST is the loopback), the nodes are read from %s without --nodes\n", FLEET_NODES_FILE);
+        fprintf(stderr, "The token is read from %s without --token-file, a TCP agent needs one\n", FLEET_TOKEN_FILE);
+        return 1;
+    }
+
+    if (number_of_nodes <= 0)
+    {
+        fprintf(stderr, "Error: No nodes in the fleet\n");
+        return 1;
+    }
+
+    if (strcmp(argv[0], "nodes") == 0)
+        return show_fleet_nodes(nodes, number_of_nodes) == 0 ? 0 : 1;
+
+    if (strcmp(argv[0], "list") == 0)
+        return list_fleet_containers(nodes, number_of_nodes) == 0 ? 0 : 1;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "Error: Missing the name of the container\n");
+        return 1;
+    }
+
+    // "--all" targets every running container of every node
+    const char *container_name = strcmp(argv[1], "--all") == 0 ? NULL : argv[1];
+
+    if (strcmp(argv[0], "create") == 0 && container_name != NULL)
+        return create_fleet_container(nodes, number_of_nodes, container_name, argc > 2 && strcmp(argv[2], "--layered") == 0) == 0 ? 0 : 1;
+
+    if (strcmp(argv[0], "remove") == 0 && container_name != NULL)
+        return remove_fleet_container(nodes, number_of_nodes, container_name) == 0 ? 0 : 1;
+
+    if (strcmp(argv[0], "exec") == 0 && argc > 3 && strcmp(argv[2], "--") == 0)
+    {
+        char command[COMMAND_BUFFER_SIZE] = {0};
+        for (int index = 3; index < argc; index++)
+        {
+            strncat(command, argv[index], sizeof(command) - strlen(command) - 1);
+            if (index + 1 < argc)
+                strncat(command, " ", sizeof(command) - strlen(command) - 1);
+        }
+        return run_fleet_command(nodes, number_of_nodes, container_name, command) == 0 ? 0 : 1;
+    }
+
+    if (strcmp(argv[0], "limit") == 0 && argc > 3)
+        return define_fleet_limits(nodes, number_of_nodes, container_name, argv[2], argv[3]) == 0 ? 0 : 1;
+
+    fprintf(stderr, "Error: Unknown or incomplete fleet command %s\n", argv[0]);
+    return 1;
+}
+
+/**
+ * @brief Run the "templates" command line: build templates from recipes, list them and create containers from them
+ *
+ * @param argc number of arguments (after "templates")
+ * @param argv arguments (after "templates")
+ *
+ * @return int 0 on success, 1 on failure
+ */
+int run_templates_command(int argc, char *argv[])
+{
+    struct template_platform platform;
+    const char *tarball_path = NULL;
+
+    if (argc >= 1 && strcmp(argv[0], "list") == 0)
+        return list_templates() == 0 ? 0 : 1;
+
+    if (argc < 3 || (strcmp(argv[0], "build") != 0 && strcmp(argv[0], "create") != 0))
+    {
+        fprintf(stderr, "Usage: program templates build TEMPLATE RECIPE [--os OS] [--release RELEASE] [--arch ARCH] [--tarball FILE]\n");
+        fprintf(stderr, "       program templates create CONTAINER TEMPLATE [--os OS] [--release RELEASE] [--arch ARCH]\n");
+        fprintf(stderr, "       program templates list\n");
+        return 1;
+    }
+
+    memset(&platform, 0, sizeof(platform));
+    for (int index = 3; index < argc; index += 2)
+    {
+        if (index + 1 >= argc)
+        {
+            fprintf(stderr, "Error: Missing value of %s\n", argv[index]);
+            return 1;
+        }
+
+        if (strcmp(argv[index], "--os") == 0)
+            snprintf(platform.os, sizeof(platform.os), "%s", argv[index + 1]);
+        else if (strcmp(argv[index], "--release") == 0)
+            snprintf(platform.release, sizeof(platform.release), "%s", argv[index + 1]);
+        else if (strcmp(argv[index], "--arch") == 0)
+            snprintf(platform.architecture, sizeof(platform.architecture), "%s", argv[index + 1]);
+        else if (strcmp(argv[index], "--tarball") == 0 && strcmp(argv[0], "build") == 0)
+            tarball_path = argv[index + 1];
+        else
+        {
+            fprintf(stderr, "Error: Unknown option %s\n", argv[index]);
+            return 1;
+        }
+    }
+
+    if (strcmp(argv[0], "build") == 0)
+        return build_template(argv[1], argv[2], &platform, tarball_path) == 0 ? 0 : 1;
+
+    return create_container_from_template(argv[1], argv[2], &platform) == 0 ? 0 : 1;
+}
+
+/**
+ * @brief Run the program in command line mode instead of showing the menu
+ *
+ * @param argc number of arguments
+ * @param argv arguments
+ *
+ * @return int exit status of the program
+ */
+int run_command_line(int argc, char *argv[])
+{
+    if (strcmp(argv[1], "log") == 0)
+        return run_log_command(argc - 2, argv + 2);
+
+    if (strcmp(argv[1], "console") == 0)
+        return run_console_command(argc - 2, argv + 2);
+
+    if (strcmp(argv[1], "net") == 0)
+        return run_net_command(argc - 2, argv + 2);
+
+    if (strcmp(argv[1], "events") == 0)
+        return run_events_command(argc - 2, argv + 2);
+
+    if (strcmp(argv[1], "layers") == 0)
+        return run_layers_command(argc - 2, argv + 2);
+
+    if (strcmp(argv[1], "idle") == 0)
+        return run_idle_command(argc - 2, argv + 2);
+
+    if (strcmp(argv[1], "jobs") == 0)
+        return run_jobs_command(argc - 2, argv + 2);
+
+    if (strcmp(argv[1], "fleet") == 0)
+        return run_fleet_command_line(argc - 2, argv + 2);
+
+    if (strcmp(argv[1], "run") == 0)
+        return run_ephemeral_command_line(argc - 2, argv + 2);
+
+    if (strcmp(argv[1], "templates") == 0)
+        return run_templates_command(argc - 2, argv + 2);
+
+    fprintf(stderr, "Error: Unknown command %s\n", argv[1]);
+    return 1;
+}
+
+int main(int argc, char *argv[])
 {
+    trace_start_from_environment(); // the trace is written at exit
+
+    if (argc > 1)
+        return run_command_line(argc, argv);
 
     int option = 0;
     char container_name[CONTAINER_NAME_SIZE] = {0};
@@ -124,13 +1104,20 @@ int main(void)
 
             printf("Adding a new Container...\n");
 
+            char layered[ANSWER_BUFFER_SIZE] = {0};
+
             // Ask for a container name
             printf("Enter the name of the new Container: ");
             if (read_input(container_name, CONTAINER_NAME_SIZE) < 0)
                 break;
 
+            printf("Share the read-only base layer with other Containers (density mode)? (y/N): ");
+            if (read_input(layered, ANSWER_BUFFER_SIZE) < 0)
+                break;
+
             // Create the new Container
-            if (create_new_container(container_name) == 0)
+            int create_result = layered[0] == 'y' || layered[0] == 'Y' ? create_layered_container(container_name) : create_new_container(container_name);
+            if (create_result == 0)
             {
                 printf("Container %s created successfully.\n", container_name);
             }
@@ -413,6 +1400,329 @@ int main(void)
             break;
         }
 
+        case 9: // Inspect Containers from their config
+        {
+            clear_screen();
+
+            printf("Enter the name of the Container (empty for all): ");
+            if (read_input(container_name, CONTAINER_NAME_SIZE) < 0)
+                break;
+
+            int inspect_result = container_name[0] == '\0' ? inspect_all_containers(0) : inspect_container(container_name);
+            if (inspect_result == 0)
+            {
+                printf("Containers inspected successfully.\n");
+            }
+            else
+            {
+                printf("Error: Failed to inspect Containers.\n");
+            }
+
+            printf("Press ENTER to continue...");
+            while (getchar() != '\n') // Clear the input buffer
+                ;
+
+            memset(container_name, 0, CONTAINER_NAME_SIZE); // clear name buffer
+
+            break;
+        }
+
+        case 10: // Query the activity log
+        {
+            clear_screen();
+
+            char level[LOG_FILTER_BUFFER_SIZE] = {0}, operation[LOG_FILTER_BUFFER_SIZE] = {0}, hours[LOG_FILTER_BUFFER_SIZE] = {0};
+
+            printf("Enter the name of the Container (empty for all): ");
+            if (read_input(container_name, CONTAINER_NAME_SIZE) < 0)
+                break;
+
+            printf("Enter the level (INFO, WARNING, ERROR or empty for all): ");
+            if (read_input(level, LOG_FILTER_BUFFER_SIZE) < 0)
+                break;
+            to_upper_case(level);
+
+            printf("Enter the operation (create, remove, list, exec, connect, copy, limit, inspect or empty for all): ");
+            if (read_input(operation, LOG_FILTER_BUFFER_SIZE) < 0)
+                break;
+
+            printf("Show the last N hours (empty for all): ");
+            if (read_input(hours, LOG_FILTER_BUFFER_SIZE) < 0)
+                break;
+
+            struct log_query query = {
+                container_name[0] ? container_name : NULL,
+                level[0] ? level : NULL,
+                operation[0] ? operation : NULL,
+                hours[0] ? (long long)time(NULL) - atoll(hours) * 60 * 60 : 0,
+                0};
+
+            if (print_log_query(&query) != 0)
+            {
+                printf("Error: Failed to query the activity log.\n");
+            }
+
+            printf("Press ENTER to continue...");
+            while (getchar() != '\n') // Clear the input buffer
+                ;
+
+            memset(container_name, 0, CONTAINER_NAME_SIZE); // clear name buffer
+
+            break;
+        }
+
+        case 11: // Share the console of a Container
+        {
+            clear_screen();
+
+            char recording_path[FILENAME_BUFFER_SIZE] = {0};
+
+            printf("Enter the name of the Container: ");
+            if (read_input(container_name, CONTAINER_NAME_SIZE) < 0)
+                break;
+
+            printf("Enter the file to record the session to (empty to not record): ");
+            if (read_input(recording_path, FILENAME_BUFFER_SIZE) < 0)
+                break;
+
+            if (start_console_relay(container_name, recording_path[0] ? recording_path : NULL) == 0)
+            {
+                printf("Console of Container %s shared successfully.\n", container_name);
+            }
+            else
+            {
+                printf("Error: Failed to share the console of Container %s.\n", container_name);
+            }
+
+            printf("Press ENTER to continue...");
+            while (getchar() != '\n') // Clear the input buffer
+                ;
+
+            memset(container_name, 0, CONTAINER_NAME_SIZE); // clear name buffer
+
+            break;
+        }
+
+        case 12: // Attach to a shared console
+        {
+            clear_screen();
+
+            char read_only[ANSWER_BUFFER_SIZE] = {0};
+
+            printf("Enter the name of the Container: ");
+            if (read_input(container_name, CONTAINER_NAME_SIZE) < 0)
+                break;
+
+            printf("Attach read-only? (y/N): ");
+            if (read_input(read_only, ANSWER_BUFFER_SIZE) < 0)
+                break;
+
+            if (attach_console_relay(container_name, read_only[0] == 'y' || read_only[0] == 'Y') != 0)
+            {
+                printf("Error: Failed to attach to the console of Container %s.\n", container_name);
+            }
+
+            printf("Press ENTER to continue...");
+            while (getchar() != '\n') // Clear the input buffer
+                ;
+
+            memset(container_name, 0, CONTAINER_NAME_SIZE); // clear name buffer
+
+            break;
+        }
+
+        case 13: // Set network bandwidth limits
+        {
+            clear_screen();
+
+            char egress_rate[RATE_BUFFER_SIZE] = {0}, ingress_rate[RATE_BUFFER_SIZE] = {0}, priority[RATE_BUFFER_SIZE] = {0};
+            struct network_qos_policy policy;
+
+            printf("Enter the name of the Container: ");
+            if (read_input(container_name, CONTAINER_NAME_SIZE) < 0)
+                break;
+
+            printf("Enter the upload limit (e.g. 10mbit, empty for unlimited): ");
+            if (read_input(egress_rate, RATE_BUFFER_SIZE) < 0)
+                break;
+
+            printf("Enter the download limit (e.g. 10mbit, empty for unlimited): ");
+            if (read_input(ingress_rate, RATE_BUFFER_SIZE) < 0)
+                break;
+
+            printf("Enter the priority (0 highest to 7 lowest, empty for 0): ");
+            if (read_input(priority, RATE_BUFFER_SIZE) < 0)
+                break;
+
+            memset(&policy, 0, sizeof(policy));
+            policy.egress_rate = egress_rate[0] ? parse_network_rate(egress_rate) : 0;
+            policy.ingress_rate = ingress_rate[0] ? parse_network_rate(ingress_rate) : 0;
+            policy.priority = (unsigned int)atoi(priority);
+            policy.weight = 1;
+
+            if ((egress_rate[0] && policy.egress_rate == 0) || (ingress_rate[0] && policy.ingress_rate == 0))
+            {
+                printf("Error: Invalid rate, use a positive number of bytes per second or a unit: kbit, mbit, gbit, kbps, mbps, gbps.\n");
+            }
+            else if (set_container_network_qos(container_name, &policy) == 0)
+            {
+                printf("Network limits defined successfully.\n");
+            }
+            else
+            {
+                printf("Error: Failed to define the network limits.\n");
+            }
+
+            printf("Press ENTER to continue...");
+            while (getchar() != '\n') // Clear the input buffer
+                ;
+
+            memset(container_name, 0, CONTAINER_NAME_SIZE); // clear name buffer
+
+            break;
+        }
+
+        case 14: // Show network statistics
+        {
+            clear_screen();
+
+            printf("Enter the name of the Container: ");
+            if (read_input(container_name, CONTAINER_NAME_SIZE) < 0)
+                break;
+
+            if (show_container_network_stats(container_name, 1000) != 0)
+            {
+                printf("Error: Failed to show the network statistics.\n");
+            }
+
+            printf("Press ENTER to continue...");
+            while (getchar() != '\n') // Clear the input buffer
+                ;
+
+            memset(container_name, 0, CONTAINER_NAME_SIZE); // clear name buffer
+
+            break;
+        }
+
+        case 15: // Watch memory and pressure events
+        {
+            clear_screen();
+
+            struct event_monitor_options options;
+            const char *container_names[1] = {container_name};
+
+            printf("Enter the name of the Container (empty for all): ");
+            if (read_input(container_name, CONTAINER_NAME_SIZE) < 0)
+                break;
+
+            event_monitor_default_options(&options);
+            if (watch_container_events(container_names, container_name[0] != '\0', &options, NULL, 0) != 0)
+            {
+                printf("Error: Failed to watch the events.\n");
+            }
+
+            printf("Press ENTER to continue...");
+            while (getchar() != '\n') // Clear the input buffer
+                ;
+
+            memset(container_name, 0, CONTAINER_NAME_SIZE); // clear name buffer
+
+            break;
+        }
+
+        case 16: // Show shared and private memory of Containers
+        {
+            clear_screen();
+
+            printf("Enter the name of the Container (empty for all): ");
+            if (read_input(container_name, CONTAINER_NAME_SIZE) < 0)
+                break;
+
+            if (show_memory_sharing_report(container_name[0] != '\0' ? container_name : NULL) != 0)
+            {
+                printf("Error: Failed to measure the memory of the Containers.\n");
+            }
+
+            printf("Press ENTER to continue...");
+            while (getchar() != '\n') // Clear the input buffer
+                ;
+
+            memset(container_name, 0, CONTAINER_NAME_SIZE); // clear name buffer
+
+            break;
+        }
+
+        case 17: // Show idle status of Containers
+        {
+            clear_screen();
+
+            printf("Enter the name of the Container (empty for all): ");
+            if (read_input(container_name, CONTAINER_NAME_SIZE) < 0)
+                break;
+
+            if (show_idle_status(container_name[0] != '\0' ? container_name : NULL) != 0)
+            {
+                printf("Error: Failed to show the idle status of the Containers.\n");
+            }
+
+            printf("Press ENTER to continue...");
+            while (getchar() != '\n') // Clear the input buffer
+                ;
+
+            memset(container_name, 0, CONTAINER_NAME_SIZE); // clear name buffer
+
+            break;
+        }
+
+        case 18: // Submit a background job to a Container
+        {
+            clear_screen();
+
+            char command[JOB_COMMAND_SIZE] = {0};
+
+            printf("Enter the name of the Container: ");
+            if (read_input(container_name, CONTAINER_NAME_SIZE) < 0)
+                break;
+
+            printf("Enter the command to run in the background: ");
+            if (read_input(command, JOB_COMMAND_SIZE) < 0)
+                break;
+
+            long long id = submit_job(container_name, command, NULL);
+            if (id < 0 || start_job_workers(NULL) < 0)
+            {
+                printf("Error: Failed to submit the job.\n");
+            }
+            else
+            {
+                printf("Job %lld queued, see its output with: ./program jobs output %lld\n", id, id);
+            }
+
+            printf("Press ENTER to continue...");
+            while (getchar() != '\n') // Clear the input buffer
+                ;
+
+            memset(container_name, 0, CONTAINER_NAME_SIZE); // clear name buffer
+
+            break;
+        }
+
+        case 19: // List background jobs
+        {
+            clear_screen();
+
+            if (list_jobs(NULL, NULL) != 0)
+            {
+                printf("Error: Failed to list the jobs.\n");
+            }
+
+            printf("Press ENTER to continue...");
+            while (getchar() != '\n') // Clear the input buffer
+                ;
+
+            break;
+        }
+
         case EXIT_OPTION:
             printf("Exiting...\n");
             break;
@@ -0,0 +1,98 @@
+#!/bin/sh
+# Run several fleet agents on this machine, each with its own lxcpath, and check the coordinator against them
+#
+# Usage: sudo tests/fleet_localhost.sh [PROGRAM] [NUMBER_OF_AGENTS]
+#
+# The agents listen on 127.0.0.1 from port 7420 on, plus one on a unix socket, and share a token made for the test.
+# Nothing is created in the real lxcpath; the containers of the test live in a temporary directory removed at the end.
+
+PROGRAM=$(realpath "${1:-./program}")
+AGENTS=${2:-3}
+PORT=7420
+WORK=$(mktemp -d)
+FAILURES=0
+
+cleanup()
+{
+    for pid in $(cat "$WORK"/*.pid 2>/dev/null); do kill "$pid" 2>/dev/null; done
+    wait 2>/dev/null
+    rm -rf "$WORK"
+}
+trap cleanup EXIT INT TERM
+
+check()
+{
+    description=$1
+    shift
+    if "$@" >"$WORK/output" 2>&1; then
+        echo "ok   - $description"
+    else
+        echo "FAIL - $description"
+        sed 's/^/       /' "$WORK/output"
+        FAILURES=$((FAILURES + 1))
+    fi
+}
+
+fails()
+{
+    description=$1
+    shift
+    if "$@" >"$WORK/output" 2>&1; then
+        echo "FAIL - $description (it succeeded)"
+        FAILURES=$((FAILURES + 1))
+    else
+        echo "ok   - $description"
+    fi
+}
+
+wait_for_agent()
+{
+    for attempt in 1 2 3 4 5 6 7 8 9 10; do
+        "$PROGRAM" fleet --nodes "probe=$1" --token-file "$WORK/token" nodes >/dev/null 2>&1 && return 0
+        sleep 0.5
+    done
+    return 1
+}
+
+cd "$WORK" || exit 1
+head -c 32 /dev/urandom | od -An -tx1 | tr -d ' \n' >token
+chmod 600 token
+echo wrong >wrong.token
+
+NODES=""
+for index in $(seq 1 "$AGENTS"); do
+    address="127.0.0.1:$((PORT + index - 1))"
+    "$PROGRAM" fleet agent --listen "$address" --token-file token --lxcpath "$WORK/lxc$index" --cpus 1 >"agent$index.log" 2>&1 &
+    echo $! >"agent$index.pid"
+    NODES="$NODES${NODES:+,}node$index=$address"
+done
+
+"$PROGRAM" fleet agent --listen "unix:$WORK/agent.sock" --lxcpath "$WORK/lxc-unix" >agent-unix.log 2>&1 &
+echo $! >agent-unix.pid
+NODES="$NODES,unix=unix:$WORK/agent.sock"
+
+for index in $(seq 1 "$AGENTS"); do
+    check "agent $index is up" wait_for_agent "127.0.0.1:$((PORT + index - 1))"
+done
+check "unix agent is up" wait_for_agent "unix:$WORK/agent.sock"
+
+check "every node answers" "$PROGRAM" fleet --nodes "$NODES" --token-file token nodes
+check "every node lists its containers" "$PROGRAM" fleet --nodes "$NODES" --token-file token list
+fails "a wrong token is refused" "$PROGRAM" fleet --nodes "node1=127.0.0.1:$PORT" --token-file wrong.token nodes
+fails "a missing token is refused" "$PROGRAM" fleet --nodes "node1=127.0.0.1:$PORT" nodes
+fails "a TCP agent without a token does not start" "$PROGRAM" fleet agent --listen "127.0.0.1:$((PORT + AGENTS))" --lxcpath "$WORK/lxc-none"
+check "the unix socket is kept to its user" test "$(stat -c %a "$WORK/agent.sock")" = 600
+
+# An empty host listens on the loopback only
+"$PROGRAM" fleet agent --listen ":$((PORT + AGENTS + 1))" --token-file token --lxcpath "$WORK/lxc-loopback" >agent-loopback.log 2>&1 &
+echo $! >agent-loopback.pid
+check "an agent with an empty host is up" wait_for_agent "127.0.0.1:$((PORT + AGENTS + 1))"
+fails "an agent with an empty host is not on the wildcard address" sh -c "ss -Hltn | grep -Eq '(0\.0\.0\.0|\*|\[::\]):$((PORT + AGENTS + 1)) '"
+
+echo
+if [ "$FAILURES" -eq 0 ]; then
+    echo "All checks passed"
+    exit 0
+fi
+echo "$FAILURES checks failed"
+exit 1